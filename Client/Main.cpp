@@ -8,6 +8,7 @@
 #include "Texture.h"
 #include "ImGui/imgui.h"
 #include "MainView.h"
+#include "Utils/CommandLineArg.h"
 
 namespace
 {
@@ -27,18 +28,44 @@ namespace GameApp
 		virtual void Update(float deltaTime);
 
 		virtual void Cleanup();
+
+		virtual bool RunOffline(int& exitCode) override;
 	};
 
+	bool SceneGameApp::RunOffline(int& exitCode)
+	{
+		// -bake <file.gltf> writes the mesh cache of an asset and quits, no window, device or scene.
+		// -bakecompress 1 writes it as a chunked .gz, inflated across the thread pool on load.
+		std::wstring bakePath;
+		if (!CommandLineArgs::GetString(L"bake", bakePath))
+			return false;
+
+		uint32_t compress = 0;
+		CommandLineArgs::GetInteger(L"bakecompress", compress);
+
+		exitCode = 0;
+		if (!ModelConverter::BakeAsset(bakePath, compress != 0))
+		{
+			Utility::PrintMessage(L"Failed to bake %ws", bakePath.c_str());
+			exitCode = 1;
+		}
+		return true;
+	}
+
 
 	void SceneGameApp::Start()
 	{
-		sAsset.Parse(L"Asset/Sponza2/sponza2.gltf");
-		//sAsset.Parse(L"Asset/CSMTest/CSMTest.gltf");
-		//sAsset.Parse(L"Asset/MetalRoughSpheres/MetalRoughSpheres.gltf");
-
-		ModelConverter::BuildMaterials(sAsset);
-		ModelConverter::BuildAllMeshes(sAsset);
-		ModelConverter::BuildScene(sScenePtr, sAsset);
+		const std::filesystem::path scenePath = L"Asset/Sponza2/sponza2.gltf";
+		//const std::filesystem::path scenePath = L"Asset/CSMTest/CSMTest.gltf";
+		//const std::filesystem::path scenePath = L"Asset/MetalRoughSpheres/MetalRoughSpheres.gltf";
+
+		if (!ModelConverter::LoadScene(sScenePtr, scenePath))
+		{
+			sAsset.Parse(scenePath);
+			ModelConverter::BuildMaterials(sAsset);
+			ModelConverter::BuildAllMeshes(sAsset);
+			ModelConverter::BuildScene(sScenePtr, sAsset);
+		}
 
 		sScenePtr->Startup();
 
@@ -60,6 +87,7 @@ namespace GameApp
 	void SceneGameApp::Update(float deltaTime)
 	{
 		MaterialManager::GetInstance()->Update();
+		MeshManager::GetInstance()->Update();
 
 		sScenePtr->Update(deltaTime);
 			
@@ -69,6 +97,8 @@ namespace GameApp
 
 	void SceneGameApp::Cleanup()
 	{
+		// the GPU is idle by now, the scene's meshes go back to the heaps before they are destroyed
+		sScenePtr->UnloadModels();
 		ModelRenderer::Destroy();
 
 		MaterialManager::RemoveInstance();
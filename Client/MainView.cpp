@@ -1,6 +1,7 @@
 #include "MainView.h"
 #include "Scene.h"
 #include "MeshRenderer.h"
+#include "Mesh.h"
 #include "ImGui/imgui.h"
 
 void MainView::ShowUI(Scene* scene)
@@ -46,9 +47,75 @@ void MainView::ShowUI(Scene* scene)
 		if (shadowMsaa != (int)ModelRenderer::gMsaaShadowSample)
 		{
 			ModelRenderer::ResetShadowMsaa(shadowMsaa);
-			scene->ResetShadowMapHandle();
 		}
 	}
 
+	if (ImGui::CollapsingHeader("Draw Sort"))
+	{
+		static const char* sBatchNames[MeshRenderer::kNumBachTypes] = { "Forward", "Shadows", "GBuffer" };
+		static const char* sPassNames[MeshRenderer::kNumPasses] = { "ZPass", "Opaque", "Transparent" };
+		ImGui::Checkbox("ExecuteIndirect", &scene->mUseIndirectDraw);
+		ImGui::Text("Model transforms uploaded %zu bytes, %zu bytes per model",
+			scene->mModelUploadBytes, sizeof(ModelTransform));
+		DescriptorRing& descriptorRing = GET_DESCRIPTOR_RING();
+		const DescriptorRing::Stats& ringStats = descriptorRing.GetStats();
+		ImGui::Text("Transient descriptors %u / %u in use, peak %u, fence waits %u", descriptorRing.GetUsedCount(),
+			descriptorRing.GetSize(), ringStats.peakUsedCount, ringStats.numFenceWaits);
+		ImGui::Text("Last frame took %u, copied %u in %u CopyDescriptors calls", ringStats.lastFrameCount,
+			ringStats.lastFrameCopies, ringStats.lastFrameFlushes);
+
+		// transparent draws always blend back to front, only the other passes can be reordered
+		for (uint32_t batch = 0; batch < MeshRenderer::kNumBachTypes; batch++)
+		{
+			for (uint32_t pass = 0; pass < MeshRenderer::kTransparent; pass++)
+			{
+				const StateCallStats& stats = scene->mPassStateStats[batch][pass];
+				if (stats.GetIssuedCount() + stats.GetSkippedCount() == 0)
+					continue;
+
+				std::string label = std::string(sBatchNames[batch]) + " " + sPassNames[pass];
+				int policy = scene->mSortPolicies[batch][pass];
+				if (ImGui::Combo(label.c_str(), &policy, "FrontToBack\0BackToFront\0StateOrdered\0"))
+					scene->mSortPolicies[batch][pass] = (MeshRenderer::SortPolicy)policy;
+				ImGui::Text("  PSO changes %u, descriptor table changes %u",
+					stats.issued[kStateCallPipelineState], stats.issued[kStateCallDescriptorTable]);
+				// instancing merges the meshes that stay adjacent under the chosen policy
+				ImGui::Text("  draws %u for %u meshes (%.1fx), ExecuteIndirect calls %u", stats.draws, stats.instances,
+					stats.draws > 0 ? (float)stats.instances / stats.draws : 1.0f, stats.executeIndirects);
+			}
+		}
+
+		// batches recorded through RenderMeshes have no chunks
+		for (uint32_t batch = 0; batch < MeshRenderer::kNumBachTypes; batch++)
+		{
+			const MeshRenderer::ChunkTimeStats& chunkStats = scene->mChunkTimeStats[batch];
+			if (chunkStats.numChunks == 0)
+				continue;
+			ImGui::Text("%s recorded in %u chunks, %.2f ms CPU total, slowest %.2f ms", sBatchNames[batch],
+				chunkStats.numChunks, chunkStats.totalMs, chunkStats.maxMs);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Mesh Heap"))
+	{
+		static const char* sHeapNames[] = { "VB", "DepthVB", "IB" };
+		MeshManager* meshMgr = MeshManager::GetInstance();
+		MeshManager::Stats stats = meshMgr->GetStats();
+		for (uint32_t i = 0; i < _countof(sHeapNames); i++)
+		{
+			ImGui::Text("%s %.1f / %.1f MB used in %u chunks, largest hole %.1f MB in %u free ranges", sHeapNames[i],
+				stats.usedBytes[i] / 1048576.0f, stats.heapSize[i] / 1048576.0f, stats.numChunks[i],
+				stats.largestFreeBytes[i] / 1048576.0f, stats.numFreeRanges[i]);
+		}
+		if (stats.numSkippedMeshes > 0)
+			ImGui::Text("%u meshes skipped, no room left", stats.numSkippedMeshes);
+
+		int defragKB = (int)(meshMgr->GetDefragBudget() / 1024);
+		if (ImGui::SliderInt("Defrag KB per frame", &defragKB, 0, 4096))
+			meshMgr->SetDefragBudget((size_t)defragKB * 1024);
+		ImGui::Text("%u meshes, %u moves in flight, %u moves %.1f MB total", stats.numMeshes, stats.numMovesInFlight,
+			stats.numMoves, stats.movedBytes / 1048576.0f);
+	}
+
 	ImGui::End();
 }
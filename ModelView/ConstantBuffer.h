@@ -5,12 +5,20 @@
 #define MAX_CSM_DIVIDES 3
 
 
-__declspec(align(256)) 
-struct ModelConstants
+// Object to world as the three rows of a 3x4 affine matrix, one per model in the structured buffer
+// mesh VS index through MeshInstance.hlsli. The normal matrix is rebuilt from it in the shader.
+struct ModelTransform
 {
-    Math::Matrix4 World;         // Object to world
-    Math::Matrix3 WorldIT;       // Object normal to world normal
+    DirectX::XMFLOAT3X4 World;
+
+    static ModelTransform Encode(const Math::AffineTransform& world)
+    {
+        ModelTransform transform;
+        DirectX::XMStoreFloat3x4(&transform.World, Math::Matrix4(world));
+        return transform;
+    }
 };
+static_assert(sizeof(ModelTransform) == 48);
 
 
 struct PBRMaterialConstants
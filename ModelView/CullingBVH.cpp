@@ -0,0 +1,283 @@
+#include "CullingBVH.h"
+
+#include <cfloat>
+#include <algorithm>
+#include <functional>
+#include <intrin.h>
+
+namespace
+{
+    enum eCullResult
+    {
+        kCullOutside,
+        kCullIntersect,
+        kCullInside,
+    };
+
+    eCullResult ClassifyBox(const SphereCuller::ViewPlanes& view, const float boundsMin[3], const float boundsMax[3])
+    {
+        eCullResult result = kCullInside;
+        for (int i = 0; i < Math::Frustum::kNumPlanes; i++)
+        {
+            // planes face inwards: the corner furthest along the normal decides outside,
+            // the nearest one decides inside
+            const float* plane = view.planes[i];
+            float farDist = plane[3];
+            float nearDist = plane[3];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float a = plane[axis] * boundsMin[axis];
+                float b = plane[axis] * boundsMax[axis];
+                farDist += std::max(a, b);
+                nearDist += std::min(a, b);
+            }
+
+            if (farDist < 0.0f)
+                return kCullOutside;
+            if (nearDist < 0.0f)
+                result = kCullIntersect;
+        }
+        return result;
+    }
+
+    float SurfaceArea(const float boundsMin[3], const float boundsMax[3])
+    {
+        float dx = boundsMax[0] - boundsMin[0];
+        float dy = boundsMax[1] - boundsMin[1];
+        float dz = boundsMax[2] - boundsMin[2];
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+}
+
+void CullingBVH::Build(std::vector<BuildItem>& items)
+{
+    mNodes.clear();
+    mEntryLeaves.clear();
+    mCost = 0.0f;
+    mBuildCost = 0.0f;
+    mTotalCost = 0.0;
+    if (items.empty())
+        return;
+
+    uint32_t numEntries = 0;
+    for (const BuildItem& item : items)
+        numEntries += item.numEntries;
+    mEntryLeaves.resize(numEntries);
+
+    mNodes.reserve(items.size() * 2 / kMaxLeafModels + 1);
+    BuildRecursive(items.data(), items.size(), 0, kInvalidNode);
+    mRefitMarks.assign(mNodes.size(), 0);
+}
+
+uint32_t CullingBVH::BuildRecursive(BuildItem* items, size_t numItems, uint32_t firstEntry, uint32_t parent)
+{
+    uint32_t nodeIndex = (uint32_t)mNodes.size();
+    mNodes.emplace_back();
+
+    uint32_t numEntries = 0;
+    for (size_t i = 0; i < numItems; i++)
+        numEntries += items[i].numEntries;
+
+    mNodes[nodeIndex].firstEntry = firstEntry;
+    mNodes[nodeIndex].numEntries = numEntries;
+    mNodes[nodeIndex].rightChild = 0;
+    mNodes[nodeIndex].parent = parent;
+
+    if (numItems <= kMaxLeafModels)
+    {
+        std::fill(mEntryLeaves.begin() + firstEntry, mEntryLeaves.begin() + firstEntry + numEntries, nodeIndex);
+        return nodeIndex;
+    }
+
+    // median split along the widest axis of the model centers
+    float centerMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float centerMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < numItems; i++)
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            centerMin[axis] = std::min(centerMin[axis], items[i].center[axis]);
+            centerMax[axis] = std::max(centerMax[axis], items[i].center[axis]);
+        }
+    }
+
+    int splitAxis = 0;
+    for (int axis = 1; axis < 3; axis++)
+    {
+        if (centerMax[axis] - centerMin[axis] > centerMax[splitAxis] - centerMin[splitAxis])
+            splitAxis = axis;
+    }
+
+    size_t numLeft = numItems / 2;
+    std::nth_element(items, items + numLeft, items + numItems,
+        [splitAxis](const BuildItem& a, const BuildItem& b) { return a.center[splitAxis] < b.center[splitAxis]; });
+
+    uint32_t numLeftEntries = 0;
+    for (size_t i = 0; i < numLeft; i++)
+        numLeftEntries += items[i].numEntries;
+
+    BuildRecursive(items, numLeft, firstEntry, nodeIndex);
+    uint32_t rightChild = BuildRecursive(items + numLeft, numItems - numLeft, firstEntry + numLeftEntries, nodeIndex);
+    mNodes[nodeIndex].rightChild = rightChild;
+    return nodeIndex;
+}
+
+void CullingBVH::Refit(const SphereCuller& culler)
+{
+    ZoneScoped;
+    // children always come after their parent, so a reverse sweep is bottom up
+    mTotalCost = 0.0;
+    for (size_t i = mNodes.size(); i-- > 0; )
+        mTotalCost += RefitNode(culler, mNodes[i], i);
+    UpdateCost();
+}
+
+void CullingBVH::RefitEntries(const SphereCuller& culler, const std::vector<uint32_t>& entries)
+{
+    ZoneScoped;
+    ASSERT(mRefitMarks.size() == mNodes.size());
+
+    // the leaves of the moved spheres and everything above them, each node once
+    mRefitNodes.clear();
+    for (uint32_t entry : entries)
+    {
+        for (uint32_t node = mEntryLeaves[entry]; node != kInvalidNode && !mRefitMarks[node]; node = mNodes[node].parent)
+        {
+            mRefitMarks[node] = 1;
+            mRefitNodes.push_back(node);
+        }
+    }
+
+    if (mRefitNodes.size() * 2 > mNodes.size())
+    {
+        for (uint32_t node : mRefitNodes)
+            mRefitMarks[node] = 0;
+        Refit(culler);
+        return;
+    }
+
+    std::sort(mRefitNodes.begin(), mRefitNodes.end(), std::greater<uint32_t>());
+    for (uint32_t nodeIndex : mRefitNodes)
+    {
+        Node& node = mNodes[nodeIndex];
+        mRefitMarks[nodeIndex] = 0;
+        mTotalCost -= GetNodeCost(node);
+        mTotalCost += RefitNode(culler, node, nodeIndex);
+    }
+    UpdateCost();
+}
+
+void CullingBVH::GetBounds(float boundsMin[3], float boundsMax[3]) const
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        boundsMin[axis] = mNodes.empty() ? FLT_MAX : mNodes[0].boundsMin[axis];
+        boundsMax[axis] = mNodes.empty() ? -FLT_MAX : mNodes[0].boundsMax[axis];
+    }
+}
+
+double CullingBVH::RefitNode(const SphereCuller& culler, Node& node, size_t nodeIndex)
+{
+    if (node.numEntries == 0)
+    {
+        std::fill(node.boundsMin, node.boundsMin + 3, FLT_MAX);
+        std::fill(node.boundsMax, node.boundsMax + 3, -FLT_MAX);
+    }
+    else if (node.rightChild == 0)
+    {
+        culler.GetBounds(node.firstEntry, node.firstEntry + node.numEntries, node.boundsMin, node.boundsMax);
+    }
+    else
+    {
+        const Node& left = mNodes[nodeIndex + 1];
+        const Node& right = mNodes[node.rightChild];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            node.boundsMin[axis] = std::min(left.boundsMin[axis], right.boundsMin[axis]);
+            node.boundsMax[axis] = std::max(left.boundsMax[axis], right.boundsMax[axis]);
+        }
+    }
+    return GetNodeCost(node);
+}
+
+double CullingBVH::GetNodeCost(const Node& node) const
+{
+    // leaves are weighted by the spheres they test, internal nodes by the one box test
+    if (node.numEntries == 0)
+        return 0.0;
+    double area = SurfaceArea(node.boundsMin, node.boundsMax);
+    return node.rightChild == 0 ? area * node.numEntries : area;
+}
+
+void CullingBVH::UpdateCost()
+{
+    // relative to the root, so a scene that only grows or shrinks as a whole keeps its cost
+    float rootArea = mNodes.empty() || mNodes[0].numEntries == 0 ? 0.0f : SurfaceArea(mNodes[0].boundsMin, mNodes[0].boundsMax);
+    mCost = rootArea > 0.0f ? (float)(mTotalCost / rootArea) : 0.0f;
+    if (mBuildCost == 0.0f)
+        mBuildCost = mCost;
+}
+
+void CullingBVH::Cull(const SphereCuller& culler, const SphereCuller::ViewPlanes* views, size_t numViews,
+    SphereCuller::VisibleList* visibleLists) const
+{
+    ZoneScoped;
+    ASSERT(numViews <= SphereCuller::kMaxViews);
+    uint32_t numVisible[SphereCuller::kMaxViews];
+    for (size_t v = 0; v < numViews; v++)
+        culler.BeginCull(visibleLists[v], numVisible[v]);
+
+    if (!mNodes.empty() && numViews > 0)
+    {
+        struct StackEntry
+        {
+            uint32_t node;
+            uint32_t viewMask; // views the parent straddled
+        };
+
+        // a median split keeps the depth near log2(models), 64 levels is far beyond any scene
+        StackEntry stack[64];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, (1u << numViews) - 1 };
+
+        while (stackSize > 0)
+        {
+            StackEntry entry = stack[--stackSize];
+            const Node& node = mNodes[entry.node];
+            if (node.numEntries == 0)
+                continue;
+
+            uint32_t insideMask = 0;
+            uint32_t intersectMask = 0;
+            unsigned long v;
+            for (unsigned long viewBits = entry.viewMask; _BitScanForward(&v, viewBits); viewBits &= viewBits - 1)
+            {
+                eCullResult result = ClassifyBox(views[v], node.boundsMin, node.boundsMax);
+                if (result == kCullInside)
+                    insideMask |= 1u << v;
+                else if (result == kCullIntersect)
+                    intersectMask |= 1u << v;
+            }
+
+            // views the box is inside take the whole range, the straddled ones go on down
+            size_t begin = node.firstEntry;
+            size_t end = begin + node.numEntries;
+            culler.CullRange(views, insideMask, begin, end, true, visibleLists, numVisible);
+            if (intersectMask == 0)
+                continue;
+
+            if (node.rightChild == 0)
+            {
+                culler.CullRange(views, intersectMask, begin, end, false, visibleLists, numVisible);
+                continue;
+            }
+
+            ASSERT(stackSize + 2 <= _countof(stack));
+            stack[stackSize++] = { node.rightChild, intersectMask };
+            stack[stackSize++] = { entry.node + 1, intersectMask };
+        }
+    }
+
+    for (size_t v = 0; v < numViews; v++)
+        culler.EndCull(visibleLists[v], numVisible[v]);
+}
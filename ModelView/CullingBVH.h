@@ -0,0 +1,80 @@
+#pragma once
+#include "SphereCuller.h"
+
+#include <vector>
+
+// Bounding volume hierarchy over the models of a scene. Each leaf owns a contiguous range of the
+// culling spheres, so a subtree maps to one range of the SphereCuller arrays: a subtree fully inside
+// a frustum is appended without plane tests and one fully outside is skipped with a single box test.
+// The topology is built from the model positions, moving models only refit the boxes until the
+// refit tree costs kMaxCostGrowth times what it did right after the build.
+class CullingBVH
+{
+public:
+    static constexpr uint32_t kMaxLeafModels = 4;
+    static constexpr float kMaxCostGrowth = 1.5f;
+
+    // One model with its culling spheres, firstEntry indexes the sphere array the caller had before Build
+    struct BuildItem
+    {
+        float center[3];
+        uint32_t firstEntry;
+        uint32_t numEntries;
+    };
+
+    struct Node
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        uint32_t firstEntry;
+        uint32_t numEntries;
+        uint32_t rightChild; // left child follows its parent, 0 marks a leaf
+        uint32_t parent;     // kInvalidNode for the root
+    };
+
+    static constexpr uint32_t kInvalidNode = (uint32_t)-1;
+
+    CullingBVH() : mCost(0.0f), mBuildCost(0.0f), mTotalCost(0.0) {}
+
+    // Reorders items into leaf order. The caller must lay the spheres out in that order, node
+    // ranges count entries from the start of the reordered list.
+    void Build(std::vector<BuildItem>& items);
+    void Clear() { mNodes.clear(); mEntryLeaves.clear(); mCost = 0.0f; mBuildCost = 0.0f; mTotalCost = 0.0; }
+    bool IsEmpty() const { return mNodes.empty(); }
+
+    // Recomputes every box bottom up from the current spheres, and the surface area heuristic cost of
+    // the tree: node areas relative to the root, leaves weighted by their sphere count
+    void Refit(const SphereCuller& culler);
+
+    // Refit after only the given spheres moved: their leaves and the paths up to the root are
+    // recomputed and the cost is corrected by the difference. Falls back to Refit when the paths
+    // cover most of the tree.
+    void RefitEntries(const SphereCuller& culler, const std::vector<uint32_t>& entries);
+
+    // Box around every sphere as of the last refit
+    void GetBounds(float boundsMin[3], float boundsMax[3]) const;
+
+    // Boxes of a fixed topology swell as models drift away from their neighbours, past the growth
+    // limit a rebuild culls faster than the refit tree
+    bool NeedsRebuild() const { return mCost > mBuildCost * kMaxCostGrowth; }
+    float GetCostGrowth() const { return mBuildCost > 0.0f ? mCost / mBuildCost : 1.0f; }
+
+    // Fills visibleLists[v] with the spheres that survive views[v]. All views share one walk, a subtree
+    // is visited while it straddles any of them and its leaf spheres are loaded once for all.
+    void Cull(const SphereCuller& culler, const SphereCuller::ViewPlanes* views, size_t numViews,
+        SphereCuller::VisibleList* visibleLists) const;
+private:
+    uint32_t BuildRecursive(BuildItem* items, size_t numItems, uint32_t firstEntry, uint32_t parent);
+    // bounds of one node from its spheres or its children, returns its share of the unnormalized cost
+    double RefitNode(const SphereCuller& culler, Node& node, size_t nodeIndex);
+    double GetNodeCost(const Node& node) const;
+    void UpdateCost();
+private:
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mEntryLeaves; // leaf node of every sphere
+    std::vector<uint32_t> mRefitNodes;
+    std::vector<uint8_t> mRefitMarks;
+    float mCost;
+    float mBuildCost; // of the first refit after Build, 0 until then
+    double mTotalCost; // sum of node costs before dividing by the root area, double so partial refits don't drift
+};
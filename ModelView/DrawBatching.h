@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+
+// Instancing of sorted draws, kept apart from MeshRenderer so it can be tested without a device.
+
+// Everything one instanced draw binds. Sorted draws with equal keys only differ in their transform,
+// which the shaders read per instance, so a run of them collapses into one draw.
+struct DrawBatchKey
+{
+    uint32_t pass;
+    uint32_t psoIdx;
+    uint32_t materialIdx;
+    uint32_t vbOffset;      // vertex and index buffer ranges of the mesh
+    uint32_t ibOffset;
+    uint32_t startIndex;
+    uint32_t indexCount;
+    uint32_t baseVertex;
+
+    bool operator==(const DrawBatchKey& other) const
+    {
+        return pass == other.pass && psoIdx == other.psoIdx && materialIdx == other.materialIdx &&
+            vbOffset == other.vbOffset && ibOffset == other.ibOffset && startIndex == other.startIndex &&
+            indexCount == other.indexCount && baseVertex == other.baseVertex;
+    }
+    bool operator!=(const DrawBatchKey& other) const { return !(*this == other); }
+};
+
+// consecutive sorted draws recorded as a single instanced draw
+struct DrawBatch
+{
+    uint32_t firstDraw;
+    uint32_t numInstances;
+};
+
+// Past a few hundred instances a longer draw saves no more CPU time, while shorter ones let the GPU
+// overlap the tail of one draw with the start of the next
+constexpr uint32_t kMaxBatchInstances = 1024;
+
+// Fills batches with the runs of equal keys among draws [0, numDraws), cutting runs at maxInstances.
+// getKey(drawIdx) returns the DrawBatchKey of a draw and is called once per draw, in order.
+template<typename BatchVector, typename GetKey>
+void BuildDrawBatches(uint32_t numDraws, uint32_t maxInstances, BatchVector& batches, GetKey&& getKey)
+{
+    batches.clear();
+    DrawBatchKey prevKey = {};
+    for (uint32_t drawIdx = 0; drawIdx < numDraws; drawIdx++)
+    {
+        const DrawBatchKey key = getKey(drawIdx);
+        if (drawIdx > 0 && key == prevKey && batches.back().numInstances < maxInstances)
+            batches.back().numInstances++;
+        else
+            batches.push_back({ drawIdx, 1 });
+        prevKey = key;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "CoreHeader.h"
+#include "Utils/DebugUtils.h"
+
+#include <cstddef>
+#include <cstring>
+
+// Writes the argument records of the mesh draw command signature (ModelRenderer::GetMeshDrawSignature)
+// for ExecuteIndirect. It knows nothing of the device, the destination is usually upload memory and
+// that is write combined: every record is assembled on the stack and stored with a single copy, in
+// order, and nothing is ever read back.
+class IndirectDrawStream
+{
+public:
+    // arguments are tightly packed in signature order, the views come first so no field is misaligned
+    struct Record
+    {
+        D3D12_VERTEX_BUFFER_VIEW vertexBuffer;
+        D3D12_INDEX_BUFFER_VIEW indexBuffer;
+        UINT firstInstance; // root constant ModelRenderer::kFirstInstance
+        D3D12_DRAW_INDEXED_ARGUMENTS draw;
+    };
+
+    static constexpr size_t kAlignment = alignof(Record);
+
+    IndirectDrawStream() : mRecords(nullptr), mCapacity(0), mCount(0) {}
+    IndirectDrawStream(void* dest, uint32_t capacity) { Reset(dest, capacity); }
+
+    void Reset(void* dest, uint32_t capacity)
+    {
+        ASSERT(((uintptr_t)dest & (kAlignment - 1)) == 0);
+        mRecords = (uint8_t*)dest;
+        mCapacity = capacity;
+        mCount = 0;
+    }
+
+    void Append(const D3D12_VERTEX_BUFFER_VIEW& vertexBuffer, const D3D12_INDEX_BUFFER_VIEW& indexBuffer, UINT firstInstance,
+        UINT indexCount, UINT instanceCount, UINT startIndex, INT baseVertex)
+    {
+        ASSERT(mCount < mCapacity);
+        Record record;
+        record.vertexBuffer = vertexBuffer;
+        record.indexBuffer = indexBuffer;
+        record.firstInstance = firstInstance;
+        record.draw.IndexCountPerInstance = indexCount;
+        record.draw.InstanceCount = instanceCount;
+        record.draw.StartIndexLocation = startIndex;
+        record.draw.BaseVertexLocation = baseVertex;
+        // SV_InstanceID ignores it, instances are located through firstInstance
+        record.draw.StartInstanceLocation = 0;
+        std::memcpy(mRecords + sizeof(Record) * mCount, &record, sizeof(Record));
+        mCount++;
+    }
+
+    uint32_t GetCount() const { return mCount; }
+
+    static size_t GetByteSize(uint32_t numRecords) { return sizeof(Record) * numRecords; }
+    static UINT64 GetByteOffset(uint32_t recordIndex) { return (UINT64)sizeof(Record) * recordIndex; }
+private:
+    uint8_t* mRecords;
+    uint32_t mCapacity;
+    uint32_t mCount;
+};
+
+static_assert(offsetof(IndirectDrawStream::Record, vertexBuffer) == 0);
+static_assert(offsetof(IndirectDrawStream::Record, indexBuffer) == sizeof(D3D12_VERTEX_BUFFER_VIEW));
+static_assert(offsetof(IndirectDrawStream::Record, firstInstance) == sizeof(D3D12_VERTEX_BUFFER_VIEW) + sizeof(D3D12_INDEX_BUFFER_VIEW));
+static_assert(offsetof(IndirectDrawStream::Record, draw) == offsetof(IndirectDrawStream::Record, firstInstance) + sizeof(UINT));
+static_assert(sizeof(IndirectDrawStream::Record) == offsetof(IndirectDrawStream::Record, draw) + sizeof(D3D12_DRAW_INDEXED_ARGUMENTS));
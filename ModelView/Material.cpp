@@ -1,27 +1,38 @@
 #include "Material.h"
 #include "DescriptorHandle.h"
 #include "Graphics.h"
-#include "CommandQueue.h"
+#include "Utils/DebugUtils.h"
 
 void Material::UpdateDescriptor()
 {
     std::vector<DescriptorHandle> texHandles = GetTextureCpuHandles();
     std::vector<DescriptorHandle> samHandles = GetSamplerCpuHandles();
 
-    if (mAllGpuTextureHandles)
-        DEALLOC_DESCRIPTOR_GPU(mAllGpuTextureHandles, 8);
-    if (mAllGpuSamplerHandles)
-        DEALLOC_DESCRIPTOR_GPU(mAllGpuSamplerHandles, 8);
+    ASSERT(texHandles.size() <= kTextureTableSize && samHandles.size() <= kTextureTableSize);
 
-    ASSERT(texHandles.size() <= 8 && samHandles.size() <= 8);
+    // tables a frame in flight may read are rewritten by MapTextureTables when their index comes round
+    bool isTextureChanged = texHandles.size() != mTextureSources.size();
+    for (size_t i = 0; !isTextureChanged && i < texHandles.size(); i++)
+        isTextureChanged = texHandles[i].GetCpuPtr() != mTextureSources[i].GetCpuPtr();
+    if (isTextureChanged)
+    {
+        mTextureSources = std::move(texHandles);
+        mStaleTables = kAllTablesStale;
+    }
+
+    // samplers are set once at load, rewriting the table a frame in flight may read is only done on change
+    bool isSamplerChanged = samHandles.size() != mSamplerSources.size();
+    for (size_t i = 0; !isSamplerChanged && i < samHandles.size(); i++)
+        isSamplerChanged = samHandles[i].GetCpuPtr() != mSamplerSources[i].GetCpuPtr();
+    if (!isSamplerChanged && mAllGpuSamplerHandles)
+        return;
 
-    mAllGpuTextureHandles = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 8);
-    mAllGpuSamplerHandles = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, 8);
+    if (!mAllGpuSamplerHandles)
+        mAllGpuSamplerHandles = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, kTextureTableSize);
 
-    for (uint32_t i = 0; i < texHandles.size(); i++)
-        Graphics::gDevice->CopyDescriptorsSimple(1, mAllGpuTextureHandles + i, texHandles[i], D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    for (uint32_t i = 0; i < samHandles.size(); i++)
-        Graphics::gDevice->CopyDescriptorsSimple(1, mAllGpuSamplerHandles + i, samHandles[i], D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
+    mSamplerSources = std::move(samHandles);
+    for (uint32_t i = 0; i < mSamplerSources.size(); i++)
+        Graphics::gDevice->CopyDescriptorsSimple(1, mAllGpuSamplerHandles + i, mSamplerSources[i], D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
 }
 
 std::vector<DescriptorHandle> PBRMaterial::GetTextureCpuHandles() const
@@ -60,16 +71,6 @@ void MaterialManager::Reserve(size_t size)
 
 void MaterialManager::Update()
 {
-    if (mNumDirtyCount == SWAP_CHAIN_BUFFER_COUNT)
-    {
-        CommandQueueManager::GetInstance()->IdleGPU();
-
-        for (auto& mat : mAllMaterials)
-        {
-            mat->UpdateDescriptor();
-        }
-    }
-
     if (mNumDirtyCount > 0 && mConstantBufferSize > 0)
     {
         mGpuBuffer[CURRENT_FARME_BUFFER_INDEX].Destroy();
@@ -81,6 +82,41 @@ void MaterialManager::Update()
     {
         UpdateMaterial(i);
     }
+
+    MapTextureTables();
+}
+
+void MaterialManager::MapTextureTables()
+{
+    ZoneScoped;
+
+    DescriptorRing& ring = GET_DESCRIPTOR_RING();
+    const uint32_t frameIndex = CURRENT_FARME_BUFFER_INDEX;
+    const uint8_t frameBit = 1 << frameIndex;
+    for (size_t i = 0; i < mAllMaterials.size(); i++)
+    {
+        Material* material = mAllMaterials[i].get();
+        DescriptorHandle& table = material->mTextureTables[frameIndex];
+        if (!table)
+        {
+            table = ring.AllocatePinned(Material::kTextureTableSize);
+            material->mStaleTables |= frameBit;
+        }
+
+        if (table)
+        {
+            // the frame that last read this index has finished, like the material constants
+            material->mFrameTextureTable = table;
+            if ((material->mStaleTables & frameBit) == 0)
+                continue;
+            material->mStaleTables &= ~frameBit;
+        }
+        else
+            material->mFrameTextureTable = ring.Allocate(Material::kTextureTableSize);
+
+        ring.CopyToTable(material->mFrameTextureTable, material->mTextureSources.data(), (uint32_t)material->mTextureSources.size());
+    }
+    ring.Flush();
 }
 
 void MaterialManager::UpdateMaterial(size_t index)
@@ -38,6 +38,8 @@ class Material
 {
     friend class MaterialManager;
 public:
+    static constexpr uint32_t kTextureTableSize = 8; // descriptors of the kModelTextures range
+
     ~Material() {}
 
     virtual const void* GetMaterialConstant() const = 0;
@@ -47,9 +49,12 @@ public:
     virtual std::vector<DescriptorHandle> GetTextureCpuHandles() const { return std::vector<DescriptorHandle>(); }
     virtual std::vector<DescriptorHandle> GetSamplerCpuHandles() const { return std::vector<DescriptorHandle>(); }
 
-    DescriptorHandle GetTextureGpuHandles() const { return mAllGpuTextureHandles; }
+    // the texture table of the frame being recorded, in the descriptor ring's heap
+    DescriptorHandle GetTextureGpuHandles() const { return mFrameTextureTable; }
     DescriptorHandle GetSamplerGpuHandles() const { return mAllGpuSamplerHandles; }
 
+    // Refreshes the texture sources, marking the table of every frame buffer index stale when they
+    // changed, and rewrites the persistent sampler table when a sampler changed
     void UpdateDescriptor();
 
     uint16_t GetMaterialIdx() const { return mMaterialIdx; }
@@ -57,7 +62,7 @@ public:
     //uint16_t GetPSOIdx() const { return mPSOIndex; }
     eMaterialType GetType() const { return (eMaterialType)mType; }
 protected:
-    Material(eMaterialType type) : mIsShared(0), mType(type), mMaterialIdx(0)/*, mPSOIndex(0)*/ {}
+    Material(eMaterialType type) : mIsShared(0), mType(type), mMaterialIdx(0), mStaleTables(kAllTablesStale)/*, mPSOIndex(0)*/ {}
 private:
     uint16_t mIsShared : 1;
 protected:
@@ -67,7 +72,13 @@ protected:
     uint32_t mBufferOffset;          // Offset of GpuBuffer, mutipile of 256 
     //uint16_t mPSOIndex;              // Index of pipeline state object
 
-    DescriptorHandle mAllGpuTextureHandles;
+    static constexpr uint8_t kAllTablesStale = (1 << SWAP_CHAIN_BUFFER_COUNT) - 1;
+    uint8_t mStaleTables;            // bit per frame buffer index whose pinned table misses the sources
+
+    std::vector<DescriptorHandle> mTextureSources;
+    std::vector<DescriptorHandle> mSamplerSources;
+    DescriptorHandle mTextureTables[SWAP_CHAIN_BUFFER_COUNT]; // pinned, null when the ring ran out of them
+    DescriptorHandle mFrameTextureTable;
     DescriptorHandle mAllGpuSamplerHandles;
 };
 
@@ -145,6 +156,10 @@ public:
     }
 private:
     void UpdateMaterial(size_t index);
+
+    // Picks this frame's texture table of every material and copies only the stale ones. A material
+    // without pinned tables falls back to a ring table copied every frame.
+    void MapTextureTables();
 private:
     std::vector<std::unique_ptr<Material>> mAllMaterials;       // store by index
     UploadBuffer mGpuBuffer[SWAP_CHAIN_BUFFER_COUNT];           // store frame resource index
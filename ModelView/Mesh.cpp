@@ -1,7 +1,13 @@
 #include "Mesh.h"
 #include "CommandList.h"
 #include "CommandQueue.h"
-#include "FrameContext.h"
+#include "StagingManager.h"
+#include "Utils/CommandLineArg.h"
+#include "Utils/DebugUtils.h"
+
+#include <algorithm>
+
+using Utility::OffsetAllocator;
 
 enum eGpuBufferUpdateFlags
 {
@@ -10,141 +16,370 @@ enum eGpuBufferUpdateFlags
     kUpdateIB = 0x4
 };
 
+namespace
+{
+    constexpr uint32_t kInvalidMeshIndex = (uint32_t)-1;
+    constexpr uint32_t kInvalidChunk = (uint32_t)-1;
+    constexpr uint32_t kMaxHeapMoves = 1024;
+    constexpr uint32_t kMaxChunkRanges = 16 * 1024;
+    constexpr uint32_t kDefaultVertexChunkMB = 32;
+
+    const wchar_t* const kHeapNames[] = { L"Mesh VB Heap", L"Mesh DepthVB Heap", L"Mesh IB Heap" };
+
+    // the fields of a mesh that go with each buffer type
+    uint32_t Mesh::* const kMeshOffsets[] = { &Mesh::vbOffset, &Mesh::vbDepthOffset, &Mesh::ibOffset };
+    uint32_t Mesh::* const kMeshSizes[] = { &Mesh::sizeVB, &Mesh::sizeDepthVB, &Mesh::sizeIB };
+    const byte* Mesh::* const kMeshData[] = { &Mesh::VB, &Mesh::DepthVB, &Mesh::IB };
+}
+
+MeshManager::MeshManager() :
+    mHasRecycledRanges(false),
+    mDefragBudget(0),
+    mNumMoves(0),
+    mMovedBytes(0),
+    mNumSkippedMeshes(0)
+{
+    uint32_t defragKB = 0;
+    CommandLineArgs::GetInteger(L"meshdefragkb", defragKB);
+    mDefragBudget = (size_t)defragKB * 1024;
+
+    // the depth only and index data run about a quarter and a half of the full vertices
+    uint32_t vertexChunkMB = kDefaultVertexChunkMB;
+    CommandLineArgs::GetInteger(L"meshheapchunkmb", vertexChunkMB);
+    vertexChunkMB = std::clamp(vertexChunkMB, 1u, kMaxHeapSize >> 20);
+    mHeapChunkSizes[kVertexBuffer] = vertexChunkMB << 20;
+    mHeapChunkSizes[kDepthVertexBuffer] = vertexChunkMB << 18;
+    mHeapChunkSizes[kIndexBuffer] = vertexChunkMB << 19;
+}
+
 Mesh& MeshManager::AddUnInitializedMesh()
 {
-    mNeedUpdate = true;
+    uint32_t meshIndex;
+    if (!mFreeMeshIndices.empty())
+    {
+        meshIndex = mFreeMeshIndices.back();
+        mFreeMeshIndices.pop_back();
+    }
+    else
+    {
+        meshIndex = (uint32_t)mAllMeshs.size();
+        mAllMeshs.emplace_back();
+        mMeshRanges.emplace_back();
+    }
+    mPendingMeshes.push_back(meshIndex);
 
-    Mesh& mesh = mAllMeshs.emplace_back();
-    mesh.meshIndex = mAllMeshs.size() - 1;
+    Mesh& mesh = mAllMeshs[meshIndex];
+    mesh.meshIndex = meshIndex;
     return mesh;
 }
 
 void MeshManager::AddMesh(Mesh&& mesh)
 {
-    mNeedUpdate = true;
-
-    mesh.meshIndex = mAllMeshs.size();
-    mAllMeshs.push_back(std::move(mesh));
+    Mesh& slot = AddUnInitializedMesh();
+    uint32_t meshIndex = slot.meshIndex;
+    slot = std::move(mesh);
+    slot.meshIndex = meshIndex;
 }
 
-void MeshManager::UpdateMeshes()
+void MeshManager::RemoveMesh(uint32_t meshIndex)
 {
-    if (!mNeedUpdate)
-        return;
-    mNeedUpdate = false;
+    ASSERT(meshIndex < mAllMeshs.size());
+    ASSERT(std::find(mFreeMeshIndices.begin(), mFreeMeshIndices.end(), meshIndex) == mFreeMeshIndices.end());
+
+    // the staging ring may not have copied the mesh data out yet
+    MeshRanges& ranges = mMeshRanges[meshIndex];
+    if (ranges.uploadToken != 0)
+        StagingManager::GetInstance()->Wait(ranges.uploadToken);
 
-    size_t totalIndexSize = 0;
-    size_t totalVertexSize = 0;
-    size_t totaldepthVertexSize = 0;
-    size_t curMeshIndex = mCurrentResientSize;
+    for (size_t i = 0; i < mHeapMoves.size();)
+    {
+        if (mHeapMoves[i].meshIndex == meshIndex)
+        {
+            FreeRange(mHeapMoves[i].type, mHeapMoves[i].target);
+            mHeapMoves[i] = mHeapMoves.back();
+            mHeapMoves.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
 
-    // calc all mesh size
-    for (size_t i = mCurrentResientSize; i < mAllMeshs.size(); i++, mCurrentResientSize++)
+    for (uint32_t type = 0; type < kNumBufferTypes; type++)
     {
-        Mesh& mesh = mAllMeshs[i];
-        totalVertexSize += mesh.sizeVB;
-        totaldepthVertexSize += mesh.sizeDepthVB;
-        totalIndexSize += mesh.sizeIB;
+        if (ranges.ranges[type].IsValid())
+            FreeRange((eBufferType)type, ranges.ranges[type]);
     }
+    ranges = MeshRanges();
 
-    ReserveBuffer(totalVertexSize + mVertexBufferOffset, totaldepthVertexSize + mDepthVertexBufferOffset, totalIndexSize + mIndexBufferOffset);
+    mPendingMeshes.erase(std::remove(mPendingMeshes.begin(), mPendingMeshes.end(), meshIndex), mPendingMeshes.end());
+    mAllMeshs[meshIndex] = Mesh();
+    mAllMeshs[meshIndex].meshIndex = meshIndex;
+    mFreeMeshIndices.push_back(meshIndex);
+}
 
-    UploadBuffer cpuBuffer[kNumBufferTypes];
-    cpuBuffer[kVertexBuffer].Create(L"VB Cpu", totalVertexSize);
-    cpuBuffer[kDepthVertexBuffer].Create(L"DepthVB Cpu", totaldepthVertexSize);
-    cpuBuffer[kIndexBuffer].Create(L"IB Cpu", totalIndexSize);
+void MeshManager::UpdateMeshes()
+{
+    if (mPendingMeshes.empty())
+        return;
+    BeginHeapWrites();
 
-    // copy to upload buffer
-    uint32_t curVertexBufferOffset = 0;
-    uint32_t curDepthVertexBufferOffset = 0;
-    uint32_t curIndexBufferOffset = 0;
-    for (size_t i = curMeshIndex; i < mAllMeshs.size(); i++, curMeshIndex++)
+    // the meshes keep their data, the staging ring copies it straight out of them
+    StagingManager* stagingMgr = StagingManager::GetInstance();
+    StagingManager::Token lastToken = 0;
+    for (uint32_t meshIndex : mPendingMeshes)
     {
-        Mesh& mesh = mAllMeshs[i];
-        CopyMemory((uint8_t*)cpuBuffer[kVertexBuffer].Map() + curVertexBufferOffset, mesh.VB.get(), mesh.sizeVB);
-        CopyMemory((uint8_t*)cpuBuffer[kDepthVertexBuffer].Map() + curDepthVertexBufferOffset, mesh.DepthVB.get(), mesh.sizeDepthVB);
-        CopyMemory((uint8_t*)cpuBuffer[kIndexBuffer].Map() + curIndexBufferOffset, mesh.IB.get(), mesh.sizeIB);
-
-        mesh.vbOffset = mVertexBufferOffset + curVertexBufferOffset;
-        mesh.vbDepthOffset = mDepthVertexBufferOffset + curDepthVertexBufferOffset;
-        mesh.ibOffset = mIndexBufferOffset + curIndexBufferOffset;
-        curVertexBufferOffset += mesh.sizeVB;
-        curDepthVertexBufferOffset += mesh.sizeDepthVB;
-        curIndexBufferOffset += mesh.sizeIB;
+        Mesh& mesh = mAllMeshs[meshIndex];
+        MeshRanges& ranges = mMeshRanges[meshIndex];
+
+        uint32_t fullType = kNumBufferTypes;
+        for (uint32_t type = 0; type < kNumBufferTypes && fullType == kNumBufferTypes; type++)
+        {
+            uint32_t numBytes = mesh.*kMeshSizes[type];
+            mesh.*kMeshOffsets[type] = 0;
+            if (numBytes == 0)
+                continue;
+
+            ranges.ranges[type] = AllocateRange((eBufferType)type, numBytes, meshIndex);
+            if (ranges.ranges[type].IsValid())
+                mesh.*kMeshOffsets[type] = GetHeapOffset((eBufferType)type, ranges.ranges[type]);
+            else
+                fullType = type;
+        }
+
+        if (fullType != kNumBufferTypes)
+        {
+            Utility::PrintMessage(L"MeshManager: no room for the %u bytes of mesh %u in %s, it is at %u MB. The mesh is skipped.\n",
+                mesh.*kMeshSizes[fullType], meshIndex, kHeapNames[fullType], (uint32_t)(mChunkSlots[fullType].size() * mHeapChunkSizes[fullType] >> 20));
+
+            // nothing was written to the ranges taken so far, they go straight back
+            for (uint32_t type = 0; type < fullType; type++)
+            {
+                if (ranges.ranges[type].IsValid())
+                    mHeapChunks[type][ranges.ranges[type].chunk]->allocator.Free(ranges.ranges[type].allocation);
+            }
+            ranges = MeshRanges();
+            mesh.subMeshCount = 0;
+            mNumSkippedMeshes++;
+            continue;
+        }
+
+        for (uint32_t type = 0; type < kNumBufferTypes; type++)
+        {
+            if (!ranges.ranges[type].IsValid())
+                continue;
+
+            lastToken = stagingMgr->QueueBufferUpload(mHeapChunks[type][ranges.ranges[type].chunk]->buffer,
+                ranges.ranges[type].allocation.offset * kHeapAlignment, mesh.*kMeshData[type], mesh.*kMeshSizes[type]);
+            ranges.uploadToken = lastToken;
+        }
     }
-    
-    PushGraphicsTaskSync(&MeshManager::UpdateMeshBufferTask, this, cpuBuffer);
+    mPendingMeshes.clear();
 
-    mIndexBufferOffset += curIndexBufferOffset;
-    mVertexBufferOffset += curVertexBufferOffset;
-    mDepthVertexBufferOffset += curDepthVertexBufferOffset;
+    // draws of the next frame read the buffers without waiting on the copy queue
+    if (lastToken != 0)
+        stagingMgr->Wait(lastToken);
 }
 
-void MeshManager::TransitionStateToRead(GraphicsCommandList& ghCommandList)
+void MeshManager::Update()
 {
-    ghCommandList.TransitionResource(mGpuBuffer[kVertexBuffer], D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
-    ghCommandList.TransitionResource(mGpuBuffer[kIndexBuffer], D3D12_RESOURCE_STATE_INDEX_BUFFER);
-    ghCommandList.TransitionResource(mGpuBuffer[kDepthVertexBuffer], D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    ZoneScoped;
+
+    FinishHeapMoves();
+    if (mDefragBudget == 0)
+        return;
+
+    size_t budget = mDefragBudget;
+    for (uint32_t type = 0; type < kNumBufferTypes && budget > 0; type++)
+        budget -= StartHeapMoves((eBufferType)type, budget);
 }
 
-void MeshManager::ReserveBuffer(uint32_t vertexBufferSize, uint32_t depthVertexBufferSize, uint32_t indexBufferSize)
+void MeshManager::TransitionStateToRead(GraphicsCommandList& ghCommandList)
 {
-    bool needReserve = false;
-    GpuBuffer newGpuBuffer[kNumBufferTypes];
+    const D3D12_RESOURCE_STATES readStates[] = { D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER,
+        D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, D3D12_RESOURCE_STATE_INDEX_BUFFER };
+    for (uint32_t type = 0; type < kNumBufferTypes; type++)
+    {
+        for (std::unique_ptr<HeapChunk>& chunk : mHeapChunks[type])
+            ghCommandList.TransitionResource(chunk->buffer, readStates[type]);
+    }
+}
 
-    if (mGpuBuffer[kVertexBuffer].GetBufferSize() < vertexBufferSize)
+MeshManager::Stats MeshManager::GetStats() const
+{
+    Stats stats = {};
+    for (uint32_t type = 0; type < kNumBufferTypes; type++)
     {
-        newGpuBuffer[kVertexBuffer].Create(L"VB Gpu", vertexBufferSize + vertexBufferSize / 2, 1);
-        needReserve = true;
+        size_t freeBytes = 0;
+        for (const std::unique_ptr<HeapChunk>& chunk : mHeapChunks[type])
+        {
+            OffsetAllocator::Report report = chunk->allocator.GetReport();
+            freeBytes += (size_t)report.freeSize * kHeapAlignment;
+            stats.largestFreeBytes[type] = std::max(stats.largestFreeBytes[type], (size_t)report.largestFreeSize * kHeapAlignment);
+            stats.numFreeRanges[type] += report.numFreeRanges;
+        }
+        stats.heapSize[type] = mChunkSlots[type].size() * mHeapChunkSizes[type];
+        stats.usedBytes[type] = stats.heapSize[type] - freeBytes;
+        stats.numChunks[type] = (uint32_t)mHeapChunks[type].size();
     }
+    stats.numMeshes = (uint32_t)(mAllMeshs.size() - mFreeMeshIndices.size());
+    stats.numSkippedMeshes = mNumSkippedMeshes;
+    stats.numMovesInFlight = (uint32_t)mHeapMoves.size();
+    stats.numMoves = mNumMoves;
+    stats.movedBytes = mMovedBytes;
+    return stats;
+}
 
-    if (mGpuBuffer[kDepthVertexBuffer].GetBufferSize() < depthVertexBufferSize)
+uint32_t MeshManager::AddHeapChunk(eBufferType type, size_t minSize)
+{
+    ZoneScoped;
+
+    // a chunk larger than the chunk size takes over the slots of as many chunks as it covers
+    size_t chunkSize = mHeapChunkSizes[type];
+    size_t numSlots = std::max<size_t>((minSize + chunkSize - 1) / chunkSize, 1);
+    size_t heapOffset = mChunkSlots[type].size() * chunkSize;
+    if (heapOffset + numSlots * chunkSize > kMaxHeapSize)
+        return kInvalidChunk;
+
+    uint32_t chunkIndex = (uint32_t)mHeapChunks[type].size();
+    std::unique_ptr<HeapChunk> chunk = std::make_unique<HeapChunk>();
+    chunk->buffer.Create(std::wstring(kHeapNames[type]) + L" " + std::to_wstring(chunkIndex), (uint32_t)(numSlots * chunkSize), 1);
+    chunk->allocator.Reset((uint32_t)(numSlots * chunkSize / kHeapAlignment), kMaxChunkRanges);
+    chunk->nodeMeshes.assign(chunk->allocator.GetMaxNodes(), kInvalidMeshIndex);
+    chunk->heapOffset = (uint32_t)heapOffset;
+    mHeapChunks[type].push_back(std::move(chunk));
+    mChunkSlots[type].insert(mChunkSlots[type].end(), numSlots, chunkIndex);
+
+    Utility::PrintMessage(L"MeshManager: %s chunk %u added, the heap is at %u MB\n", kHeapNames[type], chunkIndex,
+        (uint32_t)((heapOffset + numSlots * chunkSize) >> 20));
+    return chunkIndex;
+}
+
+MeshManager::HeapRange MeshManager::AllocateRange(eBufferType type, uint32_t numBytes, uint32_t meshIndex)
+{
+    // the lowest chunk with room, which keeps the top chunks the ones compaction empties
+    uint32_t size = (numBytes + kHeapAlignment - 1) / kHeapAlignment;
+    std::vector<std::unique_ptr<HeapChunk>>& chunks = mHeapChunks[type];
+    HeapRange range;
+    for (range.chunk = 0; range.chunk < (uint32_t)chunks.size(); range.chunk++)
     {
-        newGpuBuffer[kDepthVertexBuffer].Create(L"DepthVB Gpu", depthVertexBufferSize + depthVertexBufferSize / 2, 1);
-        needReserve = true;
+        range.allocation = chunks[range.chunk]->allocator.Allocate(size);
+        if (range.IsValid())
+            break;
     }
 
-    if (mGpuBuffer[kIndexBuffer].GetBufferSize() < indexBufferSize)
+    if (!range.IsValid())
     {
-        newGpuBuffer[kIndexBuffer].Create(L"IB Gpu", indexBufferSize + indexBufferSize / 2, 1);
-        needReserve = true;
+        // a range is only found in a size class whose smallest member fits, so the new chunk holds at
+        // least that much
+        uint32_t fitSize = OffsetAllocator::GetBinSize(OffsetAllocator::GetBinRoundUp(size));
+        range.chunk = AddHeapChunk(type, (size_t)fitSize * kHeapAlignment);
+        if (range.chunk == kInvalidChunk)
+            return HeapRange();
+        range.allocation = chunks[range.chunk]->allocator.Allocate(size);
     }
 
-    if (!needReserve)
-        return;
+    if (range.IsValid())
+        chunks[range.chunk]->nodeMeshes[range.allocation.node] = meshIndex;
+    return range;
+}
 
-    CommandQueueManager::GetInstance()->GetGraphicsQueue().WaitForIdle();
-    PushGraphicsTaskSync(&MeshManager::ReserveMeshBufferTask, this, newGpuBuffer);
+void MeshManager::FreeRange(eBufferType type, const HeapRange& range)
+{
+    mHeapChunks[type][range.chunk]->allocator.Free(range.allocation);
+    mHasRecycledRanges = true;
+}
+
+void MeshManager::BeginHeapWrites()
+{
+    // Update and the loaders run between frames, so every list that drew from a freed range is submitted
+    if (!mHasRecycledRanges)
+        return;
+    mHasRecycledRanges = false;
 
-    if (newGpuBuffer[kVertexBuffer].GetBufferSize() != 0)
-        mGpuBuffer[kVertexBuffer] = newGpuBuffer[kVertexBuffer];
-    if (newGpuBuffer[kIndexBuffer].GetBufferSize() != 0)
-        mGpuBuffer[kIndexBuffer] = newGpuBuffer[kIndexBuffer];
-    if (newGpuBuffer[kDepthVertexBuffer].GetBufferSize() != 0)
-        mGpuBuffer[kDepthVertexBuffer] = newGpuBuffer[kDepthVertexBuffer];
+    CommandQueueManager* queueMgr = CommandQueueManager::GetInstance();
+    if (queueMgr->GetGraphicsQueue().GetCurrentFenceValue() > 0)
+        queueMgr->GetCopyQueue().StallForProducer(queueMgr->GetGraphicsQueue());
 }
 
-CommandList* MeshManager::UpdateMeshBufferTask(CommandList* commandList, UploadBuffer cpuBuffer[kNumBufferTypes])
+void MeshManager::FinishHeapMoves()
 {
-    CopyCommandList& copyList = commandList->GetCopyCommandList().Begin(L"Update mesh buffer");
-    copyList.CopyBufferRegion(mGpuBuffer[kVertexBuffer], mVertexBufferOffset, cpuBuffer[kVertexBuffer], 0, 
-        cpuBuffer[kVertexBuffer].GetBufferSize());
-    copyList.CopyBufferRegion(mGpuBuffer[kIndexBuffer], mIndexBufferOffset, cpuBuffer[kIndexBuffer], 0, 
-        cpuBuffer[kIndexBuffer].GetBufferSize());
-    copyList.CopyBufferRegion(mGpuBuffer[kDepthVertexBuffer], mDepthVertexBufferOffset, cpuBuffer[kDepthVertexBuffer], 0 , 
-        cpuBuffer[kDepthVertexBuffer].GetBufferSize());
-    return commandList;
+    // a landed copy takes over from the old range before this frame records any draw
+    StagingManager* stagingMgr = StagingManager::GetInstance();
+    for (size_t i = 0; i < mHeapMoves.size();)
+    {
+        HeapMove& move = mHeapMoves[i];
+        if (!stagingMgr->IsComplete(move.token))
+        {
+            i++;
+            continue;
+        }
+
+        MeshRanges& ranges = mMeshRanges[move.meshIndex];
+        FreeRange(move.type, ranges.ranges[move.type]);
+        ranges.ranges[move.type] = move.target;
+        ranges.movingMask &= ~(1u << move.type);
+        mAllMeshs[move.meshIndex].*kMeshOffsets[move.type] = GetHeapOffset(move.type, move.target);
+
+        mHeapMoves[i] = mHeapMoves.back();
+        mHeapMoves.pop_back();
+    }
 }
 
-CommandList* MeshManager::ReserveMeshBufferTask(CommandList* commandList, GpuBuffer newBuffer[kNumBufferTypes])
+size_t MeshManager::StartHeapMoves(eBufferType type, size_t budget)
 {
-    CopyCommandList& copyList = commandList->GetCopyCommandList().Begin(L"Reserve mesh buffer");
-    if (mGpuBuffer[kVertexBuffer].GetBufferSize() > 0 && newBuffer[kVertexBuffer].GetBufferSize() != 0)
-        copyList.CopyBuffer(mGpuBuffer[kVertexBuffer], newBuffer[kVertexBuffer]);
-    if (mGpuBuffer[kVertexBuffer].GetBufferSize() > 0 && newBuffer[kIndexBuffer].GetBufferSize() != 0)
-        copyList.CopyBuffer(mGpuBuffer[kIndexBuffer], newBuffer[kIndexBuffer]);
-    if (mGpuBuffer[kVertexBuffer].GetBufferSize() > 0 && newBuffer[kDepthVertexBuffer].GetBufferSize() != 0)
-        copyList.CopyBuffer(mGpuBuffer[kDepthVertexBuffer], newBuffer[kDepthVertexBuffer]);
+    std::vector<std::unique_ptr<HeapChunk>>& chunks = mHeapChunks[type];
+    StagingManager* stagingMgr = StagingManager::GetInstance();
+    size_t movedBytes = 0;
+
+    // walk down from the top of the last chunk, a range moves only when a hole below it fits
+    for (uint32_t chunkIndex = (uint32_t)chunks.size(); chunkIndex-- > 0 && mHeapMoves.size() < kMaxHeapMoves;)
+    {
+        HeapChunk& chunk = *chunks[chunkIndex];
+        for (OffsetAllocator::Allocation allocation = chunk.allocator.GetLastAllocation();
+            allocation.IsValid() && mHeapMoves.size() < kMaxHeapMoves; allocation = chunk.allocator.GetPrevAllocation(allocation))
+        {
+            // targets of moves in flight are skipped along with the ranges they replace
+            uint32_t meshIndex = chunk.nodeMeshes[allocation.node];
+            MeshRanges& ranges = mMeshRanges[meshIndex];
+            const HeapRange& current = ranges.ranges[type];
+            if (current.chunk != chunkIndex || current.allocation.node != allocation.node || (ranges.movingMask & (1u << type)) != 0)
+                continue;
+
+            Mesh& mesh = mAllMeshs[meshIndex];
+            uint32_t numBytes = mesh.*kMeshSizes[type];
+            if (movedBytes + numBytes > budget)
+                continue;
 
-    return commandList;
+            // first fit in this chunk and the ones below
+            uint32_t size = chunk.allocator.GetAllocationSize(allocation);
+            HeapRange target;
+            for (uint32_t targetChunk = 0; targetChunk <= chunkIndex && !target.IsValid(); targetChunk++)
+            {
+                target.chunk = targetChunk;
+                target.allocation = chunks[targetChunk]->allocator.Allocate(size);
+            }
+            if (!target.IsValid())
+                continue;
+
+            if (target.chunk == chunkIndex && target.allocation.offset > allocation.offset)
+            {
+                // never written, nothing to wait for
+                chunk.allocator.Free(target.allocation);
+                continue;
+            }
+            chunks[target.chunk]->nodeMeshes[target.allocation.node] = meshIndex;
+
+            BeginHeapWrites();
+            ranges.uploadToken = stagingMgr->QueueBufferUpload(chunks[target.chunk]->buffer,
+                target.allocation.offset * kHeapAlignment, mesh.*kMeshData[type], numBytes);
+            ranges.movingMask |= 1u << type;
+            mHeapMoves.push_back({ meshIndex, type, target, ranges.uploadToken });
+
+            movedBytes += numBytes;
+            mNumMoves++;
+            mMovedBytes += numBytes;
+        }
+    }
+    return movedBytes;
 }
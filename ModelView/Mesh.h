@@ -2,6 +2,7 @@
 #include "Math/VectorMath.h"
 #include "Math/BoundingBox.h"
 #include "GpuBuffer.h"
+#include "Utils/OffsetAllocator.h"
 
 class CommandList;
 class GraphicsCommandList;
@@ -30,10 +31,13 @@ struct SubMesh
 
 struct Mesh
 {
-    std::unique_ptr<byte[]> VB;
-    std::unique_ptr<byte[]> DepthVB;
-    std::unique_ptr<byte[]> IB;
-    std::unique_ptr<SubMesh[]> subMeshes;
+    // Views of the CPU side data, kept alive by storage. Meshes read from the mesh cache point
+    // into its mapping, converted ones into arrays the converter allocated.
+    const byte* VB = nullptr;
+    const byte* DepthVB = nullptr;
+    const byte* IB = nullptr;
+    const SubMesh* subMeshes = nullptr;
+    std::shared_ptr<const void> storage;
 
     float bounds[4];     // A bounding sphere
     Math::XMFLOAT3 minPos;
@@ -52,7 +56,14 @@ struct Mesh
     uint8_t depthVertexStride;
 };
 
-class MeshManager : public Singleton<MeshManager>, public Graphics::CopyContext
+// Vertex, depth vertex and index data of every mesh, sub-allocated from chunk buffers of each type. A
+// chunk is a GpuBuffer with its own TLSF offset allocator in kHeapAlignment units, so a removed mesh
+// hands its ranges straight to the next one. A range no chunk has room for gets a new chunk. Chunks never
+// grow or move, so adding one copies nothing and waits for nobody. Mesh offsets are into the heap, where
+// each chunk spans a whole number of chunk sizes, Get*Address turns them into GPU addresses. Update
+// optionally compacts the heaps a few bytes per frame by uploading the highest placed meshes again into
+// holes further down.
+class MeshManager : public Singleton<MeshManager>
 {
     USE_SINGLETON;
 
@@ -63,46 +74,122 @@ class MeshManager : public Singleton<MeshManager>, public Graphics::CopyContext
         kIndexBuffer,
         kNumBufferTypes
     };
+public:
+    static constexpr uint32_t kHeapAlignment = 16;
+    static constexpr uint32_t kMaxMeshes = 64 * 1024;
+    static constexpr uint32_t kMaxHeapSize = 1u << 31;
+
+    struct Stats
+    {
+        size_t heapSize[kNumBufferTypes];
+        size_t usedBytes[kNumBufferTypes];
+        size_t largestFreeBytes[kNumBufferTypes];
+        uint32_t numFreeRanges[kNumBufferTypes];
+        uint32_t numChunks[kNumBufferTypes];
+        uint32_t numMeshes;
+        uint32_t numSkippedMeshes;
+        uint32_t numMovesInFlight;
+        uint32_t numMoves;
+        size_t movedBytes;
+    };
 private:
-    MeshManager() :
-        mNeedUpdate(false), 
-        mVertexBufferOffset(0), 
-        mIndexBufferOffset(0), 
-        mDepthVertexBufferOffset(0),
-        mCurrentResientSize(0)
-    {}
+    MeshManager();
 public:
     ~MeshManager() {}
 
     Mesh& AddUnInitializedMesh();
     void AddMesh(Mesh&& mesh);
+    // Frees the ranges of a mesh no model draws anymore, its index goes to the next added mesh
+    void RemoveMesh(uint32_t meshIndex);
 
+    // A mesh that cannot be placed because its heap is at kMaxHeapSize is logged and skipped. It keeps
+    // no sub-meshes, so the models using it draw nothing.
     void UpdateMeshes();
+    // Once per frame on the main thread, finishes the landed moves and starts new ones up to the defrag budget
+    void Update();
 
     void TransitionStateToRead(GraphicsCommandList& ghCommandList);
 
-    D3D12_GPU_VIRTUAL_ADDRESS GetVBVirtualAddr() { return mGpuBuffer[kVertexBuffer].GetGpuVirtualAddress(); }
-    D3D12_GPU_VIRTUAL_ADDRESS GetDepthVBVirtualAddr() { return mGpuBuffer[kDepthVertexBuffer].GetGpuVirtualAddress(); }
-    D3D12_GPU_VIRTUAL_ADDRESS GetIBVirtualAddr() { return mGpuBuffer[kIndexBuffer].GetGpuVirtualAddress(); }
+    D3D12_GPU_VIRTUAL_ADDRESS GetVBAddress(const Mesh& mesh) const { return GetHeapAddress(kVertexBuffer, mesh.vbOffset, mesh.sizeVB); }
+    D3D12_GPU_VIRTUAL_ADDRESS GetDepthVBAddress(const Mesh& mesh) const { return GetHeapAddress(kDepthVertexBuffer, mesh.vbDepthOffset, mesh.sizeDepthVB); }
+    D3D12_GPU_VIRTUAL_ADDRESS GetIBAddress(const Mesh& mesh) const { return GetHeapAddress(kIndexBuffer, mesh.ibOffset, mesh.sizeIB); }
 
     const Mesh* GetMesh(size_t index) const { return &mAllMeshs[index]; }
+
+    Stats GetStats() const;
+    size_t GetDefragBudget() const { return mDefragBudget; }
+    void SetDefragBudget(size_t bytesPerFrame) { mDefragBudget = bytesPerFrame; }
 private:
-    void ReserveBuffer(uint32_t vertexBufferSize, uint32_t depthVertexBufferSize, uint32_t indexBufferSize);
+    struct HeapChunk
+    {
+        GpuBuffer buffer;
+        Utility::OffsetAllocator allocator;
+        std::vector<uint32_t> nodeMeshes; // owning mesh of each allocator node
+        uint32_t heapOffset;              // where the chunk starts in the heap
+    };
 
-    CommandList* UpdateMeshBufferTask(CommandList* commandList, UploadBuffer cpuBuffer[kNumBufferTypes]);
-    CommandList* ReserveMeshBufferTask(CommandList* commandList, GpuBuffer newBuffer[kNumBufferTypes]);
+    // a range of one chunk
+    struct HeapRange
+    {
+        Utility::OffsetAllocator::Allocation allocation;
+        uint32_t chunk = 0;
+
+        bool IsValid() const { return allocation.IsValid(); }
+    };
+
+    struct MeshRanges
+    {
+        HeapRange ranges[kNumBufferTypes];
+        uint64_t uploadToken;   // last staging upload reading the mesh data
+        uint8_t movingMask;     // bit per buffer type with a move in flight
+    };
+
+    struct HeapMove
+    {
+        uint32_t meshIndex;
+        eBufferType type;
+        HeapRange target;
+        uint64_t token;
+    };
+
+    D3D12_GPU_VIRTUAL_ADDRESS GetHeapAddress(eBufferType type, uint32_t heapOffset, uint32_t numBytes) const
+    {
+        if (numBytes == 0)
+            return 0;
+        const HeapChunk& chunk = *mHeapChunks[type][mChunkSlots[type][heapOffset / mHeapChunkSizes[type]]];
+        return chunk.buffer.GetGpuVirtualAddress() + (heapOffset - chunk.heapOffset);
+    }
+    uint32_t GetHeapOffset(eBufferType type, const HeapRange& range) const
+    {
+        return mHeapChunks[type][range.chunk]->heapOffset + range.allocation.offset * kHeapAlignment;
+    }
+
+    // kInvalidChunk when the heap would pass kMaxHeapSize
+    uint32_t AddHeapChunk(eBufferType type, size_t minSize);
+    // first fit over the chunks, adds one when none has room. Invalid when the heap is full.
+    HeapRange AllocateRange(eBufferType type, uint32_t numBytes, uint32_t meshIndex);
+    void FreeRange(eBufferType type, const HeapRange& range);
+    // the copy queue waits for the graphics work that may still read a recycled range
+    void BeginHeapWrites();
+
+    void FinishHeapMoves();
+    size_t StartHeapMoves(eBufferType type, size_t budget);
 private:
-    bool mNeedUpdate;
-    uint32_t mVertexBufferOffset;
-    uint32_t mIndexBufferOffset;
-    uint32_t mDepthVertexBufferOffset;
-    GpuBuffer mGpuBuffer[kNumBufferTypes];
+    std::vector<std::unique_ptr<HeapChunk>> mHeapChunks[kNumBufferTypes];
+    std::vector<uint32_t> mChunkSlots[kNumBufferTypes]; // chunk covering each chunk size of the heap
+    uint32_t mHeapChunkSizes[kNumBufferTypes];
 
-    size_t mCurrentResientSize;
     std::vector<Mesh> mAllMeshs;
+    std::vector<MeshRanges> mMeshRanges; // indexed like mAllMeshs
+    std::vector<uint32_t> mPendingMeshes; // added, not uploaded yet
+    std::vector<uint32_t> mFreeMeshIndices;
+
+    std::vector<HeapMove> mHeapMoves;
+    bool mHasRecycledRanges;
+    size_t mDefragBudget;
+    uint32_t mNumMoves;
+    size_t mMovedBytes;
+    uint32_t mNumSkippedMeshes;
 };
 
 #define GET_MESH(index) MeshManager::GetInstance()->GetMesh(index)
-#define GET_MESH_VB MeshManager::GetInstance()->GetVBVirtualAddr()
-#define GET_MESH_DepthVB MeshManager::GetInstance()->GetDepthVBVirtualAddr()
-#define GET_MESH_IB MeshManager::GetInstance()->GetIBVirtualAddr()
@@ -0,0 +1,392 @@
+#include "MeshCache.h"
+#include "CoreHeader.h"
+#include "Utils/FileUtility.h"
+#include "Utils/DebugUtils.h"
+#include "Utils/Hash.h"
+
+#include <fstream>
+
+namespace
+{
+    inline uint64_t AlignOffset(uint64_t offset)
+    {
+        return (offset + 15) & ~15ull;
+    }
+
+    uint64_t GetWriteTime(const std::filesystem::path& path)
+    {
+        std::error_code ec;
+        auto writeTime = std::filesystem::last_write_time(path, ec);
+        return ec ? 0 : (uint64_t)writeTime.time_since_epoch().count();
+    }
+
+    bool HashSourceFile(const std::filesystem::path& path, uint64_t& fileSize, uint64_t& contentHash)
+    {
+        Utility::MappedFileRef data = Utility::MapFile(path);
+        if (data == nullptr)
+            return false;
+
+        fileSize = data->size();
+        contentHash = Utility::HashBytes(data->data(), data->size());
+        return true;
+    }
+
+    std::filesystem::path MakeRelative(const std::filesystem::path& path, const std::filesystem::path& base)
+    {
+        std::filesystem::path relative = path.lexically_normal().lexically_relative(base.lexically_normal());
+        return relative.empty() ? path : relative;
+    }
+
+    class StringTable
+    {
+    public:
+        uint32_t Add(const std::filesystem::path& path)
+        {
+            uint32_t offset = (uint32_t)(mChars.size() * sizeof(wchar_t));
+            std::wstring str = path.generic_wstring();
+            mChars.insert(mChars.end(), str.begin(), str.end());
+            mChars.push_back(L'\0');
+            return offset;
+        }
+
+        const void* Data() const { return mChars.data(); }
+        size_t Size() const { return mChars.size() * sizeof(wchar_t); }
+    private:
+        std::vector<wchar_t> mChars;
+    };
+}
+
+namespace MeshCache
+{
+    std::filesystem::path GetCachePath(const std::filesystem::path& sourcePath)
+    {
+        std::filesystem::path cachePath = sourcePath;
+        return cachePath.replace_extension(L".meshcache");
+    }
+
+    std::filesystem::path GetCompressedPath(const std::filesystem::path& cachePath)
+    {
+        std::filesystem::path compressedPath = cachePath;
+        return compressedPath += L".gz";
+    }
+
+    bool Write(const std::filesystem::path& cachePath, const BakedAsset& asset, uint64_t settingsHash, bool compress)
+    {
+        const std::filesystem::path cacheDir = cachePath.parent_path();
+        StringTable strings;
+
+        FileHeader header = {};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.settingsHash = settingsHash;
+
+        std::vector<SourceRecord> sources(asset.sources.size());
+        size_t sourceHash = 2166136261U;
+        for (size_t i = 0; i < asset.sources.size(); i++)
+        {
+            SourceRecord& record = sources[i];
+            if (!HashSourceFile(asset.sources[i], record.fileSize, record.contentHash))
+            {
+                Utility::PrintMessage(L"MeshCache: missing source %ws", asset.sources[i].c_str());
+                return false;
+            }
+            record.pathOffset = strings.Add(MakeRelative(asset.sources[i], cacheDir));
+            record.writeTime = GetWriteTime(asset.sources[i]);
+            sourceHash = Utility::HashState(&record.contentHash, 1, sourceHash);
+        }
+        header.sourceHash = sourceHash;
+
+        std::vector<MaterialRecord> materials(asset.materials.size());
+        for (size_t i = 0; i < asset.materials.size(); i++)
+        {
+            const BakedMaterial& bakedMat = asset.materials[i];
+            materials[i] = bakedMat.record;
+            for (uint32_t ti = 0; ti < kNumMaterialTextures; ti++)
+            {
+                materials[i].texturePathOffsets[ti] = bakedMat.texturePaths[ti].empty() ?
+                    kInvalidIndex : strings.Add(MakeRelative(bakedMat.texturePaths[ti], cacheDir));
+            }
+        }
+
+        std::vector<MeshRecord> meshes(asset.meshes.size());
+        std::vector<SubMesh> subMeshes;
+        uint64_t blobSize = 0;
+        for (size_t i = 0; i < asset.meshes.size(); i++)
+        {
+            const Mesh& mesh = asset.meshes[i];
+            MeshRecord& record = meshes[i];
+            memcpy(record.bounds, mesh.bounds, sizeof(record.bounds));
+            memcpy(record.minPos, &mesh.minPos, sizeof(record.minPos));
+            memcpy(record.maxPos, &mesh.maxPos, sizeof(record.maxPos));
+            record.sizeVB = mesh.sizeVB;
+            record.sizeDepthVB = mesh.sizeDepthVB;
+            record.sizeIB = mesh.sizeIB;
+            record.firstSubMesh = (uint32_t)subMeshes.size();
+            record.subMeshCount = mesh.subMeshCount;
+            record.vertexStride = mesh.vertexStride;
+            record.depthVertexStride = mesh.depthVertexStride;
+
+            record.vbOffset = blobSize;
+            blobSize = AlignOffset(blobSize + mesh.sizeVB);
+            record.depthVBOffset = blobSize;
+            blobSize = AlignOffset(blobSize + mesh.sizeDepthVB);
+            record.ibOffset = blobSize;
+            blobSize = AlignOffset(blobSize + mesh.sizeIB);
+
+            subMeshes.insert(subMeshes.end(), mesh.subMeshes, mesh.subMeshes + mesh.subMeshCount);
+        }
+
+        header.numSources = (uint32_t)sources.size();
+        header.numMaterials = (uint32_t)materials.size();
+        header.numNodes = (uint32_t)asset.nodes.size();
+        header.numMeshes = (uint32_t)meshes.size();
+        header.numSubMeshes = (uint32_t)subMeshes.size();
+
+        uint64_t offset = AlignOffset(sizeof(FileHeader));
+        header.sourcesOffset = offset;
+        offset = AlignOffset(offset + sizeof(SourceRecord) * sources.size());
+        header.materialsOffset = offset;
+        offset = AlignOffset(offset + sizeof(MaterialRecord) * materials.size());
+        header.nodesOffset = offset;
+        offset = AlignOffset(offset + sizeof(NodeRecord) * asset.nodes.size());
+        header.meshesOffset = offset;
+        offset = AlignOffset(offset + sizeof(MeshRecord) * meshes.size());
+        header.subMeshesOffset = offset;
+        offset = AlignOffset(offset + sizeof(SubMesh) * subMeshes.size());
+        header.stringsOffset = offset;
+        offset = AlignOffset(offset + strings.Size());
+        header.blobsOffset = offset;
+        header.fileSize = offset + blobSize;
+
+        std::vector<byte> image(header.fileSize, 0);
+        byte* base = image.data();
+        memcpy(base, &header, sizeof(header));
+        memcpy(base + header.sourcesOffset, sources.data(), sizeof(SourceRecord) * sources.size());
+        memcpy(base + header.materialsOffset, materials.data(), sizeof(MaterialRecord) * materials.size());
+        memcpy(base + header.nodesOffset, asset.nodes.data(), sizeof(NodeRecord) * asset.nodes.size());
+        memcpy(base + header.meshesOffset, meshes.data(), sizeof(MeshRecord) * meshes.size());
+        memcpy(base + header.subMeshesOffset, subMeshes.data(), sizeof(SubMesh) * subMeshes.size());
+        memcpy(base + header.stringsOffset, strings.Data(), strings.Size());
+        for (size_t i = 0; i < asset.meshes.size(); i++)
+        {
+            const Mesh& mesh = asset.meshes[i];
+            byte* blobs = base + header.blobsOffset;
+            memcpy(blobs + meshes[i].vbOffset, mesh.VB, mesh.sizeVB);
+            memcpy(blobs + meshes[i].depthVBOffset, mesh.DepthVB, mesh.sizeDepthVB);
+            memcpy(blobs + meshes[i].ibOffset, mesh.IB, mesh.sizeIB);
+        }
+
+        const void* fileData = image.data();
+        size_t fileSize = image.size();
+        Utility::ByteArray compressed;
+        std::filesystem::path filePath = cachePath;
+        std::filesystem::path otherPath = GetCompressedPath(cachePath);
+        if (compress)
+        {
+            compressed = Utility::CompressChunked(image.data(), image.size());
+            if (compressed == Utility::NullFile)
+                return false;
+            fileData = compressed->data();
+            fileSize = compressed->size();
+            std::swap(filePath, otherPath);
+        }
+
+        // write aside and swap in, a crashed bake never leaves a truncated cache behind
+        std::filesystem::path tempPath = filePath;
+        tempPath += L".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file)
+                return false;
+            file.write((const char*)fileData, fileSize);
+            if (!file.good())
+                return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempPath, filePath, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+
+        // a stale cache of the other form would shadow or outlive this one
+        std::filesystem::remove(otherPath, ec);
+
+        Utility::PrintMessage(L"MeshCache: baked %ws (%llu bytes, %zu on disk)", filePath.c_str(), header.fileSize, fileSize);
+        return true;
+    }
+
+    bool Read(const std::filesystem::path& cachePath, BakedAsset& asset, uint64_t settingsHash)
+    {
+        // The meshes keep views into the cache image, which lives as long as one of them does. That is
+        // the mapped file, or the inflated copy of a compressed one.
+        std::error_code ec;
+        std::shared_ptr<const void> storage;
+        const byte* base = nullptr;
+        uint64_t fileSize = 0;
+        if (std::filesystem::exists(cachePath, ec))
+        {
+            Utility::MappedFileRef file = Utility::MapFile(cachePath);
+            if (file != nullptr)
+            {
+                base = file->data();
+                fileSize = file->size();
+                storage = file;
+            }
+        }
+        else if (std::filesystem::exists(GetCompressedPath(cachePath), ec))
+        {
+            // ReadFileSync picks up the .gz and inflates its chunks across the thread pool
+            Utility::ByteArray image = Utility::ReadFileSync(cachePath);
+            base = image->data();
+            fileSize = image->size();
+            storage = image;
+        }
+
+        if (base == nullptr || fileSize < sizeof(FileHeader))
+            return false;
+
+        const FileHeader& header = *(const FileHeader*)base;
+        if (header.magic != kMagic || header.version != kVersion || header.settingsHash != settingsHash || header.fileSize != fileSize)
+        {
+            Utility::PrintMessage(L"MeshCache: %ws is out of date", cachePath.c_str());
+            return false;
+        }
+
+        auto SectionFits = [fileSize](uint64_t offset, uint64_t count, uint64_t stride)
+        {
+            return offset <= fileSize && count * stride <= fileSize - offset;
+        };
+        if (!SectionFits(header.sourcesOffset, header.numSources, sizeof(SourceRecord)) ||
+            !SectionFits(header.materialsOffset, header.numMaterials, sizeof(MaterialRecord)) ||
+            !SectionFits(header.nodesOffset, header.numNodes, sizeof(NodeRecord)) ||
+            !SectionFits(header.meshesOffset, header.numMeshes, sizeof(MeshRecord)) ||
+            !SectionFits(header.subMeshesOffset, header.numSubMeshes, sizeof(SubMesh)) ||
+            header.stringsOffset > header.blobsOffset || header.blobsOffset > fileSize)
+        {
+            Utility::PrintMessage(L"MeshCache: %ws is corrupt", cachePath.c_str());
+            return false;
+        }
+
+        const std::filesystem::path cacheDir = cachePath.parent_path();
+        const wchar_t* strings = (const wchar_t*)(base + header.stringsOffset);
+        const size_t numChars = (header.blobsOffset - header.stringsOffset) / sizeof(wchar_t);
+        if (numChars > 0 && strings[numChars - 1] != L'\0')
+            return false;
+
+        auto GetPath = [&](uint32_t offset, std::filesystem::path& path)
+        {
+            size_t index = offset / sizeof(wchar_t);
+            if (index >= numChars)
+                return false;
+            path = std::filesystem::path(strings + index);
+            if (path.is_relative())
+                path = cacheDir / path;
+            return true;
+        };
+
+        BakedAsset baked;
+
+        // invalidate when a source moved on, the content hash only runs if size matches and the time stamp differs
+        const SourceRecord* sources = (const SourceRecord*)(base + header.sourcesOffset);
+        baked.sources.resize(header.numSources);
+        for (uint32_t i = 0; i < header.numSources; i++)
+        {
+            const SourceRecord& record = sources[i];
+            std::filesystem::path& sourcePath = baked.sources[i];
+            if (!GetPath(record.pathOffset, sourcePath))
+                return false;
+
+            uint64_t sourceSize = std::filesystem::file_size(sourcePath, ec);
+            if (ec || sourceSize != record.fileSize)
+            {
+                Utility::PrintMessage(L"MeshCache: %ws changed", sourcePath.c_str());
+                return false;
+            }
+
+            if (GetWriteTime(sourcePath) != record.writeTime)
+            {
+                uint64_t contentHash = 0;
+                if (!HashSourceFile(sourcePath, sourceSize, contentHash) || contentHash != record.contentHash)
+                {
+                    Utility::PrintMessage(L"MeshCache: %ws changed", sourcePath.c_str());
+                    return false;
+                }
+            }
+        }
+
+        const MaterialRecord* materials = (const MaterialRecord*)(base + header.materialsOffset);
+        baked.materials.resize(header.numMaterials);
+        for (uint32_t i = 0; i < header.numMaterials; i++)
+        {
+            BakedMaterial& bakedMat = baked.materials[i];
+            bakedMat.record = materials[i];
+            for (uint32_t ti = 0; ti < kNumMaterialTextures; ti++)
+            {
+                uint32_t pathOffset = bakedMat.record.texturePathOffsets[ti];
+                if (pathOffset != kInvalidIndex && !GetPath(pathOffset, bakedMat.texturePaths[ti]))
+                    return false;
+            }
+        }
+
+        const NodeRecord* nodes = (const NodeRecord*)(base + header.nodesOffset);
+        baked.nodes.assign(nodes, nodes + header.numNodes);
+        // Scene looks meshes and parent transforms up by these as is, and TransformHierarchy needs every
+        // parent before its children
+        for (uint32_t i = 0; i < header.numNodes; i++)
+        {
+            const NodeRecord& node = baked.nodes[i];
+            if ((node.meshIndex != kInvalidIndex && node.meshIndex >= header.numMeshes) ||
+                (node.parentIndex != kInvalidIndex && (node.parentIndex >= header.numNodes || node.parentIndex >= i)))
+            {
+                Utility::PrintMessage(L"MeshCache: %ws is corrupt", cachePath.c_str());
+                return false;
+            }
+        }
+
+        const MeshRecord* meshes = (const MeshRecord*)(base + header.meshesOffset);
+        const SubMesh* subMeshes = (const SubMesh*)(base + header.subMeshesOffset);
+        const byte* blobs = base + header.blobsOffset;
+        const uint64_t blobSize = fileSize - header.blobsOffset;
+        baked.meshes.reserve(header.numMeshes);
+        for (uint32_t i = 0; i < header.numMeshes; i++)
+        {
+            const MeshRecord& record = meshes[i];
+            if ((uint64_t)record.firstSubMesh + record.subMeshCount > header.numSubMeshes ||
+                record.vbOffset + record.sizeVB > blobSize ||
+                record.depthVBOffset + record.sizeDepthVB > blobSize ||
+                record.ibOffset + record.sizeIB > blobSize)
+            {
+                Utility::PrintMessage(L"MeshCache: %ws is corrupt", cachePath.c_str());
+                return false;
+            }
+
+            Mesh& mesh = baked.meshes.emplace_back();
+            memcpy(mesh.bounds, record.bounds, sizeof(mesh.bounds));
+            memcpy(&mesh.minPos, record.minPos, sizeof(record.minPos));
+            memcpy(&mesh.maxPos, record.maxPos, sizeof(record.maxPos));
+            mesh.sizeVB = record.sizeVB;
+            mesh.sizeDepthVB = record.sizeDepthVB;
+            mesh.sizeIB = record.sizeIB;
+            mesh.vbOffset = 0;
+            mesh.vbDepthOffset = 0;
+            mesh.ibOffset = 0;
+            mesh.meshIndex = i;
+            mesh.subMeshCount = record.subMeshCount;
+            mesh.vertexStride = record.vertexStride;
+            mesh.depthVertexStride = record.depthVertexStride;
+
+            // views into the mapping, the mesh holds it until the data is no longer needed
+            mesh.VB = blobs + record.vbOffset;
+            mesh.DepthVB = blobs + record.depthVBOffset;
+            mesh.IB = blobs + record.ibOffset;
+            mesh.subMeshes = subMeshes + record.firstSubMesh;
+            mesh.storage = storage;
+        }
+
+        asset = std::move(baked);
+        return true;
+    }
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "Mesh.h"
+
+/*
+	Baked scene cache, a flat binary image of what ModelConverter produces from a glTF asset.
+	Every section is a POD array at a 16 byte aligned offset, so a mapped file can be read in place.
+
+	FileHeader | SourceRecord[] | MaterialRecord[] | NodeRecord[] | MeshRecord[] | SubMesh[] | strings | VB/DepthVB/IB blobs
+*/
+namespace MeshCache
+{
+	constexpr uint32_t kMagic = 0x4843584D; // "MXCH"
+	constexpr uint32_t kVersion = 1;
+	constexpr uint32_t kInvalidIndex = 0xFFFFFFFF;
+	constexpr uint32_t kNumMaterialTextures = 4;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t settingsHash;
+		uint64_t sourceHash;
+		uint32_t numSources;
+		uint32_t numMaterials;
+		uint32_t numNodes;
+		uint32_t numMeshes;
+		uint32_t numSubMeshes;
+		uint32_t _pad;
+		uint64_t sourcesOffset;
+		uint64_t materialsOffset;
+		uint64_t nodesOffset;
+		uint64_t meshesOffset;
+		uint64_t subMeshesOffset;
+		uint64_t stringsOffset;
+		uint64_t blobsOffset;
+		uint64_t fileSize;
+	};
+
+	// paths are offsets into the string table, relative to the cache file directory
+	struct SourceRecord
+	{
+		uint32_t pathOffset;
+		uint32_t _pad;
+		uint64_t fileSize;
+		uint64_t writeTime;
+		uint64_t contentHash;
+	};
+
+	struct SamplerRecord
+	{
+		uint32_t filter;
+		uint32_t addressU;
+		uint32_t addressV;
+	};
+
+	struct MaterialRecord
+	{
+		float baseColorFactor[4];
+		float emissiveFactor[3];
+		float normalTextureScale;
+		float metallicFactor;
+		float roughnessFactor;
+		uint32_t flags;
+		uint16_t textureFlags[kNumMaterialTextures];
+		uint32_t texturePathOffsets[kNumMaterialTextures]; // kInvalidIndex selects the default texture
+		SamplerRecord samplers[kNumMaterialTextures];
+	};
+
+	struct NodeRecord
+	{
+		uint32_t parentIndex;
+		uint32_t meshIndex;     // kInvalidIndex when the node draws nothing
+		uint32_t isValid : 1;   // reachable from the scene root
+		uint32_t hasChildren : 1;
+		uint32_t hasSiblings : 1;
+		uint32_t : 29;
+		float position[3];
+		float rotation[4];
+		float scale[3];
+	};
+
+	struct MeshRecord
+	{
+		float bounds[4];
+		float minPos[3];
+		float maxPos[3];
+		uint32_t sizeVB;
+		uint32_t sizeDepthVB;
+		uint32_t sizeIB;
+		uint32_t firstSubMesh;
+		uint16_t subMeshCount;
+		uint8_t vertexStride;
+		uint8_t depthVertexStride;
+		uint32_t _pad;
+		uint64_t vbOffset;      // relative to FileHeader::blobsOffset
+		uint64_t depthVBOffset;
+		uint64_t ibOffset;
+	};
+
+	struct BakedMaterial
+	{
+		MaterialRecord record;
+		std::filesystem::path texturePaths[kNumMaterialTextures];
+	};
+
+	// Everything needed to create the materials, meshes and models of a scene without the source asset
+	struct BakedAsset
+	{
+		std::vector<std::filesystem::path> sources;
+		std::vector<BakedMaterial> materials;
+		std::vector<NodeRecord> nodes;
+		std::vector<Mesh> meshes;
+	};
+
+	// <stem>.meshcache next to the source asset
+	std::filesystem::path GetCachePath(const std::filesystem::path& sourcePath);
+
+	// <cachePath>.gz, where a compressed cache goes
+	std::filesystem::path GetCompressedPath(const std::filesystem::path& cachePath);
+
+	// compress writes <cachePath>.gz as a chunked container instead, smaller on disk and inflated in
+	// parallel on load. Either form replaces the other.
+	bool Write(const std::filesystem::path& cachePath, const BakedAsset& asset, uint64_t settingsHash, bool compress = false);
+
+	// false when the cache is missing, corrupt, baked with other settings or any source file changed
+	bool Read(const std::filesystem::path& cachePath, BakedAsset& asset, uint64_t settingsHash);
+};
@@ -7,6 +7,11 @@
 #include "Material.h"
 #include "Scene.h"
 #include "Model.h"
+#include "SystemTime.h"
+#include "CommandSignature.h"
+#include "IndirectDrawStream.h"
+#include "Utils/RadixSort.h"
+#include "Utils/ThreadPoolExecutor.h"
 
 #include <sstream>
 
@@ -23,6 +28,7 @@ namespace ModelRenderer
     std::vector<GraphicsPipelineState*> sAllPSOs;
     RootSignature* sForwardRootSig = nullptr;
     RootSignature* sDeferredRootSig = nullptr;
+    CommandSignature sMeshDrawSignature;
     GraphicsPipelineState* sSkyboxPSO = nullptr;
 
     ShadowBuffer sShadowBuffer[SWAP_CHAIN_BUFFER_COUNT];
@@ -112,6 +118,9 @@ void ModelRenderer::Initialize()
             D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 10, 8, D3D12_SHADER_VISIBILITY_PIXEL);
         sForwardRootSig->GetParam(kShadowTexture).InitAsDescriptorRange(
             D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 18, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+        sForwardRootSig->GetParam(kModelInstances).InitAsBufferSRV(20, D3D12_SHADER_VISIBILITY_VERTEX);
+        sForwardRootSig->GetParam(kInstanceModelIndices).InitAsBufferSRV(21, D3D12_SHADER_VISIBILITY_VERTEX);
+        sForwardRootSig->GetParam(kFirstInstance).InitAsConstants(2, 1, D3D12_SHADER_VISIBILITY_VERTEX);
         sForwardRootSig->Finalize(D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 
@@ -208,6 +217,14 @@ void ModelRenderer::Initialize()
         sFullScreenPSO.SetPixelShader(GET_SHADER("DeferredPS"));
         sFullScreenPSO.SetRenderTargetFormat(renderFormat, DXGI_FORMAT_UNKNOWN);
 
+        sMeshDrawSignature.Reset(4);
+        sMeshDrawSignature[0].VertexBufferView(0);
+        sMeshDrawSignature[1].IndexBufferView();
+        sMeshDrawSignature[2].Constant(kFirstInstance, 0, 1);
+        sMeshDrawSignature[3].DrawIndexed();
+        sMeshDrawSignature.Finalize(sForwardRootSig);
+        ASSERT(sMeshDrawSignature.GetByteStride() == sizeof(IndirectDrawStream::Record));
+
         //sDeferredFinalPSO = GET_GPSO(L"DeferredFinal PSO");
         //*sDeferredFinalPSO = sFullScreenPSO;
         //sDeferredFinalPSO->SetRootSignature(*sDeferredRootSig);
@@ -393,6 +410,11 @@ uint16_t ModelRenderer::GetFullScreenPsoIndex(RendererPsoDesc rendererPsoDesc)
     return psoIndex;
 }
 
+const CommandSignature& ModelRenderer::GetMeshDrawSignature()
+{
+    return sMeshDrawSignature;
+}
+
 ShadowBuffer* ModelRenderer::GetShadowBuffers()
 {
     return sShadowBuffer;
@@ -437,9 +459,112 @@ void ModelRenderer::ResetShadowMsaa(uint32_t sampleCount)
 
 
 
+namespace
+{
+    // Sort key layouts, generated from the fields each SortPolicy orders by. Fields are listed most
+    // significant first and packed below passID, objectIdx always takes the low 16 bits.
+    enum eSortField { kFieldDistance, kFieldReverseDistance, kFieldDepthBucket, kFieldPso, kFieldMaterial, kFieldMesh, kNumSortFields };
+    constexpr uint32_t kSortFieldBits[kNumSortFields] = { 32, 32, 5, 12, 15, 12 };
+
+    constexpr uint32_t kMaxSortFields = 4;
+    struct SortKeyLayout
+    {
+        uint32_t numFields;
+        eSortField fields[kMaxSortFields];
+    };
+
+    constexpr SortKeyLayout kSortKeyLayouts[MeshRenderer::kNumSortPolicies] =
+    {
+        { 2, { kFieldDistance, kFieldPso } },
+        { 2, { kFieldReverseDistance, kFieldPso } },
+        { 4, { kFieldPso, kFieldMaterial, kFieldMesh, kFieldDepthBucket } },
+    };
+
+    constexpr uint32_t kSortFieldsTop = 60;
+    constexpr uint32_t kSortFieldsBottom = 16;
+
+    constexpr uint32_t GetSortFieldShift(const SortKeyLayout& layout, eSortField field)
+    {
+        uint32_t shift = kSortFieldsTop;
+        for (uint32_t i = 0; i < layout.numFields; i++)
+        {
+            shift -= kSortFieldBits[layout.fields[i]];
+            if (layout.fields[i] == field)
+                return shift;
+        }
+        return 0;
+    }
+
+    constexpr bool IsSortKeyLayoutValid(const SortKeyLayout& layout)
+    {
+        uint32_t bits = 0;
+        bool hasPso = false;
+        for (uint32_t i = 0; i < layout.numFields; i++)
+        {
+            bits += kSortFieldBits[layout.fields[i]];
+            hasPso |= layout.fields[i] == kFieldPso;
+        }
+        return hasPso && bits <= kSortFieldsTop - kSortFieldsBottom;
+    }
+
+    static_assert(IsSortKeyLayoutValid(kSortKeyLayouts[MeshRenderer::kSortFrontToBack]));
+    static_assert(IsSortKeyLayoutValid(kSortKeyLayouts[MeshRenderer::kSortBackToFront]));
+    static_assert(IsSortKeyLayoutValid(kSortKeyLayouts[MeshRenderer::kSortStateOrdered]));
+
+    constexpr uint32_t kPsoShifts[MeshRenderer::kNumSortPolicies] =
+    {
+        GetSortFieldShift(kSortKeyLayouts[MeshRenderer::kSortFrontToBack], kFieldPso),
+        GetSortFieldShift(kSortKeyLayouts[MeshRenderer::kSortBackToFront], kFieldPso),
+        GetSortFieldShift(kSortKeyLayouts[MeshRenderer::kSortStateOrdered], kFieldPso),
+    };
+
+    // half an octave of distance per bucket from 1 on, enough to keep near draws of a state group first
+    uint32_t GetDepthBucket(uint32_t distanceBits)
+    {
+        int32_t bucket = (int32_t)(distanceBits >> 22) - (127 << 1);
+        return (uint32_t)std::clamp(bucket, 0, (1 << kSortFieldBits[kFieldDepthBucket]) - 1);
+    }
+
+    // passKey holds the pass and object bits, everything else is replaced
+    template<typename SortObject>
+    uint64_t PackSortKey(MeshRenderer::SortPolicy policy, uint64_t passKey, const SortObject& object, uint16_t psoIdx)
+    {
+        const SortKeyLayout& layout = kSortKeyLayouts[policy];
+        uint64_t key = passKey & ((0xFull << kSortFieldsTop) | ((1ull << kSortFieldsBottom) - 1));
+
+        uint32_t shift = kSortFieldsTop;
+        for (uint32_t i = 0; i < layout.numFields; i++)
+        {
+            uint64_t value = 0;
+            switch (layout.fields[i])
+            {
+            case kFieldDistance: value = object.distance; break;
+            case kFieldReverseDistance: value = ~object.distance; break;
+            case kFieldDepthBucket: value = GetDepthBucket(object.distance); break;
+            case kFieldPso: value = psoIdx; break;
+            case kFieldMaterial: value = object.subMesh->materialIdx; break;
+            // meshes sharing the low bits of their index only lose adjacency, the order stays valid
+            case kFieldMesh: value = object.model->GetMesh()->meshIndex; break;
+            default: break;
+            }
+
+            const uint32_t bits = kSortFieldBits[layout.fields[i]];
+            shift -= bits;
+            key |= (value & ((1ull << bits) - 1)) << shift;
+        }
+        return key;
+    }
+
+    uint32_t UnpackPsoIndex(MeshRenderer::SortPolicy policy, uint64_t key)
+    {
+        return (uint32_t)(key >> kPsoShifts[policy]) & ((1u << kSortFieldBits[kFieldPso]) - 1);
+    }
+}
+
 void MeshRenderer::Reset()
 {
     mScene = nullptr;
+    mModelConstants = 0;
     mViewport = {};
     mScissor = {};
     mNumRTVs = 0;
@@ -447,120 +572,194 @@ void MeshRenderer::Reset()
     mDepthBuffer = nullptr;
     mNonMsaaDepthBuffer = nullptr;
     mRenderPasses.clear();
+    mRecordChunks.clear();
 
     for (size_t i = 0; i < 8; i++)
     {
         mMsaaRenderTargets[i] = nullptr;
     }
+
+    for (size_t i = 0; i < kNumPasses; i++)
+    {
+        mSortPolicies[i] = kNumSortPolicies;
+    }
+    mUseIndirectDraw = false;
 }
 
-void MeshRenderer::SetObjectsPSO()
+MeshRenderer::SortPolicy MeshRenderer::GetDefaultSortPolicy(BatchType type, DrawPass pass)
 {
-    for (RenderPass& pass : mRenderPasses)
+    switch (pass)
     {
-        for (SortKey& key : pass.sortKeys)
-        {
-            const SubMesh& subMesh = *pass.sortObjects[key.objectIdx].subMesh;
-            ModelRenderer::RendererPsoDesc rendererPsoDesc{};
-            rendererPsoDesc.meshPSOFlags = subMesh.psoFlags;
-            rendererPsoDesc.numCSMDividesCount = ModelRenderer::gNumCSMDivides;
+    case kZPass:
+        return kSortFrontToBack;
+    case kOpaque:
+        // only the forward batch lays down depth in a prepass first
+        return type == kDefault ? kSortStateOrdered : kSortFrontToBack;
+    default:
+        return kSortBackToFront;
+    }
+}
 
-            switch (key.passID)
-            {
-            case kZPass:
-            {
-                if (mBatchType == kShadows)
-                {
-                    rendererPsoDesc.isDepth = rendererPsoDesc.isShadow = true;
-                    rendererPsoDesc.shadowMsaaCount = Math::Log2(ModelRenderer::gMsaaShadowSample);
-                }
-                else
-                {
-                    rendererPsoDesc.isDepth = true;
-                }
-                break;
-            }
-            case kOpaque:
-            case kTransparent:
-            {
-                break;
-            }
-            default:
-                break;
-            }
+uint16_t MeshRenderer::GetObjectPsoIndex(const SubMesh& subMesh, DrawPass pass) const
+{
+    ModelRenderer::RendererPsoDesc rendererPsoDesc{};
+    rendererPsoDesc.meshPSOFlags = subMesh.psoFlags;
+    rendererPsoDesc.numCSMDividesCount = ModelRenderer::gNumCSMDivides;
 
-            key.psoIdx = ModelRenderer::GetPsoIndex(rendererPsoDesc);
+    if (pass == kZPass)
+    {
+        rendererPsoDesc.isDepth = true;
+        if (mBatchType == kShadows)
+        {
+            rendererPsoDesc.isShadow = true;
+            rendererPsoDesc.shadowMsaaCount = Math::Log2(ModelRenderer::gMsaaShadowSample);
         }
     }
+
+    return ModelRenderer::GetPsoIndex(rendererPsoDesc);
+}
+
+void MeshRenderer::ReserveMeshes(size_t passIndex, size_t numMeshes)
+{
+    // the forward batch adds a depth and a color key for every opaque mesh
+    RenderPass& renderPass = mRenderPasses[passIndex];
+    renderPass.sortObjects.reserve(renderPass.sortObjects.size() + numMeshes);
+    renderPass.sortKeys.reserve(renderPass.sortKeys.size() + numMeshes * (mBatchType == kDefault ? 2 : 1));
+    renderPass.batches.reserve(renderPass.sortKeys.capacity());
+    renderPass.instanceModels.reserve(renderPass.sortKeys.capacity());
 }
 
-void MeshRenderer::AddMesh(size_t passIndex, const SubMesh& subMesh, const Model* model, float distance, D3D12_GPU_VIRTUAL_ADDRESS meshCBV)
+void MeshRenderer::AddMesh(size_t passIndex, const SubMesh& subMesh, const Model* model, float distance, uint32_t modelIndex)
 {
     RenderPass& renderePass = mRenderPasses[passIndex];
     ASSERT(renderePass.camera != nullptr);
+    ASSERT(renderePass.sortObjects.size() < (1ull << SortKey::kObjectBits));
 
+    // only the pass and the object go in now, Sort packs the rest once the PSOs are known
     SortKey key;
     key.value = renderePass.sortObjects.size();
 
     bool alphaBlend = subMesh.psoFlags & ePSOFlags::kAlphaBlend;
-    bool alphaTest = subMesh.psoFlags & ePSOFlags::kAlphaTest;
 
     union float_or_int { float f; uint32_t u; } dist;
     dist.f = Math::Max(distance, 0.0f);
 
-    key.distance = dist.u;
+    auto AddKey = [&](DrawPass pass)
+    {
+        renderePass.sortKeys.push_back({ key.value | ((uint64_t)pass << SortKey::kPassShift) });
+        renderePass.passCounts[pass]++;
+    };
 
     if (mBatchType == kShadows)
     {
         if (alphaBlend)
             return;
 
-        key.passID = kZPass;
-        renderePass.sortKeys.push_back(key);
-        renderePass.passCounts[kZPass]++;
+        AddKey(kZPass);
     }
     else if (mBatchType == kGBuffer)
     {
         if (alphaBlend)
             return;
 
-        key.passID = kOpaque;
-        renderePass.sortKeys.push_back(key);
-        renderePass.passCounts[kOpaque]++;
+        AddKey(kOpaque);
     }
     else if (alphaBlend)
     {
-        key.passID = kTransparent;
-        key.distance = ~dist.u;
-        renderePass.sortKeys.push_back(key);
-        renderePass.passCounts[kTransparent]++;
+        AddKey(kTransparent);
     }
     else
     {
-        key.passID = kZPass;
-        renderePass.sortKeys.push_back(key);
-        renderePass.passCounts[kZPass]++;
-
-        key.passID = kOpaque;
-        renderePass.sortKeys.push_back(key);
-        renderePass.passCounts[kOpaque]++;
+        AddKey(kZPass);
+        AddKey(kOpaque);
     }
 
 
-    SortObject object = { model, &subMesh, meshCBV };
+    SortObject object = { model, &subMesh, modelIndex, dist.u };
     renderePass.sortObjects.push_back(object);
 }
 
 void MeshRenderer::Sort()
 {
+    static_assert(sizeof(SortKey) == sizeof(uint64_t));
+
+    // a scene only has a handful of distinct psoFlags, look each up once instead of hashing per draw
+    Utility::FrameVector<std::pair<uint16_t, uint16_t>> psoCache[kNumPasses];
+
     for (RenderPass& pass : mRenderPasses)
     {
-        std::sort(pass.sortKeys.begin(), pass.sortKeys.end(), [](uint64_t a, uint64_t b) {return a < b; });
+        for (SortKey& key : pass.sortKeys)
+        {
+            const DrawPass drawPass = key.GetPass();
+            const SortObject& object = pass.sortObjects[key.GetObjectIdx()];
+            const uint16_t psoFlags = (uint16_t)object.subMesh->psoFlags;
+
+            auto psoIter = std::find_if(psoCache[drawPass].begin(), psoCache[drawPass].end(),
+                [psoFlags](const std::pair<uint16_t, uint16_t>& entry) { return entry.first == psoFlags; });
+            if (psoIter == psoCache[drawPass].end())
+                psoIter = psoCache[drawPass].insert(psoIter, { psoFlags, GetObjectPsoIndex(*object.subMesh, drawPass) });
+            ASSERT(psoIter->second < (1u << kSortFieldBits[kFieldPso]));
+
+            key.value = PackSortKey(GetSortPolicy(drawPass), key.value, object, psoIter->second);
+        }
+
+        if (pass.sortKeys.size() > Utility::kRadixSortSmallThreshold)
+            pass.sortScratch.resize(pass.sortKeys.size());
+        Utility::RadixSort((uint64_t*)pass.sortKeys.data(), pass.sortKeys.size(), pass.sortScratch.data());
+
+        BuildBatches(pass);
     }
 }
 
+void MeshRenderer::BuildBatches(RenderPass& renderPass) const
+{
+    // How often draws that only differ in their transform are neighbours is up to the SortPolicy of the pass
+    const uint32_t numDraws = (uint32_t)renderPass.sortKeys.size();
+    renderPass.instanceModels.resize(numDraws);
+
+    BuildDrawBatches(numDraws, kMaxBatchInstances, renderPass.batches, [&](uint32_t drawIdx)
+    {
+        const SortKey key = renderPass.sortKeys[drawIdx];
+        const SortObject& object = renderPass.sortObjects[key.GetObjectIdx()];
+        renderPass.instanceModels[drawIdx] = object.modelIndex;
+
+        const Mesh& mesh = *object.model->GetMesh();
+        const SubMesh& subMesh = *object.subMesh;
+        const DrawPass pass = key.GetPass();
+        return DrawBatchKey{ (uint32_t)pass, UnpackPsoIndex(GetSortPolicy(pass), key.value), subMesh.materialIdx,
+            mesh.vbOffset, mesh.ibOffset, subMesh.startIndex, subMesh.indexCount, subMesh.baseVertex };
+    });
+}
+
+StateCallStats MeshRenderer::GetStateStats(DrawPass pass) const
+{
+    StateCallStats stats;
+    for (const RenderPass& renderPass : mRenderPasses)
+        stats += renderPass.stateStats[pass];
+    for (const RecordChunk& chunk : mRecordChunks)
+    {
+        if (chunk.drawPass == pass)
+            stats += chunk.stateStats;
+    }
+    return stats;
+}
+
+MeshRenderer::ChunkTimeStats MeshRenderer::GetChunkTimeStats() const
+{
+    ChunkTimeStats stats;
+    for (const RecordChunk& chunk : mRecordChunks)
+    {
+        stats.numChunks++;
+        stats.totalMs += chunk.cpuTimeMs;
+        stats.maxMs = std::max(stats.maxMs, chunk.cpuTimeMs);
+    }
+    return stats;
+}
+
 void MeshRenderer::RenderMeshes(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass)
 {
+    // the chunked path runs it in BuildRecordChunks, before any chunk records
+    PrepareRecord();
     RenderMeshesBegin(context, globals, pass);
 
     for (RenderPass& renderPass : mRenderPasses)
@@ -578,86 +777,248 @@ void MeshRenderer::RenderMeshes(GraphicsCommandList& context, GlobalConstants& g
 }
 
 void MeshRenderer::RenderMeshesImpl(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass, RenderPass& renderPass)
+{
+    for (; renderPass.currentPass <= pass; renderPass.currentPass = (DrawPass)(renderPass.currentPass + 1))
+    {
+        const uint32_t passCount = renderPass.passCounts[renderPass.currentPass];
+        if (passCount == 0)
+            continue;
+
+        BindPassTargets(context, mCurrentRenderPassIdx, renderPass.currentPass, true);
+
+        const uint32_t lastDraw = renderPass.currentDraw + passCount;
+        RecordDraws(context, globals, renderPass, renderPass.currentPass, renderPass.currentDraw, lastDraw,
+            renderPass.stateStats[renderPass.currentPass]);
+        renderPass.currentDraw = lastDraw;
+    }
+}
+
+void MeshRenderer::BindPassTargets(GraphicsCommandList& context, size_t passIndex, DrawPass pass, bool clearTargets)
+{
+    if (mBatchType != kDefault)
+        return;
+
+    switch (pass)
+    {
+    case kZPass:
+        context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+        if (clearTargets)
+            context.ClearDepth(*mDepthBuffer);
+        context.SetDepthStencilTarget(mDepthBuffer->GetDSV(passIndex));
+        break;
+    case kOpaque:
+        //{
+        //    context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ);
+        //    context.TransitionResource(*mRenderTargets[0], D3D12_RESOURCE_STATE_RENDER_TARGET);
+        //    context.SetRenderTarget(mRenderTargets[0]->GetRTV(), mDepthBuffer->GetDSV_DepthReadOnly());
+        //}
+        //{
+        //    context.TransitionResource(*mDSV, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+        //    context.TransitionResource(gSceneColorBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
+        //    context.SetRenderTarget(gSceneColorBuffer.GetRTV(), mDSV->GetDSV());
+        //}
+        //break;
+    case kTransparent:
+        context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ);
+        context.TransitionResource(*mRenderTargets[0], D3D12_RESOURCE_STATE_RENDER_TARGET);
+        if (clearTargets)
+            context.ClearColor(*mRenderTargets[0]);
+        context.SetRenderTarget(mRenderTargets[0]->GetRTV(), mDepthBuffer->GetDSV_DepthReadOnly());
+        break;
+    }
+}
+
+void MeshRenderer::RecordDraws(GraphicsCommandList& context, GlobalConstants& globals, const RenderPass& renderPass, DrawPass pass,
+    uint32_t firstDraw, uint32_t lastDraw, StateCallStats& stateStats)
 {
     // Set common shader constants
     globals.ViewProjMatrix = renderPass.camera->GetViewProjMatrix();
     globals.InvViewProjMatrix = Math::Invert(renderPass.camera->GetViewProjMatrix());
     globals.CameraPos = renderPass.camera->GetPosition();
 
-    context.SetRootSignature(*ModelRenderer::sForwardRootSig);
-    context.SetDynamicConstantBufferView(ModelRenderer::kGlobalConstants, sizeof(GlobalConstants), &globals);
-    context.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    StateCachingCommandList<GraphicsCommandList> stateCache(context, &stateStats);
+    stateCache.SetRootSignature(*ModelRenderer::sForwardRootSig);
+    stateCache.SetDynamicConstantBufferView(ModelRenderer::kGlobalConstants, sizeof(GlobalConstants), &globals);
+    stateCache.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-    for (; renderPass.currentPass <= pass; renderPass.currentPass = (DrawPass)(renderPass.currentPass + 1))
+    // the scene tables are the same for every draw of the pass, mesh buffers depend on the chunk a mesh sits in
+    const MeshManager* meshMgr = MeshManager::GetInstance();
+    const DescriptorHandle sceneTextures = mScene->GetSceneTextureHandles();
+    const DescriptorHandle shadowTexture = mScene->GetShadowTextureHandle();
+
+    context.SetViewportAndScissor(mViewport, mScissor);
+    context.FlushResourceBarriers();
+
+    // transforms are read per instance through the model index list of the range
+    stateCache.SetShaderResourceView(ModelRenderer::kModelInstances, mModelConstants);
+    stateCache.SetDynamicSRV(ModelRenderer::kInstanceModelIndices, sizeof(uint32_t) * (lastDraw - firstDraw),
+        renderPass.instanceModels.data() + firstDraw);
+
+    // the range of a record chunk may start or end inside a batch, each chunk draws its own part
+    const auto batchBegin = std::upper_bound(renderPass.batches.begin(), renderPass.batches.end(), firstDraw,
+        [](uint32_t drawIdx, const DrawBatch& batch) { return drawIdx < batch.firstDraw; }) - 1;
+    const auto batchEnd = std::lower_bound(batchBegin, renderPass.batches.end(), lastDraw,
+        [](const DrawBatch& batch, uint32_t drawIdx) { return batch.firstDraw < drawIdx; });
+
+    // indirect records of the whole range go into one upload allocation, a run of batches sharing
+    // PSO and material is executed as soon as the next batch changes either
+    GraphicsCommandList::UploadSpan argumentSpan = {};
+    IndirectDrawStream argumentStream;
+    uint32_t runFirstRecord = 0;
+    uint32_t runInstances = 0;
+    if (mUseIndirectDraw)
     {
-        const uint32_t passCount = renderPass.passCounts[renderPass.currentPass];
-        if (passCount == 0)
-            continue;
+        const uint32_t numBatches = (uint32_t)(batchEnd - batchBegin);
+        argumentSpan = context.ReserveUploadMemory(IndirectDrawStream::GetByteSize(numBatches), IndirectDrawStream::kAlignment);
+        argumentStream.Reset(argumentSpan.cpuAddress, numBatches);
+    }
+
+    auto ExecuteIndirectRun = [&]()
+    {
+        const uint32_t numRecords = argumentStream.GetCount() - runFirstRecord;
+        if (numRecords == 0)
+            return;
+
+        stateCache.ExecuteIndirect(ModelRenderer::GetMeshDrawSignature(), argumentSpan.resource,
+            argumentSpan.offset + IndirectDrawStream::GetByteOffset(runFirstRecord), numRecords, runInstances);
+        runFirstRecord = argumentStream.GetCount();
+        runInstances = 0;
+    };
+
+    const SortPolicy sortPolicy = GetSortPolicy(pass);
+    uint32_t psoIdx = ~0u;
+    uint32_t materialIdx = ~0u;
+    const Material* material = nullptr;
+    D3D12_GPU_VIRTUAL_ADDRESS materialCBV = 0;
+
+    for (auto batchIter = batchBegin; batchIter != batchEnd; ++batchIter)
+    {
+        const uint32_t batchFirst = std::max(batchIter->firstDraw, firstDraw);
+        const uint32_t batchLast = std::min(batchIter->firstDraw + batchIter->numInstances, lastDraw);
+
+        SortKey key = renderPass.sortKeys[batchFirst];
+        const SortObject& object = renderPass.sortObjects[key.GetObjectIdx()];
+        const Mesh& mesh = *object.model->GetMesh();
+        const SubMesh& subMesh = *object.subMesh;
 
-        if (mBatchType == kDefault)
+        // sorted draws tend to repeat the PSO and material, only rebind them when they change
+        const uint32_t batchPsoIdx = UnpackPsoIndex(sortPolicy, key.value);
+        if (batchPsoIdx != psoIdx || subMesh.materialIdx != materialIdx)
         {
-            switch (renderPass.currentPass)
+            ExecuteIndirectRun();
+
+            if (subMesh.materialIdx != materialIdx)
             {
-            case kZPass:
-                context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-                context.ClearDepth(*mDepthBuffer);
-                context.SetDepthStencilTarget(mDepthBuffer->GetDSV(mCurrentRenderPassIdx));
-                break;
-            case kOpaque:
-                //{
-                //    context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ);
-                //    context.TransitionResource(*mRenderTargets[0], D3D12_RESOURCE_STATE_RENDER_TARGET);
-                //    context.SetRenderTarget(mRenderTargets[0]->GetRTV(), mDepthBuffer->GetDSV_DepthReadOnly());
-                //}
-                //{
-                //    context.TransitionResource(*mDSV, D3D12_RESOURCE_STATE_DEPTH_WRITE);
-                //    context.TransitionResource(gSceneColorBuffer, D3D12_RESOURCE_STATE_RENDER_TARGET);
-                //    context.SetRenderTarget(gSceneColorBuffer.GetRTV(), mDSV->GetDSV());
-                //}
-                //break;
-            case kTransparent:
-                context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_READ);
-                context.TransitionResource(*mRenderTargets[0], D3D12_RESOURCE_STATE_RENDER_TARGET);
-                context.ClearColor(*mRenderTargets[0]);
-                context.SetRenderTarget(mRenderTargets[0]->GetRTV(), mDepthBuffer->GetDSV_DepthReadOnly());
-                break;
+                materialIdx = subMesh.materialIdx;
+                material = GET_MATERIAL(materialIdx);
+                materialCBV = GET_MAT_VPTR(materialIdx);
             }
+            psoIdx = batchPsoIdx;
+
+            stateCache.SetPipelineState(*ModelRenderer::sAllPSOs[psoIdx]);
+            stateCache.SetConstantBuffer(ModelRenderer::kMaterialConstants, materialCBV);
+            stateCache.SetDescriptorTable(ModelRenderer::kModelTextures, material->GetTextureGpuHandles());
+            stateCache.SetDescriptorTable(ModelRenderer::kModelTextureSamplers, material->GetSamplerGpuHandles());
+            stateCache.SetDescriptorTable(ModelRenderer::kSceneTextures, sceneTextures);
+            stateCache.SetDescriptorTable(ModelRenderer::kShadowTexture, shadowTexture);
         }
 
-        context.SetViewportAndScissor(mViewport, mScissor);
-        context.FlushResourceBarriers();
+        D3D12_VERTEX_BUFFER_VIEW vertexBuffer;
+        if (pass == kZPass)
+            vertexBuffer = { meshMgr->GetDepthVBAddress(mesh), mesh.sizeDepthVB, mesh.depthVertexStride };
+        else
+            vertexBuffer = { meshMgr->GetVBAddress(mesh), mesh.sizeVB, mesh.vertexStride };
 
-        const uint32_t lastDraw = renderPass.currentDraw + passCount;
+        DXGI_FORMAT indexFormat = subMesh.index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+        const D3D12_INDEX_BUFFER_VIEW indexBuffer = { meshMgr->GetIBAddress(mesh), mesh.sizeIB, indexFormat };
 
-        while (renderPass.currentDraw < lastDraw)
+        if (mUseIndirectDraw)
         {
-            SortKey key = renderPass.sortKeys[renderPass.currentDraw];
-            const SortObject& object = renderPass.sortObjects[key.objectIdx];
-            const Mesh& mesh = *object.model->GetMesh();
-            const SubMesh& subMesh = *object.subMesh;
-            const Material& material = *GET_MATERIAL(subMesh.materialIdx);
-
-            context.SetPipelineState(*ModelRenderer::sAllPSOs[key.psoIdx]);
-            context.SetConstantBuffer(ModelRenderer::kMeshConstants, object.meshCBV);
-            context.SetConstantBuffer(ModelRenderer::kMaterialConstants, GET_MAT_VPTR(subMesh.materialIdx));
-            context.SetDescriptorTable(ModelRenderer::kModelTextures, material.GetTextureGpuHandles());
-            context.SetDescriptorTable(ModelRenderer::kModelTextureSamplers, material.GetSamplerGpuHandles());
-            context.SetDescriptorTable(ModelRenderer::kSceneTextures, mScene->GetSceneTextureHandles());
-            context.SetDescriptorTable(ModelRenderer::kShadowTexture, mScene->GetShadowTextureHandle());
-
-            if (renderPass.currentPass == kZPass)
-                context.SetVertexBuffer(0, { GET_MESH_DepthVB + mesh.vbDepthOffset, mesh.sizeDepthVB, mesh.depthVertexStride });
-            else
-                context.SetVertexBuffer(0, { GET_MESH_VB + mesh.vbOffset, mesh.sizeVB, mesh.vertexStride });
-
-            DXGI_FORMAT indexFormat = subMesh.index32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
-            context.SetIndexBuffer({ GET_MESH_IB + mesh.ibOffset, mesh.sizeIB, indexFormat });
-
-            context.DrawIndexed(subMesh.indexCount, subMesh.startIndex, subMesh.baseVertex);
-
-            ++renderPass.currentDraw;
+            argumentStream.Append(vertexBuffer, indexBuffer, batchFirst - firstDraw,
+                subMesh.indexCount, batchLast - batchFirst, subMesh.startIndex, subMesh.baseVertex);
+            runInstances += batchLast - batchFirst;
+            continue;
         }
+
+        stateCache.SetVertexBuffer(0, vertexBuffer);
+        stateCache.SetIndexBuffer(indexBuffer);
+        stateCache.SetConstant(ModelRenderer::kFirstInstance, batchFirst - firstDraw);
+        stateCache.DrawIndexedInstanced(subMesh.indexCount, batchLast - batchFirst, subMesh.startIndex, subMesh.baseVertex, 0);
     }
+
+    ExecuteIndirectRun();
+}
+
+size_t MeshRenderer::BuildRecordChunks(DrawPass pass)
+{
+    PrepareRecord();
+    mRecordChunks.clear();
+
+    uint32_t totalDraws = 0;
+    for (const RenderPass& renderPass : mRenderPasses)
+        totalDraws += renderPass.passCounts[pass];
+
+    // enough chunks to give every worker and the submitting thread a share, but never so small
+    // that the per list overhead dominates
+    uint32_t numWorkers = (uint32_t)Utility::gThreadPoolExecutor.GetThreadCount() + 1;
+    uint32_t drawsPerChunk = std::max(kMinDrawsPerChunk, (totalDraws + numWorkers - 1) / numWorkers);
+
+    // every render pass (CSM cascade) gets chunks of its own, so cascades record independently
+    for (uint32_t passIndex = 0; passIndex < (uint32_t)mRenderPasses.size(); passIndex++)
+    {
+        const RenderPass& renderPass = mRenderPasses[passIndex];
+        uint32_t firstDraw = 0;
+        for (uint32_t i = 0; i < (uint32_t)pass; i++)
+            firstDraw += renderPass.passCounts[i];
+
+        const uint32_t passCount = renderPass.passCounts[pass];
+        const uint32_t numChunks = (passCount + drawsPerChunk - 1) / drawsPerChunk;
+        for (uint32_t i = 0; i < numChunks; i++)
+        {
+            RecordChunk chunk = {};
+            chunk.passIndex = passIndex;
+            chunk.drawPass = pass;
+            chunk.firstDraw = firstDraw + (uint32_t)((uint64_t)passCount * i / numChunks);
+            chunk.lastDraw = firstDraw + (uint32_t)((uint64_t)passCount * (i + 1) / numChunks);
+            chunk.isFirstOfPass = i == 0;
+            mRecordChunks.push_back(chunk);
+        }
+    }
+
+    // RenderMeshesBegin and RenderMeshesEnd still need a list when nothing is drawn
+    if (mRecordChunks.empty())
+    {
+        RecordChunk chunk = {};
+        chunk.drawPass = pass;
+        mRecordChunks.push_back(chunk);
+    }
+
+    return mRecordChunks.size();
+}
+
+void MeshRenderer::RenderChunk(GraphicsCommandList& context, GlobalConstants& globals, size_t chunkIndex)
+{
+    ZoneScoped;
+    RecordChunk& chunk = mRecordChunks[chunkIndex];
+    int64_t startTick = SystemTime::GetCurrentTick();
+
+    context.PIXBeginEvent((L"Pass " + std::to_wstring(chunk.passIndex) + L" Chunk " + std::to_wstring(chunkIndex)).c_str());
+
+    if (chunkIndex == 0)
+        RenderMeshesBegin(context, globals, chunk.drawPass);
+
+    if (chunk.firstDraw < chunk.lastDraw)
+    {
+        BindPassTargets(context, chunk.passIndex, chunk.drawPass, chunk.isFirstOfPass);
+        RecordDraws(context, globals, mRenderPasses[chunk.passIndex], chunk.drawPass, chunk.firstDraw, chunk.lastDraw, chunk.stateStats);
+    }
+
+    if (chunkIndex + 1 == mRecordChunks.size())
+        RenderMeshesEnd(context, globals, chunk.drawPass);
+
+    context.PIXEndEvent();
+
+    chunk.cpuTimeMs = (float)SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick);
 }
 
 void ShadowMeshRenderer::RenderMeshesBegin(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass)
@@ -665,17 +1026,20 @@ void ShadowMeshRenderer::RenderMeshesBegin(GraphicsCommandList& context, GlobalC
     ShadowBuffer* shadowBuffer = dynamic_cast<ShadowBuffer*>(mDepthBuffer);
     context.TransitionResource(*shadowBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE, true);
     context.ClearDepth(*shadowBuffer);
+}
 
+void ShadowMeshRenderer::PrepareRecord()
+{
+    ShadowBuffer* shadowBuffer = dynamic_cast<ShadowBuffer*>(mDepthBuffer);
     mScissor = shadowBuffer->GetScissor();
     mViewport = shadowBuffer->GetViewPort();
 }
 
-void ShadowMeshRenderer::RenderMeshesImpl(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass, RenderPass& renderPass)
+void ShadowMeshRenderer::BindPassTargets(GraphicsCommandList& context, size_t passIndex, DrawPass pass, bool clearTargets)
 {
     ShadowBuffer* shadowBuffer = dynamic_cast<ShadowBuffer*>(mDepthBuffer);
-    context.SetDepthStencilTarget(shadowBuffer->GetDSV(mCurrentRenderPassIdx));
-
-    MeshRenderer::RenderMeshesImpl(context, globals, pass, renderPass);
+    context.TransitionResource(*shadowBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    context.SetDepthStencilTarget(shadowBuffer->GetDSV(passIndex));
 }
 
 void ShadowMeshRenderer::RenderMeshesEnd(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass)
@@ -712,6 +1076,14 @@ void DeferredRenderer::RenderMeshesEnd(GraphicsCommandList& context, GlobalConst
     context.TransitionResource(*mRenderTargets[0], D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 }
 
+void DeferredRenderer::BindPassTargets(GraphicsCommandList& context, size_t passIndex, DrawPass pass, bool clearTargets)
+{
+    // the GBuffer is cleared once in RenderMeshesBegin, chunks only rebind it
+    context.TransitionResource(*mDepthBuffer, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+    context.TransitionResource(*mRenderTargets[0], D3D12_RESOURCE_STATE_RENDER_TARGET);
+    context.SetRenderTarget(mRenderTargets[0]->GetRTV(), mDepthBuffer->GetDSV());
+}
+
 
 void FullScreenRenderer::Reset()
 {
@@ -745,7 +1117,7 @@ void FullScreenRenderer::RenderScreen(GraphicsCommandList& context, GlobalConsta
         context.SetRootSignature(*ModelRenderer::sDeferredRootSig);
         context.SetPipelineState(*ModelRenderer::sAllPSOs[mPSOIndex]);
         context.SetDynamicConstantBufferView(ModelRenderer::kGlobalConstantsDeferred, sizeof(GlobalConstants), &globals);
-        context.SetDescriptorTable(ModelRenderer::kGBufferTextures, mScene->GetDeferredTextureHandle());
+        context.SetDescriptorTable(ModelRenderer::kGBufferTextures, mScene->GetGBufferTextureHandle());
         context.SetDescriptorTable(ModelRenderer::kSceneTexturesDeferred, mScene->GetSceneTextureHandles());
         context.SetDescriptorTable(ModelRenderer::kShadowTextureDeferred, mScene->GetShadowTextureHandle());
     }
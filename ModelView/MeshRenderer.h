@@ -3,7 +3,10 @@
 #include "Math/VectorMath.h"
 #include "Camera.h"
 #include "Material.h"
+#include "DrawBatching.h"
+#include "StateCachingCommandList.h"
 #include "Utils/DebugUtils.h"
+#include "Utils/FrameArena.h"
 
 #define SHADOW_MAP_FORMAT DXGI_FORMAT_D32_FLOAT
 #define DEFERRED_RENDER
@@ -24,6 +27,7 @@ class ShadowBuffer;
 class CameraController;
 class GraphicsCommandList;
 class GraphicsPipelineState;
+class CommandSignature;
 
 struct GlobalConstants;
 
@@ -67,6 +71,11 @@ namespace ModelRenderer
         kSceneTextures,
         kShadowTexture,
 
+        // mesh VS read their transforms per instance, kMeshConstants is left to the skybox
+        kModelInstances,
+        kInstanceModelIndices,
+        kFirstInstance,
+
         kNumRootBindings
     };
 
@@ -95,6 +104,8 @@ namespace ModelRenderer
 
     uint16_t GetPsoIndex(RendererPsoDesc rendererPsoDesc);
     uint16_t GetFullScreenPsoIndex(RendererPsoDesc rendererPsoDesc);
+    // vertex buffer, index buffer, kFirstInstance and DrawIndexed per record, see IndirectDrawStream
+    const CommandSignature& GetMeshDrawSignature();
     ShadowBuffer* GetShadowBuffers();
     ColorBuffer* GetNonMsaaShadowBuffers();
     ColorBuffer* GetGBuffers();
@@ -110,21 +121,28 @@ class MeshRenderer : public NonCopyable
 public:
     enum BatchType { kDefault, kShadows, kGBuffer, kNumBachTypes };
     enum DrawPass { kZPass, kOpaque, kTransparent, kNumPasses };
+    // Order of the draws inside one DrawPass. Depth only passes want front to back for early z, color
+    // passes behind a prepass gain nothing from depth order and want the fewest state changes instead.
+    enum SortPolicy
+    {
+        kSortFrontToBack,   // distance, PSO
+        kSortBackToFront,   // reversed distance, PSO, required for blending
+        kSortStateOrdered,  // PSO, material, mesh buffer, coarse distance bucket
+        kNumSortPolicies
+    };
 
 protected:
+    // passID sits in the top bits and objectIdx in the bottom ones of every key, so draws of a pass stay
+    // contiguous whatever the policy, the bits between are packed per SortPolicy by Sort()
     struct SortKey
     {
-        union
-        {
-            uint64_t value;
-            struct
-            {
-                uint64_t objectIdx : 16;
-                uint64_t psoIdx : 12;
-                uint64_t distance : 32;
-                uint64_t passID : 4;    // high bit is priority
-            };
-        };
+        static constexpr uint32_t kObjectBits = 16;
+        static constexpr uint32_t kPassShift = 60;
+
+        uint64_t value;
+
+        uint32_t GetObjectIdx() const { return (uint32_t)(value & ((1ull << kObjectBits) - 1)); }
+        DrawPass GetPass() const { return (DrawPass)(value >> kPassShift); }
 
         operator uint64_t() { return value; }
     };
@@ -133,31 +151,63 @@ protected:
     {
         const Model* model;
         const SubMesh* subMesh;
-        D3D12_GPU_VIRTUAL_ADDRESS meshCBV;
+        uint32_t modelIndex; // element of the model constants buffer
+        uint32_t distance; // bits of the non negative float distance, ordered like the float
     };
 
     struct RenderPass
     {
-        std::vector<SortObject> sortObjects;
-        std::vector<SortKey> sortKeys;
+        // renderers are rebuilt every frame, so everything they hold lives in the frame arena
+        Utility::FrameVector<SortObject> sortObjects;
+        Utility::FrameVector<SortKey> sortKeys;
+        Utility::FrameVector<uint64_t> sortScratch;    // radix sort ping-pong buffer
+        Utility::FrameVector<DrawBatch> batches;       // cover every sorted draw, in order
+        Utility::FrameVector<uint32_t> instanceModels; // modelIndex of every sorted draw
         uint32_t passCounts[kNumPasses];
         DrawPass currentPass;
         uint32_t currentDraw;
         const Math::BaseCamera* camera;
+        StateCallStats stateStats[kNumPasses]; // state calls issued and filtered by RenderMeshes
     };
 public:
+    // A contiguous run of one render pass's draws recorded on its own command list
+    struct RecordChunk
+    {
+        uint32_t passIndex;
+        DrawPass drawPass;
+        uint32_t firstDraw;
+        uint32_t lastDraw;
+        bool isFirstOfPass; // clears the pass targets
+        float cpuTimeMs;    // written by RenderChunk
+        StateCallStats stateStats;
+    };
+
+    // CPU time RenderChunk spent recording the chunks of the frame, how evenly the parallel lists split the work
+    struct ChunkTimeStats
+    {
+        uint32_t numChunks = 0;
+        float totalMs = 0.0f;
+        float maxMs = 0.0f;
+    };
+
+    // below this a chunk costs more in list reset, submission and state re-binding than it saves
+    static constexpr uint32_t kMinDrawsPerChunk = 1024;
 
     MeshRenderer() : mBatchType(kDefault)
     {
         Reset();
     }
+    virtual ~MeshRenderer() {}
 
     void Reset();
 
     void SetPassCount(size_t count) { mRenderPasses.resize(count); }
     size_t GetPassCount() const { return mRenderPasses.size(); }
     void SetBatchType(BatchType type) { mBatchType = type; }
+    BatchType GetBatchType() const { return mBatchType; }
     void SetScene(const Scene& scene) { mScene = &scene; }
+    // StructuredBuffer of ModelTransform that the modelIndex of AddMesh refers to
+    void SetModelConstants(D3D12_GPU_VIRTUAL_ADDRESS modelConstants) { mModelConstants = modelConstants; }
     void SetViewport(const D3D12_VIEWPORT& viewport) { mViewport = viewport; }
     void SetScissor(const D3D12_RECT& scissor) { mScissor = scissor; }
     template<typename CameraType>
@@ -195,31 +245,66 @@ public:
     const Math::Frustum& GetWorldFrustum(size_t passIndex = 0) const { return mRenderPasses[passIndex].camera->GetWorldSpaceFrustum(); }
     const Math::Frustum& GetViewFrustum(size_t passIndex = 0) const { return mRenderPasses[passIndex].camera->GetViewSpaceFrustum(); }
     const Math::Matrix4& GetViewMatrix(size_t passIndex = 0) const { return mRenderPasses[passIndex].camera->GetViewMatrix(); }
+    // state calls of pass summed over every render pass and record chunk, valid once recording is done
+    StateCallStats GetStateStats(DrawPass pass) const;
+
+    // records the batches of a PSO and material run into one ExecuteIndirect instead of a draw each
+    void SetIndirectDraw(bool enable) { mUseIndirectDraw = enable; }
+    bool IsIndirectDraw() const { return mUseIndirectDraw; }
 
-    void SetObjectsPSO();
+    static SortPolicy GetDefaultSortPolicy(BatchType type, DrawPass pass);
+    void SetSortPolicy(DrawPass pass, SortPolicy policy) { mSortPolicies[pass] = policy; }
+    SortPolicy GetSortPolicy(DrawPass pass) const { return mSortPolicies[pass] == kNumSortPolicies ? GetDefaultSortPolicy(mBatchType, pass) : mSortPolicies[pass]; }
 
-    void AddMesh(size_t passIndex, const SubMesh& mesh, const Model* model, float distance, D3D12_GPU_VIRTUAL_ADDRESS meshCBV);
+    // arena memory is not reclaimed when a vector grows, so size the pass up front when the count is known
+    void ReserveMeshes(size_t passIndex, size_t numMeshes);
+    void AddMesh(size_t passIndex, const SubMesh& mesh, const Model* model, float distance, uint32_t modelIndex);
 
+    // resolves the PSO of every draw, packs the keys of each pass per its SortPolicy, sorts them and
+    // merges the runs of draws that can be instanced into batches
     void Sort();
 
     void RenderMeshes(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass);
+
+    // Parallel alternative to RenderMeshes: splits the draws of pass in every render pass into chunks,
+    // each recorded by RenderChunk on its own command list. The lists must be submitted in chunk order,
+    // the first chunk runs RenderMeshesBegin and the last one RenderMeshesEnd.
+    size_t BuildRecordChunks(DrawPass pass);
+    void RenderChunk(GraphicsCommandList& context, GlobalConstants& globals, size_t chunkIndex);
+    const Utility::FrameVector<RecordChunk>& GetRecordChunks() const { return mRecordChunks; }
+    // valid once every chunk was recorded
+    ChunkTimeStats GetChunkTimeStats() const;
 protected:
     virtual void RenderMeshesBegin(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass) {}
     virtual void RenderMeshesImpl(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass, RenderPass& renderPass);
     virtual void RenderMeshesEnd(GraphicsCommandList& context, GlobalConstants& globals, DrawPass pass) {}
 
+    // CPU side setup that must be done before chunks start recording concurrently
+    virtual void PrepareRecord() {}
+    // Binds the targets of one render pass, a new command list inherits none of them
+    virtual void BindPassTargets(GraphicsCommandList& context, size_t passIndex, DrawPass pass, bool clearTargets);
+    void RecordDraws(GraphicsCommandList& context, GlobalConstants& globals, const RenderPass& renderPass, DrawPass pass,
+        uint32_t firstDraw, uint32_t lastDraw, StateCallStats& stateStats);
+    uint16_t GetObjectPsoIndex(const SubMesh& subMesh, DrawPass pass) const;
+    void BuildBatches(RenderPass& renderPass) const;
+
     BatchType mBatchType;
-    std::vector<RenderPass> mRenderPasses;
+    SortPolicy mSortPolicies[kNumPasses]; // kNumSortPolicies selects GetDefaultSortPolicy
+    bool mUseIndirectDraw;
+    Utility::FrameVector<RenderPass> mRenderPasses;
     uint32_t mCurrentRenderPassIdx;
 
     D3D12_VIEWPORT mViewport;
     D3D12_RECT mScissor;
     uint32_t mNumRTVs;
     const Scene* mScene;
+    D3D12_GPU_VIRTUAL_ADDRESS mModelConstants;
     ColorBuffer* mRenderTargets[8];
     DepthBuffer* mDepthBuffer;
     ColorBuffer* mMsaaRenderTargets[8];
     ColorBuffer* mNonMsaaDepthBuffer;
+
+    Utility::FrameVector<RecordChunk> mRecordChunks;
 };
 
 
@@ -233,10 +318,11 @@ public:
 
     virtual void RenderMeshesBegin(GraphicsCommandList& context, GlobalConstants& globals,
         DrawPass pass) override;
-    virtual void RenderMeshesImpl(GraphicsCommandList& context, GlobalConstants& globals, 
-        DrawPass pass, RenderPass& renderPass) override;
     virtual void RenderMeshesEnd(GraphicsCommandList& context, GlobalConstants& globals, 
         DrawPass pass) override;
+
+    virtual void PrepareRecord() override;
+    virtual void BindPassTargets(GraphicsCommandList& context, size_t passIndex, DrawPass pass, bool clearTargets) override;
 };
 
 
@@ -254,6 +340,8 @@ public:
     //    DrawPass pass, RenderPass& renderPass) override;
     virtual void RenderMeshesEnd(GraphicsCommandList& context, GlobalConstants& globals,
         DrawPass pass) override;
+
+    virtual void BindPassTargets(GraphicsCommandList& context, size_t passIndex, DrawPass pass, bool clearTargets) override;
 };
 
 
@@ -267,14 +355,15 @@ public:
     T& Add(MeshRenderer::BatchType type) 
     {
         ASSERT(mMeshRenderers[type] == nullptr);
-        mMeshRenderers[type] = std::make_unique<T>();
+        mMeshRenderers[type] = Utility::MakeFrameUnique<T>();
         return static_cast<T&>(*mMeshRenderers[type]); 
     }
 
     template<typename T>
     T& Get(MeshRenderer::BatchType type) { return static_cast<T&>(*mMeshRenderers[type]); }
+    MeshRenderer* Find(MeshRenderer::BatchType type) { return mMeshRenderers[type].get(); }
 private:
-    std::vector<std::unique_ptr<MeshRenderer>> mMeshRenderers;
+    Utility::FrameVector<Utility::FrameUniquePtr<MeshRenderer>> mMeshRenderers;
 };
 
 
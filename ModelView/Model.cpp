@@ -3,7 +3,7 @@
 #include "Mesh.h"
 #include "Scene.h"
 
-void Model::Render(MeshRenderer& renderer, const Math::AffineTransform& transform, D3D12_GPU_VIRTUAL_ADDRESS meshCBV) const
+void Model::Render(MeshRenderer& renderer, const Math::AffineTransform& transform) const
 {
     for (size_t passIndex = 0; passIndex < renderer.GetPassCount(); passIndex++)
     {
@@ -21,7 +21,7 @@ void Model::Render(MeshRenderer& renderer, const Math::AffineTransform& transfor
             if (frustum.IntersectSphere(sphereVS))
             {
                 float distance = -sphereVS.GetCenter().GetZ() - sphereVS.GetRadius();
-                renderer.AddMesh(passIndex, subMesh, this, distance, meshCBV);
+                renderer.AddMesh(passIndex, subMesh, this, distance, mCurIndex);
             }
         }
     }
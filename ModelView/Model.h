@@ -16,16 +16,12 @@ public:
     Model() {}
 	~Model() {}
 
-    void Render(MeshRenderer& renderer, const Math::AffineTransform& transform, D3D12_GPU_VIRTUAL_ADDRESS meshCBV) const;
+    void Render(MeshRenderer& renderer, const Math::AffineTransform& transform) const;
 
     const Mesh* GetMesh() const { return mMesh; }
     Math::BoundingSphere GetWorldBoundingSphere() const;
 private:
-    Math::XMFLOAT3 mPosition;
-    Math::XMFLOAT4 mRotation;
-    Math::XMFLOAT3 mScale;
-
-    uint32_t mParentIndex;
+    // local transform and parent live in Scene::mTransforms at the same index
     uint32_t mCurIndex;
 
     Math::BoundingSphere m_BSLS;         // local space bounds
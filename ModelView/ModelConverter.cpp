@@ -9,10 +9,13 @@
 #include "Model.h"
 #include "Mesh.h"
 #include "Scene.h"
+#include "SystemTime.h"
+#include "MeshCache.h"
 #include "Math/BoundingSphere.h"
 #include "Math/VectorMath.h"
 #include "Utils/DirectXMesh/DirectXMesh.h"
 #include "Utils/ThreadPoolExecutor.h"
+#include "Utils/Hash.h"
 
 static std::unordered_map<std::wstring, std::filesystem::path> sIBLTexturePaths;
 
@@ -116,17 +119,56 @@ static void LoadIBLTextures()
     }
 }
 
-struct GeometryData
+// Per primitive state carried through the mesh build stages
+struct PrimitiveBuildTask
 {
-    std::unique_ptr<byte[]> VB;
-    std::unique_ptr<byte[]> depthVB;
-    std::unique_ptr<byte[]> IB;
-    uint32_t vertexBufferSize;
-    uint32_t depthVertexBufferSize;
-    uint32_t indexBufferSize;
+    const glTF::Primitive* primitive;
+    SubMesh* subMesh;
+    ePSOFlags meshPsoFlags;
+
     uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t maxIndex;
+    bool b32BitIndices;
+    bool hasTangent;
     uint8_t vertexStride;
     uint8_t depthVertexStride;
+
+    // destination inside the packed mesh buffers, assigned by PackMesh
+    byte* IB;
+    byte* VB;
+    byte* depthVB;
+
+    std::unique_ptr<DirectX::XMFLOAT3[]> position;
+    std::unique_ptr<DirectX::XMFLOAT3[]> normal;
+    std::unique_ptr<DirectX::XMFLOAT4[]> tangent;
+    std::unique_ptr<DirectX::XMFLOAT2[]> texcoords[4];
+};
+
+// The arrays a converted mesh views, meshes read from the mesh cache view its mapping instead
+struct MeshBuffers
+{
+    std::unique_ptr<byte[]> VB;
+    std::unique_ptr<byte[]> DepthVB;
+    std::unique_ptr<byte[]> IB;
+    std::unique_ptr<SubMesh[]> subMeshes;
+};
+
+static ModelConverter::MeshBuildStats sMeshBuildStats;
+static std::atomic<int64_t> sMeshBuildStageTicks[ModelConverter::MeshBuildStats::kNumStages];
+
+class MeshBuildStageTimer
+{
+public:
+    MeshBuildStageTimer(ModelConverter::MeshBuildStats::eStage stage) : 
+        mStage(stage), mStartTick(SystemTime::GetCurrentTick()) {}
+    ~MeshBuildStageTimer()
+    {
+        sMeshBuildStageTicks[mStage].fetch_add(SystemTime::GetCurrentTick() - mStartTick, std::memory_order_relaxed);
+    }
+private:
+    ModelConverter::MeshBuildStats::eStage mStage;
+    int64_t mStartTick;
 };
 
 namespace ModelConverter
@@ -141,162 +183,338 @@ namespace ModelConverter
         return std::filesystem::path();
     }
 
-    void BuildMaterials(const glTF::Asset& asset)
-	{
-        MaterialManager* matMgr = MaterialManager::GetInstance();
-        matMgr->Reserve(asset.m_materials.size());
-
+    static void GatherMaterials(const glTF::Asset& asset, std::vector<MeshCache::BakedMaterial>& materials)
+    {
+        materials.resize(asset.m_materials.size());
         for (uint32_t i = 0; i < asset.m_materials.size(); ++i)
         {
             const glTF::Material& gltfMat = asset.m_materials[i];
-            PBRMaterial& pbrMat = matMgr->AddMaterial<PBRMaterial>();
+            MeshCache::BakedMaterial& bakedMat = materials[i];
+            MeshCache::MaterialRecord& record = bakedMat.record;
 
-            pbrMat.mMaterialConstant.baseColorFactor[0] = gltfMat.baseColorFactor[0];
-            pbrMat.mMaterialConstant.baseColorFactor[1] = gltfMat.baseColorFactor[1];
-            pbrMat.mMaterialConstant.baseColorFactor[2] = gltfMat.baseColorFactor[2];
-            pbrMat.mMaterialConstant.baseColorFactor[3] = gltfMat.baseColorFactor[3];
+            CopyMemory(record.baseColorFactor, gltfMat.baseColorFactor, sizeof(record.baseColorFactor));
+            CopyMemory(record.emissiveFactor, gltfMat.emissiveFactor, sizeof(record.emissiveFactor));
+            record.normalTextureScale = gltfMat.normalTextureScale;
+            record.metallicFactor = gltfMat.metallicFactor;
+            record.roughnessFactor = gltfMat.roughnessFactor;
+            record.flags = gltfMat.flags;
 
-            pbrMat.mMaterialConstant.emissiveFactor[0] = gltfMat.emissiveFactor[0];
-            pbrMat.mMaterialConstant.emissiveFactor[1] = gltfMat.emissiveFactor[1];
-            pbrMat.mMaterialConstant.emissiveFactor[2] = gltfMat.emissiveFactor[2];
-
-            pbrMat.mMaterialConstant.normalTextureScale = gltfMat.normalTextureScale;
-            pbrMat.mMaterialConstant.metallicFactor = gltfMat.metallicFactor;
-            pbrMat.mMaterialConstant.roughnessFactor = gltfMat.roughnessFactor;
-
-            pbrMat.mMaterialConstant.flags = gltfMat.flags;
-
-            std::filesystem::path imagePath[PBRMaterial::kNumTextures];
             for (uint32_t ti = 0; ti < PBRMaterial::kNumTextures; ++ti)
             {
-                SamplerDesc texSampleDesc;
-
+                MeshCache::SamplerRecord& sampler = record.samplers[ti];
                 if (gltfMat.textures[ti] && gltfMat.textures[ti]->sampler != nullptr)
                 {
-                    texSampleDesc.AddressU = gltfMat.textures[ti]->sampler->wrapS;
-                    texSampleDesc.AddressV = gltfMat.textures[ti]->sampler->wrapT;
-                    texSampleDesc.Filter = gltfMat.textures[ti]->sampler->filter;
+                    sampler.addressU = gltfMat.textures[ti]->sampler->wrapS;
+                    sampler.addressV = gltfMat.textures[ti]->sampler->wrapT;
+                    sampler.filter = gltfMat.textures[ti]->sampler->filter;
                 }
                 else
                 {
                     // for default
-                    texSampleDesc.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-                    texSampleDesc.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-                    texSampleDesc.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
+                    sampler.addressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+                    sampler.addressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+                    sampler.filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
                 }
 
+                record.textureFlags[ti] = GetTextureFlag(ti, (gltfMat.alphaBlend | gltfMat.alphaTest) && ti == PBRMaterial::kBaseColor);
+                record.texturePathOffsets[ti] = MeshCache::kInvalidIndex;
+                if (gltfMat.textures[ti] != nullptr)
+                    bakedMat.texturePaths[ti] = asset.m_basePath / gltfMat.textures[ti]->source->path;
+            }
+        }
+    }
+
+    // priorities holds one entry per material, nullptr reads every texture at normal priority
+    static void CreateMaterials(const std::vector<MeshCache::BakedMaterial>& materials,
+        const Utility::eIOPriority* priorities = nullptr)
+    {
+        MaterialManager* matMgr = MaterialManager::GetInstance();
+        TextureManager* texMgr = TextureManager::GetInstance();
+        matMgr->Reserve(materials.size());
+
+        for (uint32_t i = 0; i < materials.size(); ++i)
+        {
+            const MeshCache::MaterialRecord& record = materials[i].record;
+            PBRMaterial& pbrMat = matMgr->AddMaterial<PBRMaterial>();
+
+            pbrMat.mMaterialConstant.baseColorFactor[0] = record.baseColorFactor[0];
+            pbrMat.mMaterialConstant.baseColorFactor[1] = record.baseColorFactor[1];
+            pbrMat.mMaterialConstant.baseColorFactor[2] = record.baseColorFactor[2];
+            pbrMat.mMaterialConstant.baseColorFactor[3] = record.baseColorFactor[3];
+
+            pbrMat.mMaterialConstant.emissiveFactor[0] = record.emissiveFactor[0];
+            pbrMat.mMaterialConstant.emissiveFactor[1] = record.emissiveFactor[1];
+            pbrMat.mMaterialConstant.emissiveFactor[2] = record.emissiveFactor[2];
+
+            pbrMat.mMaterialConstant.normalTextureScale = record.normalTextureScale;
+            pbrMat.mMaterialConstant.metallicFactor = record.metallicFactor;
+            pbrMat.mMaterialConstant.roughnessFactor = record.roughnessFactor;
+
+            pbrMat.mMaterialConstant.flags = record.flags;
+
+            for (uint32_t ti = 0; ti < PBRMaterial::kNumTextures; ++ti)
+            {
+                SamplerDesc texSampleDesc;
+                texSampleDesc.AddressU = (D3D12_TEXTURE_ADDRESS_MODE)record.samplers[ti].addressU;
+                texSampleDesc.AddressV = (D3D12_TEXTURE_ADDRESS_MODE)record.samplers[ti].addressV;
+                texSampleDesc.Filter = (D3D12_FILTER)record.samplers[ti].filter;
+
                 pbrMat.mSamplerHandles[ti] = GET_SAM_HANDLE(texSampleDesc);
 
-                if (gltfMat.textures[ti] == nullptr)
+                const std::filesystem::path& imagePath = materials[i].texturePaths[ti];
+                if (imagePath.empty())
                 {
                     pbrMat.mTextures[ti] = GET_TEXD(GetDefaultTexture(ti));
                     continue;
                 }
 
-                std::filesystem::path imagePath = asset.m_basePath / gltfMat.textures[ti]->source->path;
-                pbrMat.mTextures[ti] = GET_TEXFF(
+                pbrMat.mTextures[ti] = texMgr->GetTexture(
                     imagePath, 
-                    GetTextureFlag(ti, (gltfMat.alphaBlend | gltfMat.alphaTest) && ti == PBRMaterial::kBaseColor),
+                    record.textureFlags[ti],
                     GetDefaultTexture(ti),
-                    pbrMat.mTextureHandles + ti);
+                    priorities ? priorities[i] : Utility::kIOPriorityNormal);
             }
         }
 
         TextureManager::GetInstance()->WaitLoading();
 
         LoadIBLTextures();
+    }
+
+    void BuildMaterials(const glTF::Asset& asset)
+	{
+        std::vector<MeshCache::BakedMaterial> materials;
+        GatherMaterials(asset, materials);
+        CreateMaterials(materials);
 	}
 
-    GeometryData BuildSubMesh(const glTF::Primitive& primitive, SubMesh& subMesh, const ePSOFlags meshPsoFlags)
+    const MeshBuildStats& GetMeshBuildStats()
+    {
+        return sMeshBuildStats;
+    }
+
+    static uint16_t BuildOutputLayouts(const glTF::Primitive& primitive, const ePSOFlags meshPsoFlags, bool hasTangent,
+        std::vector<D3D12_INPUT_ELEMENT_DESC>& outputElements, std::vector<D3D12_INPUT_ELEMENT_DESC>& depthElements)
+    {
+        const bool HasUV0 = primitive.attributes[glTF::Primitive::kTexcoord0] != nullptr;
+        const bool HasUV1 = primitive.attributes[glTF::Primitive::kTexcoord1] != nullptr;
+
+        // interleaved and compressed vertex buffer
+        uint16_t psoFlags = ePSOFlags::kHasPosition | ePSOFlags::kHasNormal;
+        outputElements.push_back({ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        outputElements.push_back({ "NORMAL", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        if (hasTangent)
+        {
+            outputElements.push_back({ "TANGENT", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+            psoFlags |= ePSOFlags::kHasTangent;
+        }
+        if (HasUV0 || meshPsoFlags & ePSOFlags::kHasUV0)
+        {
+            outputElements.push_back({ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+            psoFlags |= ePSOFlags::kHasUV0;
+        }
+        if (HasUV1 || meshPsoFlags & ePSOFlags::kHasUV1)
+        {
+            outputElements.push_back({ "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+            psoFlags |= ePSOFlags::kHasUV1;
+        }
+        if (primitive.material->alphaBlend)
+            psoFlags |= ePSOFlags::kAlphaBlend;
+        if (primitive.material->alphaTest)
+            psoFlags |= ePSOFlags::kAlphaTest;
+        if (primitive.material->twoSided)
+            psoFlags |= ePSOFlags::kTwoSided;
+
+        // positions only (or positions and UV when alpha testing)
+        depthElements.push_back({ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        if (primitive.material->alphaTest || meshPsoFlags & ePSOFlags::kAlphaTest)
+        {
+            depthElements.push_back({ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
+        }
+
+        return psoFlags;
+    }
+
+    // Stage 0: index counts, index width and vertex layout, enough to size the packed buffers
+    static void AnalyzePrimitive(PrimitiveBuildTask& task)
     {
+        ZoneScoped;
+        MeshBuildStageTimer timer(MeshBuildStats::kAnalyze);
+
+        const glTF::Primitive& primitive = *task.primitive;
         ASSERT(primitive.attributes[glTF::Primitive::kPosition] != nullptr, "Must have POSITION");
-        GeometryData geoData;
-        uint32_t vertexCount = primitive.attributes[glTF::Primitive::kPosition]->count;
-        geoData.vertexCount = vertexCount;
-
-        // process index
-        bool b32BitIndices;
-        uint32_t maxIndex;
-        uint32_t indexCount;
-        std::unique_ptr<byte[]> newIndices;
+        task.vertexCount = primitive.attributes[glTF::Primitive::kPosition]->count;
+
         if (primitive.indices != nullptr)
         {
-            void* indicesPtr = primitive.indices->dataPtr;
-            indexCount = primitive.indices->count;
-            maxIndex = primitive.maxIndex;
+            task.indexCount = primitive.indices->count;
+            task.maxIndex = primitive.maxIndex;
 
             if (primitive.indices->componentType == glTF::Accessor::kUnsignedInt)
             {
-                uint32_t* ib = (uint32_t*)primitive.indices->dataPtr;
-                for (uint32_t k = 0; k < indexCount; ++k)
-                    maxIndex = std::max(ib[k], maxIndex);
+                const uint32_t* ib = (const uint32_t*)primitive.indices->dataPtr;
+                for (uint32_t k = 0; k < task.indexCount; ++k)
+                    task.maxIndex = std::max(ib[k], task.maxIndex);
             }
             else
             {
-                uint16_t* ib = (uint16_t*)primitive.indices->dataPtr;
-                for (uint32_t k = 0; k < indexCount; ++k)
-                    maxIndex = std::max<uint32_t>(ib[k], maxIndex);
+                const uint16_t* ib = (const uint16_t*)primitive.indices->dataPtr;
+                for (uint32_t k = 0; k < task.indexCount; ++k)
+                    task.maxIndex = std::max<uint32_t>(ib[k], task.maxIndex);
             }
-            b32BitIndices = maxIndex > 0xFFFF;
-            uint32_t perIndexSize = b32BitIndices ? 4 : 2;
+            task.b32BitIndices = task.maxIndex > 0xFFFF;
+        }
+        else
+        {
+            WARN_IF(primitive.mode == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, "Impossible primitive topology when lacking indices");
+
+            task.indexCount = task.vertexCount * 3;
+            task.maxIndex = task.indexCount - 1;
+            task.b32BitIndices = task.indexCount > 0xFFFF;
+        }
+
+        const bool HasTangents = primitive.attributes[glTF::Primitive::kTangent] != nullptr;
+        const uint32_t normalUV = primitive.material->normalUV;
+        task.hasTangent = HasTangents || primitive.attributes[glTF::Primitive::kTexcoord0 + normalUV] != nullptr;
 
-            // Index Optimize
+        std::vector<D3D12_INPUT_ELEMENT_DESC> outputElements;
+        std::vector<D3D12_INPUT_ELEMENT_DESC> depthElements;
+        uint16_t psoFlags = BuildOutputLayouts(primitive, task.meshPsoFlags, task.hasTangent, outputElements, depthElements);
+
+        uint32_t offsets[D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT];
+        uint32_t strides[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+        ComputeInputLayout({ outputElements.data(), (uint32_t)outputElements.size() }, offsets, strides);
+        uint32_t stride = strides[0];
+        ComputeInputLayout({ depthElements.data(), (uint32_t)depthElements.size() }, offsets, strides);
+        uint32_t depthStride = strides[0];
+
+        ASSERT(primitive.material->index < 0x8000, "Only 15-bit material indices allowed");
+        ASSERT(stride <= 0xFF && depthStride <= 0xFF);
+        task.vertexStride = (uint8_t)stride;
+        task.depthVertexStride = (uint8_t)depthStride;
+
+        SubMesh& subMesh = *task.subMesh;
+        subMesh.psoFlags = psoFlags;
+        subMesh.index32 = task.b32BitIndices;
+        subMesh.materialIdx = primitive.material->index;
+        subMesh.indexCount = task.indexCount;
+        subMesh.uniqueMaterialIdx = -1;
+    }
+
+    // Prefix sum over the primitives, every later stage writes straight into the packed buffers
+    static void PackMesh(Mesh& mesh, MeshBuffers& buffers, PrimitiveBuildTask* tasks, size_t taskCount)
+    {
+        MeshBuildStageTimer timer(MeshBuildStats::kPack);
+
+        uint32_t startIndex = 0;
+        uint32_t baseVertex = 0;
+        uint32_t totalIndexSize = 0;
+        uint32_t totalVertexSize = 0;
+        uint32_t totaldepthVertexSize = 0;
+        mesh.vertexStride = 0;
+        mesh.depthVertexStride = 0;
+
+        for (size_t pi = 0; pi < taskCount; pi++)
+        {
+            const PrimitiveBuildTask& task = tasks[pi];
+            ASSERT(mesh.vertexStride == 0 || mesh.vertexStride == task.vertexStride);
+            ASSERT(mesh.depthVertexStride == 0 || mesh.depthVertexStride == task.depthVertexStride);
+            mesh.vertexStride = task.vertexStride;
+            mesh.depthVertexStride = task.depthVertexStride;
+
+            SubMesh& submesh = *task.subMesh;
+            submesh.baseVertex = baseVertex;
+            submesh.startIndex = startIndex;
+            baseVertex += task.vertexCount;
+            startIndex += task.indexCount;
+            totalIndexSize += task.indexCount * (task.b32BitIndices ? 4 : 2);
+            totalVertexSize += task.vertexCount * task.vertexStride;
+            totaldepthVertexSize += task.vertexCount * task.depthVertexStride;
+        }
+
+        mesh.sizeVB = totalVertexSize;
+        mesh.sizeDepthVB = totaldepthVertexSize;
+        mesh.sizeIB = totalIndexSize;
+        buffers.VB = std::make_unique<byte[]>(totalVertexSize);
+        buffers.DepthVB = std::make_unique<byte[]>(totaldepthVertexSize);
+        buffers.IB = std::make_unique<byte[]>(totalIndexSize);
+        mesh.VB = buffers.VB.get();
+        mesh.DepthVB = buffers.DepthVB.get();
+        mesh.IB = buffers.IB.get();
+
+        uint32_t vertexBufferOffset = 0;
+        uint32_t indexBufferOffset = 0;
+        uint32_t depthVertexBufferOffset = 0;
+        for (size_t pi = 0; pi < taskCount; pi++)
+        {
+            PrimitiveBuildTask& task = tasks[pi];
+            task.VB = buffers.VB.get() + vertexBufferOffset;
+            task.depthVB = buffers.DepthVB.get() + depthVertexBufferOffset;
+            task.IB = buffers.IB.get() + indexBufferOffset;
+            vertexBufferOffset += task.vertexCount * task.vertexStride;
+            depthVertexBufferOffset += task.vertexCount * task.depthVertexStride;
+            indexBufferOffset += task.indexCount * (task.b32BitIndices ? 4 : 2);
+        }
+    }
+
+    // Stage 1
+    static void OptimizeIndices(PrimitiveBuildTask& task)
+    {
+        ZoneScoped;
+        MeshBuildStageTimer timer(MeshBuildStats::kIndexOptimize);
+
+        const glTF::Primitive& primitive = *task.primitive;
+        const uint32_t indexCount = task.indexCount;
+        if (primitive.indices != nullptr)
+        {
             uint32_t nFaces = indexCount / 3;
-            geoData.indexBufferSize = perIndexSize * indexCount;
-            newIndices = std::make_unique<byte[]>(geoData.indexBufferSize);
             std::unique_ptr<byte[]> faceRemap = std::make_unique<byte[]>(nFaces * sizeof(uint32_t));
-            if (b32BitIndices) // must be 32Bit
+            if (task.b32BitIndices) // must be 32Bit
             {
-                CheckHR(OptimizeFacesLRU((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), 64));
-                CheckHR(ReorderIB((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), (uint32_t*)newIndices.get()));
+                CheckHR(OptimizeFacesLRU((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), kVertexCacheSize));
+                CheckHR(ReorderIB((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), (uint32_t*)task.IB));
             }
             else if (primitive.indices->componentType == glTF::Accessor::kUnsignedShort)
             {
-                CheckHR(OptimizeFacesLRU((uint16_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), 64));
-                CheckHR(ReorderIB((uint16_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), (uint16_t*)newIndices.get()));
+                CheckHR(OptimizeFacesLRU((uint16_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), kVertexCacheSize));
+                CheckHR(ReorderIB((uint16_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), (uint16_t*)task.IB));
             }
             else
             {
-                CheckHR(OptimizeFacesLRU((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), 64));
-                CheckHR(ReorderIB((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), (uint16_t*)newIndices.get()));
+                CheckHR(OptimizeFacesLRU((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), kVertexCacheSize));
+                CheckHR(ReorderIB((uint32_t*)primitive.indices->dataPtr, nFaces, (uint32_t*)faceRemap.get(), (uint16_t*)task.IB));
             }
         }
+        else if (task.b32BitIndices)
+        {
+            uint32_t* tmp = (uint32_t*)task.IB;
+            for (uint32_t i = 0; i < indexCount; ++i)
+                tmp[i] = i;
+        }
         else
         {
-            WARN_IF(primitive.mode == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, "Impossible primitive topology when lacking indices");
-
-            indexCount = vertexCount * 3;
-            maxIndex = indexCount - 1;
-            if (indexCount > 0xFFFF)
-            {
-                b32BitIndices = true;
-                geoData.indexBufferSize = 4 * indexCount;
-                newIndices = std::make_unique<byte[]>(geoData.indexBufferSize);
-                uint32_t* tmp = (uint32_t*)newIndices.get();
-                for (uint32_t i = 0; i < indexCount; ++i)
-                    tmp[i] = i;
-            }
-            else
-            {
-                b32BitIndices = false;
-                geoData.indexBufferSize = 2 * indexCount;
-                newIndices = std::make_unique<byte[]>(geoData.indexBufferSize);
-                uint16_t* tmp = (uint16_t*)newIndices.get();
-                for (uint16_t i = 0; i < indexCount; ++i)
-                    tmp[i] = i;
-            }
+            uint16_t* tmp = (uint16_t*)task.IB;
+            for (uint16_t i = 0; i < indexCount; ++i)
+                tmp[i] = i;
         }
-        ASSERT(maxIndex > 0 && newIndices);
-        geoData.IB.swap(newIndices);
+        ASSERT(task.maxIndex > 0);
+    }
 
+    // Stage 2: read the source streams, local bounds and normals
+    static void ReadVertices(PrimitiveBuildTask& task)
+    {
+        ZoneScoped;
+        MeshBuildStageTimer timer(MeshBuildStats::kNormals);
+
+        const glTF::Primitive& primitive = *task.primitive;
+        SubMesh& subMesh = *task.subMesh;
+        const uint32_t vertexCount = task.vertexCount;
+        const uint32_t indexCount = task.indexCount;
 
-        // process vertex
         const bool HasNormals = primitive.attributes[glTF::Primitive::kNormal] != nullptr;
         const bool HasTangents = primitive.attributes[glTF::Primitive::kTangent] != nullptr;
         const bool HasUV0 = primitive.attributes[glTF::Primitive::kTexcoord0] != nullptr;
         const bool HasUV1 = primitive.attributes[glTF::Primitive::kTexcoord1] != nullptr;
-        //const bool HasUV2 = primitive.attributes[glTF::Primitive::kTexcoord2] != nullptr;
-        //const bool HasUV3 = primitive.attributes[glTF::Primitive::kTexcoord3] != nullptr;
 
         std::vector<D3D12_INPUT_ELEMENT_DESC> InputElements;
         InputElements.push_back({ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, glTF::Primitive::kPosition });
@@ -320,18 +538,6 @@ namespace ModelConverter
                 AccessorFormat(*primitive.attributes[glTF::Primitive::kTexcoord1]),
                 glTF::Primitive::kTexcoord1 });
         }
-        //if (HasUV2)
-        //{
-        //    InputElements.push_back({ "TEXCOORD", 2,
-        //       AccessorFormat(*primitive.attributes[glTF::Primitive::kTexcoord2]),
-        //       glTF::Primitive::kTexcoord2 });
-        //}
-        //if (HasUV3)
-        //{
-        //    InputElements.push_back({ "TEXCOORD", 3,
-        //       AccessorFormat(*primitive.attributes[glTF::Primitive::kTexcoord3]),
-        //       glTF::Primitive::kTexcoord3 });
-        //}
 
         VBReader vbr;
         vbr.Initialize({ InputElements.data(), (uint32_t)InputElements.size() });
@@ -343,12 +549,10 @@ namespace ModelConverter
                 vbr.AddStream(attrib->dataPtr, vertexCount, i, attrib->stride);
         }
 
-        std::unique_ptr<XMFLOAT3[]> position = std::make_unique<XMFLOAT3[]>(vertexCount);
-        std::unique_ptr<XMFLOAT3[]> normal = std::make_unique<XMFLOAT3[]>(vertexCount);
-        std::unique_ptr<XMFLOAT4[]> tangent;
-        std::unique_ptr<XMFLOAT2[]> texcoords[4];
+        task.position = std::make_unique<XMFLOAT3[]>(vertexCount);
+        task.normal = std::make_unique<XMFLOAT3[]>(vertexCount);
 
-        CheckHR(vbr.Read(position.get(), "POSITION", 0, vertexCount));
+        CheckHR(vbr.Read(task.position.get(), "POSITION", 0, vertexCount));
         {
             using namespace Math;
             // Local space bounds
@@ -356,9 +560,9 @@ namespace ModelConverter
             Scalar maxRadiusLSSq(kZero);
             AxisAlignedBox aabbLS(kZero);
 
-            for (uint32_t v = 0; v < vertexCount/*maxIndex*/; ++v)
+            for (uint32_t v = 0; v < vertexCount; ++v)
             {
-                Vector3 positionLS = Vector3(position[v]);
+                Vector3 positionLS = Vector3(task.position[v]);
 
                 aabbLS.AddPoint(positionLS);
 
@@ -373,244 +577,115 @@ namespace ModelConverter
 
         if (HasNormals)
         {
-            CheckHR(vbr.Read(normal.get(), "NORMAL", 0, vertexCount));
+            CheckHR(vbr.Read(task.normal.get(), "NORMAL", 0, vertexCount));
         }
         else
         {
             const size_t faceCount = indexCount / 3;
 
-            if (b32BitIndices)
-                ComputeNormals((const uint32_t*)geoData.IB.get(), faceCount, position.get(), vertexCount, CNORM_DEFAULT, normal.get());
+            if (task.b32BitIndices)
+                ComputeNormals((const uint32_t*)task.IB, faceCount, task.position.get(), vertexCount, CNORM_DEFAULT, task.normal.get());
             else
-                ComputeNormals((const uint16_t*)geoData.IB.get(), faceCount, position.get(), vertexCount, CNORM_DEFAULT, normal.get());
+                ComputeNormals((const uint16_t*)task.IB, faceCount, task.position.get(), vertexCount, CNORM_DEFAULT, task.normal.get());
         }
 
         if (HasUV0)
         {
-            texcoords[0].reset(new XMFLOAT2[vertexCount]);
-            CheckHR(vbr.Read(texcoords[0].get(), "TEXCOORD", 0, vertexCount));
+            task.texcoords[0].reset(new XMFLOAT2[vertexCount]);
+            CheckHR(vbr.Read(task.texcoords[0].get(), "TEXCOORD", 0, vertexCount));
         }
         if (HasUV1)
         {
-            texcoords[1].reset(new XMFLOAT2[vertexCount]);
-            CheckHR(vbr.Read(texcoords[1].get(), "TEXCOORD", 1, vertexCount));
+            task.texcoords[1].reset(new XMFLOAT2[vertexCount]);
+            CheckHR(vbr.Read(task.texcoords[1].get(), "TEXCOORD", 1, vertexCount));
         }
-        //if (HasUV2)
-        //{
-        //    texcoords[2].reset(new XMFLOAT2[vertexCount]);
-        //    CheckHR(vbr.Read(texcoords[2].get(), "TEXCOORD", 2, vertexCount));
-        //}
-        //if (HasUV3)
-        //{
-        //    texcoords[3].reset(new XMFLOAT2[vertexCount]);
-        //    CheckHR(vbr.Read(texcoords[3].get(), "TEXCOORD", 3, vertexCount));
-        //}
 
         if (HasTangents)
         {
-            tangent.reset(new XMFLOAT4[vertexCount]);
-            CheckHR(vbr.Read(tangent.get(), "TANGENT", 0, vertexCount));
+            task.tangent.reset(new XMFLOAT4[vertexCount]);
+            CheckHR(vbr.Read(task.tangent.get(), "TANGENT", 0, vertexCount));
         }
-        else
-        {
-            ASSERT(maxIndex < vertexCount);
-            ASSERT(indexCount % 3 == 0);
-            if (texcoords[primitive.material->normalUV])
-            {
-                tangent.reset(new XMFLOAT4[vertexCount]);
+    }
 
-                if (b32BitIndices)
-                {
-                    CheckHR(ComputeTangentFrame((uint32_t*)geoData.IB.get(), indexCount / 3, position.get(), normal.get(), 
-                        texcoords[primitive.material->normalUV].get(), vertexCount, tangent.get()));
-                }
-                else
-                {
-                    CheckHR(ComputeTangentFrame((uint16_t*)geoData.IB.get(), indexCount / 3, position.get(), normal.get(),
-                        texcoords[primitive.material->normalUV].get(), vertexCount, tangent.get()));
-                }
-            }
-        }
+    // Stage 3
+    static void ComputeTangents(PrimitiveBuildTask& task)
+    {
+        if (!task.hasTangent || task.tangent)
+            return;
 
-        // Use VBWriter to generate a new, interleaved and compressed vertex buffer
-        std::vector<D3D12_INPUT_ELEMENT_DESC> outputElements;
+        ZoneScoped;
+        MeshBuildStageTimer timer(MeshBuildStats::kTangents);
 
-        subMesh.psoFlags = ePSOFlags::kHasPosition | ePSOFlags::kHasNormal;
-        outputElements.push_back({ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        outputElements.push_back({ "NORMAL", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        if (tangent.get())
+        const glTF::Primitive& primitive = *task.primitive;
+        const uint32_t vertexCount = task.vertexCount;
+        const uint32_t indexCount = task.indexCount;
+        ASSERT(task.maxIndex < vertexCount);
+        ASSERT(indexCount % 3 == 0);
+        ASSERT(task.texcoords[primitive.material->normalUV]);
+
+        task.tangent.reset(new XMFLOAT4[vertexCount]);
+        if (task.b32BitIndices)
         {
-            outputElements.push_back({ "TANGENT", 0, DXGI_FORMAT_R10G10B10A2_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-            subMesh.psoFlags |= ePSOFlags::kHasTangent;
+            CheckHR(ComputeTangentFrame((uint32_t*)task.IB, indexCount / 3, task.position.get(), task.normal.get(),
+                task.texcoords[primitive.material->normalUV].get(), vertexCount, task.tangent.get()));
         }
-        if (texcoords[0].get() || meshPsoFlags & ePSOFlags::kHasUV0)
+        else
         {
-            outputElements.push_back({ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-            subMesh.psoFlags |= ePSOFlags::kHasUV0;
+            CheckHR(ComputeTangentFrame((uint16_t*)task.IB, indexCount / 3, task.position.get(), task.normal.get(),
+                task.texcoords[primitive.material->normalUV].get(), vertexCount, task.tangent.get()));
         }
-        if (texcoords[1].get() || meshPsoFlags & ePSOFlags::kHasUV1)
-        {
-            outputElements.push_back({ "TEXCOORD", 1, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-            subMesh.psoFlags |= ePSOFlags::kHasUV1;
-        }
-        //if (texcoords[2].get())
-        //{
-        //    outputElements.push_back({ "TEXCOORD", 2, DXGI_FORMAT_R8G8_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        //    subMesh.psoFlags |= ePSOFlags::kHasUV2;
-        //}
-        //if (texcoords[3].get())
-        //{
-        //    outputElements.push_back({ "TEXCOORD", 3, DXGI_FORMAT_R8G8_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        //    subMesh.psoFlags |= ePSOFlags::kHasUV3;
-        //}
-        if (primitive.material->alphaBlend)
-            subMesh.psoFlags |= ePSOFlags::kAlphaBlend;
-        if (primitive.material->alphaTest)
-            subMesh.psoFlags |= ePSOFlags::kAlphaTest;
-        if (primitive.material->twoSided)
-            subMesh.psoFlags |= ePSOFlags::kTwoSided;
+    }
 
-        D3D12_INPUT_LAYOUT_DESC layout = { outputElements.data(), (uint32_t)outputElements.size() };
+    // Stage 4: encode into the packed VB and DepthVB
+    static void WriteVertices(PrimitiveBuildTask& task)
+    {
+        ZoneScoped;
+        MeshBuildStageTimer timer(MeshBuildStats::kVertexWrite);
 
-        VBWriter vbw;
-        vbw.Initialize(layout);
+        const glTF::Primitive& primitive = *task.primitive;
+        const uint32_t vertexCount = task.vertexCount;
 
-        uint32_t offsets[D3D12_IA_VERTEX_INPUT_STRUCTURE_ELEMENT_COUNT];
-        uint32_t strides[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
-        ComputeInputLayout(layout, offsets, strides);
-        uint32_t stride = strides[0];
-
-        geoData.vertexBufferSize = stride * vertexCount;
-        geoData.VB = std::make_unique<byte[]>(geoData.vertexBufferSize);
-        CheckHR(vbw.AddStream(geoData.VB.get(), vertexCount, 0, stride));
-
-        vbw.Write(position.get(), "POSITION", 0, vertexCount);
-        vbw.Write(normal.get(), "NORMAL", 0, vertexCount, true);
-        if (tangent.get())
-            CheckHR(vbw.Write(tangent.get(), "TANGENT", 0, vertexCount, true));
-        if (texcoords[0].get())
-            CheckHR(vbw.Write(texcoords[0].get(), "TEXCOORD", 0, vertexCount));
-        if (texcoords[1].get())
-            CheckHR(vbw.Write(texcoords[1].get(), "TEXCOORD", 1, vertexCount));
-        //if (texcoords[2].get())
-        //    CheckHR(vbw.Write(texcoords[2].get(), "TEXCOORD", 2, vertexCount));
-        //if (texcoords[3].get())
-        //    CheckHR(vbw.Write(texcoords[3].get(), "TEXCOORD", 3, vertexCount));
-
-        // Now write a VB for positions only (or positions and UV when alpha testing)
+        std::vector<D3D12_INPUT_ELEMENT_DESC> outputElements;
         std::vector<D3D12_INPUT_ELEMENT_DESC> depthElements;
-        depthElements.push_back({ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        if (primitive.material->alphaTest || meshPsoFlags & ePSOFlags::kAlphaTest)
-        {
-            depthElements.push_back({ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, D3D12_APPEND_ALIGNED_ELEMENT });
-        }
-        D3D12_INPUT_LAYOUT_DESC depthLayout = { depthElements.data(), (uint32_t)depthElements.size() };
+        BuildOutputLayouts(primitive, task.meshPsoFlags, task.hasTangent, outputElements, depthElements);
 
-        VBWriter dvbw;
-        dvbw.Initialize(depthLayout);
-        ComputeInputLayout(depthLayout, offsets, strides);
-        uint32_t depthStride = strides[0];
+        VBWriter vbw;
+        vbw.Initialize({ outputElements.data(), (uint32_t)outputElements.size() });
+        CheckHR(vbw.AddStream(task.VB, vertexCount, 0, task.vertexStride));
+
+        vbw.Write(task.position.get(), "POSITION", 0, vertexCount);
+        vbw.Write(task.normal.get(), "NORMAL", 0, vertexCount, true);
+        if (task.tangent.get())
+            CheckHR(vbw.Write(task.tangent.get(), "TANGENT", 0, vertexCount, true));
+        if (task.texcoords[0].get())
+            CheckHR(vbw.Write(task.texcoords[0].get(), "TEXCOORD", 0, vertexCount));
+        if (task.texcoords[1].get())
+            CheckHR(vbw.Write(task.texcoords[1].get(), "TEXCOORD", 1, vertexCount));
 
-        geoData.depthVertexBufferSize = depthStride * vertexCount;
-        geoData.depthVB = std::make_unique<byte[]>(geoData.depthVertexBufferSize);
-        CheckHR(dvbw.AddStream(geoData.depthVB.get(), vertexCount, 0, depthStride));
+        VBWriter dvbw;
+        dvbw.Initialize({ depthElements.data(), (uint32_t)depthElements.size() });
+        CheckHR(dvbw.AddStream(task.depthVB, vertexCount, 0, task.depthVertexStride));
 
-        dvbw.Write(position.get(), "POSITION", 0, vertexCount);
-        if (primitive.material->alphaTest && texcoords[0])
+        dvbw.Write(task.position.get(), "POSITION", 0, vertexCount);
+        if (primitive.material->alphaTest && task.texcoords[0])
         {
-            dvbw.Write(texcoords[0].get(), "TEXCOORD", 0, vertexCount);
+            dvbw.Write(task.texcoords[0].get(), "TEXCOORD", 0, vertexCount);
         }
 
-        ASSERT(primitive.material->index < 0x8000, "Only 15-bit material indices allowed");
-        ASSERT(stride <= 0xFF && depthStride <= 0xFF);
-        geoData.vertexStride = (uint8_t)stride;
-        geoData.depthVertexStride = (uint8_t)depthStride;
-        subMesh.index32 = b32BitIndices;
-        subMesh.materialIdx = primitive.material->index;
-        subMesh.indexCount = indexCount;
-        subMesh.uniqueMaterialIdx = -1;
-
-        return geoData;
+        task.position.reset();
+        task.normal.reset();
+        task.tangent.reset();
+        for (auto& texcoord : task.texcoords)
+            texcoord.reset();
     }
 
-    Mesh BuildMesh(const glTF::Mesh& gltfMesh)
+    static void InitMeshBuildTasks(Mesh& mesh, MeshBuffers& buffers, const glTF::Mesh& gltfMesh, PrimitiveBuildTask* tasks)
     {
-        Mesh mesh;
-        mesh.subMeshes = std::make_unique<SubMesh[]>(gltfMesh.primitives.size());
+        buffers.subMeshes = std::make_unique<SubMesh[]>(gltfMesh.primitives.size());
+        mesh.subMeshes = buffers.subMeshes.get();
         ASSERT(gltfMesh.primitives.size() < 65536);
         mesh.subMeshCount = (uint16_t)gltfMesh.primitives.size();
 
-        /*
-        //std::vector<std::future<GeometryData>> futureGeoData;
-        //std::vector<GeometryData> futureGeoData1;
-        //for (size_t pi = 0; pi < gltfMesh.primitives.size(); pi++)
-        //{
-        //    futureGeoData.emplace_back(Utility::gThreadPoolExecutor.Submit(
-        //        &BuildSubMesh, std::cref(gltfMesh.primitives[pi]), std::ref(mesh.subMeshes[pi])));
-        //}
-        //futureGeoData1.resize(futureGeoData.size());
-
-        //// calc all submesh size
-        //uint32_t startIndex = 0;
-        //uint32_t baseVertex = 0;
-        //uint32_t totalIndexSize = 0;
-        //uint32_t totalVertexSize = 0;
-        //uint32_t totaldepthVertexSize = 0;
-
-        //Math::AxisAlignedBox boundingBox;
-        //Math::BoundingSphere boundingSphere;
-        //for (size_t fi = 0; fi < futureGeoData.size(); fi++)
-        //{
-        //    const GeometryData& geoData = futureGeoData1.emplace_back(futureGeoData[fi].get());
-        //    SubMesh& submesh = mesh.subMeshes[fi];
-        //    submesh.baseVertex = baseVertex;
-        //    submesh.startIndex = startIndex;
-        //    baseVertex += geoData.vertexCount;
-        //    startIndex += submesh.indexCount;
-        //    totalIndexSize += geoData.indexBufferSize;
-        //    totalVertexSize += geoData.vertexBufferSize;
-        //    totaldepthVertexSize += geoData.depthVertexBufferSize;
-
-        //    Math::AxisAlignedBox aabbSub(submesh.minPos, submesh.maxPos);
-        //    Math::BoundingSphere shSub((const XMFLOAT4*)submesh.bounds);
-        //    boundingBox.AddBoundingBox(aabbSub);
-        //    boundingSphere.Union(shSub);
-        //}
-        //DirectX::XMStoreFloat4((XMFLOAT4*)mesh.bounds, (Vector4)boundingSphere);
-        //DirectX::XMStoreFloat3(&mesh.minPos, (Vector4)boundingBox.GetMin());
-        //DirectX::XMStoreFloat3(&mesh.maxPos, (Vector4)boundingBox.GetMax());
-
-        // copy all buffers to a single buffer
-        //mesh.sizeVB = totalVertexSize;
-        //mesh.sizeDepthVB = totaldepthVertexSize;
-        //mesh.sizeIB = totalIndexSize;
-        //mesh.VB = std::make_unique<byte[]>(totalVertexSize);
-        //mesh.DepthVB = std::make_unique<byte[]>(totaldepthVertexSize);
-        //mesh.IB = std::make_unique<byte[]>(totalIndexSize);
-        //uint32_t vertexBufferOffset = 0;
-        //uint32_t indexBufferOffset = 0;
-        //uint32_t depthVertexBufferOffset = 0;
-        //for (size_t fi = 0; fi < futureGeoData.size(); fi++)
-        //{
-        //    const GeometryData& geoData = futureGeoData1[fi];
-        //    CopyMemory(mesh.VB.get() + vertexBufferOffset, geoData.VB.get(), geoData.vertexBufferSize);
-        //    CopyMemory(mesh.DepthVB.get() + depthVertexBufferOffset, geoData.depthVB.get(), geoData.depthVertexBufferSize);
-        //    CopyMemory(mesh.IB.get() + indexBufferOffset, geoData.IB.get(), geoData.indexBufferSize);
-        //    vertexBufferOffset += geoData.vertexBufferSize;
-        //    depthVertexBufferOffset += geoData.depthVertexBufferSize;
-        //    indexBufferOffset += geoData.indexBufferSize;
-        //}
-        */
-
-        uint32_t startIndex = 0;
-        uint32_t baseVertex = 0;
-        uint32_t totalIndexSize = 0;
-        uint32_t totalVertexSize = 0;
-        uint32_t totaldepthVertexSize = 0;
-        Math::AxisAlignedBox boundingBox(kZero);
-        Math::BoundingSphere boundingSphere(kZero);
-        std::vector<GeometryData> allGeoData;
-
         // preprocess mesh flags, each mesh has same vertex layout
         uint32_t meshflags = (ePSOFlags::kHasNormal | ePSOFlags::kHasPosition);
         for (size_t pi = 0; pi < gltfMesh.primitives.size(); pi++)
@@ -625,24 +700,19 @@ namespace ModelConverter
 
         for (size_t pi = 0; pi < gltfMesh.primitives.size(); pi++)
         {
-            GeometryData& geoData = allGeoData.emplace_back(BuildSubMesh(
-                gltfMesh.primitives[pi], mesh.subMeshes[pi], (ePSOFlags) meshflags));
-
-            //Utility::PrintMessage("%d %d", mesh.depthVertexStride, geoData.depthVertexStride);
-            ASSERT(mesh.vertexStride == 0 || mesh.vertexStride == geoData.vertexStride);
-            ASSERT(mesh.depthVertexStride == 0 || mesh.depthVertexStride == geoData.depthVertexStride);
-            mesh.vertexStride = geoData.vertexStride;
-            mesh.depthVertexStride = geoData.depthVertexStride;
-
-            SubMesh& submesh = mesh.subMeshes[pi];
-            submesh.baseVertex = baseVertex;
-            submesh.startIndex = startIndex;
-            baseVertex += geoData.vertexCount;
-            startIndex += submesh.indexCount;
-            totalIndexSize += geoData.indexBufferSize;
-            totalVertexSize += geoData.vertexBufferSize;
-            totaldepthVertexSize += geoData.depthVertexBufferSize;
+            tasks[pi].primitive = &gltfMesh.primitives[pi];
+            tasks[pi].subMesh = &buffers.subMeshes[pi];
+            tasks[pi].meshPsoFlags = (ePSOFlags)meshflags;
+        }
+    }
 
+    static void ComputeMeshBounds(Mesh& mesh)
+    {
+        Math::AxisAlignedBox boundingBox(kZero);
+        Math::BoundingSphere boundingSphere(kZero);
+        for (uint32_t si = 0; si < mesh.subMeshCount; si++)
+        {
+            const SubMesh& submesh = mesh.subMeshes[si];
             Math::AxisAlignedBox aabbSub(submesh.minPos, submesh.maxPos);
             Math::BoundingSphere shSub((const XMFLOAT4*)submesh.bounds);
             boundingBox.AddBoundingBox(aabbSub);
@@ -651,46 +721,229 @@ namespace ModelConverter
         DirectX::XMStoreFloat4((XMFLOAT4*)mesh.bounds, (Vector4)boundingSphere);
         DirectX::XMStoreFloat3(&mesh.minPos, (Vector4)boundingBox.GetMin());
         DirectX::XMStoreFloat3(&mesh.maxPos, (Vector4)boundingBox.GetMax());
+    }
 
-        // copy all buffers to a single buffer
-        mesh.sizeVB = totalVertexSize;
-        mesh.sizeDepthVB = totaldepthVertexSize;
-        mesh.sizeIB = totalIndexSize;
-        mesh.VB = std::make_unique<byte[]>(totalVertexSize);
-        mesh.DepthVB = std::make_unique<byte[]>(totaldepthVertexSize);
-        mesh.IB = std::make_unique<byte[]>(totalIndexSize);
-        uint32_t vertexBufferOffset = 0;
-        uint32_t indexBufferOffset = 0;
-        uint32_t depthVertexBufferOffset = 0;
-        for (size_t fi = 0; fi < allGeoData.size(); fi++)
+    static void BuildMeshes(const glTF::Asset& asset, std::vector<Mesh>& meshes)
+    {
+        ZoneScoped;
+        int64_t startTick = SystemTime::GetCurrentTick();
+        for (auto& ticks : sMeshBuildStageTicks)
+            ticks.store(0);
+
+        // flatten every primitive of every mesh so one big mesh doesn't serialize the load
+        const size_t numMeshes = asset.m_meshes.size();
+        meshes.clear();
+        meshes.resize(numMeshes);
+        std::vector<size_t> firstTask(numMeshes + 1, 0);
+        for (size_t i = 0; i < numMeshes; i++)
+            firstTask[i + 1] = firstTask[i] + asset.m_meshes[i].primitives.size();
+
+        std::vector<PrimitiveBuildTask> tasks(firstTask[numMeshes]);
+        std::vector<std::shared_ptr<MeshBuffers>> buffers(numMeshes);
+        for (size_t i = 0; i < numMeshes; i++)
         {
-            const GeometryData& geoData = allGeoData[fi];
-            CopyMemory(mesh.VB.get() + vertexBufferOffset, geoData.VB.get(), geoData.vertexBufferSize);
-            CopyMemory(mesh.DepthVB.get() + depthVertexBufferOffset, geoData.depthVB.get(), geoData.depthVertexBufferSize);
-            CopyMemory(mesh.IB.get() + indexBufferOffset, geoData.IB.get(), geoData.indexBufferSize);
-            vertexBufferOffset += geoData.vertexBufferSize;
-            depthVertexBufferOffset += geoData.depthVertexBufferSize;
-            indexBufferOffset += geoData.indexBufferSize;
+            buffers[i] = std::make_shared<MeshBuffers>();
+            meshes[i].storage = buffers[i];
+            InitMeshBuildTasks(meshes[i], *buffers[i], asset.m_meshes[i], tasks.data() + firstTask[i]);
         }
 
-        return mesh;
+        ThreadPoolExecutor& executor = Utility::gThreadPoolExecutor;
+        executor.ParallelFor(0, tasks.size(), 1, [&tasks](size_t i) { AnalyzePrimitive(tasks[i]); });
+
+        executor.ParallelFor(0, numMeshes, 1, [&](size_t i) 
+        {
+            PackMesh(meshes[i], *buffers[i], tasks.data() + firstTask[i], firstTask[i + 1] - firstTask[i]);
+        });
+
+        executor.ParallelFor(0, tasks.size(), 1, [&tasks](size_t i)
+        {
+            PrimitiveBuildTask& task = tasks[i];
+            OptimizeIndices(task);
+            ReadVertices(task);
+            ComputeTangents(task);
+            WriteVertices(task);
+        });
+
+        for (size_t i = 0; i < numMeshes; i++)
+            ComputeMeshBounds(meshes[i]);
+
+        for (size_t i = 0; i < MeshBuildStats::kNumStages; i++)
+            sMeshBuildStats.stageMs[i] = SystemTime::TicksToMillisecs(sMeshBuildStageTicks[i].load());
+        sMeshBuildStats.wallMs = SystemTime::TicksToMillisecs(SystemTime::GetCurrentTick() - startTick);
+        sMeshBuildStats.numMeshes = (uint32_t)numMeshes;
+        sMeshBuildStats.numPrimitives = (uint32_t)tasks.size();
+
+        Utility::PrintMessage("BuildAllMeshes: %u meshes, %u primitives, %.2f ms (analyze %.2f, index %.2f, normals %.2f, tangents %.2f, write %.2f, pack %.2f)",
+            sMeshBuildStats.numMeshes, sMeshBuildStats.numPrimitives, sMeshBuildStats.wallMs,
+            sMeshBuildStats.stageMs[MeshBuildStats::kAnalyze], sMeshBuildStats.stageMs[MeshBuildStats::kIndexOptimize],
+            sMeshBuildStats.stageMs[MeshBuildStats::kNormals], sMeshBuildStats.stageMs[MeshBuildStats::kTangents],
+            sMeshBuildStats.stageMs[MeshBuildStats::kVertexWrite], sMeshBuildStats.stageMs[MeshBuildStats::kPack]);
+    }
+
+    static void CreateMeshes(std::vector<Mesh>& meshes)
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+            MeshManager::GetInstance()->AddMesh(std::move(meshes[i]));
+
+        MeshManager::GetInstance()->UpdateMeshes();
     }
 
     void BuildAllMeshes(const glTF::Asset& asset)
     {
-        std::vector<std::future<Mesh>> meshBuildTasks;
-        for (size_t i = 0; i < asset.m_meshes.size(); i++)
+        std::vector<Mesh> meshes;
+        BuildMeshes(asset, meshes);
+        CreateMeshes(meshes);
+    }
+
+    // Same traversal as Scene::WalkGraph, flattened into node records
+    static void GatherNodes(const std::vector<glTF::Node*>& siblings, uint32_t curIndex, std::vector<MeshCache::NodeRecord>& nodes)
+    {
+        using namespace Math;
+
+        size_t numSiblings = siblings.size();
+        for (size_t i = 0; i < numSiblings; ++i)
         {
-            const glTF::Mesh& gltfMesh = asset.m_meshes[i];
-            //Mesh& mesh = MeshManager::GetInstance()->AddUnInitializedMesh();
+            const glTF::Node* curNode = siblings[i];
+            MeshCache::NodeRecord& record = nodes[curNode->linearIdx];
+            record.isValid = true;
+            record.parentIndex = curIndex;
+            record.hasChildren = curNode->children.size() > 0;
+            record.hasSiblings = i + 1 < numSiblings;
+            record.meshIndex = (!curNode->pointsToCamera && curNode->mesh != nullptr) ? 
+                curNode->mesh->index : MeshCache::kInvalidIndex;
+
+            if (curNode->hasMatrix)
+            {
+                Matrix4 modelXForm = Matrix4(curNode->matrix);
+                const AffineTransform& affineTrans = (const AffineTransform&)modelXForm;
+                XMStoreFloat3((XMFLOAT3*)record.scale, affineTrans.GetScale());
+                XMStoreFloat3((XMFLOAT3*)record.position, affineTrans.GetTranslation());
+                XMStoreFloat4((XMFLOAT4*)record.rotation, affineTrans.GetRotation());
+            }
+            else
+            {
+                CopyMemory(record.position, curNode->translation, sizeof(record.position));
+                CopyMemory(record.scale, curNode->scale, sizeof(record.scale));
+                CopyMemory(record.rotation, curNode->rotation, sizeof(record.rotation));
+            }
 
-            meshBuildTasks.emplace_back(Utility::gThreadPoolExecutor.Submit(&BuildMesh, std::cref(gltfMesh)));
+            if (record.hasChildren)
+                GatherNodes(curNode->children, curNode->linearIdx, nodes);
         }
+    }
 
-        for (size_t i = 0; i < meshBuildTasks.size(); i++)
-            MeshManager::GetInstance()->AddMesh(std::move(meshBuildTasks[i].get()));
+    uint64_t GetConverterSettingsHash()
+    {
+        const uint32_t settings[] = { 
+            MeshCache::kVersion, 
+            kVertexCacheSize,
+            DXGI_FORMAT_R10G10B10A2_UNORM,
+            DXGI_FORMAT_R16G16_FLOAT,
+            (uint32_t)sizeof(SubMesh),
+            (uint32_t)sizeof(MeshCache::MeshRecord),
+            (uint32_t)sizeof(MeshCache::MaterialRecord),
+            (uint32_t)sizeof(MeshCache::NodeRecord) };
+        return Utility::HashState(settings, _countof(settings));
+    }
 
-        MeshManager::GetInstance()->UpdateMeshes();
+    bool ConvertAsset(const std::filesystem::path& sourcePath, MeshCache::BakedAsset& baked)
+    {
+        glTF::Asset asset(sourcePath);
+        if (asset.m_scene == nullptr)
+            return false;
+
+        baked.sources = asset.m_sourcePaths;
+        GatherMaterials(asset, baked.materials);
+        BuildMeshes(asset, baked.meshes);
+
+        MeshCache::NodeRecord emptyNode = {};
+        emptyNode.parentIndex = MeshCache::kInvalidIndex;
+        emptyNode.meshIndex = MeshCache::kInvalidIndex;
+        baked.nodes.assign(asset.m_nodes.size(), emptyNode);
+        GatherNodes(asset.m_scene->nodes, -1, baked.nodes);
+        return true;
+    }
+
+    bool BakeAsset(const std::filesystem::path& sourcePath, bool compress)
+    {
+        ZoneScoped;
+        MeshCache::BakedAsset baked;
+        if (!ConvertAsset(sourcePath, baked))
+            return false;
+
+        return MeshCache::Write(MeshCache::GetCachePath(sourcePath), baked, GetConverterSettingsHash(), compress);
+    }
+
+    // Materials drawn by nodes in view of the startup camera, or right around it, read their textures first. The
+    // ones beyond its far plane are only prefetched.
+    static void GetTexturePriorities(const MeshCache::BakedAsset& baked, const Math::Camera& camera,
+        std::vector<Utility::eIOPriority>& priorities)
+    {
+        using namespace Math;
+
+        priorities.assign(baked.materials.size(), Utility::kIOPriorityLow);
+
+        const Frustum& frustum = camera.GetWorldSpaceFrustum();
+        const Vector3 eye = camera.GetPosition();
+        const float nearDistance = camera.GetFarClip() * 0.1f;
+
+        std::vector<AffineTransform> worlds(baked.nodes.size(), AffineTransform(kIdentity));
+        for (size_t i = 0; i < baked.nodes.size(); ++i)
+        {
+            const MeshCache::NodeRecord& node = baked.nodes[i];
+            if (!node.isValid)
+                continue;
+
+            AffineTransform local(Matrix3(Quaternion(*(const XMFLOAT4*)node.rotation)) * 
+                Matrix3::MakeScale(Vector3(*(const XMFLOAT3*)node.scale)), Vector3(*(const XMFLOAT3*)node.position));
+            worlds[i] = node.parentIndex < i ? worlds[node.parentIndex] * local : local;
+
+            if (node.meshIndex >= baked.meshes.size())
+                continue;
+
+            const Mesh& mesh = baked.meshes[node.meshIndex];
+            const Vector3 center = worlds[i] * Vector3(mesh.bounds[0], mesh.bounds[1], mesh.bounds[2]);
+            const float radius = mesh.bounds[3] * (float)worlds[i].GetUniformScale();
+            const float distance = (float)Length(center - eye) - radius;
+
+            Utility::eIOPriority priority = Utility::kIOPriorityLow;
+            if (distance < nearDistance || frustum.IntersectSphere(BoundingSphere(center, Scalar(radius))))
+                priority = Utility::kIOPriorityHigh;
+            else if (distance < camera.GetFarClip())
+                priority = Utility::kIOPriorityNormal;
+
+            for (uint32_t j = 0; j < mesh.subMeshCount; ++j)
+            {
+                uint32_t materialIdx = mesh.subMeshes[j].materialIdx;
+                if (materialIdx < priorities.size())
+                    priorities[materialIdx] = std::min(priorities[materialIdx], priority);
+            }
+        }
+    }
+
+    bool LoadScene(Scene* scene, const std::filesystem::path& sourcePath)
+    {
+        ZoneScoped;
+        const std::filesystem::path cachePath = MeshCache::GetCachePath(sourcePath);
+        const uint64_t settingsHash = GetConverterSettingsHash();
+
+        MeshCache::BakedAsset baked;
+        if (!MeshCache::Read(cachePath, baked, settingsHash))
+        {
+            // miss, convert the source once and leave a cache for the next run
+            if (!ConvertAsset(sourcePath, baked))
+                return false;
+            MeshCache::Write(cachePath, baked, settingsHash);
+        }
+
+        std::vector<Utility::eIOPriority> texturePriorities;
+        scene->ResetCamera();
+        GetTexturePriorities(baked, scene->GetCamera(), texturePriorities);
+
+        CreateMaterials(baked.materials, texturePriorities.data());
+        CreateMeshes(baked.meshes);
+        scene->InitModels(baked.nodes.data(), baked.nodes.size());
+        return true;
     }
 
     void BuildScene(Scene* scene, const glTF::Asset& asset)
@@ -1,6 +1,7 @@
 #pragma once
 #include <filesystem>
 #include <string>
+#include <cstdint>
 
 namespace glTF
 {
@@ -9,16 +10,49 @@ namespace glTF
 
 class Scene;
 
+namespace MeshCache
+{
+	struct BakedAsset;
+}
+
 /*
 	Convert glTF Model To Renderer Model
 */
 namespace ModelConverter
 {
+	constexpr uint32_t kVertexCacheSize = 64; // OptimizeFacesLRU
+
+	struct MeshBuildStats
+	{
+		enum eStage { kAnalyze, kIndexOptimize, kNormals, kTangents, kVertexWrite, kPack, kNumStages };
+
+		double stageMs[kNumStages]; // summed over all worker threads
+		double wallMs;
+		uint32_t numMeshes;
+		uint32_t numPrimitives;
+	};
+
 	std::filesystem::path GetIBLTextureFilename(const std::wstring& name);
 
 	void BuildMaterials(const glTF::Asset& asset);
 
 	void BuildAllMeshes(const glTF::Asset& asset);
 
+	// timings of the last BuildAllMeshes
+	const MeshBuildStats& GetMeshBuildStats();
+
 	void BuildScene(Scene* scene, const glTF::Asset& asset);
+
+	// Hash of everything that shapes the converted data, a MeshCache baked with another one is stale
+	uint64_t GetConverterSettingsHash();
+
+	// Parse and convert a glTF file on the CPU, what a MeshCache miss costs
+	bool ConvertAsset(const std::filesystem::path& sourcePath, MeshCache::BakedAsset& baked);
+
+	// Convert a glTF file and write its MeshCache next to it, compressed when asked
+	bool BakeAsset(const std::filesystem::path& sourcePath, bool compress = false);
+
+	// Create materials, meshes and models from the MeshCache of sourcePath, 
+	// converting (and baking) the glTF file only when the cache is missing or stale
+	bool LoadScene(Scene* scene, const std::filesystem::path& sourcePath);
 };
@@ -6,26 +6,35 @@
 #include "Graphics.h"
 #include "Mesh.h"
 #include "glTF.h"
+#include "MeshCache.h"
 #include "PixelBuffer.h"
 #include "PipelineState.h"
 #include "SSAO.h"
 #include "Utils/ThreadPoolExecutor.h"
+#include "Utils/CommandLineArg.h"
+
+#include <algorithm>
 
 void Scene::Destroy()
 {
-    if (mShadowGpuHandle)
-        DEALLOC_DESCRIPTOR_GPU(mShadowGpuHandle, SWAP_CHAIN_BUFFER_COUNT);
+    if (mDeferredTextureGpuHandle)
+        DEALLOC_DESCRIPTOR_GPU(mDeferredTextureGpuHandle, 4 * SWAP_CHAIN_BUFFER_COUNT);
+}
 
-    if (mSceneTextureGpuHandle)
-        DEALLOC_DESCRIPTOR_GPU(mSceneTextureGpuHandle, 8);
+void Scene::ResetCamera()
+{
+    mSceneCamera.SetZRange(1.0f, 200.0f);
+    mSceneCamera.SetLookDirection(-Vector3(kZUnitVector), Vector3(kYUnitVector));
+    mSceneCamera.Update();
 }
 
 void Scene::Startup()
 {
     mSceneBS_WS = Math::BoundingSphere(kZero);
-    mSceneCamera.SetZRange(1.0f, 200.0f);
-    mSceneCamera.SetLookDirection(-Vector3(kZUnitVector), Vector3(kYUnitVector));
-    mModelDirtyFrameCount = SWAP_CHAIN_BUFFER_COUNT;
+    ResetCamera();
+    mModelUploadBytes = 0;
+    mAnimatedModelPercent = 0;
+    CommandLineArgs::GetInteger(L"animatemodels", mAnimatedModelPercent);
 
     mSunDirectionTheta = 0.0f;
     mSunDirectionPhi = 0.0f;
@@ -34,25 +43,35 @@ void Scene::Startup()
 
     mCameraController.reset(new FlyingFPSCamera(mSceneCamera, Vector3(kYUnitVector)));
 
-    if (mModelWorldTransform.size() != mModels.size())
-        mModelWorldTransform.resize(mModels.size());
+    uint32_t opaqueSortPolicy = MeshRenderer::kNumSortPolicies;
+    CommandLineArgs::GetInteger(L"opaquesort", opaqueSortPolicy);
+    uint32_t useIndirectDraw = 0;
+    CommandLineArgs::GetInteger(L"indirectdraw", useIndirectDraw);
+    mUseIndirectDraw = useIndirectDraw != 0;
+    for (uint32_t batch = 0; batch < MeshRenderer::kNumBachTypes; batch++)
+    {
+        for (uint32_t pass = 0; pass < MeshRenderer::kNumPasses; pass++)
+        {
+            mSortPolicies[batch][pass] = MeshRenderer::GetDefaultSortPolicy((MeshRenderer::BatchType)batch, (MeshRenderer::DrawPass)pass);
+            if (pass == MeshRenderer::kOpaque && opaqueSortPolicy < MeshRenderer::kNumSortPolicies)
+                mSortPolicies[batch][pass] = (MeshRenderer::SortPolicy)opaqueSortPolicy;
+        }
+    }
+
+    ASSERT(mTransforms.GetSize() == mModels.size());
     for (size_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; i++)
     {
         mMeshConstantsUploader[i].Create(L"Mesh Constants Buffer " + std::to_wstring(i),
-            sizeof(ModelConstants) * mModelWorldTransform.size());
+            sizeof(ModelTransform) * mModels.size());
     }
 }
 
-CommandList* Scene::RenderScene(CommandList* context, std::shared_ptr<MeshRendererBuilder> meshRendererBuilder)
+GlobalConstants Scene::MakeGlobalConstants() const
 {
-    GraphicsCommandList& ghContext = context->GetGraphicsCommandList().Begin(L"Render Scene");
-
-    MeshManager::GetInstance()->TransitionStateToRead(ghContext);
-
     GlobalConstants globals;
     for (size_t i = 0; i < std::min((size_t)MAX_CSM_DIVIDES + 1, mShadowCameras.size()); i++)
         globals.SunShadowMatrix[i] = mShadowCameras[i].GetShadowMatrix();
-    ShadowCamera::GetDivideCSMZRange(globals.CSMDivides, mSceneCamera, ModelRenderer::gCSMDivides, 
+    ShadowCamera::GetDivideCSMZRange(globals.CSMDivides, mSceneCamera, ModelRenderer::gCSMDivides,
         ModelRenderer::gNumCSMDivides, MAX_CSM_DIVIDES);
     globals.SunDirection = mSunDirection;
     globals.SunIntensity = mSunLightIntensity;
@@ -60,6 +79,16 @@ CommandList* Scene::RenderScene(CommandList* context, std::shared_ptr<MeshRender
     globals.ShadowBias = mShadowBias;
     globals.gNearZ = mSceneCamera.GetNearClip();
     globals.gFarZ = mSceneCamera.GetFarClip();
+    return globals;
+}
+
+CommandList* Scene::RenderScene(CommandList* context, std::shared_ptr<MeshRendererBuilder> meshRendererBuilder)
+{
+    GraphicsCommandList& ghContext = context->GetGraphicsCommandList().Begin(L"Render Scene");
+
+    MeshManager::GetInstance()->TransitionStateToRead(ghContext);
+
+    GlobalConstants globals = MakeGlobalConstants();
 
     // Begin rendering depth
     DepthBuffer& depthBuffer = CURRENT_SCENE_DEPTH_BUFFER;
@@ -97,28 +126,10 @@ CommandList* Scene::RenderSceneDeferred(CommandList* context, std::shared_ptr<Me
 
     MeshManager::GetInstance()->TransitionStateToRead(ghContext);
 
-    GlobalConstants globals;
-    for (size_t i = 0; i < std::min((size_t)MAX_CSM_DIVIDES + 1, mShadowCameras.size()); i++)
-        globals.SunShadowMatrix[i] = mShadowCameras[i].GetShadowMatrix();
-    ShadowCamera::GetDivideCSMZRange(globals.CSMDivides, mSceneCamera, ModelRenderer::gCSMDivides,
-        ModelRenderer::gNumCSMDivides, MAX_CSM_DIVIDES);
-    globals.SunDirection = mSunDirection;
-    globals.SunIntensity = mSunLightIntensity;
-    globals.IBLRange = mSpecularIBLRange;
-    globals.ShadowBias = mShadowBias;
-    globals.gNearZ = mSceneCamera.GetNearClip();
-    globals.gFarZ = mSceneCamera.GetFarClip();
+    GlobalConstants globals = MakeGlobalConstants();
 
+    // GBuffer and shadow map were recorded by the mesh chunk tasks pushed ahead of this one
     MeshRenderer& meshRenderer = meshRendererBuilder->Get<MeshRenderer>(MeshRenderer::kGBuffer);
-    ShadowMeshRenderer& shadowRenderer = meshRendererBuilder->Get<ShadowMeshRenderer>(MeshRenderer::kShadows);
-
-    ghContext.PIXBeginEvent(L"GBuffer"); // render GBuffer
-    meshRenderer.RenderMeshes(ghContext, globals, MeshRenderer::kOpaque);
-    ghContext.PIXEndEvent(); // render GBuffer end
-
-    ghContext.PIXBeginEvent(L"ShadowMap"); // render shadowmap
-    shadowRenderer.RenderMeshes(ghContext, globals, MeshRenderer::kZPass);
-    ghContext.PIXEndEvent(); // render shadowmap end
 
     SSAORenderer::RenderTaskSSAO(ghContext, GetDeferredTextureHandle(), meshRenderer.GetRenderTarget(0), meshRenderer.GetDepthStencilTarget());
 
@@ -132,6 +143,31 @@ CommandList* Scene::RenderSceneDeferred(CommandList* context, std::shared_ptr<Me
     return context;
 }
 
+CommandList* Scene::RenderMeshChunk(CommandList* context, std::shared_ptr<MeshRendererBuilder> meshRendererBuilder,
+    MeshRenderer* meshRenderer, size_t chunkIndex)
+{
+    GraphicsCommandList& ghContext = context->GetGraphicsCommandList().Begin(L"Render Mesh Chunk");
+
+    MeshManager::GetInstance()->TransitionStateToRead(ghContext);
+
+    GlobalConstants globals = MakeGlobalConstants();
+    meshRenderer->RenderChunk(ghContext, globals, chunkIndex);
+
+    ghContext.Finish();
+    return context;
+}
+
+void Scene::PushMeshChunkTasks(std::shared_ptr<MeshRendererBuilder> meshRendererBuilder, MeshRenderer& meshRenderer)
+{
+    // one task per chunk, the frame context records them in parallel and submits them in push order
+    size_t numChunks = meshRenderer.GetRecordChunks().size();
+    for (size_t i = 0; i < numChunks; i++)
+    {
+        PUSH_MUTIRENDER_TASK({ D3D12_COMMAND_LIST_TYPE_DIRECT, PushFrameGraphicsTaskBind(
+            &Scene::RenderMeshChunk, this, meshRendererBuilder, &meshRenderer, i) });
+    }
+}
+
 void Scene::RenderSkyBox(GraphicsCommandList& ghContext)
 {
     __declspec(align(256)) struct SkyboxVSCB
@@ -160,31 +196,48 @@ void Scene::RenderSkyBox(GraphicsCommandList& ghContext)
 
     ghContext.SetDynamicConstantBufferView(ModelRenderer::kMeshConstants, sizeof(SkyboxVSCB), &skyVSCB);
     ghContext.SetDynamicConstantBufferView(ModelRenderer::kMaterialConstants, sizeof(SkyboxPSCB), &skyPSCB);
-    ghContext.SetDescriptorTable(ModelRenderer::kSceneTextures, mSceneTextureGpuHandle);
+    ghContext.SetDescriptorTable(ModelRenderer::kSceneTextures, GetSceneTextureHandles());
     ghContext.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     ghContext.Draw(3);
 }
 
 void Scene::Update(float deltaTime)
 {
+    if (mAnimatedModelPercent > 0)
+        AnimateModels(deltaTime);
     UpdateModels();
 
     mCameraController->Update(deltaTime);
 
     UpdateLight();
+
+    MapFrameDescriptors();
 }
 
 void Scene::Render()
 {
+    CollectPassStateStats();
+
 #ifdef DEFERRED_RENDER
     std::pair<std::shared_ptr<MeshRendererBuilder>, std::shared_ptr<FullScreenRenderer>> renderers = 
         SetMeshRenderersDeferred();
-    PUSH_MUTIRENDER_TASK({ D3D12_COMMAND_LIST_TYPE_DIRECT, PushGraphicsTaskBind(
+    mLastMeshRenderers = renderers.first;
+
+    MeshRenderer& gBufferRenderer = renderers.first->Get<MeshRenderer>(MeshRenderer::kGBuffer);
+    gBufferRenderer.BuildRecordChunks(MeshRenderer::kOpaque);
+    PushMeshChunkTasks(renderers.first, gBufferRenderer);
+
+    ShadowMeshRenderer& shadowRenderer = renderers.first->Get<ShadowMeshRenderer>(MeshRenderer::kShadows);
+    shadowRenderer.BuildRecordChunks(MeshRenderer::kZPass);
+    PushMeshChunkTasks(renderers.first, shadowRenderer);
+
+    PUSH_MUTIRENDER_TASK({ D3D12_COMMAND_LIST_TYPE_DIRECT, PushFrameGraphicsTaskBind(
         &Scene::RenderSceneDeferred, this, renderers.first, renderers.second) });
 
 #else
     std::shared_ptr<MeshRendererBuilder> allMeshRenderers = SetMeshRenderers();
-    PUSH_MUTIRENDER_TASK({ D3D12_COMMAND_LIST_TYPE_DIRECT, PushGraphicsTaskBind(&Scene::RenderScene, this, allMeshRenderers) });
+    mLastMeshRenderers = allMeshRenderers;
+    PUSH_MUTIRENDER_TASK({ D3D12_COMMAND_LIST_TYPE_DIRECT, PushFrameGraphicsTaskBind(&Scene::RenderScene, this, allMeshRenderers) });
 
 #endif // DEFERRED_RENDER
 }
@@ -219,27 +272,30 @@ void Scene::WalkGraph(const std::vector<glTF::Node*>& siblings,
         model.mScene = this;
         model.mHasChildren = false;
         model.mCurIndex = curNode->linearIdx;
-        model.mParentIndex = curIndex;
 
+        XMFLOAT3 position;
+        XMFLOAT4 rotation;
+        XMFLOAT3 scale;
         Math::Matrix4 modelXForm;
         if (curNode->hasMatrix)
         {
             modelXForm = Matrix4(curNode->matrix);
             const AffineTransform& affineTrans = (const AffineTransform&)modelXForm;
-            XMStoreFloat3(&model.mScale, affineTrans.GetScale());
-            XMStoreFloat3(&model.mPosition, affineTrans.GetTranslation());
-            XMStoreFloat4(&model.mRotation, affineTrans.GetRotation());
+            XMStoreFloat3(&scale, affineTrans.GetScale());
+            XMStoreFloat3(&position, affineTrans.GetTranslation());
+            XMStoreFloat4(&rotation, affineTrans.GetRotation());
         }
         else
         {
-            CopyMemory((float*)&model.mPosition, curNode->translation, sizeof(curNode->translation));
-            CopyMemory((float*)&model.mScale, curNode->scale, sizeof(curNode->scale));
-            CopyMemory((float*)&model.mRotation, curNode->rotation, sizeof(curNode->rotation));
+            CopyMemory((float*)&position, curNode->translation, sizeof(curNode->translation));
+            CopyMemory((float*)&scale, curNode->scale, sizeof(curNode->scale));
+            CopyMemory((float*)&rotation, curNode->rotation, sizeof(curNode->rotation));
             modelXForm = Matrix4(
-                Matrix3(Quaternion(model.mRotation)) * Matrix3::MakeScale(Vector3(model.mScale)),
+                Matrix3(Quaternion(rotation)) * Matrix3::MakeScale(Vector3(scale)),
                 Vector3(*(const XMFLOAT3*)curNode->translation)
             );
         }
+        mTransforms.SetNode(model.mCurIndex, curIndex, position, rotation, scale);
 
         const Matrix4 LocalXform = xform * modelXForm;
 
@@ -277,9 +333,55 @@ void Scene::WalkGraph(const std::vector<glTF::Node*>& siblings,
     }
 }
 
-DescriptorHandle Scene::GetShadowTextureHandle() const
+void Scene::InitModels(const MeshCache::NodeRecord* nodes, size_t numNodes)
 {
-    return mShadowGpuHandle + (UINT)CURRENT_FARME_BUFFER_INDEX;
+    ResizeModels(numNodes);
+
+    for (size_t i = 0; i < numNodes; ++i)
+    {
+        const MeshCache::NodeRecord& node = nodes[i];
+        Model& model = mModels[i];
+        model.mScene = this;
+        model.mCurIndex = (uint32_t)i;
+        model.mHasChildren = node.hasChildren;
+        model.mHasSiblings = node.hasSiblings;
+        model.mMesh = nullptr;
+
+        if (!node.isValid)
+            continue;
+
+        mTransforms.SetNode((uint32_t)i, node.parentIndex, *(const XMFLOAT3*)node.position,
+            *(const XMFLOAT4*)node.rotation, *(const XMFLOAT3*)node.scale);
+
+        if (node.meshIndex != MeshCache::kInvalidIndex)
+        {
+            model.mMesh = GET_MESH(node.meshIndex);
+            model.m_BSLS = Math::BoundingSphere((const XMFLOAT4*)model.mMesh->bounds);
+            model.m_BBoxLS = Math::AxisAlignedBox::CreateFromSphere(model.m_BSLS);
+        }
+    }
+}
+
+void Scene::UnloadModels()
+{
+    // nodes instancing a mesh share its index, each mesh is removed once
+    std::vector<uint32_t> meshIndices;
+    for (Model& model : mModels)
+    {
+        if (model.mMesh != nullptr)
+            meshIndices.push_back(model.mMesh->meshIndex);
+        model.mMesh = nullptr;
+    }
+    std::sort(meshIndices.begin(), meshIndices.end());
+    meshIndices.erase(std::unique(meshIndices.begin(), meshIndices.end()), meshIndices.end());
+
+    MeshManager* meshMgr = MeshManager::GetInstance();
+    for (uint32_t meshIndex : meshIndices)
+        meshMgr->RemoveMesh(meshIndex);
+
+    // rebuilt empty on the next update
+    mCullingBVH.Clear();
+    mCullEntries.clear();
 }
 
 DescriptorHandle Scene::GetDeferredTextureHandle() const
@@ -287,46 +389,65 @@ DescriptorHandle Scene::GetDeferredTextureHandle() const
     return mDeferredTextureGpuHandle + (UINT)(CURRENT_FARME_BUFFER_INDEX * 4);
 }
 
-void Scene::ResetShadowMapHandle()
+void Scene::SetRenderModels(MeshRenderer& renderer)
 {
-    ShadowBuffer* shadowBuffers = ModelRenderer::GetShadowBuffers();
-    ColorBuffer* nonMsaaShadowBuffers = ModelRenderer::GetNonMsaaShadowBuffers();
+    size_t currentFrameIdx = CURRENT_FARME_BUFFER_INDEX;
+    renderer.SetModelConstants(mMeshConstantsUploader[currentFrameIdx].GetGpuVirtualAddress());
 
-    if (ModelRenderer::gMsaaShadowSample > 0)
+    // renderers are filled on different threads, each keeps its own lists alive between frames
+    static thread_local SphereCuller::VisibleList sVisibleLists[SphereCuller::kMaxViews];
+
+    size_t numPasses = renderer.GetPassCount();
+    ASSERT(numPasses <= SphereCuller::kMaxViews);
+    SphereCuller::ViewPlanes viewPlanes[SphereCuller::kMaxViews];
+    for (size_t passIndex = 0; passIndex < numPasses; passIndex++)
     {
-        for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; i++)
-        {
-            Graphics::gDevice->CopyDescriptorsSimple(1, mShadowGpuHandle + i, nonMsaaShadowBuffers[i].GetSRV(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-        }
+        SphereCuller::CullView view = { &renderer.GetWorldFrustum(passIndex), &renderer.GetViewMatrix(passIndex) };
+        viewPlanes[passIndex] = SphereCuller::MakeViewPlanes(view);
     }
-    else
+
+    // one walk for every pass, the shadow cascades share the box tests and sphere loads
+    mCullingBVH.Cull(mSphereCuller, viewPlanes, numPasses, sVisibleLists);
+
+    for (size_t passIndex = 0; passIndex < numPasses; passIndex++)
     {
-        for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; i++)
+        const SphereCuller::VisibleList& visibleList = sVisibleLists[passIndex];
+        renderer.ReserveMeshes(passIndex, visibleList.indices.size());
+        for (size_t i = 0; i < visibleList.indices.size(); i++)
         {
-            Graphics::gDevice->CopyDescriptorsSimple(1, mShadowGpuHandle + i, shadowBuffers[i].GetSRV(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+            const CullEntry& entry = mCullEntries[visibleList.indices[i]];
+            const Model& model = mModels[entry.modelIndex];
+            renderer.AddMesh(passIndex, model.mMesh->subMeshes[entry.subMeshIndex], &model, visibleList.distances[i], entry.modelIndex);
         }
     }
 }
 
-void Scene::SetRenderModels(MeshRenderer& renderer)
+void Scene::ApplyDrawSettings(MeshRenderer& renderer) const
 {
-    size_t currentFrameIdx = CURRENT_FARME_BUFFER_INDEX;
+    renderer.SetIndirectDraw(mUseIndirectDraw);
+    for (uint32_t pass = 0; pass < MeshRenderer::kNumPasses; pass++)
+        renderer.SetSortPolicy((MeshRenderer::DrawPass)pass, mSortPolicies[renderer.GetBatchType()][pass]);
+}
 
-    for (size_t i = 0; i < mModels.size(); i++)
-    {
-        if (mModels[i].mMesh == nullptr)
-            continue;
+void Scene::CollectPassStateStats()
+{
+    // the renderers of the last frame are done recording once its tasks were committed
+    if (mLastMeshRenderers == nullptr)
+        return;
 
-        mModels[i].Render(renderer, mModelWorldTransform[i],
-            mMeshConstantsUploader[currentFrameIdx].GetGpuVirtualAddress() + sizeof(ModelConstants) * i);
+    for (uint32_t batch = 0; batch < MeshRenderer::kNumBachTypes; batch++)
+    {
+        const MeshRenderer* renderer = mLastMeshRenderers->Find((MeshRenderer::BatchType)batch);
+        for (uint32_t pass = 0; pass < MeshRenderer::kNumPasses; pass++)
+            mPassStateStats[batch][pass] = renderer ? renderer->GetStateStats((MeshRenderer::DrawPass)pass) : StateCallStats();
+        mChunkTimeStats[batch] = renderer ? renderer->GetChunkTimeStats() : MeshRenderer::ChunkTimeStats();
     }
-
-    renderer.Sort();
+    mLastMeshRenderers.reset();
 }
 
 std::shared_ptr<MeshRendererBuilder> Scene::SetMeshRenderers()
 {
-    std::shared_ptr<MeshRendererBuilder> meshRendererBuilder = std::make_shared<MeshRendererBuilder>();
+    std::shared_ptr<MeshRendererBuilder> meshRendererBuilder = Utility::MakeFrameShared<MeshRendererBuilder>();
     std::queue<std::future<void>> renderTaskQueue;
 
     DepthBuffer& depthBuffer = CURRENT_SCENE_DEPTH_BUFFER;
@@ -362,16 +483,19 @@ std::shared_ptr<MeshRendererBuilder> Scene::SetMeshRenderers()
         renderTaskQueue.pop();
     }
 
-    meshRenderer.SetObjectsPSO();
-    shadowRenderer.SetObjectsPSO();
+    // PSO lookups may create PSOs, so keys are packed and sorted here rather than on the culling tasks
+    ApplyDrawSettings(meshRenderer);
+    ApplyDrawSettings(shadowRenderer);
+    meshRenderer.Sort();
+    shadowRenderer.Sort();
 
     return meshRendererBuilder;
 }
 
 std::pair<std::shared_ptr<MeshRendererBuilder>, std::shared_ptr<FullScreenRenderer>> Scene::SetMeshRenderersDeferred()
 {
-    std::shared_ptr<MeshRendererBuilder> meshRendererBuilder = std::make_shared<MeshRendererBuilder>();
-    std::shared_ptr<FullScreenRenderer> deferredRenderer = std::make_shared<FullScreenRenderer>();
+    std::shared_ptr<MeshRendererBuilder> meshRendererBuilder = Utility::MakeFrameShared<MeshRendererBuilder>();
+    std::shared_ptr<FullScreenRenderer> deferredRenderer = Utility::MakeFrameShared<FullScreenRenderer>();
     std::queue<std::future<void>> renderTaskQueue;
 
     DepthBuffer& depthBuffer = CURRENT_SCENE_DEPTH_BUFFER;
@@ -401,8 +525,10 @@ std::pair<std::shared_ptr<MeshRendererBuilder>, std::shared_ptr<FullScreenRender
     SetRenderModels(shadowRenderer);
     //renderTaskQueue.emplace(Utility::gThreadPoolExecutor.Submit(&Scene::SetRenderModels, this, std::ref(shadowRenderer)));
 
-    meshRenderer.SetObjectsPSO();
-    shadowRenderer.SetObjectsPSO();
+    ApplyDrawSettings(meshRenderer);
+    ApplyDrawSettings(shadowRenderer);
+    meshRenderer.Sort();
+    shadowRenderer.Sort();
 
     deferredRenderer->AddRenderTarget(colorBuffer);
     deferredRenderer->SetCamera(mSceneCamera);
@@ -416,49 +542,42 @@ std::pair<std::shared_ptr<MeshRendererBuilder>, std::shared_ptr<FullScreenRender
 
 void Scene::UpdateModels()
 {
-    if (mModelDirtyFrameCount == 0)
-        return;
-
-    ASSERT(mModelWorldTransform.size() == mModels.size());
-
-    if (mModelDirtyFrameCount == SWAP_CHAIN_BUFFER_COUNT)
+    if (mTransforms.Update() > 0)
     {
-        for (size_t i = 0; i < mModels.size(); i++)
-        {
-            Model& model = mModels[i];
-
-            Matrix4 localTrans(
-                Matrix3(Quaternion(model.mRotation)) * Matrix3::MakeScale(Vector3(model.mScale)),
-                Vector3(model.mPosition));
-            const Math::AffineTransform& transformAffine = (const Math::AffineTransform&)localTrans;
-            if (model.mParentIndex != (uint32_t)-1)
-            {
-                ASSERT(model.mParentIndex < i);
-                mModelWorldTransform[i] = mModelWorldTransform[model.mParentIndex] * transformAffine;
-            }
-            else
-            {
-                mModelWorldTransform[i] = transformAffine;
-            }
-        }
-
+        UpdateCullingSpheres();
         UpdateModelBoundingSphere();
     }
 
-    void* modelTransBuffer = mMeshConstantsUploader[CURRENT_FARME_BUFFER_INDEX].Map();
+    // each frame buffer only receives the transforms that changed since it was last written,
+    // no inverse here, the VS derives the normal matrix from the cofactors of the world basis
+    mModelUploadBytes = 0;
+    mTransforms.TakeStaleRanges((uint32_t)CURRENT_FARME_BUFFER_INDEX, mStaleTransformRanges);
+    if (mStaleTransformRanges.empty())
+        return;
 
-    for (size_t i = 0; i < mModels.size(); i++)
+    ModelTransform* modelTransBuffer = (ModelTransform*)mMeshConstantsUploader[CURRENT_FARME_BUFFER_INDEX].Map();
+    for (const TransformHierarchy::Range& range : mStaleTransformRanges)
     {
-        ModelConstants modelConstants;
-        modelConstants.World = mModelWorldTransform[i];
-        modelConstants.WorldIT = Math::Transpose(Math::Invert(modelConstants.World)).Get3x3();
-        CopyMemory((uint8_t*)modelTransBuffer + i * sizeof(ModelConstants), &modelConstants, sizeof(ModelConstants));
+        for (uint32_t i = range.first; i < range.first + range.count; i++)
+            mTransforms.GetWorldRows(i, modelTransBuffer[i].World.m);
+        mModelUploadBytes += sizeof(ModelTransform) * range.count;
     }
-    //Math::BoundingSphere boundingSphere(mModelWorldTransform[i].GetTranslation(), mModelWorldTransform[i].GetUniformScale());
-    //model.m_BSOS = boundingSphere;
-    //model.m_BBoxOS = Math::AxisAlignedBox::CreateFromSphere(boundingSphere);
+}
 
-    mModelDirtyFrameCount--;
+void Scene::AnimateModels(float deltaTime)
+{
+    // the first mAnimatedModelPercent nodes of every hundred, spread over the whole hierarchy
+    Math::Quaternion spin(Vector3(kYUnitVector), deltaTime);
+    uint32_t numModels = (uint32_t)mModels.size();
+    for (uint32_t base = 0; base < numModels; base += 100)
+    {
+        for (uint32_t i = base; i < std::min(base + mAnimatedModelPercent, numModels); i++)
+        {
+            XMFLOAT4 rotation;
+            XMStoreFloat4(&rotation, Math::Normalize(spin * Math::Quaternion(mTransforms.GetRotation(i))));
+            mTransforms.SetLocal(i, mTransforms.GetPosition(i), rotation, mTransforms.GetScale(i));
+        }
+    }
 }
 
 void Scene::UpdateLight()
@@ -485,33 +604,10 @@ void Scene::UpdateLight()
 
 void Scene::MapGpuDescriptors()
 {
-    ShadowBuffer* shadowBuffers = ModelRenderer::GetShadowBuffers();
+#ifdef DEFERRED_RENDER
     ColorBuffer* GBuffers = ModelRenderer::GetGBuffers();
     DepthBuffer* depthBuffer = Graphics::GetSceneDepthBuffers();
 
-    std::vector<DescriptorHandle> allHandles;
-    allHandles.push_back(mRadianceCubeMap.GetSRV());
-    allHandles.push_back(mIrradianceCubeMap.GetSRV());
-    allHandles.push_back(mPreComputeBRDF.GetSRV());
-    //allHandles.push_back(shadowBuffer.GetSRV());
-
-    ASSERT(allHandles.size() <= 8);
-
-    if (!mSceneTextureGpuHandle)
-        mSceneTextureGpuHandle = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 8);
-
-    if (!mShadowGpuHandle)
-        mShadowGpuHandle = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, SWAP_CHAIN_BUFFER_COUNT);
-
-    
-
-    for (uint32_t i = 0; i < allHandles.size(); i++)
-    {
-        if (allHandles[i])
-            Graphics::gDevice->CopyDescriptorsSimple(1, mSceneTextureGpuHandle + i, allHandles[i], D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-    }
-
-#ifdef DEFERRED_RENDER
     if (!mDeferredTextureGpuHandle)
         mDeferredTextureGpuHandle = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, 4 * SWAP_CHAIN_BUFFER_COUNT);
     for (uint32_t i = 0, j = 0; i < SWAP_CHAIN_BUFFER_COUNT * 4; i += 4, j++)
@@ -524,15 +620,136 @@ void Scene::MapGpuDescriptors()
             SSAORenderer::GetSSAOFinalHandle(j), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
     }
 #endif // DEFERRED_RENDER
+}
+
+void Scene::MapFrameDescriptors()
+{
+    size_t frameIndex = CURRENT_FARME_BUFFER_INDEX;
+    DescriptorHandle sources[kNumFrameDescriptors];
 
-    ResetShadowMapHandle();
+    if (mRadianceCubeMap)
+    {
+        sources[kFrameSceneTextures] = mRadianceCubeMap.GetSRV();
+        sources[kFrameSceneTextures + 1] = mIrradianceCubeMap.GetSRV();
+        sources[kFrameSceneTextures + 2] = mPreComputeBRDF.GetSRV();
+    }
+
+    // picked every frame, so switching shadow msaa needs no rebuild
+    if (ModelRenderer::gMsaaShadowSample > 0)
+        sources[kFrameShadowTexture] = ModelRenderer::GetNonMsaaShadowBuffers()[frameIndex].GetSRV();
+    else
+        sources[kFrameShadowTexture] = ModelRenderer::GetShadowBuffers()[frameIndex].GetSRV();
+
+#ifdef DEFERRED_RENDER
+    sources[kFrameGBufferTextures] = ModelRenderer::GetGBuffers()[frameIndex].GetSRV();
+    sources[kFrameGBufferTextures + 1] = Graphics::GetSceneDepthBuffers()[frameIndex].GetDepthSRV();
+    sources[kFrameGBufferTextures + 2] = SSAORenderer::GetSSAOFinalHandle(frameIndex);
+#endif // DEFERRED_RENDER
+
+    DescriptorRing& ring = GET_DESCRIPTOR_RING();
+    mFrameTextureTable = ring.Allocate(kNumFrameDescriptors);
+    ring.CopyToTable(mFrameTextureTable, sources, kNumFrameDescriptors);
+    ring.Flush();
 }
 
 void Scene::UpdateModelBoundingSphere()
 {
-    mSceneBS_WS = BoundingSphere(kZero);
+    // the refit root box already bounds every culling sphere, so no pass over the models
+    if (mCullingBVH.IsEmpty())
+    {
+        mSceneBS_WS = BoundingSphere(kZero);
+        return;
+    }
+
+    float boundsMin[3], boundsMax[3];
+    mCullingBVH.GetBounds(boundsMin, boundsMax);
+    Vector3 minCorner(boundsMin[0], boundsMin[1], boundsMin[2]);
+    Vector3 maxCorner(boundsMax[0], boundsMax[1], boundsMax[2]);
+    mSceneBS_WS = BoundingSphere((minCorner + maxCorner) * 0.5f, Length(maxCorner - minCorner) * 0.5f);
+}
+
+void Scene::UpdateCullingSpheres()
+{
+    // the hierarchy changes with the set of models
+    if (mModelCullEntries.size() != mModels.size() || mCullingBVH.IsEmpty())
+    {
+        BuildCullingHierarchy();
+        SetCullingSpheres();
+        mCullingBVH.Refit(mSphereCuller);
+        return;
+    }
+
+    // moving models only rewrite their own spheres and refit the leaves they sit in
+    mMovedCullEntries.clear();
+    for (const std::vector<uint32_t>& level : mTransforms.GetUpdatedLevels())
+    {
+        for (uint32_t modelIndex : level)
+        {
+            const Mesh* mesh = mModels[modelIndex].mMesh;
+            if (mesh == nullptr)
+                continue;
+
+            for (uint32_t j = 0; j < mesh->subMeshCount; j++)
+            {
+                uint32_t entryIndex = mModelCullEntries[modelIndex] + j;
+                SetCullingSphere(entryIndex);
+                mMovedCullEntries.push_back(entryIndex);
+            }
+        }
+    }
+    mCullingBVH.RefitEntries(mSphereCuller, mMovedCullEntries);
+
+    // until the refit boxes have swollen enough that a new topology culls faster
+    if (mCullingBVH.NeedsRebuild())
+    {
+        BuildCullingHierarchy();
+        SetCullingSpheres();
+        mCullingBVH.Refit(mSphereCuller);
+    }
+}
+
+void Scene::SetCullingSpheres()
+{
+    mSphereCuller.Resize(mCullEntries.size());
+    for (uint32_t i = 0; i < (uint32_t)mCullEntries.size(); i++)
+        SetCullingSphere(i);
+}
+
+void Scene::SetCullingSphere(uint32_t entryIndex)
+{
+    const CullEntry& entry = mCullEntries[entryIndex];
+    Math::AffineTransform transform = mTransforms.GetWorld(entry.modelIndex);
+    const SubMesh& subMesh = mModels[entry.modelIndex].mMesh->subMeshes[entry.subMeshIndex];
+
+    Math::BoundingSphere sphereLS((const XMFLOAT4*)subMesh.bounds);
+    mSphereCuller.SetSphere(entryIndex, Math::BoundingSphere(transform * sphereLS.GetCenter(),
+        sphereLS.GetRadius() * transform.GetUniformScale()));
+}
+
+void Scene::BuildCullingHierarchy()
+{
+    std::vector<CullEntry> entries;
+    std::vector<CullingBVH::BuildItem> items;
     for (size_t i = 0; i < mModels.size(); i++)
     {
-        mSceneBS_WS = mSceneBS_WS.Union(mModels[i].GetWorldBoundingSphere());
+        const Mesh* mesh = mModels[i].mMesh;
+        if (mesh == nullptr || mesh->subMeshCount == 0)
+            continue;
+
+        Math::Vector3 center = mTransforms.GetWorld((uint32_t)i).GetTranslation();
+        items.push_back({ { center.GetX(), center.GetY(), center.GetZ() }, (uint32_t)entries.size(), mesh->subMeshCount });
+        for (uint32_t j = 0; j < mesh->subMeshCount; j++)
+            entries.push_back({ (uint32_t)i, j });
+    }
+
+    mCullingBVH.Build(items);
+
+    mCullEntries.clear();
+    mCullEntries.reserve(entries.size());
+    mModelCullEntries.assign(mModels.size(), 0);
+    for (const CullingBVH::BuildItem& item : items)
+    {
+        mModelCullEntries[entries[item.firstEntry].modelIndex] = (uint32_t)mCullEntries.size();
+        mCullEntries.insert(mCullEntries.end(), entries.begin() + item.firstEntry, entries.begin() + item.firstEntry + item.numEntries);
     }
 }
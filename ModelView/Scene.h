@@ -7,17 +7,24 @@
 #include "GpuBuffer.h"
 #include "Texture.h"
 #include "Model.h"
+#include "SphereCuller.h"
+#include "CullingBVH.h"
+#include "TransformHierarchy.h"
+#include "MeshRenderer.h"
 
 class CameraController;
 class GraphicsCommandList;
-class MeshRendererBuilder;
-class FullScreenRenderer;
 
 namespace glTF
 {
     struct Node;
 }
 
+namespace MeshCache
+{
+    struct NodeRecord;
+}
+
 namespace MainView
 {
     void ShowUI(Scene*);
@@ -45,6 +52,10 @@ public:
 
     void Startup();
 
+    // Back to the view the scene starts with, usable before Startup to know what the first frames will show
+    void ResetCamera();
+    const Math::Camera& GetCamera() const { return mSceneCamera; }
+
     void Update(float deltaTime);
 
     virtual void Render() override;
@@ -52,35 +63,58 @@ public:
     void SetIBLTextures(TextureRef diffuseIBL, TextureRef specularIBL);
     void SetIBLRange(float range) { mSpecularIBLRange = range; }
 
-    void ResizeModels(size_t numModels) { mModels.resize(numModels);  }
+    void ResizeModels(size_t numModels)
+    {
+        mModels.resize(numModels);
+        mTransforms.Resize(numModels, SWAP_CHAIN_BUFFER_COUNT);
+    }
     void WalkGraph(const std::vector<glTF::Node*>& siblings, uint32_t curIndex, const Math::Matrix4& xform);
+    void InitModels(const MeshCache::NodeRecord* nodes, size_t numNodes);
+    // Gives the meshes of every model back to MeshManager, the models stay as empty nodes. The GPU must
+    // be done with the frames that drew them.
+    void UnloadModels();
 
     const Model& GetModel(size_t index) const { return mModels[index]; }
-    const Math::AffineTransform& GetModelTranform(size_t index) const { return mModelWorldTransform[index]; }
+    Math::AffineTransform GetModelTranform(size_t index) const { return mTransforms.GetWorld((uint32_t)index); }
 
     float GetIBLRange() const { return mSpecularIBLRange; }
 
-    DescriptorHandle GetSceneTextureHandles() const { return mSceneTextureGpuHandle; }
-    DescriptorHandle GetShadowTextureHandle() const;
+    // scene, shadow and GBuffer tables of the frame being recorded, from the transient descriptor ring
+    DescriptorHandle GetSceneTextureHandles() const { return mFrameTextureTable + (UINT)kFrameSceneTextures; }
+    DescriptorHandle GetShadowTextureHandle() const { return mFrameTextureTable + (UINT)kFrameShadowTexture; }
+#ifdef DEFERRED_RENDER
+    DescriptorHandle GetGBufferTextureHandle() const { return mFrameTextureTable + (UINT)kFrameGBufferTextures; }
+#endif // DEFERRED_RENDER
+    // persistent copy of the GBuffer table for SSAO, which binds it next to its own persistent tables
     DescriptorHandle GetDeferredTextureHandle() const;
-
-    void ResetShadowMapHandle();
 private:
     void SetRenderModels(MeshRenderer& renderer);
+    void ApplyDrawSettings(MeshRenderer& renderer) const;
+    void CollectPassStateStats();
     std::shared_ptr<MeshRendererBuilder> SetMeshRenderers();
     std::pair<std::shared_ptr<MeshRendererBuilder>, std::shared_ptr<FullScreenRenderer>> SetMeshRenderersDeferred();
 
     void UpdateModels();
+    void AnimateModels(float deltaTime);
     void UpdateLight();
 
     void MapGpuDescriptors();
+    void MapFrameDescriptors();
     
     void UpdateModelBoundingSphere();
+    void UpdateCullingSpheres();
+    void SetCullingSpheres();
+    void SetCullingSphere(uint32_t entryIndex);
+    void BuildCullingHierarchy();
 
     CommandList* RenderScene(CommandList* context, std::shared_ptr<MeshRendererBuilder> meshRendererBuilder);
     CommandList* RenderSceneDeferred(CommandList* context, std::shared_ptr<MeshRendererBuilder> meshRendererBuilder, 
         std::shared_ptr<FullScreenRenderer> deferredRender);
+    CommandList* RenderMeshChunk(CommandList* context, std::shared_ptr<MeshRendererBuilder> meshRendererBuilder,
+        MeshRenderer* meshRenderer, size_t chunkIndex);
+    void PushMeshChunkTasks(std::shared_ptr<MeshRendererBuilder> meshRendererBuilder, MeshRenderer& meshRenderer);
     void RenderSkyBox(GraphicsCommandList& context);
+    GlobalConstants MakeGlobalConstants() const;
 private:
 	Math::Camera mSceneCamera;
     std::vector<ShadowCamera>  mShadowCameras;
@@ -91,11 +125,25 @@ private:
     Vector3 mSunDirection;
 
 	std::vector<Model> mModels;
-	std::vector<Math::AffineTransform> mModelWorldTransform;
+    TransformHierarchy mTransforms;
+    std::vector<TransformHierarchy::Range> mStaleTransformRanges;
     GlobalConstants mGlobalConstants;
-    UploadBuffer mMeshConstantsUploader[SWAP_CHAIN_BUFFER_COUNT];
+    UploadBuffer mMeshConstantsUploader[SWAP_CHAIN_BUFFER_COUNT]; // ModelTransform per model
     Math::BoundingSphere mSceneBS_WS;
-    size_t mModelDirtyFrameCount;
+    size_t mModelUploadBytes; // written by the last UpdateModels, 0 when no model moved
+    uint32_t mAnimatedModelPercent; // -animatemodels <percent>, spins that share of the models every frame
+
+    // one culling sphere per submesh of every model with a mesh, in leaf order of mCullingBVH
+    struct CullEntry
+    {
+        uint32_t modelIndex;
+        uint32_t subMeshIndex;
+    };
+    std::vector<CullEntry> mCullEntries;
+    std::vector<uint32_t> mModelCullEntries; // first entry of each model, its submeshes follow
+    std::vector<uint32_t> mMovedCullEntries;
+    SphereCuller mSphereCuller;
+    CullingBVH mCullingBVH;
 
     TextureRef mRadianceCubeMap;
     TextureRef mIrradianceCubeMap;
@@ -103,7 +151,26 @@ private:
     float mSpecularIBLRange;
     float mShadowBias;
 
-    DescriptorHandle mShadowGpuHandle;
-    DescriptorHandle mSceneTextureGpuHandle;
+    // per batch and pass, -opaquesort <policy> overrides the opaque passes
+    MeshRenderer::SortPolicy mSortPolicies[MeshRenderer::kNumBachTypes][MeshRenderer::kNumPasses];
+    bool mUseIndirectDraw; // -indirectdraw 1
+    // state calls of the last recorded frame, its renderers are kept one frame to read them back
+    StateCallStats mPassStateStats[MeshRenderer::kNumBachTypes][MeshRenderer::kNumPasses];
+    MeshRenderer::ChunkTimeStats mChunkTimeStats[MeshRenderer::kNumBachTypes];
+    std::shared_ptr<MeshRendererBuilder> mLastMeshRenderers;
+
+    // layout of mFrameTextureTable, each part matches a descriptor range of the mesh root signatures
+    enum eFrameTextureTable
+    {
+        kFrameSceneTextures = 0,
+        kFrameShadowTexture = kFrameSceneTextures + 8,
+        kFrameGBufferTextures = kFrameShadowTexture + 1,
+#ifdef DEFERRED_RENDER
+        kNumFrameDescriptors = kFrameGBufferTextures + 4
+#else
+        kNumFrameDescriptors = kFrameGBufferTextures
+#endif // DEFERRED_RENDER
+    };
+    DescriptorHandle mFrameTextureTable;
     DescriptorHandle mDeferredTextureGpuHandle;
 };
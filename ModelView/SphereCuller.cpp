@@ -0,0 +1,275 @@
+#include "SphereCuller.h"
+
+#include <cfloat>
+#include <algorithm>
+#include <intrin.h>
+#include <immintrin.h>
+
+namespace
+{
+    constexpr size_t kBatchSize = 8;
+
+    bool IsAVXSupported()
+    {
+        int cpuInfo[4];
+        __cpuid(cpuInfo, 1);
+        bool osxsave = (cpuInfo[2] & (1 << 27)) != 0;
+        bool avx = (cpuInfo[2] & (1 << 28)) != 0;
+        // the OS must also save the upper halves of the ymm registers
+        return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+    }
+
+    const bool sHasAVX = IsAVXSupported();
+    SphereCuller::eCullPath sCullPath = sHasAVX ? SphereCuller::kCullAVX : SphereCuller::kCullSSE;
+}
+
+SphereCuller::eCullPath SphereCuller::GetCullPath()
+{
+    return sCullPath;
+}
+
+void SphereCuller::SetCullPath(eCullPath path)
+{
+    sCullPath = path == kCullAVX && !sHasAVX ? kCullSSE : path;
+}
+
+void SphereCuller::Resize(size_t count)
+{
+    mCount = count;
+    size_t paddedCount = Math::AlignUp(count, kBatchSize);
+
+    // padding spheres sit behind every plane so they never show up as visible
+    mCenterX.assign(paddedCount, 0.0f);
+    mCenterY.assign(paddedCount, 0.0f);
+    mCenterZ.assign(paddedCount, 0.0f);
+    mRadius.assign(paddedCount, -FLT_MAX);
+}
+
+void SphereCuller::GetBounds(size_t begin, size_t end, float boundsMin[3], float boundsMax[3]) const
+{
+    ASSERT(begin < end && end <= mCount);
+    const float* centers[3] = { mCenterX.data(), mCenterY.data(), mCenterZ.data() };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        boundsMin[axis] = FLT_MAX;
+        boundsMax[axis] = -FLT_MAX;
+        for (size_t i = begin; i < end; i++)
+        {
+            boundsMin[axis] = std::min(boundsMin[axis], centers[axis][i] - mRadius[i]);
+            boundsMax[axis] = std::max(boundsMax[axis], centers[axis][i] + mRadius[i]);
+        }
+    }
+}
+
+SphereCuller::ViewPlanes SphereCuller::MakeViewPlanes(const CullView& view)
+{
+    ViewPlanes viewPlanes;
+    for (int i = 0; i < Math::Frustum::kNumPlanes; i++)
+    {
+        Math::Vector4 plane = view.frustumWS->GetFrustumPlane((Math::Frustum::PlaneID)i);
+        viewPlanes.planes[i][0] = plane.GetX();
+        viewPlanes.planes[i][1] = plane.GetY();
+        viewPlanes.planes[i][2] = plane.GetZ();
+        viewPlanes.planes[i][3] = plane.GetW();
+    }
+
+    // -z in view space, the camera looks down -z
+    const Math::Matrix4& viewMatrix = *view.viewMatrix;
+    float* depth = viewPlanes.planes[Math::Frustum::kNumPlanes];
+    depth[0] = -viewMatrix.GetX().GetZ();
+    depth[1] = -viewMatrix.GetY().GetZ();
+    depth[2] = -viewMatrix.GetZ().GetZ();
+    depth[3] = -viewMatrix.GetW().GetZ();
+    return viewPlanes;
+}
+
+void SphereCuller::BeginCull(VisibleList& visibleList, uint32_t& numVisible) const
+{
+    // sized for the worst case so the loops can store without checking capacity
+    visibleList.indices.resize(mCount);
+    visibleList.distances.resize(mCount);
+    numVisible = 0;
+}
+
+void SphereCuller::CullRange(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+    VisibleList* visibleLists, uint32_t* numVisible) const
+{
+    ASSERT(begin <= end && end <= mCount);
+    ASSERT(viewMask < (1u << kMaxViews));
+    if (begin == end || viewMask == 0)
+        return;
+
+    switch (sCullPath)
+    {
+    case kCullScalar: CullScalar(views, viewMask, begin, end, acceptAll, visibleLists, numVisible); break;
+    case kCullSSE: CullSSE(views, viewMask, begin, end, acceptAll, visibleLists, numVisible); break;
+    case kCullAVX: CullAVX(views, viewMask, begin, end, acceptAll, visibleLists, numVisible); break;
+    }
+}
+
+void SphereCuller::EndCull(VisibleList& visibleList, uint32_t numVisible) const
+{
+    visibleList.indices.resize(numVisible);
+    visibleList.distances.resize(numVisible);
+}
+
+// One sphere at a time, with the sums in the same order as the SIMD loops
+void SphereCuller::CullScalar(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+    VisibleList* visibleLists, uint32_t* numVisible) const
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        const float x = mCenterX[i];
+        const float y = mCenterY[i];
+        const float z = mCenterZ[i];
+        const float r = mRadius[i];
+
+        unsigned long v;
+        for (unsigned long viewBits = viewMask; _BitScanForward(&v, viewBits); viewBits &= viewBits - 1)
+        {
+            const ViewPlanes& view = views[v];
+            bool inside = true;
+            for (int p = 0; p < Math::Frustum::kNumPlanes && inside && !acceptAll; p++)
+            {
+                const float* plane = view.planes[p];
+                inside = x * plane[0] + y * plane[1] + z * plane[2] + (plane[3] + r) >= 0.0f;
+            }
+
+            if (!inside)
+                continue;
+
+            const float* depth = view.planes[Math::Frustum::kNumPlanes];
+            uint32_t count = numVisible[v]++;
+            visibleLists[v].indices[count] = (uint32_t)i;
+            visibleLists[v].distances[count] = x * depth[0] + y * depth[1] + z * depth[2] + depth[3] - r;
+        }
+    }
+}
+
+void SphereCuller::CullSSE(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+    VisibleList* visibleLists, uint32_t* numVisible) const
+{
+    const __m128 zero = _mm_setzero_ps();
+    alignas(16) float distances[4];
+
+    for (size_t base = begin & ~size_t(3); base < end; base += 4)
+    {
+        // lanes of this batch that fall inside [begin, end)
+        unsigned long rangeMask = 0xF;
+        if (base < begin)
+            rangeMask &= 0xF << (begin - base);
+        if (base + 4 > end)
+            rangeMask &= 0xF >> (base + 4 - end);
+
+        __m128 x = _mm_loadu_ps(&mCenterX[base]);
+        __m128 y = _mm_loadu_ps(&mCenterY[base]);
+        __m128 z = _mm_loadu_ps(&mCenterZ[base]);
+        __m128 r = _mm_loadu_ps(&mRadius[base]);
+
+        unsigned long v;
+        for (unsigned long viewBits = viewMask; _BitScanForward(&v, viewBits); viewBits &= viewBits - 1)
+        {
+            const ViewPlanes& view = views[v];
+            unsigned long mask = rangeMask;
+            if (!acceptAll)
+            {
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int i = 0; i < Math::Frustum::kNumPlanes; i++)
+                {
+                    const float* plane = view.planes[i];
+                    __m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])), _mm_mul_ps(y, _mm_set1_ps(plane[1])));
+                    d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(plane[2])));
+                    d = _mm_add_ps(d, _mm_add_ps(_mm_set1_ps(plane[3]), r));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+                }
+                mask &= (unsigned long)_mm_movemask_ps(inside);
+            }
+
+            if (mask == 0)
+                continue;
+
+            const float* depth = view.planes[Math::Frustum::kNumPlanes];
+            __m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(depth[0])), _mm_mul_ps(y, _mm_set1_ps(depth[1])));
+            d = _mm_add_ps(d, _mm_mul_ps(z, _mm_set1_ps(depth[2])));
+            d = _mm_sub_ps(_mm_add_ps(d, _mm_set1_ps(depth[3])), r);
+            _mm_store_ps(distances, d);
+
+            uint32_t* indices = visibleLists[v].indices.data();
+            float* outDistances = visibleLists[v].distances.data();
+            uint32_t count = numVisible[v];
+            unsigned long lane;
+            while (_BitScanForward(&lane, mask))
+            {
+                indices[count] = (uint32_t)(base + lane);
+                outDistances[count] = distances[lane];
+                count++;
+                mask &= mask - 1;
+            }
+            numVisible[v] = count;
+        }
+    }
+}
+
+void SphereCuller::CullAVX(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+    VisibleList* visibleLists, uint32_t* numVisible) const
+{
+    const __m256 zero = _mm256_setzero_ps();
+    alignas(32) float distances[8];
+
+    for (size_t base = begin & ~size_t(7); base < end; base += 8)
+    {
+        // lanes of this batch that fall inside [begin, end)
+        unsigned long rangeMask = 0xFF;
+        if (base < begin)
+            rangeMask &= 0xFF << (begin - base);
+        if (base + 8 > end)
+            rangeMask &= 0xFF >> (base + 8 - end);
+
+        __m256 x = _mm256_loadu_ps(&mCenterX[base]);
+        __m256 y = _mm256_loadu_ps(&mCenterY[base]);
+        __m256 z = _mm256_loadu_ps(&mCenterZ[base]);
+        __m256 r = _mm256_loadu_ps(&mRadius[base]);
+
+        unsigned long v;
+        for (unsigned long viewBits = viewMask; _BitScanForward(&v, viewBits); viewBits &= viewBits - 1)
+        {
+            const ViewPlanes& view = views[v];
+            unsigned long mask = rangeMask;
+            if (!acceptAll)
+            {
+                __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for (int i = 0; i < Math::Frustum::kNumPlanes; i++)
+                {
+                    const float* plane = view.planes[i];
+                    __m256 d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane[0])), _mm256_mul_ps(y, _mm256_set1_ps(plane[1])));
+                    d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(plane[2])));
+                    d = _mm256_add_ps(d, _mm256_add_ps(_mm256_set1_ps(plane[3]), r));
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, zero, _CMP_GE_OQ));
+                }
+                mask &= (unsigned long)_mm256_movemask_ps(inside);
+            }
+
+            if (mask == 0)
+                continue;
+
+            const float* depth = view.planes[Math::Frustum::kNumPlanes];
+            __m256 d = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(depth[0])), _mm256_mul_ps(y, _mm256_set1_ps(depth[1])));
+            d = _mm256_add_ps(d, _mm256_mul_ps(z, _mm256_set1_ps(depth[2])));
+            d = _mm256_sub_ps(_mm256_add_ps(d, _mm256_set1_ps(depth[3])), r);
+            _mm256_store_ps(distances, d);
+
+            uint32_t* indices = visibleLists[v].indices.data();
+            float* outDistances = visibleLists[v].distances.data();
+            uint32_t count = numVisible[v];
+            unsigned long lane;
+            while (_BitScanForward(&lane, mask))
+            {
+                indices[count] = (uint32_t)(base + lane);
+                outDistances[count] = distances[lane];
+                count++;
+                mask &= mask - 1;
+            }
+            numVisible[v] = count;
+        }
+    }
+}
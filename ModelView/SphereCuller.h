@@ -0,0 +1,79 @@
+#pragma once
+#include "Math/VectorMath.h"
+#include "Math/Frustum.h"
+#include "Utils/DebugUtils.h"
+
+#include <vector>
+
+// World space bounding spheres stored as SoA float arrays, so a batch of 4 (SSE) or 8 (AVX) spheres
+// is tested against every plane of every view with a few vector instructions. The sphere count is
+// padded to a whole AVX batch with spheres that always fail the plane test.
+class SphereCuller
+{
+public:
+    static constexpr size_t kMaxViews = 8;
+
+    // Loop CullRange runs, the widest one the CPU has unless a test or benchmark picks another.
+    // kCullAVX falls back to kCullSSE without AVX.
+    enum eCullPath { kCullScalar, kCullSSE, kCullAVX };
+    static eCullPath GetCullPath();
+    static void SetCullPath(eCullPath path);
+
+    struct CullView
+    {
+        const Math::Frustum* frustumWS;
+        const Math::Matrix4* viewMatrix;
+    };
+
+    // Compact list of the spheres that survived one view
+    struct VisibleList
+    {
+        std::vector<uint32_t> indices;
+        std::vector<float> distances; // view space depth of the nearest point, -z - radius
+    };
+
+    SphereCuller() : mCount(0) {}
+
+    void Resize(size_t count);
+    size_t GetCount() const { return mCount; }
+
+    void SetSphere(size_t index, const Math::BoundingSphere& sphereWS)
+    {
+        ASSERT(index < mCount);
+        mCenterX[index] = sphereWS.GetCenter().GetX();
+        mCenterY[index] = sphereWS.GetCenter().GetY();
+        mCenterZ[index] = sphereWS.GetCenter().GetZ();
+        mRadius[index] = sphereWS.GetRadius();
+    }
+
+    // AABB around spheres [begin, end)
+    void GetBounds(size_t begin, size_t end, float boundsMin[3], float boundsMax[3]) const;
+
+    // Frustum and depth row splatted for the SIMD loops
+    struct ViewPlanes
+    {
+        float planes[Math::Frustum::kNumPlanes + 1][4];
+    };
+    static ViewPlanes MakeViewPlanes(const CullView& view);
+
+    // Range culling for a hierarchy walk: BeginCull per view, CullRange for every range the walk reaches, EndCull.
+    // One sweep over the range fills visibleLists[v] for every view v set in viewMask. acceptAll appends the
+    // whole range without plane tests, for subtrees known to be inside those views.
+    void BeginCull(VisibleList& visibleList, uint32_t& numVisible) const;
+    void CullRange(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+        VisibleList* visibleLists, uint32_t* numVisible) const;
+    void EndCull(VisibleList& visibleList, uint32_t numVisible) const;
+private:
+    void CullScalar(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+        VisibleList* visibleLists, uint32_t* numVisible) const;
+    void CullSSE(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+        VisibleList* visibleLists, uint32_t* numVisible) const;
+    void CullAVX(const ViewPlanes* views, uint32_t viewMask, size_t begin, size_t end, bool acceptAll,
+        VisibleList* visibleLists, uint32_t* numVisible) const;
+private:
+    size_t mCount;
+    std::vector<float> mCenterX;
+    std::vector<float> mCenterY;
+    std::vector<float> mCenterZ;
+    std::vector<float> mRadius;
+};
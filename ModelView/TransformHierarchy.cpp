@@ -0,0 +1,274 @@
+#include "TransformHierarchy.h"
+#include "Utils/ThreadPoolExecutor.h"
+#include "Utils/DebugUtils.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+using namespace Math;
+
+namespace
+{
+    constexpr size_t kLanes = 4;
+
+    // consecutive nodes load and store whole vectors, anything else goes lane by lane
+    __m128 Gather(const std::vector<float>& values, const uint32_t* indices, bool isContiguous)
+    {
+        if (isContiguous)
+            return _mm_loadu_ps(&values[indices[0]]);
+        return _mm_setr_ps(values[indices[0]], values[indices[1]], values[indices[2]], values[indices[3]]);
+    }
+
+    void Scatter(std::vector<float>& values, const uint32_t* indices, bool isContiguous, __m128 lanes)
+    {
+        if (isContiguous)
+        {
+            _mm_storeu_ps(&values[indices[0]], lanes);
+            return;
+        }
+
+        alignas(16) float laneValues[kLanes];
+        _mm_store_ps(laneValues, lanes);
+        for (size_t i = 0; i < kLanes; i++)
+            values[indices[i]] = laneValues[i];
+    }
+}
+
+void TransformHierarchy::Resize(size_t numNodes, uint32_t numFrameSlots)
+{
+    ASSERT(numFrameSlots > 0 && numFrameSlots <= kMaxFrameSlots);
+    mNumFrameSlots = numFrameSlots;
+
+    for (uint32_t i = 0; i < kNumLocalComponents; i++)
+    {
+        bool isOne = i == kRotationW || i >= kScaleX;
+        mLocals[i].assign(numNodes, isOne ? 1.0f : 0.0f);
+    }
+    for (uint32_t i = 0; i < kNumWorldComponents; i++)
+        mWorlds[i].assign(numNodes + 1, i / 4 == i % 4 ? 1.0f : 0.0f);
+    mParents.assign(numNodes, kInvalidIndex);
+    mDepths.assign(numNodes, 0);
+
+    mDirty.assign(numNodes, 1);
+    mHasDirty = numNodes > 0;
+    mDirtyLevels.clear();
+    mDirtyLevels.resize(1);
+
+    mStaleSlots.assign(numNodes, 0);
+    for (std::vector<uint32_t>& staleNodes : mStaleNodes)
+        staleNodes.clear();
+}
+
+void TransformHierarchy::SetNode(uint32_t index, uint32_t parent, const XMFLOAT3& position, const XMFLOAT4& rotation,
+    const XMFLOAT3& scale)
+{
+    ASSERT(parent == kInvalidIndex || parent < index);
+    mParents[index] = parent;
+    mDepths[index] = parent == kInvalidIndex ? 0 : mDepths[parent] + 1;
+    if (mDepths[index] >= mDirtyLevels.size())
+        mDirtyLevels.resize(mDepths[index] + 1);
+
+    SetLocal(index, position, rotation, scale);
+}
+
+void TransformHierarchy::SetLocal(uint32_t index, const XMFLOAT3& position, const XMFLOAT4& rotation, const XMFLOAT3& scale)
+{
+    mLocals[kPositionX][index] = position.x;
+    mLocals[kPositionY][index] = position.y;
+    mLocals[kPositionZ][index] = position.z;
+    mLocals[kRotationX][index] = rotation.x;
+    mLocals[kRotationY][index] = rotation.y;
+    mLocals[kRotationZ][index] = rotation.z;
+    mLocals[kRotationW][index] = rotation.w;
+    mLocals[kScaleX][index] = scale.x;
+    mLocals[kScaleY][index] = scale.y;
+    mLocals[kScaleZ][index] = scale.z;
+    mDirty[index] = 1;
+    mHasDirty = true;
+}
+
+XMFLOAT3 TransformHierarchy::GetPosition(uint32_t index) const
+{
+    return XMFLOAT3(mLocals[kPositionX][index], mLocals[kPositionY][index], mLocals[kPositionZ][index]);
+}
+
+XMFLOAT4 TransformHierarchy::GetRotation(uint32_t index) const
+{
+    return XMFLOAT4(mLocals[kRotationX][index], mLocals[kRotationY][index], mLocals[kRotationZ][index], mLocals[kRotationW][index]);
+}
+
+XMFLOAT3 TransformHierarchy::GetScale(uint32_t index) const
+{
+    return XMFLOAT3(mLocals[kScaleX][index], mLocals[kScaleY][index], mLocals[kScaleZ][index]);
+}
+
+AffineTransform TransformHierarchy::GetWorld(uint32_t index) const
+{
+    float rows[3][4];
+    GetWorldRows(index, rows);
+    return AffineTransform(Vector3(rows[0][0], rows[1][0], rows[2][0]), Vector3(rows[0][1], rows[1][1], rows[2][1]),
+        Vector3(rows[0][2], rows[1][2], rows[2][2]), Vector3(rows[0][3], rows[1][3], rows[2][3]));
+}
+
+void TransformHierarchy::GetWorldRows(uint32_t index, float rows[3][4]) const
+{
+    ASSERT(index < mParents.size());
+    for (uint32_t i = 0; i < kNumWorldComponents; i++)
+        rows[i / 4][i % 4] = mWorlds[i][index];
+}
+
+size_t TransformHierarchy::Update()
+{
+    ZoneScoped;
+    for (std::vector<uint32_t>& level : mDirtyLevels)
+        level.clear();
+    if (!mHasDirty)
+        return 0;
+
+    // parents come first, so one forward pass pushes the flags down whole subtrees
+    size_t numDirty = 0;
+    for (uint32_t i = 0; i < (uint32_t)mParents.size(); i++)
+    {
+        uint32_t parent = mParents[i];
+        if (parent != kInvalidIndex && mDirty[parent])
+            mDirty[i] = 1;
+        if (mDirty[i])
+        {
+            mDirtyLevels[mDepths[i]].push_back(i);
+            numDirty++;
+        }
+    }
+
+    for (const std::vector<uint32_t>& level : mDirtyLevels)
+    {
+        size_t numBatches = (level.size() + kLanes - 1) / kLanes;
+        Utility::gThreadPoolExecutor.ParallelFor(0, numBatches, kBatchSize / kLanes, [this, &level](size_t batch)
+        {
+            size_t first = batch * kLanes;
+            UpdateNodes(&level[first], std::min(kLanes, level.size() - first));
+        });
+    }
+
+    uint8_t allSlots = (uint8_t)((1u << mNumFrameSlots) - 1);
+    for (const std::vector<uint32_t>& level : mDirtyLevels)
+    {
+        for (uint32_t index : level)
+        {
+            mDirty[index] = 0;
+            for (uint32_t slot = 0; slot < mNumFrameSlots; slot++)
+            {
+                if ((mStaleSlots[index] & (1u << slot)) == 0)
+                    mStaleNodes[slot].push_back(index);
+            }
+            mStaleSlots[index] = allSlots;
+        }
+    }
+
+    mHasDirty = false;
+    return numDirty;
+}
+
+void TransformHierarchy::TakeStaleRanges(uint32_t frameSlot, std::vector<Range>& ranges)
+{
+    ASSERT(frameSlot < mNumFrameSlots);
+    ranges.clear();
+
+    std::vector<uint32_t>& staleNodes = mStaleNodes[frameSlot];
+    if (staleNodes.empty())
+        return;
+
+    uint8_t slotMask = (uint8_t)~(1u << frameSlot);
+    if (staleNodes.size() * 2 >= mParents.size())
+    {
+        // most of the scene moved, one range is cheaper than sorting
+        ranges.push_back({ 0, (uint32_t)mParents.size() });
+        for (uint8_t& staleSlots : mStaleSlots)
+            staleSlots &= slotMask;
+    }
+    else
+    {
+        std::sort(staleNodes.begin(), staleNodes.end());
+        for (uint32_t index : staleNodes)
+        {
+            mStaleSlots[index] &= slotMask;
+            if (!ranges.empty() && ranges.back().first + ranges.back().count == index)
+                ranges.back().count++;
+            else
+                ranges.push_back({ index, 1 });
+        }
+    }
+    staleNodes.clear();
+}
+
+void TransformHierarchy::UpdateNodes(const uint32_t* nodes, size_t count)
+{
+    ASSERT(count > 0 && count <= kLanes);
+    uint32_t indices[kLanes];
+    uint32_t parents[kLanes];
+    bool isRootBatch = true;
+    bool areParentsContiguous = true;
+    for (size_t i = 0; i < kLanes; i++)
+    {
+        indices[i] = nodes[std::min(i, count - 1)];
+        uint32_t parent = mParents[indices[i]];
+        parents[i] = parent == kInvalidIndex ? (uint32_t)mParents.size() : parent;
+        isRootBatch = isRootBatch && parent == kInvalidIndex;
+        areParentsContiguous = areParentsContiguous && parents[i] == parents[0] + i;
+    }
+    // a level is ascending, so a full batch spanning kLanes - 1 is consecutive
+    bool isContiguous = count == kLanes && indices[kLanes - 1] == indices[0] + kLanes - 1;
+
+    // rotation matrix rows of the quaternion, the same terms as XMMatrixRotationQuaternion
+    __m128 qx = Gather(mLocals[kRotationX], indices, isContiguous);
+    __m128 qy = Gather(mLocals[kRotationY], indices, isContiguous);
+    __m128 qz = Gather(mLocals[kRotationZ], indices, isContiguous);
+    __m128 qw = Gather(mLocals[kRotationW], indices, isContiguous);
+    __m128 x2 = _mm_add_ps(qx, qx);
+    __m128 y2 = _mm_add_ps(qy, qy);
+    __m128 z2 = _mm_add_ps(qz, qz);
+    __m128 xx = _mm_mul_ps(qx, x2);
+    __m128 yy = _mm_mul_ps(qy, y2);
+    __m128 zz = _mm_mul_ps(qz, z2);
+    __m128 xy = _mm_mul_ps(qx, y2);
+    __m128 xz = _mm_mul_ps(qx, z2);
+    __m128 yz = _mm_mul_ps(qy, z2);
+    __m128 wx = _mm_mul_ps(qw, x2);
+    __m128 wy = _mm_mul_ps(qw, y2);
+    __m128 wz = _mm_mul_ps(qw, z2);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    // local[column][component], the basis scaled per axis then the translation
+    __m128 sx = Gather(mLocals[kScaleX], indices, isContiguous);
+    __m128 sy = Gather(mLocals[kScaleY], indices, isContiguous);
+    __m128 sz = Gather(mLocals[kScaleZ], indices, isContiguous);
+    __m128 local[4][3] = {
+        { _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx), _mm_mul_ps(_mm_add_ps(xy, wz), sx), _mm_mul_ps(_mm_sub_ps(xz, wy), sx) },
+        { _mm_mul_ps(_mm_sub_ps(xy, wz), sy), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy), _mm_mul_ps(_mm_add_ps(yz, wx), sy) },
+        { _mm_mul_ps(_mm_add_ps(xz, wy), sz), _mm_mul_ps(_mm_sub_ps(yz, wx), sz), _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz) },
+        { Gather(mLocals[kPositionX], indices, isContiguous), Gather(mLocals[kPositionY], indices, isContiguous),
+            Gather(mLocals[kPositionZ], indices, isContiguous) } };
+
+    if (isRootBatch)
+    {
+        for (uint32_t i = 0; i < kNumWorldComponents; i++)
+            Scatter(mWorlds[i], indices, isContiguous, local[i % 4][i / 4]);
+        return;
+    }
+
+    // world = parent * local, row r of each column mixes row r of the parent basis
+    for (uint32_t row = 0; row < 3; row++)
+    {
+        __m128 parent[4];
+        for (uint32_t column = 0; column < 4; column++)
+            parent[column] = Gather(mWorlds[row * 4 + column], parents, areParentsContiguous);
+
+        for (uint32_t column = 0; column < 4; column++)
+        {
+            __m128 world = _mm_add_ps(_mm_mul_ps(parent[0], local[column][0]), _mm_mul_ps(parent[1], local[column][1]));
+            world = _mm_add_ps(world, _mm_mul_ps(parent[2], local[column][2]));
+            if (column == 3)
+                world = _mm_add_ps(world, parent[3]);
+            Scatter(mWorlds[row * 4 + column], indices, isContiguous, world);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Math/VectorMath.h"
+
+#include <vector>
+
+// Local TRS, parent and world transform of every model of a scene as SoA float arrays, indexed like
+// the models themselves with parents before children. Moving a node marks it dirty, Update recomputes
+// the dirty nodes and their subtrees one depth level at a time: nodes of a level only read worlds of
+// the level above, so each level is split across gThreadPoolExecutor, and within a job 4 nodes share
+// every SSE instruction of the matrix math.
+// Recomputed nodes stay stale for every frame slot until TakeStaleRanges hands them to its upload.
+class TransformHierarchy
+{
+public:
+    static constexpr uint32_t kInvalidIndex = (uint32_t)-1;
+    static constexpr uint32_t kMaxFrameSlots = 8;
+    static constexpr size_t kBatchSize = 256; // nodes per thread pool job
+
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    TransformHierarchy() : mNumFrameSlots(1) {}
+
+    // Every node becomes an identity root and dirty
+    void Resize(size_t numNodes, uint32_t numFrameSlots);
+    size_t GetSize() const { return mParents.size(); }
+
+    // parent must come before index, or be kInvalidIndex for a root
+    void SetNode(uint32_t index, uint32_t parent, const Math::XMFLOAT3& position, const Math::XMFLOAT4& rotation,
+        const Math::XMFLOAT3& scale);
+    void SetLocal(uint32_t index, const Math::XMFLOAT3& position, const Math::XMFLOAT4& rotation, const Math::XMFLOAT3& scale);
+
+    uint32_t GetParent(uint32_t index) const { return mParents[index]; }
+    Math::XMFLOAT3 GetPosition(uint32_t index) const;
+    Math::XMFLOAT4 GetRotation(uint32_t index) const;
+    Math::XMFLOAT3 GetScale(uint32_t index) const;
+    Math::AffineTransform GetWorld(uint32_t index) const;
+
+    // The world as the three rows of a 3x4 matrix, X, Y, Z basis and translation in the columns.
+    // Same layout as ModelTransform, so the upload copies it as is.
+    void GetWorldRows(uint32_t index, float rows[3][4]) const;
+
+    // Recomputes the world transform of the dirty nodes and everything below them, returns how many
+    size_t Update();
+
+    // The nodes the last Update recomputed, ascending within each depth level, empty if none
+    const std::vector<std::vector<uint32_t>>& GetUpdatedLevels() const { return mDirtyLevels; }
+
+    // Nodes recomputed since frameSlot was last taken, merged into ascending ranges
+    void TakeStaleRanges(uint32_t frameSlot, std::vector<Range>& ranges);
+private:
+    // locals of nodes[0, 4) times the worlds of their parents, count < 4 repeats the last node
+    void UpdateNodes(const uint32_t* nodes, size_t count);
+private:
+    enum LocalComponent { kPositionX, kPositionY, kPositionZ, kRotationX, kRotationY, kRotationZ, kRotationW,
+        kScaleX, kScaleY, kScaleZ, kNumLocalComponents };
+    static constexpr uint32_t kNumWorldComponents = 12; // row * 4 + column of the 3x4 matrix
+
+    std::vector<float> mLocals[kNumLocalComponents];
+    std::vector<float> mWorlds[kNumWorldComponents]; // one extra identity node, the parent of every root
+    std::vector<uint32_t> mParents;
+    std::vector<uint32_t> mDepths;
+
+    std::vector<uint8_t> mDirty;
+    bool mHasDirty = false;
+    std::vector<std::vector<uint32_t>> mDirtyLevels; // dirty nodes of each depth, ascending
+
+    uint32_t mNumFrameSlots;
+    std::vector<uint8_t> mStaleSlots; // bit per frame slot that has not seen the latest world
+    std::vector<uint32_t> mStaleNodes[kMaxFrameSlots];
+};
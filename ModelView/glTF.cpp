@@ -176,7 +176,7 @@ void glTF::Asset::ProcessAccessors( json& accessors )
         json& thisAccessor = *it;
 
         glTF::BufferView& bufferView = m_bufferViews[thisAccessor["bufferView"].GetUint()];
-        accessor.dataPtr = m_buffers[bufferView.buffer].get()->data() + bufferView.byteOffset;
+        accessor.dataPtr = m_buffers[bufferView.buffer].data + bufferView.byteOffset;
         accessor.stride = bufferView.byteStride;
         if (thisAccessor.HasMember("byteOffset"))
             accessor.dataPtr += thisAccessor["byteOffset"].GetUint64();
@@ -398,7 +398,7 @@ void glTF::Asset::ProcessMaterials( json& materials )
     }
 }
 
-void glTF::Asset::ProcessBuffers( json& buffers, ByteArray chunk1bin )
+void glTF::Asset::ProcessBuffers( json& buffers, const Buffer& chunk1bin )
 {
     m_buffers.reserve(buffers.GetArray().Size());
 
@@ -411,14 +411,30 @@ void glTF::Asset::ProcessBuffers( json& buffers, ByteArray chunk1bin )
             std::filesystem::path uri = thisBuffer["uri"].GetString();
             std::filesystem::path filepath = m_basePath / uri;
 
-            //ASSERT(ba->size() > 0, "Missing bin file %ws", filepath.c_str());
+            Buffer buffer = {};
+            buffer.mappedFile = Utility::MapFile(filepath);
+            if (buffer.mappedFile != nullptr)
+            {
+                buffer.data = buffer.mappedFile->data();
+                buffer.byteLength = buffer.mappedFile->size();
+            }
+            else
+            {
+                // only a zipped copy (or nothing) on disk
+                buffer.byteArray = Utility::ReadFileSync(filepath);
+                buffer.data = buffer.byteArray->data();
+                buffer.byteLength = buffer.byteArray->size();
+            }
+
+            ASSERT(buffer.byteLength > 0, "Missing bin file %ws", filepath.c_str());
 
-            m_buffers.emplace_back(Utility::ReadFileSync(filepath));
+            m_buffers.push_back(buffer);
+            m_sourcePaths.push_back(filepath);
         }
         else
         {
             ASSERT(it == buffers.GetArray().Begin(), "Only the 1st buffer allowed to be internal");
-            ASSERT(chunk1bin->size() > 0, "GLB chunk1 missing data or not a GLB file");
+            ASSERT(chunk1bin.byteLength > 0, "GLB chunk1 missing data or not a GLB file");
             m_buffers.push_back(chunk1bin);
         }
     }
@@ -644,20 +660,42 @@ void glTF::Asset::Parse(const std::filesystem::path& filepath)
     //https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#glb-file-format-specification
 
     ByteArray gltfFile;
-    ByteArray chunk1Bin;
+    Buffer chunk1Bin = {};
+    rapidjson::Document document;
 
     std::filesystem::path fileExt = filepath.extension();
 
     if (fileExt == L".glb")
     {
-        std::ifstream glbFile(filepath, std::ios::in | std::ios::binary);
+        // The binary chunk is referenced in place, the mapping stays alive through m_buffers[0]
+        MappedFileRef glbFile = Utility::MapFile(filepath);
+        if (glbFile == nullptr)
+        {
+            Utility::PrintMessage("Error:  Could not open %ws\n", filepath.c_str());
+            return;
+        }
+
         struct GLBHeader
         {
             char magic[4];
             uint32_t version;
             uint32_t length;
-        } header;
-        glbFile.read((char*)&header, sizeof(GLBHeader));
+        };
+        struct GLBChunkHeader
+        {
+            uint32_t length;
+            char type[4];
+        };
+
+        const byte* glbData = glbFile->data();
+        const byte* glbEnd = glbData + glbFile->size();
+        if (glbFile->size() < sizeof(GLBHeader) + sizeof(GLBChunkHeader))
+        {
+            Utility::Print("Error:  Invalid glTF binary format\n");
+            return;
+        }
+
+        const GLBHeader& header = *(const GLBHeader*)glbData;
         if (strncmp(header.magic, "glTF", 4) != 0)
         {
             Utility::Print("Error:  Invalid glTF binary format\n");
@@ -669,31 +707,33 @@ void glTF::Asset::Parse(const std::filesystem::path& filepath)
             return;
         }
 
-        uint32_t chunk0Length;
-        char chunk0Type[4];
-        glbFile.read((char*)&chunk0Length, 4);
-        glbFile.read((char*)&chunk0Type, 4);
-        if (strncmp(chunk0Type, "JSON", 4) != 0)
+        const GLBChunkHeader& chunk0 = *(const GLBChunkHeader*)(glbData + sizeof(GLBHeader));
+        const byte* chunk0Data = (const byte*)(&chunk0 + 1);
+        if (strncmp(chunk0.type, "JSON", 4) != 0 || chunk0.length > size_t(glbEnd - chunk0Data))
         {
             Utility::Print("Error: Expected chunk0 to contain JSON\n");
             return;
         }
-        gltfFile = std::make_shared<std::vector<byte>>( chunk0Length + 1 );
-        glbFile.read((char*)gltfFile->data(), chunk0Length);
-        (*gltfFile)[chunk0Length] = '\0';
-
-        uint32_t chunk1Length;
-        char chunk1Type[4];
-        glbFile.read((char*)&chunk1Length, 4);
-        glbFile.read((char*)&chunk1Type, 4);
-        if (strncmp(chunk1Type, "BIN", 3) != 0)
+        document.Parse((const char*)chunk0Data, chunk0.length);
+
+        const byte* chunk1Header = chunk0Data + chunk0.length;
+        if (size_t(glbEnd - chunk1Header) < sizeof(GLBChunkHeader))
         {
             Utility::Print("Error: Expected chunk1 to contain BIN\n");
             return;
-       }
+        }
 
-        chunk1Bin = std::make_shared<std::vector<byte>>(chunk1Length);
-        glbFile.read((char*)chunk1Bin->data(), chunk1Length);
+        const GLBChunkHeader& chunk1 = *(const GLBChunkHeader*)chunk1Header;
+        const byte* chunk1Data = (const byte*)(&chunk1 + 1);
+        if (strncmp(chunk1.type, "BIN", 3) != 0 || chunk1.length > size_t(glbEnd - chunk1Data))
+        {
+            Utility::Print("Error: Expected chunk1 to contain BIN\n");
+            return;
+        }
+
+        chunk1Bin.mappedFile = glbFile;
+        chunk1Bin.data = chunk1Data;
+        chunk1Bin.byteLength = chunk1.length;
     }
     else 
     {
@@ -705,11 +745,9 @@ void glTF::Asset::Parse(const std::filesystem::path& filepath)
             return;
 
         gltfFile->push_back('\0');
-        chunk1Bin = std::make_shared<std::vector<byte>>(0);
+        document.Parse((const char*)gltfFile->data());
     }
 
-    rapidjson::Document document;
-    document.Parse((const char*)gltfFile->data());
     if (!document.IsObject())
     {
         Utility::PrintMessage("Invalid glTF file: %s\n", filepath.c_str());
@@ -718,6 +756,7 @@ void glTF::Asset::Parse(const std::filesystem::path& filepath)
 
     // Strip off file name to get root path to other related files
     m_basePath = filepath.parent_path();
+    m_sourcePaths.push_back(filepath);
 
 #undef GetObject // windows confit
     // Parse all state
@@ -16,8 +16,18 @@ namespace glTF
 {
     using json = const rapidjson::Value;
     using Utility::ByteArray;
+    using Utility::MappedFileRef;
     using Utility::byte;
 
+    // Points into a mapped .bin/.glb file, or into a heap copy when the file only exists as .gz
+    struct Buffer
+    {
+        MappedFileRef mappedFile;
+        ByteArray byteArray;
+        const byte* data;
+        size_t byteLength;
+    };
+
     struct BufferView
     {
         uint32_t buffer;
@@ -51,7 +61,7 @@ namespace glTF
             kMat4
         };
 
-        byte* dataPtr;
+        const byte* dataPtr;
         uint32_t stride;
         uint32_t count; // number of elements
         uint16_t componentType;
@@ -232,13 +242,14 @@ namespace glTF
         std::vector<Accessor> m_accessors;
         std::vector<Skin> m_skins;
         std::vector<Material> m_materials;
-        std::vector<ByteArray> m_buffers;
+        std::vector<Buffer> m_buffers;
+        std::vector<std::filesystem::path> m_sourcePaths; // the .gltf/.glb and every external buffer it loaded
         ByteArray m_trunkBuffer;
         std::vector<BufferView> m_bufferViews;
         std::vector<Animation> m_animations;
 
     private:
-        void ProcessBuffers( json& buffers, ByteArray chunk1bin );
+        void ProcessBuffers( json& buffers, const Buffer& chunk1bin );
         void ProcessBufferViews( json& bufferViews );
         void ProcessAccessors( json& accessors );
         void ProcessMaterials( json& materials );
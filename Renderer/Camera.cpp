@@ -209,7 +209,8 @@ void ShadowCamera::GetDivideCSMCameras(std::vector<ShadowCamera>& shadowCameras,
 {
     ASSERT(numDivides > 0);
 
-    std::vector<Math::Camera> allDividesCamera(numDivides + 1, mainCamera);
+    // one cascade camera at a time is enough, its frustum is consumed right away
+    Math::Camera divideCamera = mainCamera;
     shadowCameras.resize(numDivides + 1);
 
     float* zDivides_0 = (float*)alloca(maxNumDivides * 4);
@@ -218,10 +219,10 @@ void ShadowCamera::GetDivideCSMCameras(std::vector<ShadowCamera>& shadowCameras,
     {
         float nearZ = i == 0 ? mainCamera.GetNearClip() : zDivides_0[i - 1];
         float farZ = i < numDivides ? zDivides_0[i] : mainCamera.GetFarClip();
-        allDividesCamera[i].SetZRange(nearZ, farZ);
-        allDividesCamera[i].Update();
+        divideCamera.SetZRange(nearZ, farZ);
+        divideCamera.Update();
 
-        shadowCameras[i].UpdateMatrix(lightDirection, allDividesCamera[i].GetWorldSpaceFrustum(), cameraNearstZOffset,
+        shadowCameras[i].UpdateMatrix(lightDirection, divideCamera.GetWorldSpaceFrustum(), cameraNearstZOffset,
             bufferWidth, bufferHeight, bufferPrecision);
     }
 }
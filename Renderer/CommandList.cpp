@@ -4,6 +4,7 @@
 #include "PixelBuffer.h"
 #include "PipelineState.h"
 #include "RootSignature.h"
+#include "CommandSignature.h"
 #include "Graphics.h"
 #include "CommandQueue.h"
 
@@ -15,6 +16,11 @@
     | D3D12_RESOURCE_STATE_COPY_DEST \
     | D3D12_RESOURCE_STATE_COPY_SOURCE )
 
+#define VALID_COPY_QUEUE_RESOURCE_STATES \
+    ( D3D12_RESOURCE_STATE_COMMON \
+    | D3D12_RESOURCE_STATE_COPY_DEST \
+    | D3D12_RESOURCE_STATE_COPY_SOURCE )
+
 CommandList::CommandList(D3D12_COMMAND_LIST_TYPE Type) :
     mType(Type),
     mCommandList(nullptr),
@@ -23,7 +29,6 @@ CommandList::CommandList(D3D12_COMMAND_LIST_TYPE Type) :
     mCurComputeRootSignature(nullptr),
     mCurPipelineState(nullptr),
     mNumBarriersToFlush(0),
-    mCpuLinearAllocator(kCpuWritable),
     mGpuLinearAllocator(kGpuExclusive),
     mCommandListIndex(0),
     mRetiredFenceValue(0)
@@ -37,9 +42,10 @@ CommandList* CommandList::Reset()
     CheckHR(mCommandAllocator->Reset());
     CheckHR(mCommandList->Reset(mCommandAllocator.Get(), nullptr));
 
-    mCpuLinearAllocator.CleanupUsedPages();
+    // pages still held here were never submitted, the GPU has not seen them
+    UploadPagePool::Retire(mUploadPages, Graphics::GetQueueType(mType), 0);
     mGpuLinearAllocator.CleanupUsedPages();
-    mResourceStateCache.clear();
+    mResourceStateCache.Clear();
 
     mCurGraphicsRootSignature = nullptr;
     mCurComputeRootSignature = nullptr;
@@ -53,6 +59,11 @@ CommandList* CommandList::Reset()
     return this;
 }
 
+void CommandList::RetireUploadPages(uint64_t fenceValue)
+{
+    UploadPagePool::Retire(mUploadPages, Graphics::GetQueueType(mType), fenceValue);
+}
+
 CommandList& CommandList::Begin(const std::wstring& id)
 {
     PIXBeginEvent(id.c_str());
@@ -106,6 +117,13 @@ void CommandList::ExceptResourceBeginState(GpuResource& resource, D3D12_RESOURCE
 {
     ResourceStateCache& resStatae = GetResourceStateCache(resource);
 
+    if (mCommandListIndex != 0 && resStatae.mStateBegin == (D3D12_RESOURCE_STATES)-1)
+    {
+        resStatae.mStateBegin = newState;
+        resStatae.mStateCurrent = newState;
+        return;
+    }
+
     if (newState == resStatae.mStateCurrent)
         return;
 
@@ -126,6 +144,15 @@ void CommandList::TransitionResource(GpuResource& resource, D3D12_RESOURCE_STATE
 {
     ResourceStateCache& resStatae = GetResourceStateCache(resource);
 
+    // a later commandList can't see the state left by the lists before it, so its first use becomes
+    // the begin state and the frame context transitions the previous list into it
+    if (mCommandListIndex != 0 && resStatae.mStateBegin == (D3D12_RESOURCE_STATES)-1)
+    {
+        resStatae.mStateBegin = newState;
+        resStatae.mStateCurrent = newState;
+        return;
+    }
+
     D3D12_RESOURCE_STATES oldState = resStatae.mStateCurrent;
 
     if (mType == D3D12_COMMAND_LIST_TYPE_COMPUTE)
@@ -133,6 +160,11 @@ void CommandList::TransitionResource(GpuResource& resource, D3D12_RESOURCE_STATE
         ASSERT((oldState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == oldState);
         ASSERT((newState & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == newState);
     }
+    else if (mType == D3D12_COMMAND_LIST_TYPE_COPY)
+    {
+        ASSERT((oldState & VALID_COPY_QUEUE_RESOURCE_STATES) == oldState);
+        ASSERT((newState & VALID_COPY_QUEUE_RESOURCE_STATES) == newState);
+    }
 
     if (oldState != newState)
     {
@@ -173,6 +205,13 @@ void CommandList::TransitionResource(ResourceStateCache& curStateCache, Resource
     {
         ASSERT((newStateCahce.mStateCurrent & VALID_COMPUTE_QUEUE_RESOURCE_STATES) == newStateCahce.mStateCurrent);
     }
+    else if (mType == D3D12_COMMAND_LIST_TYPE_COPY)
+    {
+        ASSERT((newStateCahce.mStateCurrent & VALID_COPY_QUEUE_RESOURCE_STATES) == newStateCahce.mStateCurrent);
+    }
+
+    if (mNumBarriersToFlush == MAX_BARRIERS_CACHE_FLUSH)
+        FlushResourceBarriers();
 
     D3D12_RESOURCE_BARRIER& barrierDesc = mResourceBarrierBuffer[mNumBarriersToFlush++];
 
@@ -254,8 +293,8 @@ void CommandList::FlushResourceBarriers()
 void CommandList::UpdateResourceState()
 {
     // now resource has real state
-    for (auto& resourceCache : mResourceStateCache)
-        resourceCache.second.mGpuResource.mUsageState = resourceCache.second.mStateCurrent;
+    for (ResourceStateCache& resourceCache : mResourceStateCache)
+        resourceCache.mGpuResource.mUsageState = resourceCache.mStateCurrent;
 }
 
 void CommandList::SetDescriptorHeap(D3D12_DESCRIPTOR_HEAP_TYPE type, ID3D12DescriptorHeap* heapPtr)
@@ -337,13 +376,7 @@ void CommandList::BindDescriptorHeaps()
 
 ResourceStateCache& CommandList::GetResourceStateCache(GpuResource& resource)
 {
-    size_t resourceHash = Utility::HashState(&resource);
-    auto findIter = mResourceStateCache.find(resourceHash);
-    if (findIter != mResourceStateCache.end())
-        return findIter->second;
-
-    auto insertIter = mResourceStateCache.emplace(resourceHash, resource);
-    return insertIter.first->second;
+    return mResourceStateCache.FindOrAdd(resource);
 }
 
 
@@ -437,19 +470,19 @@ void CopyCommandList::InitializeTexture(GpuResource& dest, UINT numSubresources,
     UINT64 uploadBufferSize = GetRequiredIntermediateSize(dest.GetResource(), 0, numSubresources);
 
     // copy data to the intermediate upload heap and then schedule a copy from the upload heap to the default texture
-    AllocSpan span = mCpuLinearAllocator.Allocate(uploadBufferSize);
-    UpdateSubresources(mCommandList.Get(), dest.GetResource(), span.mPage.GetResource(), 0, 0, numSubresources, subData);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, uploadBufferSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+    UpdateSubresources(mCommandList.Get(), dest.GetResource(), span.mPage.GetResource(), span.mOffset, 0, numSubresources, subData);
     //TransitionResource(dest, D3D12_RESOURCE_STATE_GENERIC_READ);
 }
 
 void CopyCommandList::InitializeBuffer(GpuBuffer& dest, const void* data, size_t numBytes, size_t destOffset)
 {
-    AllocSpan span = mCpuLinearAllocator.Allocate(numBytes);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, numBytes);
     CopyMemory(span.mCpuAddress, data, numBytes);
 
     // copy data to the intermediate upload heap and then schedule a copy from the upload heap to the default texture
     TransitionResource(dest, D3D12_RESOURCE_STATE_COPY_DEST, true);
-    mCommandList->CopyBufferRegion(dest.GetResource(), destOffset, span.mPage.GetResource(), 0, numBytes);
+    mCommandList->CopyBufferRegion(dest.GetResource(), destOffset, span.mPage.GetResource(), span.mOffset, numBytes);
     //TransitionResource(dest, D3D12_RESOURCE_STATE_GENERIC_READ, true);
 }
 
@@ -464,6 +497,23 @@ void CopyCommandList::InitializeBuffer(GpuBuffer& dest, const UploadBuffer& src,
     //TransitionResource(dest, D3D12_RESOURCE_STATE_GENERIC_READ, true);
 }
 
+void CopyCommandList::CopyBufferRegionDecayed(GpuBuffer& dest, size_t destOffset, UploadBuffer& src, size_t srcOffset, size_t numBytes)
+{
+    ASSERT(mType == D3D12_COMMAND_LIST_TYPE_COPY);
+    GetResourceStateCache(dest).mStateCurrent = D3D12_RESOURCE_STATE_COMMON;
+    mCommandList->CopyBufferRegion(dest.GetResource(), destOffset, src.GetResource(), srcOffset, numBytes);
+}
+
+void CopyCommandList::InitializeBufferDecayed(GpuBuffer& dest, const void* data, size_t numBytes, size_t destOffset)
+{
+    ASSERT(mType == D3D12_COMMAND_LIST_TYPE_COPY);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, numBytes);
+    CopyMemory(span.mCpuAddress, data, numBytes);
+
+    GetResourceStateCache(dest).mStateCurrent = D3D12_RESOURCE_STATE_COMMON;
+    mCommandList->CopyBufferRegion(dest.GetResource(), destOffset, span.mPage.GetResource(), span.mOffset, numBytes);
+}
+
 void CopyCommandList::InitializeTextureArraySlice(GpuResource& dest, UINT sliceIndex, GpuResource& src)
 {
     TransitionResource(dest, D3D12_RESOURCE_STATE_COPY_DEST);
@@ -506,14 +556,14 @@ void CopyCommandList::InitializeTextureArraySlice(GpuResource& dest, UINT sliceI
 void CopyCommandList::WriteBuffer(GpuResource& dest, size_t destOffset, const void* data, size_t numBytes)
 {
     ASSERT(data && Math::IsAligned(data, 4));
-    AllocSpan span = mCpuLinearAllocator.Allocate(numBytes, 4);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, numBytes, 4);
     CopyMemory(span.mCpuAddress, data, numBytes);
     CopyBufferRegion(dest, destOffset, span.mPage, span.mOffset, numBytes);
 }
 
 void CopyCommandList::FillBuffer(GpuResource& dest, size_t destOffset, DWParam value, size_t numBytes)
 {
-    AllocSpan span = mCpuLinearAllocator.Allocate(numBytes, 4);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, numBytes, 4);
     FillMemory(span.mCpuAddress, value.Float, numBytes);
     CopyBufferRegion(dest, destOffset, span.mPage, span.mOffset, numBytes);
 }
@@ -601,7 +651,7 @@ void ComputeCommandList::SetConstantBuffer(UINT rootIndex, D3D12_GPU_VIRTUAL_ADD
 void ComputeCommandList::SetDynamicConstantBufferView(UINT rootIndex, size_t bufferSize, const void* bufferData)
 {
     ASSERT(bufferData);
-    AllocSpan span = mCpuLinearAllocator.Allocate(bufferSize, 256);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, bufferSize, 256);
     CopyMemory(span.mCpuAddress, bufferData, bufferSize);
     mCommandList->SetComputeRootConstantBufferView(rootIndex, span.mGpuAddress);
 }
@@ -609,11 +659,16 @@ void ComputeCommandList::SetDynamicConstantBufferView(UINT rootIndex, size_t buf
 void ComputeCommandList::SetDynamicSRV(UINT rootIndex, size_t bufferSize, const void* bufferData)
 {
     ASSERT(bufferData);
-    AllocSpan span = mCpuLinearAllocator.Allocate(bufferSize);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, bufferSize);
     CopyMemory(span.mCpuAddress, bufferData, bufferSize);
     mCommandList->SetComputeRootShaderResourceView(rootIndex, span.mGpuAddress);
 }
 
+void ComputeCommandList::SetShaderResourceView(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS srv)
+{
+    mCommandList->SetComputeRootShaderResourceView(rootIndex, srv);
+}
+
 void ComputeCommandList::SetBufferSRV(UINT rootIndex, const GpuBuffer& srv, UINT64 offset)
 {
     D3D12_RESOURCE_STATES usageState = GetResourceStateCache(const_cast<GpuBuffer&>(srv)).mStateCurrent;
@@ -854,11 +909,16 @@ void GraphicsCommandList::SetConstantBuffer(UINT rootIndex, D3D12_GPU_VIRTUAL_AD
 void GraphicsCommandList::SetDynamicConstantBufferView(UINT rootIndex, size_t bufferSize, const void* bufferData)
 {
     ASSERT(bufferData);
-    AllocSpan span = mCpuLinearAllocator.Allocate(bufferSize, 256);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, bufferSize, 256);
     CopyMemory(span.mCpuAddress, bufferData, bufferSize);
     mCommandList->SetGraphicsRootConstantBufferView(rootIndex, span.mGpuAddress);
 }
 
+void GraphicsCommandList::SetShaderResourceView(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS srv)
+{
+    mCommandList->SetGraphicsRootShaderResourceView(rootIndex, srv);
+}
+
 void GraphicsCommandList::SetBufferSRV(UINT rootIndex, const GpuBuffer& srv, UINT64 offset)
 {
     D3D12_RESOURCE_STATES usageState = GetResourceStateCache(const_cast<GpuBuffer&>(srv)).mStateCurrent;
@@ -923,7 +983,7 @@ void GraphicsCommandList::SetDynamicVB(UINT slot, size_t numVertices, size_t ver
     ASSERT(vbData != nullptr);
 
     size_t bufferSize = numVertices * vertexStride;
-    AllocSpan span = mCpuLinearAllocator.Allocate(bufferSize);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, bufferSize);
 
     CopyMemory(span.mCpuAddress, vbData, bufferSize);
 
@@ -940,7 +1000,7 @@ void GraphicsCommandList::SetDynamicIB(size_t indexCount, const uint16_t* ibData
     ASSERT(ibData != nullptr);
 
     size_t bufferSize = indexCount * sizeof(uint16_t);
-    AllocSpan span = mCpuLinearAllocator.Allocate(bufferSize);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, bufferSize);
 
     CopyMemory(span.mCpuAddress, ibData, bufferSize);
 
@@ -955,11 +1015,17 @@ void GraphicsCommandList::SetDynamicIB(size_t indexCount, const uint16_t* ibData
 void GraphicsCommandList::SetDynamicSRV(UINT rootIndex, size_t bufferSize, const void* bufferData)
 {
     ASSERT(bufferData);
-    AllocSpan span = mCpuLinearAllocator.Allocate(bufferSize);
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, bufferSize);
     CopyMemory(span.mCpuAddress, bufferData, bufferSize);
     mCommandList->SetGraphicsRootShaderResourceView(rootIndex, span.mGpuAddress);
 }
 
+GraphicsCommandList::UploadSpan GraphicsCommandList::ReserveUploadMemory(size_t sizeInBytes, size_t alignment)
+{
+    AllocSpan span = UploadPagePool::Allocate(mUploadPages, sizeInBytes, alignment);
+    return { span.mCpuAddress, span.mGpuAddress, span.mPage.GetResource(), span.mOffset };
+}
+
 void GraphicsCommandList::Draw(UINT vertexCount, UINT vertexStartOffset)
 {
     DrawInstanced(vertexCount, 1, vertexStartOffset, 0);
@@ -985,6 +1051,12 @@ void GraphicsCommandList::DrawIndexedInstanced(
         indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
 }
 
+void GraphicsCommandList::ExecuteIndirect(const CommandSignature& commandSig, ID3D12Resource* argumentBuffer, UINT64 argumentOffset, UINT numCommands)
+{
+    FlushResourceBarriers();
+    mCommandList->ExecuteIndirect(commandSig.GetSignature(), numCommands, argumentBuffer, argumentOffset, nullptr, 0);
+}
+
 void GraphicsCommandList::ResolveMSAAResource(GpuResource& dest, GpuResource& src, DXGI_FORMAT destFormat)
 {
     TransitionResource(dest, D3D12_RESOURCE_STATE_RESOLVE_DEST);
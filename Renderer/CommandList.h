@@ -5,6 +5,7 @@
 #include "Utils/DebugUtils.h"
 #include "LinearAllocator2.h"
 #include "DescriptorHandle.h"
+#include "ResourceStateSet.h"
 
 class GraphicsCommandList;
 class ComputeCommandList;
@@ -19,6 +20,7 @@ class ColorBuffer;
 class DepthBuffer;
 class RootSignature;
 class PipelineState;
+class CommandSignature;
 
 struct DWParam
 {
@@ -38,18 +40,6 @@ struct DWParam
     };
 };
 
-struct ResourceStateCache
-{
-    ResourceStateCache(GpuResource& resource) :
-        mGpuResource(resource), mStateCurrent(resource.mUsageState), mStateTransition((D3D12_RESOURCE_STATES)-1)
-    {}
-    ~ResourceStateCache() {}
-
-    GpuResource& mGpuResource;
-    D3D12_RESOURCE_STATES mStateCurrent;
-    D3D12_RESOURCE_STATES mStateTransition;
-};
-
 template<enum D3D12_COMMAND_LIST_TYPE> 
 struct CommandListType {};
 template<> 
@@ -66,6 +56,8 @@ class CommandList : NonCopyable
     friend class FrameContext;
 private:
     CommandList* Reset();
+    // the list was submitted to its queue with fenceValue
+    void RetireUploadPages(uint64_t fenceValue);
 public:
     ~CommandList() {}
 
@@ -129,11 +121,11 @@ protected:
     ID3D12PipelineState* mCurPipelineState;
     ID3D12DescriptorHeap* mCurrentDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 
-    std::map<size_t, ResourceStateCache> mResourceStateCache;
+    ResourceStateSet mResourceStateCache;
     D3D12_RESOURCE_BARRIER mResourceBarrierBuffer[16];
     UINT mNumBarriersToFlush;
 
-    LinearAllocator mCpuLinearAllocator;
+    UploadPageList mUploadPages;
     LinearAllocator mGpuLinearAllocator;
 
     size_t mCommandListIndex;
@@ -168,6 +160,11 @@ public:
     void InitializeBuffer(GpuBuffer& dest, const UploadBuffer& src, size_t srcOffset, size_t numBytes = -1, size_t destOffset = 0);
     void InitializeTextureArraySlice(GpuResource& dest, UINT sliceIndex, GpuResource& src);
 
+    // Copy queue only. A buffer is promoted to COPY_DEST by the copy and decays back to COMMON once the
+    // list has run, so these record no barrier and only reset the state the list tracks for dest
+    void CopyBufferRegionDecayed(GpuBuffer& dest, size_t destOffset, UploadBuffer& src, size_t srcOffset, size_t numBytes);
+    void InitializeBufferDecayed(GpuBuffer& dest, const void* data, size_t numBytes, size_t destOffset = 0);
+
     void WriteBuffer(GpuResource& dest, size_t destOffset, const void* data, size_t numBytes);
     void FillBuffer(GpuResource& dest, size_t destOffset, DWParam value, size_t numBytes);
 
@@ -202,6 +199,7 @@ public:
     void SetConstantBuffer(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS cbv);
     void SetDynamicConstantBufferView(UINT rootIndex, size_t bufferSize, const void* bufferData);
     void SetDynamicSRV(UINT rootIndex, size_t bufferSize, const void* bufferData);
+    void SetShaderResourceView(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS srv);
     void SetBufferSRV(UINT rootIndex, const GpuBuffer& srv, UINT64 offset = 0);
     void SetBufferUAV(UINT rootIndex, const GpuBuffer& uav, UINT64 offset = 0);
 
@@ -268,6 +266,8 @@ public:
     void SetConstants(UINT rootIndex, DWParam x, DWParam y, DWParam z, DWParam w);
     void SetConstantBuffer(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS cbv);
     void SetDynamicConstantBufferView(UINT rootIndex, size_t bufferSize, const void* bufferData);
+    // raw root SRV, for upload heap buffers that are always readable and have no tracked state
+    void SetShaderResourceView(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS srv);
     void SetBufferSRV(UINT rootIndex, const GpuBuffer& srv, UINT64 offset = 0);
     void SetBufferUAV(UINT rootIndex, const GpuBuffer& uav, UINT64 offset = 0);
 
@@ -284,6 +284,17 @@ public:
     void SetDynamicIB(size_t indexCount, const uint16_t* ibData);
     void SetDynamicSRV(UINT rootIndex, size_t bufferSize, const void* bufferData);
 
+    // Upload memory the caller fills in place, valid until the list is retired. Write it front to
+    // back and never read it, the pages are write combined.
+    struct UploadSpan
+    {
+        void* cpuAddress;
+        D3D12_GPU_VIRTUAL_ADDRESS gpuAddress;
+        ID3D12Resource* resource;
+        UINT64 offset;
+    };
+    UploadSpan ReserveUploadMemory(size_t sizeInBytes, size_t alignment = 16);
+
     void Draw(UINT vertexCount, UINT vertexStartOffset = 0);
     void DrawIndexed(UINT indexCount, UINT startIndexLocation = 0, INT baseVertexLocation = 0);
     void DrawInstanced(UINT vertexCountPerInstance, UINT instanceCount, UINT startVertexLocation = 0, UINT startInstanceLocation = 0);
@@ -292,4 +303,5 @@ public:
     //void DrawIndirect(GpuBuffer& argumentBuffer, uint64_t argumentBufferOffset = 0);
     //void ExecuteIndirect(CommandSignature& commandSig, GpuBuffer& argumentBuffer, uint64_t argumentStartOffset = 0,
     //    uint32_t maxCommands = 1, GpuBuffer* commandCounterBuffer = nullptr, uint64_t counterOffset = 0);
+    void ExecuteIndirect(const CommandSignature& commandSig, ID3D12Resource* argumentBuffer, UINT64 argumentOffset, UINT numCommands);
 };
@@ -46,6 +46,11 @@ bool CommandQueue::IsFenceComplete(uint64_t fenceValue)
     return fenceValue <= mFence->GetCompletedValue();
 }
 
+uint64_t CommandQueue::GetCompletedFenceValue()
+{
+    return mFence->GetCompletedValue();
+}
+
 void CommandQueue::StallForProducer(CommandQueue& producer)
 {
     ASSERT(producer.mNextFenceValue > 0);
@@ -26,6 +26,8 @@ public:
 
     bool IsFenceComplete(uint64_t fenceValue);
 
+    uint64_t GetCompletedFenceValue();
+
     void StallForProducer(CommandQueue& producer);
 
     void WaitForFence(uint64_t fenceValue);
@@ -0,0 +1,65 @@
+#include "CommandSignature.h"
+#include "RootSignature.h"
+#include "Graphics.h"
+
+UINT IndirectParameter::GetByteSize() const
+{
+    switch (mIndirectParam.Type)
+    {
+    case D3D12_INDIRECT_ARGUMENT_TYPE_DRAW:
+        return sizeof(D3D12_DRAW_ARGUMENTS);
+    case D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED:
+        return sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
+    case D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH:
+        return sizeof(D3D12_DISPATCH_ARGUMENTS);
+    case D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW:
+        return sizeof(D3D12_VERTEX_BUFFER_VIEW);
+    case D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW:
+        return sizeof(D3D12_INDEX_BUFFER_VIEW);
+    case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT:
+        return mIndirectParam.Constant.Num32BitValuesToSet * sizeof(UINT);
+    case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW:
+    case D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW:
+    case D3D12_INDIRECT_ARGUMENT_TYPE_UNORDERED_ACCESS_VIEW:
+        return sizeof(D3D12_GPU_VIRTUAL_ADDRESS);
+    default:
+        ASSERT(false, "Indirect parameter is not initialized");
+        return 0;
+    }
+}
+
+void CommandSignature::Finalize(const RootSignature* rootSignature)
+{
+    if (mSignature != nullptr)
+        return;
+
+    bool requiresRootSignature = false;
+    mByteStride = 0;
+    for (UINT i = 0; i < mNumParameters; i++)
+    {
+        const D3D12_INDIRECT_ARGUMENT_TYPE type = mParamArray[i].GetDesc().Type;
+        mByteStride += mParamArray[i].GetByteSize();
+
+        const bool isLast = i + 1 == mNumParameters;
+        const bool isCall = type == D3D12_INDIRECT_ARGUMENT_TYPE_DRAW || type == D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED ||
+            type == D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH;
+        ASSERT(isCall == isLast, "The draw or dispatch must be the last indirect parameter");
+
+        requiresRootSignature |= type == D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT ||
+            type == D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW ||
+            type == D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW ||
+            type == D3D12_INDIRECT_ARGUMENT_TYPE_UNORDERED_ACCESS_VIEW;
+    }
+    ASSERT(!requiresRootSignature || rootSignature != nullptr);
+
+    D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc;
+    commandSignatureDesc.ByteStride = mByteStride;
+    commandSignatureDesc.NumArgumentDescs = mNumParameters;
+    commandSignatureDesc.pArgumentDescs = (const D3D12_INDIRECT_ARGUMENT_DESC*)mParamArray.get();
+    commandSignatureDesc.NodeMask = 1;
+
+    ID3D12RootSignature* d3dRootSignature = requiresRootSignature ? rootSignature->GetRootSignature() : nullptr;
+    CheckHR(Graphics::gDevice->CreateCommandSignature(&commandSignatureDesc, d3dRootSignature,
+        IID_PPV_ARGS(mSignature.GetAddressOf())));
+    mSignature->SetName(L"CommandSignature");
+}
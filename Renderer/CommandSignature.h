@@ -0,0 +1,105 @@
+#pragma once
+#include "CoreHeader.h"
+#include "Common.h"
+#include "Utils/DebugUtils.h"
+
+class RootSignature;
+
+class IndirectParameter
+{
+    friend class CommandSignature;
+public:
+    IndirectParameter()
+    {
+        mIndirectParam.Type = (D3D12_INDIRECT_ARGUMENT_TYPE)0xFFFFFFFF;
+    }
+
+    void Draw() { mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW; }
+    void DrawIndexed() { mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED; }
+    void Dispatch() { mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH; }
+
+    void VertexBufferView(UINT slot)
+    {
+        mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+        mIndirectParam.VertexBuffer.Slot = slot;
+    }
+
+    void IndexBufferView() { mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW; }
+
+    void Constant(UINT rootParameterIndex, UINT destOffsetIn32BitValues, UINT num32BitValuesToSet)
+    {
+        mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+        mIndirectParam.Constant.RootParameterIndex = rootParameterIndex;
+        mIndirectParam.Constant.DestOffsetIn32BitValues = destOffsetIn32BitValues;
+        mIndirectParam.Constant.Num32BitValuesToSet = num32BitValuesToSet;
+    }
+
+    void ConstantBufferView(UINT rootParameterIndex)
+    {
+        mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW;
+        mIndirectParam.ConstantBufferView.RootParameterIndex = rootParameterIndex;
+    }
+
+    void ShaderResourceView(UINT rootParameterIndex)
+    {
+        mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+        mIndirectParam.ShaderResourceView.RootParameterIndex = rootParameterIndex;
+    }
+
+    void UnorderedAccessView(UINT rootParameterIndex)
+    {
+        mIndirectParam.Type = D3D12_INDIRECT_ARGUMENT_TYPE_UNORDERED_ACCESS_VIEW;
+        mIndirectParam.UnorderedAccessView.RootParameterIndex = rootParameterIndex;
+    }
+
+    const D3D12_INDIRECT_ARGUMENT_DESC& GetDesc() const { return mIndirectParam; }
+
+    // bytes the argument takes in every record of the argument buffer
+    UINT GetByteSize() const;
+protected:
+    D3D12_INDIRECT_ARGUMENT_DESC mIndirectParam;
+};
+
+
+// Layout of the records ExecuteIndirect reads. Arguments are packed in parameter order without
+// padding and the draw or dispatch must come last. A signature that changes root arguments needs
+// the root signature the lists will bind when it is executed.
+class CommandSignature : public NonCopyable
+{
+public:
+    CommandSignature(UINT numParams = 0) : mNumParameters(numParams), mByteStride(0)
+    {
+        Reset(numParams);
+    }
+
+    void Reset(UINT numParams)
+    {
+        mParamArray = numParams > 0 ? std::make_unique<IndirectParameter[]>(numParams) : nullptr;
+        mNumParameters = numParams;
+        mByteStride = 0;
+        mSignature = nullptr;
+    }
+
+    IndirectParameter& operator[](size_t entryIndex)
+    {
+        ASSERT(entryIndex < mNumParameters);
+        return mParamArray[entryIndex];
+    }
+
+    const IndirectParameter& operator[](size_t entryIndex) const
+    {
+        ASSERT(entryIndex < mNumParameters);
+        return mParamArray[entryIndex];
+    }
+
+    void Finalize(const RootSignature* rootSignature = nullptr);
+
+    ID3D12CommandSignature* GetSignature() const { return mSignature.Get(); }
+    UINT GetNumParameters() const { return mNumParameters; }
+    UINT GetByteStride() const { return mByteStride; }
+private:
+    UINT mNumParameters;
+    UINT mByteStride;
+    std::unique_ptr<IndirectParameter[]> mParamArray;
+    Microsoft::WRL::ComPtr<ID3D12CommandSignature> mSignature;
+};
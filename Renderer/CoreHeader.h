@@ -53,6 +53,10 @@
 #define D3D12_DEFAULT_SAMEPLE_MASK 0xFFFFFFFF
 
 #define MAX_DESCRIPTOR_HEAP_SIZE 1024
+#define TRANSIENT_DESCRIPTOR_RING_SIZE 65536
+#define PINNED_DESCRIPTOR_TABLE_SIZE 16384
+#define STAGING_RING_SIZE (64 * 1024 * 1024)
+#define STAGING_FRAME_BUDGET (16 * 1024 * 1024)
 #define MAX_DESCRIPTOR_ALLOC_CACHE_SIZE 16
 #define MAX_BARRIERS_CACHE_FLUSH 16
 #define MAX_ALLOCATOR_PAGES 16
@@ -1,255 +1,72 @@
 #include "DescriptorHandle.h"
 #include "Graphics.h"
+#include "CommandQueue.h"
 #include "Utils/DebugUtils.h"
-#include "Math/Common.h"
-
-void TreeShiftSetBit(uint32_t bitMap[], int startIdx, size_t startBitIdx)
-{
-    constexpr uint32_t halfBitSize = sizeof(uint32_t) * 8 / 2;
-    bool isRight = startIdx % 2 == 0; // right leaf
-    startIdx = ((startIdx + 1) >> 1) - 1; // parent node (startIdx + 1) / 2 - 1
-    startBitIdx >>= 1; // parent node bit pos
-
-    while (startIdx >= 0)
-    {
-        if (isRight)
-            bitMap[startIdx] |= 1 << (startBitIdx + halfBitSize);
-        else
-            bitMap[startIdx] |= 1 << startBitIdx;
-
-        isRight = startIdx % 2 == 0;
-        startIdx = ((startIdx + 1) >> 1) - 1;
-        startBitIdx >>= 1;
-    }
-}
-
-void TreeShiftResetBit(uint32_t bitMap[], int startIdx, size_t startBitIdx)
-{
-    constexpr size_t halfBitSize = sizeof(uint32_t) * 8 / 2;
-    bool isRight = startIdx % 2 == 0;
-    //bool isCompleteReset = true;
-
-    BOOLEAN hasBitSet = _bittest((const LONG*)&bitMap[startIdx], startBitIdx);
-    size_t neighborBitIdx = startBitIdx % 2 == 0 ? startBitIdx + 1 : startBitIdx - 1;
-    hasBitSet |= _bittest((const LONG*)&bitMap[startIdx], neighborBitIdx);
-
-    startIdx = ((startIdx + 1) >> 1) - 1;
-    startBitIdx >>= 1;
-
-    // not same as TreeShiftSetBit, the parent node will not reset, unless child adjacent bit is reset
-    while (startIdx >= 0)
-    {
-        if (!hasBitSet)
-        {
-            if (isRight)
-                bitMap[startIdx] ^= 1 << (startBitIdx + halfBitSize);
-            else
-                bitMap[startIdx] ^= 1 << startBitIdx;
-        }
-        else
-        {
-            //isCompleteReset = false;
-            break;
-        }
-
-        hasBitSet = _bittest((const LONG*)&bitMap[startIdx], startBitIdx);
-        neighborBitIdx = startBitIdx % 2 == 0 ? startBitIdx + 1 : startBitIdx - 1;
-        hasBitSet |= _bittest((const LONG*)&bitMap[startIdx], neighborBitIdx);
-
-        isRight = startIdx % 2 == 0;
-        startIdx = ((startIdx + 1) >> 1) - 1;
-        startBitIdx >>= 1;
-    }
-
-    //return isCompleteReset;
-}
-
-void TreeSinkSetAll(uint32_t bitMap[], int startIdx, size_t startBitIdx, size_t numNodes)
-{
-    constexpr uint32_t BIT_SETS[] = { 3, 15, 255, 65535, 4294967295 };
-
-    bool isLeft = startBitIdx < 16;
-    int childIndex = startIdx * 2 + (isLeft ? 1 : 2);
-    startBitIdx = (startBitIdx % 16) << 1;
-
-    for (size_t i = 0; i < 5 && childIndex < numNodes; i++)
-    {
-        bitMap[childIndex] |= BIT_SETS[i] << startBitIdx;
-
-        isLeft = startBitIdx < 16;
-        startBitIdx = (startBitIdx % 16) << 1;
-        childIndex = childIndex * 2 + (isLeft ? 1 : 2);
-    }
-}
-
-void TreeSinkResetAll(uint32_t bitMap[], int startIdx, size_t startBitIdx, size_t numNodes)
-{
-    constexpr uint32_t BIT_SETS[] = { 3, 15, 255, 65535, 4294967295 };
-
-    bool isLeft = startBitIdx < 16;
-    int childIndex = startIdx * 2 + (isLeft ? 1 : 2);
-    startBitIdx = (startBitIdx % 16) << 1;
-
-    for (size_t i = 0; i < 5 && childIndex < numNodes; i++)
-    {
-        bitMap[childIndex] &= ~(BIT_SETS[i] << startBitIdx);
-
-        isLeft = startBitIdx < 16;
-        startBitIdx = (startBitIdx % 16) << 1;
-        childIndex = childIndex * 2 + (isLeft ? 1 : 2);
-    }
-}
-
 
 void DescriptorAllocator::Deallocate(DescriptorHandle& handle, uint32_t count)
 {
-    constexpr uint32_t perNodeSize = (sizeof(uint32_t) * 8);
-    constexpr uint32_t firstLayerSize = MAX_DESCRIPTOR_HEAP_SIZE / perNodeSize;
-    ASSERT(count > 0 && count <= firstLayerSize);
+    ASSERT(count > 0 && count <= MAX_DESCRIPTOR_HEAP_SIZE);
 
     if (!handle)
         return;
 
-    SubHeap* subHeap = GetSubHeap(handle.mOwningHeapIndex);
-    ASSERT(subHeap);
-
-    if (count > 1)
-        count = Math::AlignUpToPower2(count);
-
-    unsigned long maxLayerIdx = 0;
-    unsigned long allocLayerIdx = 0;
-    _BitScanForward(&maxLayerIdx, firstLayerSize);
-    _BitScanForward(&allocLayerIdx, count);
-    unsigned long startLayerIdx = maxLayerIdx - allocLayerIdx;
-
-    std::unique_lock<std::mutex> lock1(mAllocatorMutex, std::defer_lock);
-    while (!lock1.try_lock())
-        std::this_thread::yield();
-
-    uint32_t startLayerNodeIdx = (1 << startLayerIdx) - 1;
-    //uint32_t offset = (handle.GetCpuPtr() - subHeap->mCpuStartHandle.ptr) / subHeap->mDescriptorSize / count; // Calc Address Offset
-    uint32_t offset = (handle.GetCpuPtr() - subHeap->mCpuStartHandle.ptr) / mDescriptorSize / count; // Calc Address Offset
-    uint32_t nodeIdx = startLayerNodeIdx + offset / perNodeSize; // Tree Node Index
-    uint32_t bitIdx = offset % perNodeSize; // BitSet Index
-
-    subHeap->mBitMap[nodeIdx] ^= 1 << bitIdx;
-
-    TreeShiftResetBit(subHeap->mBitMap, nodeIdx, bitIdx);
-    TreeSinkResetAll(subHeap->mBitMap, nodeIdx, bitIdx, ARRAYSIZE(subHeap->mBitMap));
-    subHeap->mNumRemainHandles += count;
-    subHeap->mNumReleasedHandles += count;
-
-    if (subHeap->mNumReleasedHandles > MAX_DESCRIPTOR_ALLOC_CACHE_SIZE)
-    {
-        subHeap->mNumReleasedHandles = 0;
-        auto maxHandleIter = std::max_element(mDescriptorHeapPool.cbegin(), mDescriptorHeapPool.cend(),
-            [](auto& p1, auto& p2) { return p1->mNumRemainHandles > p2->mNumRemainHandles; });
-        mCurrentHeapIndex = std::distance(mDescriptorHeapPool.cbegin(), maxHandleIter);
-    }
-
+    mIndices.Free({ (uint32_t)handle.mOffset, (uint8_t)handle.mOwningHeapIndex }, count);
     handle.mOffset = UNKNOWN_OFFSET;
 }
 
 DescriptorHandle DescriptorAllocator::Allocate(uint32_t count)
 {
-    constexpr uint32_t perNodeSize = (sizeof(uint32_t) * 8);
-    constexpr uint32_t firstLayerSize = MAX_DESCRIPTOR_HEAP_SIZE / perNodeSize;
-    ASSERT(count > 0 && count <= firstLayerSize);
-
-    if (count > 1)
-        count = Math::AlignUpToPower2(count);
-
-    unsigned long maxLayerIdx = 0;
-    unsigned long allocLayerIdx = 0;
-    _BitScanForward(&maxLayerIdx, firstLayerSize);
-    _BitScanForward(&allocLayerIdx, count);
-    unsigned long startLayerIdx = maxLayerIdx - allocLayerIdx; // Calc tree layer
-    uint32_t totalNodeSize = (1UL << (startLayerIdx + 1)) - 1; // Calc total tree Nodes
-    uint32_t startLayerNodeIdx = (1 << startLayerIdx) - 1; // Prev layer total nodes
-
-    std::unique_lock<std::mutex> lock1(mAllocatorMutex, std::defer_lock);
-    while (!lock1.try_lock())
-        std::this_thread::yield();
-
-    if (mCurrentHeapIndex == (uint8_t)-1 || mDescriptorHeapPool[mCurrentHeapIndex]->mNumRemainHandles < count)
-        mCurrentHeapIndex = AllocNewHeap();
-
-    DescriptorHandle newHandle = AllocateLayer(startLayerNodeIdx, totalNodeSize, count);
-    if (newHandle)
-        return newHandle;
-
-    mCurrentHeapIndex = AllocNewHeap();
-    return AllocateLayer(startLayerNodeIdx, totalNodeSize, count);
+    ASSERT(count > 0 && count <= MAX_DESCRIPTOR_HEAP_SIZE);
+
+    Utility::IndexBlockPool::Block block = mIndices.Allocate(count);
+    return DescriptorHandle(block.offset, block.page, mType, mGpuVisible);
 }
 
-DescriptorHandle DescriptorAllocator::AllocateLayer(uint32_t startLayerNodeIdx, uint32_t totalNodeSize, size_t alignedCount)
+DescriptorAllocator::DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE heapType, bool gpuVisible) :
+    mType(heapType), mGpuVisible(gpuVisible),
+    mDescriptorSize(Graphics::gDevice->GetDescriptorHandleIncrementSize(heapType)),
+    mIndices(MAX_DESCRIPTOR_HEAP_SIZE, !gpuVisible, [this](uint8_t index, uint32_t numDescriptors) { CreateHeap(index, numDescriptors); })
 {
-    constexpr uint32_t perNodeSize = (sizeof(uint32_t) * 8);
-
-    SubHeap* subHeap = mDescriptorHeapPool[mCurrentHeapIndex];
-
-    //if (subHeap->mBitMap.size() < totalNodeSize) // Fill tree nodes
-        //subHeap->mBitMap.resize(totalNodeSize);
-
-    size_t offsetFromHeap = UNKNOWN_OFFSET;
-    for (uint32_t i = startLayerNodeIdx, j = 0; i < totalNodeSize; i++, j++) // iter curlayer node
-    {
-        unsigned long freeIdx = 0;
-        if (_BitScanForward(&freeIdx, ~subHeap->mBitMap[i]))
-        {
-            offsetFromHeap = (j * perNodeSize + freeIdx) * alignedCount;
-            subHeap->mNumRemainHandles -= alignedCount;
-            subHeap->mBitMap[i] |= 1 << freeIdx;
-            TreeShiftSetBit(subHeap->mBitMap, i, freeIdx);
-            TreeSinkSetAll(subHeap->mBitMap, i, freeIdx, ARRAYSIZE(subHeap->mBitMap));
-            break;
-        }
-    }
-    return DescriptorHandle(offsetFromHeap, mCurrentHeapIndex, mType, mGpuVisible);
 }
 
-DescriptorAllocator::DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE heapType, bool gpuVisible) :
-    mType(heapType), mCurrentHeapIndex(-1), mGpuVisible(gpuVisible)
+DescriptorAllocator::~DescriptorAllocator()
 {
-    mDescriptorSize = Graphics::gDevice->GetDescriptorHandleIncrementSize(mType);
+    Clear();
 }
 
 void DescriptorAllocator::Clear()
 {
-    std::unique_lock<std::mutex> lock1(mAllocatorMutex, std::defer_lock);
-    ASSERT(lock1.try_lock(), "Lock is owning by other thread!");
+    mIndices.Clear();
 
     for (auto& subHeap : mDescriptorHeapPool)
     {
         delete subHeap;
     }
-
-    mCurrentHeapIndex = -1;
     mDescriptorHeapPool.clear();
 }
 
-uint8_t DescriptorAllocator::AllocNewHeap()
+DescriptorHandle DescriptorAllocator::AllocateDedicatedHeap(uint32_t numDescriptors)
 {
+    return DescriptorHandle(0, mIndices.AddDedicatedPage(numDescriptors), mType, mGpuVisible);
+}
+
+void DescriptorAllocator::CreateHeap(uint8_t index, uint32_t numDescriptors)
+{
+    ASSERT(index == mDescriptorHeapPool.size());
+
     D3D12_DESCRIPTOR_HEAP_DESC desc;
     desc.Type = mType;
-    desc.NumDescriptors = MAX_DESCRIPTOR_HEAP_SIZE;
+    desc.NumDescriptors = numDescriptors;
     desc.NodeMask = 0;
     if (mGpuVisible && (mType == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV || mType == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER))
         desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
     else
         desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 
-    SubHeap* subAllocator = mDescriptorHeapPool.emplace_back(new SubHeap(*this));
-    CheckHR(Graphics::gDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(subAllocator->mDescriptorHeap.GetAddressOf())));
-    subAllocator->mCpuStartHandle = subAllocator->mDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-    subAllocator->mGpuStartHandle = subAllocator->mDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-
-    //constexpr uint32_t perNodeSize = (sizeof(BITMAP_TYPE) * 8);
-    //constexpr uint32_t firstLayerSize = MAX_DESCRIPTOR_HEAP_SIZE / perNodeSize;
-    //unsigned long maxLayerIdx = 0;
-    //_BitScanForward(&maxLayerIdx, firstLayerSize);
-    //subAllocator->mPerLayerRemainHandles.resize(maxLayerIdx + 1);
-    return mDescriptorHeapPool.size() - 1;
+    SubHeap* subHeap = mDescriptorHeapPool.emplace_back(new SubHeap());
+    CheckHR(Graphics::gDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(subHeap->mDescriptorHeap.GetAddressOf())));
+    subHeap->mCpuStartHandle = subHeap->mDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    subHeap->mGpuStartHandle = subHeap->mDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
 }
 
 DescriptorAllocator& DescriptorHandle::GetAlloc() const
@@ -281,61 +98,101 @@ uint64_t DescriptorHandle::GetGpuPtr() const
 }
 
 
-// DescriptorLinearAlloc
-DescriptorLinearAlloc::DescriptorLinearAlloc(D3D12_DESCRIPTOR_HEAP_TYPE type, size_t size)
+// DescriptorRing
+DescriptorRing::DescriptorRing(DescriptorAllocator& gpuAllocator, uint32_t numDescriptors, uint32_t numPinned) :
+    mType(gpuAllocator.mType), mDescriptorSize(gpuAllocator.mDescriptorSize), mRing(numDescriptors), mPinned(numPinned),
+    mFrameCopies(0), mFrameFlushes(0)
 {
-    ASSERT(type == D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV || type == D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER);
-    mType = type;
+    ASSERT(gpuAllocator.mGpuVisible);
+    mHeapStart = gpuAllocator.AllocateDedicatedHeap(numDescriptors + numPinned);
+}
 
-    D3D12_DESCRIPTOR_HEAP_DESC desc;
-    desc.Type = mType;
-    desc.NumDescriptors = size;
-    desc.NodeMask = 0;
-    desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+DescriptorHandle DescriptorRing::Allocate(uint32_t count)
+{
+    uint32_t offset = mRing.Allocate(count);
+    while (offset == Utility::FenceRingAllocator::kInvalidOffset)
+    {
+        // only the frames still in flight can give space back
+        ASSERT(mRing.HasFinishedFrames(), "One frame needs more transient descriptors than the ring holds");
+        CommandQueue& queue = CommandQueueManager::GetInstance()->GetGraphicsQueue();
+        queue.WaitForFence(mRing.GetOldestFence());
+        mRing.Retire(queue.GetCompletedFenceValue());
+        mStats.numFenceWaits++;
+        offset = mRing.Allocate(count);
+    }
 
-    CheckHR(Graphics::gDevice->CreateDescriptorHeap(&desc, IID_PPV_ARGS(mDescriptorHeap.GetAddressOf())));
-    mCpuStart = mDescriptorHeap->GetCPUDescriptorHandleForHeapStart();
-    mGpuStart = mDescriptorHeap->GetGPUDescriptorHandleForHeapStart();
-    mCurrentOffset = 0;
+    mStats.peakUsedCount = std::max(mStats.peakUsedCount, mRing.GetUsedCount());
+    return mHeapStart + offset;
 }
 
-D3D12_GPU_DESCRIPTOR_HANDLE DescriptorLinearAlloc::Map(DescriptorHandle handles[], size_t size, size_t index)
+DescriptorHandle DescriptorRing::AllocatePinned(uint32_t count)
 {
-    if (index == (size_t)-1)
-        index = mCurrentOffset;
-
-    ASSERT(index + size < 64);
+    uint32_t offset = mPinned.Allocate(count);
+    if (offset == Utility::IndexRangeAllocator::kInvalidIndex)
+        return DescriptorHandle();
 
-    CD3DX12_CPU_DESCRIPTOR_HANDLE curCpuHandle(mCpuStart);
-    CD3DX12_GPU_DESCRIPTOR_HANDLE curGpuHandle(mGpuStart);
-    size_t descriptorSize = Graphics::gDevice->GetDescriptorHandleIncrementSize(mType);
-    curCpuHandle.Offset(index, descriptorSize);
-    curGpuHandle.Offset(index, descriptorSize);
+    mStats.pinnedUsedCount = mPinned.GetCapacity() - mPinned.GetFreeCount();
+    return mHeapStart + (mRing.GetSize() + offset);
+}
 
-    for (size_t i = 0; i < size; i++)
+void DescriptorRing::CopyToTable(const DescriptorHandle& dest, const DescriptorHandle sources[], uint32_t numSources)
+{
+    ASSERT(dest.GetType() == mType);
+    size_t destPtr = dest.GetCpuPtr();
+    for (uint32_t i = 0; i < numSources; i++, destPtr += mDescriptorSize)
     {
-        const D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle1 = handles[i];
-        Graphics::gDevice->CopyDescriptorsSimple(1, curCpuHandle, cpuHandle1, mType);
-        curCpuHandle.Offset(1, descriptorSize);
+        if (!sources[i])
+            continue;
+
+        size_t srcPtr = sources[i].GetCpuPtr();
+        if (!mDestStarts.empty() && mDestStarts.back().ptr + mDestSizes.back() * mDescriptorSize == destPtr)
+            mDestSizes.back()++;
+        else
+        {
+            mDestStarts.push_back({ destPtr });
+            mDestSizes.push_back(1);
+        }
+
+        if (!mSrcStarts.empty() && mSrcStarts.back().ptr + mSrcSizes.back() * mDescriptorSize == srcPtr)
+            mSrcSizes.back()++;
+        else
+        {
+            mSrcStarts.push_back({ srcPtr });
+            mSrcSizes.push_back(1);
+        }
     }
+}
 
-    mCurrentOffset += size;
-    return curGpuHandle;
+void DescriptorRing::Flush()
+{
+    if (mDestStarts.empty())
+        return;
+
+    Graphics::gDevice->CopyDescriptors((UINT)mDestStarts.size(), mDestStarts.data(), mDestSizes.data(),
+        (UINT)mSrcStarts.size(), mSrcStarts.data(), mSrcSizes.data(), mType);
+
+    for (UINT size : mDestSizes)
+        mFrameCopies += size;
+    mFrameFlushes++;
+
+    mDestStarts.clear();
+    mDestSizes.clear();
+    mSrcStarts.clear();
+    mSrcSizes.clear();
 }
 
-D3D12_GPU_DESCRIPTOR_HANDLE DescriptorLinearAlloc::Map(DescriptorHandle handle, size_t index)
+void DescriptorRing::EndFrame(uint64_t fenceValue)
 {
-    ASSERT(index < 64);
+    ASSERT(mDestStarts.empty(), "Transient descriptors copied after the frame was submitted");
 
-    const D3D12_CPU_DESCRIPTOR_HANDLE& cpuHandle = handle;
-    size_t descriptorSize = Graphics::gDevice->GetDescriptorHandleIncrementSize(mType);
-    CD3DX12_CPU_DESCRIPTOR_HANDLE curCpuHandle(mCpuStart);
-    CD3DX12_GPU_DESCRIPTOR_HANDLE curGpuHandle(mGpuStart);
-    curCpuHandle.Offset(index, descriptorSize);
-    curGpuHandle.Offset(index, descriptorSize);
-    Graphics::gDevice->CopyDescriptorsSimple(1, curCpuHandle, cpuHandle, mType);
+    mStats.lastFrameCount = mRing.GetOpenFrameCount();
+    mStats.lastFrameCopies = mFrameCopies;
+    mStats.lastFrameFlushes = mFrameFlushes;
+    mFrameCopies = 0;
+    mFrameFlushes = 0;
 
-    return curGpuHandle;
+    mRing.FinishFrame(fenceValue);
+    mRing.Retire(CommandQueueManager::GetInstance()->GetGraphicsQueue().GetCompletedFenceValue());
 }
 
 DescriptorAllocatorManager::DescriptorAllocatorManager()
@@ -346,10 +203,14 @@ DescriptorAllocatorManager::DescriptorAllocatorManager()
     mDescriptorAllocators.push_back(new DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE_DSV));
     mDescriptorAllocators.push_back(new DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true));
     mDescriptorAllocators.push_back(new DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER, true));
+
+    mTransientRing = new DescriptorRing(*mDescriptorAllocators[D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV + D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES],
+        TRANSIENT_DESCRIPTOR_RING_SIZE, PINNED_DESCRIPTOR_TABLE_SIZE);
 }
 
 DescriptorAllocatorManager::~DescriptorAllocatorManager()
 {
+    delete mTransientRing;
     for (size_t i = 0; i < mDescriptorAllocators.size(); i++)
     {
         delete mDescriptorAllocators[i];
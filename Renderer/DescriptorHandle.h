@@ -1,35 +1,33 @@
 #pragma once
 #include "CoreHeader.h"
 #include "Common.h"
+#include "Utils/IndexBlockPool.h"
+#include "Utils/FenceRingAllocator.h"
+
+#include <atomic>
 
 class DescriptorHandle;
+class DescriptorRing;
 
+// Hands out descriptor ranges from a pool of MAX_DESCRIPTOR_HEAP_SIZE sized heaps. The bookkeeping is
+// an IndexBlockPool with a page per heap, non shader visible allocators use its per thread magazines.
+// Shader visible allocators skip the magazines, blocks parked in threads would push allocations into a
+// second heap and only one can be bound.
 class DescriptorAllocator
 {
     friend class DescriptorHandle;
+    friend class DescriptorRing;
 
     struct SubHeap
     {
-        DescriptorAllocator& mOwningAllocator;
-        size_t mNumRemainHandles;
-        size_t mNumReleasedHandles;
         D3D12_CPU_DESCRIPTOR_HANDLE mCpuStartHandle;
         D3D12_GPU_DESCRIPTOR_HANDLE mGpuStartHandle;
         Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mDescriptorHeap;
-        uint32_t mBitMap[63]; // all tree node size 2^6 - 1
-        //std::vector<size_t> mPerLayerRemainHandles; // simple handle all layer has same remain handles
-
-        SubHeap(DescriptorAllocator& owningAlloc) : mOwningAllocator(owningAlloc),
-            mNumRemainHandles(MAX_DESCRIPTOR_HEAP_SIZE), mNumReleasedHandles(0)
-        {
-            ZeroMemory(&mBitMap, sizeof(mBitMap));
-        }
-        ~SubHeap() {}
     };
 public:
     DescriptorAllocator(D3D12_DESCRIPTOR_HEAP_TYPE heapType, bool gpuVisible = false);
 
-    ~DescriptorAllocator() { Clear(); }
+    ~DescriptorAllocator();
 
     void Clear();
 
@@ -42,19 +40,19 @@ public:
     void Deallocate(DescriptorHandle& handle, uint32_t count);
 
     DescriptorHandle Allocate(uint32_t count);
-private:
-    SubHeap* GetSubHeap(uint8_t index) const { return mDescriptorHeapPool[index]; }
 
-    DescriptorHandle AllocateLayer(uint32_t startLayerNodeIdx, uint32_t totalNodeSize, size_t alignedCount);
-    
-    uint8_t AllocNewHeap();
+    // First descriptor of a heap of its own that Allocate never hands out from, the caller manages
+    // all numDescriptors of it. Lives until Clear.
+    DescriptorHandle AllocateDedicatedHeap(uint32_t numDescriptors);
+private:
+    // called by mIndices under its lock
+    void CreateHeap(uint8_t index, uint32_t numDescriptors);
 private:
     D3D12_DESCRIPTOR_HEAP_TYPE mType;
     bool mGpuVisible;
     UINT mDescriptorSize;
-    uint8_t mCurrentHeapIndex;
-    std::mutex mAllocatorMutex;
     std::vector<SubHeap*> mDescriptorHeapPool;
+    Utility::IndexBlockPool mIndices;
 };
 
 #define UNKNOWN_OFFSET (((uint64_t)-1) >> 11)
@@ -226,8 +224,12 @@ public:
 
     DescriptorAllocator& GetAllocGpu(D3D12_DESCRIPTOR_HEAP_TYPE type) { return *mDescriptorAllocators[type + D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES]; }
 
+    // CBV_SRV_UAV tables that only live for the frame being recorded
+    DescriptorRing& GetTransientRing() { return *mTransientRing; }
+
 private:
     std::vector<DescriptorAllocator*> mDescriptorAllocators;
+    DescriptorRing* mTransientRing;
 };
 
 #define GET_DESCRIPTOR_ALLOC(type) DescriptorAllocatorManager::GetInstance()->GetAlloc(type)
@@ -237,25 +239,63 @@ private:
 #define DEALLOC_DESCRIPTOR(handle, count) DescriptorAllocatorManager::GetInstance()->DeAllocateDescriptor(handle, count)
 #define ALLOC_DESCRIPTOR_GPU(type, count) DescriptorAllocatorManager::GetInstance()->AllocateDescriptorGpu(type, count)
 #define DEALLOC_DESCRIPTOR_GPU(handle, count) DescriptorAllocatorManager::GetInstance()->DeAllocateDescriptorGpu(handle, count)
-
-
-// LinearAllocForGpu
-class DescriptorLinearAlloc
+#define GET_DESCRIPTOR_RING() DescriptorAllocatorManager::GetInstance()->GetTransientRing()
+
+
+// Shader visible descriptors for tables rebuilt every frame, from a heap of their own. Tables are
+// handed out by a FenceRingAllocator, EndFrame tags them with the graphics fence of the frame and they
+// are reused once the queue has passed it. A full ring waits for its oldest frame, never for idle.
+// CopyToTable only queues the copy: Flush writes everything queued with one CopyDescriptors call and
+// has to run before the lists reading the tables are submitted. Main thread only.
+// A draw can only see one CBV_SRV_UAV heap, tables from here should not be mixed with persistent ones.
+// Tables that change only now and then go in the pinned part of the same heap instead, which the ring
+// never reaches: they keep their slots across frames and need no copy while their sources stay put.
+class DescriptorRing : public NonCopyable
 {
 public:
-    DescriptorLinearAlloc(D3D12_DESCRIPTOR_HEAP_TYPE type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, size_t size = 64);
-    ~DescriptorLinearAlloc() {}
+    struct Stats
+    {
+        uint32_t lastFrameCount = 0;   // descriptors the last finished frame took, skipped ones included
+        uint32_t lastFrameCopies = 0;  // descriptors it copied
+        uint32_t lastFrameFlushes = 0; // CopyDescriptors calls it made
+        uint32_t peakUsedCount = 0;
+        uint32_t numFenceWaits = 0;    // allocations that had to wait for an older frame
+        uint32_t pinnedUsedCount = 0;
+    };
+
+    DescriptorRing(DescriptorAllocator& gpuAllocator, uint32_t numDescriptors, uint32_t numPinned);
+    ~DescriptorRing() {}
+
+    DescriptorHandle Allocate(uint32_t count);
 
-    D3D12_GPU_DESCRIPTOR_HANDLE Map(DescriptorHandle handles[], size_t size, size_t index = -1);
-    D3D12_GPU_DESCRIPTOR_HANDLE Map(DescriptorHandle handle, size_t index);
+    // A table that lives until the ring is destroyed, null once the pinned part is full. Not fenced,
+    // the owner only rewrites it when no frame in flight reads it, e.g. one per frame buffer index.
+    DescriptorHandle AllocatePinned(uint32_t count);
 
-    D3D12_GPU_DESCRIPTOR_HANDLE GetStart() const { return mGpuStart; }
-    D3D12_DESCRIPTOR_HEAP_TYPE GetType() const { return mType; }
-    ID3D12DescriptorHeap* GetHeap() { return mDescriptorHeap.Get(); }
+    // queues a copy of sources into consecutive slots from dest, null sources leave their slot as is
+    void CopyToTable(const DescriptorHandle& dest, const DescriptorHandle sources[], uint32_t numSources);
+    void Flush();
+
+    // fenceValue is signaled by the last graphics submission of the frame
+    void EndFrame(uint64_t fenceValue);
+
+    uint32_t GetSize() const { return mRing.GetSize(); }
+    uint32_t GetUsedCount() const { return mRing.GetUsedCount(); }
+    const Stats& GetStats() const { return mStats; }
 private:
     D3D12_DESCRIPTOR_HEAP_TYPE mType;
-    D3D12_CPU_DESCRIPTOR_HANDLE mCpuStart;
-    D3D12_GPU_DESCRIPTOR_HANDLE mGpuStart;
-    size_t mCurrentOffset;
-    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mDescriptorHeap;
+    UINT mDescriptorSize;
+    DescriptorHandle mHeapStart;
+    Utility::FenceRingAllocator mRing;
+    Utility::IndexRangeAllocator mPinned; // indices after the ring's
+
+    // ranges queued for Flush, neighbouring slots are merged into one range
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> mDestStarts;
+    std::vector<UINT> mDestSizes;
+    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> mSrcStarts;
+    std::vector<UINT> mSrcSizes;
+
+    uint32_t mFrameCopies;
+    uint32_t mFrameFlushes;
+    Stats mStats;
 };
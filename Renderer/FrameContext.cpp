@@ -3,7 +3,8 @@
 #include "CommandList.h"
 #include "Graphics.h"
 #include "PixelBuffer.h"
-#include "Utils/Hash.h"
+#include "StagingManager.h"
+#include "Utils/FrameArena.h"
 #include "Utils/ThreadPoolExecutor.h"
 
 //namespace CollectionHelper
@@ -88,7 +89,7 @@ void FrameContext::Flush(CommandQueue& queue, bool isTempTask)
 	if (!isTempTask)
 	{
 		mIsStartRenderTask = false;
-		mFrameResourceStateCache.clear();
+		mFrameResourceStateCache.Clear();
 		mGraphicsTask.clear();
 	}
 }
@@ -116,6 +117,20 @@ void FrameContext::Finish(bool waitForCompletion)
 	//EngineProfiling::EndBlock(this);
 }
 
+void FrameContext::BeginFrameArena(size_t slot)
+{
+	ZoneScoped;
+
+	// the same fences RecordGraphicsTask waits for, so this only moves the wait ahead of Render
+	for (int i = 0; i < Graphics::NUM_RENDER_TASK_TYPE; i++)
+	{
+		CommandQueue& queue = CommandQueueManager::GetInstance()->GetQueue(Graphics::GetQueueType((Graphics::RENDER_TASK_TYPE)i));
+		queue.WaitForFence(mCurTaskFence[i]);
+	}
+
+	Utility::FrameArena::BeginFrame(slot);
+}
+
 void FrameContext::BeginRecordGraphicsTask(CommandList& commanList, size_t idx)
 {
 	commanList.mCommandListIndex = idx;
@@ -135,29 +150,36 @@ void FrameContext::EndRecordGraphicsTask(CommandList* beforeList, CommandList* a
 {
 	if (!beforeList && !isRear)
 	{
-		mFrameResourceStateCache = std::move(afterList->mResourceStateCache);
+		mFrameResourceStateCache.Swap(afterList->mResourceStateCache);
+		afterList->mResourceStateCache.Clear();
 	}
 	else
 	{
 		// berfore state already in mFrameResourceStateCache
-		std::map<size_t, ResourceStateCache>& afterResCache = afterList->mResourceStateCache;
-		for (auto kvAfterIter = afterResCache.begin(); kvAfterIter != afterResCache.end();)
+		for (ResourceStateCache& afterStateCache : afterList->mResourceStateCache)
 		{
-			auto curFindIter = mFrameResourceStateCache.find(kvAfterIter->first);
-			if (curFindIter == mFrameResourceStateCache.end())
+			// after list may have moved the resource on from the state it began with
+			ResourceStateCache beginStateCache = afterStateCache;
+			if (afterStateCache.mStateBegin != (D3D12_RESOURCE_STATES)-1)
+				beginStateCache.mStateCurrent = afterStateCache.mStateBegin;
+
+			ResourceStateCache* curStateCache = mFrameResourceStateCache.Find(afterStateCache.mGpuResource);
+			if (curStateCache == nullptr)
 			{
-				auto releaseIter = kvAfterIter++;
-				mFrameResourceStateCache.insert(afterResCache.extract(releaseIter));
+				// first touched by this list, it still holds the state of last frame
+				ResourceStateCache usageStateCache(afterStateCache.mGpuResource);
+				if (beforeList && usageStateCache.mStateCurrent != beginStateCache.mStateCurrent)
+					beforeList->TransitionResource(usageStateCache, beginStateCache);
+
+				mFrameResourceStateCache.Add(afterStateCache);
 				continue;
 			}
 
-			ResourceStateCache& curStateCache = curFindIter->second;
-			ResourceStateCache& afterStateCache = kvAfterIter->second;
-			if (curStateCache.mStateCurrent != afterStateCache.mStateCurrent)
+			if (curStateCache->mStateCurrent != beginStateCache.mStateCurrent)
 			{
-				beforeList->TransitionResource(curStateCache, afterStateCache);
+				beforeList->TransitionResource(*curStateCache, beginStateCache);
 			}
-			kvAfterIter++;
+			curStateCache->mStateCurrent = afterStateCache.mStateCurrent;
 		}
 	}
 
@@ -171,8 +193,8 @@ void FrameContext::EndRecordGraphicsTask(CommandList* beforeList, CommandList* a
 		}
 
 		// now resource has real state
-		for (auto& resourceCache : mFrameResourceStateCache)
-			resourceCache.second.mGpuResource.mUsageState = resourceCache.second.mStateCurrent;
+		for (ResourceStateCache& resourceCache : mFrameResourceStateCache)
+			resourceCache.mGpuResource.mUsageState = resourceCache.mStateCurrent;
 
 		afterList->FlushResourceBarriers();
 
@@ -202,17 +224,19 @@ void FrameContext::PrepareRevealBufferBegin(GraphicsCommandList& ghCommandList)
 void FrameContext::PrepareRevealBufferEnd(CommandList& ghCommandList)
 {
 	ColorBuffer& renderTarget = FrameContextManager::GetInstance()->GetCurrentSwapChain();
-	auto stateCacheIter = mFrameResourceStateCache.find(Utility::HashState((GpuResource*)&renderTarget));
-	ASSERT(stateCacheIter != mFrameResourceStateCache.end());
-	ResourceStateCache presentStateCache = stateCacheIter->second;
+	ResourceStateCache* stateCache = mFrameResourceStateCache.Find(renderTarget);
+	ASSERT(stateCache != nullptr);
+	ResourceStateCache presentStateCache = *stateCache;
 	presentStateCache.mStateCurrent = D3D12_RESOURCE_STATE_PRESENT;
-	ghCommandList.TransitionResource(stateCacheIter->second, presentStateCache);
+	ghCommandList.TransitionResource(*stateCache, presentStateCache);
 }
 
 
 // -- FrameContextManager --
 void FrameContextManager::InitFrameContexts()
 {
+	static_assert(SWAP_CHAIN_BUFFER_COUNT <= Utility::FrameArena::kMaxFrameSlots);
+
 	mCurFrameContextIdx = 0;
 
 	for (size_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; i++)
@@ -229,7 +253,9 @@ uint64_t FrameContextManager::CommitAsyncCopyTask(const Graphics::GraphicsContex
 	copyTask(commandList);
 	commandList->UpdateResourceState();
 	commandList->BeforeCommandListSubmit();
-	return queue.ExecuteCommandLists((ID3D12CommandList**)commandList->GetDeviceCommandListOf(), 1);
+	uint64_t fenceValue = queue.ExecuteCommandLists((ID3D12CommandList**)commandList->GetDeviceCommandListOf(), 1);
+	commandList->RetireUploadPages(fenceValue);
+	return fenceValue;
 }
 
 uint64_t FrameContextManager::CommitAsyncComputeTask(const Graphics::GraphicsContext::GraphicsTask& computeTask)
@@ -240,7 +266,9 @@ uint64_t FrameContextManager::CommitAsyncComputeTask(const Graphics::GraphicsCon
 	computeTask(commandList);
 	commandList->UpdateResourceState();
 	commandList->BeforeCommandListSubmit();
-	return queue.ExecuteCommandLists((ID3D12CommandList**)commandList->GetDeviceCommandListOf(), 1);
+	uint64_t fenceValue = queue.ExecuteCommandLists((ID3D12CommandList**)commandList->GetDeviceCommandListOf(), 1);
+	commandList->RetireUploadPages(fenceValue);
+	return fenceValue;
 }
 
 uint64_t FrameContextManager::CommitAsyncGraphicsTask(const Graphics::GraphicsContext::GraphicsTask& graphicsTask)
@@ -251,7 +279,9 @@ uint64_t FrameContextManager::CommitAsyncGraphicsTask(const Graphics::GraphicsCo
 	graphicsTask(commandList);
 	commandList->UpdateResourceState();
 	commandList->BeforeCommandListSubmit();
-	return queue.ExecuteCommandLists((ID3D12CommandList**)commandList->GetDeviceCommandListOf(), 1);
+	uint64_t fenceValue = queue.ExecuteCommandLists((ID3D12CommandList**)commandList->GetDeviceCommandListOf(), 1);
+	commandList->RetireUploadPages(fenceValue);
+	return fenceValue;
 }
 
 ColorBuffer& FrameContextManager::GetCurrentSwapChain()
@@ -318,6 +348,8 @@ void FrameContextManager::BeginRender()
 {
 	ZoneScoped;
 
+	GetCurFrameContext()->BeginFrameArena(mCurFrameContextIdx);
+
 	for (size_t i = 0; i < mGraphicsContexts.size(); i++)
 		mGraphicsContexts[i]->BeginRender();
 }
@@ -329,6 +361,11 @@ void FrameContextManager::ComitRenderTask()
 	GetCurFrameContext()->RecordGraphicsTask();
 	GetCurFrameContext()->Finish();
 
+	// every list reading the frame's transient tables is submitted, the last graphics fence covers them
+	GET_DESCRIPTOR_RING().EndFrame(CommandQueueManager::GetInstance()->GetGraphicsQueue().GetCurrentFenceValue());
+	StagingManager::GetInstance()->Flush();
+	UploadPagePool::EndFrame();
+
 	mCurFrameContextIdx = (mCurFrameContextIdx + 1) % SWAP_CHAIN_BUFFER_COUNT;
 }
 
@@ -392,7 +429,10 @@ CommandList* FrameContextManager::RequireCommandList(D3D12_COMMAND_LIST_TYPE typ
 void FrameContextManager::DiscardUsedCommandLists(Graphics::RENDER_TASK_TYPE type, uint64_t fenceValue)
 {
 	for (auto& usingList : mUsingCommandLists[type])
+	{
 		usingList->mRetiredFenceValue = fenceValue;
+		usingList->RetireUploadPages(fenceValue);
+	}
 
 	mRetiredCommandLists[type].splice(mRetiredCommandLists[type].end(), mUsingCommandLists[type]);
 }
@@ -37,6 +37,9 @@ private:
 
     void Finish(bool waitForCompletion = false);
 
+    // waits for the GPU to retire this context's last frame, then hands its frame arena slot to the new one
+    void BeginFrameArena(size_t slot);
+
     void BeginRecordGraphicsTask(CommandList& commanList, size_t idx);
     void EndRecordGraphicsTask(CommandList* before, CommandList* after, bool isRear, bool isTemp); //resolve resource transition
     void ResolveResourceState(ResourceStateCache& curState, ResourceStateCache& afterState);
@@ -52,7 +55,7 @@ private:
     std::vector<MutiGraphicsCommand> mGraphicsTask;
     std::queue<std::future<Graphics::GraphicsContext::GraphicsTask::result_type>> mFutureQueue;
     std::vector<ID3D12CommandList*> mFinalCommandLists;
-    std::map<size_t, ResourceStateCache> mFrameResourceStateCache;
+    ResourceStateSet mFrameResourceStateCache;
 };
 
 
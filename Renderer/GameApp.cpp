@@ -4,6 +4,8 @@
 #include "SystemTime.h"
 #include "GameInput.h"
 #include "CommandQueue.h"
+#include "LinearAllocator2.h"
+#include "StagingManager.h"
 #include "FrameContext.h"
 #include "RootSignature.h"
 #include "PipelineState.h"
@@ -12,7 +14,9 @@
 #include "SamplerManager.h"
 #include "TextRenderer.h"
 #include "PostEffect.h"
+#include "NullDevice.h"
 #include "Utils/CommandLineArg.h"
+#include "Utils/FrameArena.h"
 #include "Utils/DebugUtils.h"
 #include "ImGui/imgui_backend.h"
 #include "ImGui/imgui.h"
@@ -25,16 +29,77 @@ namespace GameApp
 
     LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
+    // -benchframes N runs N frames without showing the window and prints the CPU cost of each stage,
+    // with -nulldevice 1 it needs no GPU
+    enum eFrameStage { kStageQueueEvents, kStageUpdate, kStageRecord, kStageSubmit, kStagePresent, kNumFrameStages };
+    const char* sFrameStageNames[kNumFrameStages] = { "QueueEvents", "Update", "Record", "Submit", "Present" };
+
+    const uint32_t kBenchmarkWarmupFrames = 16;
+    uint32_t sBenchmarkFrames = 0;
+    uint32_t sBenchmarkFrameIndex = 0;
+    int64_t sStageTicks[kNumFrameStages] = {};
+
+    struct StageTimer
+    {
+        StageTimer() : mTick(SystemTime::GetCurrentTick()) {}
+
+        void Next(eFrameStage stage)
+        {
+            int64_t tick = SystemTime::GetCurrentTick();
+            sStageTicks[stage] += tick - mTick;
+            mTick = tick;
+        }
+
+        int64_t mTick;
+    };
+
+    void PrintBenchmark()
+    {
+        if (sBenchmarkFrameIndex <= kBenchmarkWarmupFrames)
+            return;
+
+        uint32_t numFrames = sBenchmarkFrameIndex - kBenchmarkWarmupFrames;
+        double totalMs = 0.0;
+        Utility::PrintMessage("Benchmark: %u frames, CPU ms per frame\n", numFrames);
+        for (uint32_t i = 0; i < kNumFrameStages; i++)
+        {
+            double stageMs = SystemTime::TicksToMillisecs(sStageTicks[i]) / numFrames;
+            totalMs += stageMs;
+            Utility::PrintMessage("  %-12s %8.3f\n", sFrameStageNames[i], stageMs);
+        }
+        Utility::PrintMessage("  %-12s %8.3f\n", "Total", totalMs);
+
+        if (Graphics::gUseNullDevice)
+        {
+            NullDevice::CommandStats stats = NullDevice::GetExecutedStats();
+            Utility::PrintMessage("Commands per frame: lists %.1f, draws %.1f, dispatches %.1f, copies %.1f, barriers %.1f, state calls %.1f\n",
+                (double)stats.commandLists / numFrames, (double)stats.draws / numFrames,
+                (double)stats.dispatches / numFrames, (double)stats.copies / numFrames,
+                (double)stats.barriers / numFrames, (double)stats.stateCalls / numFrames);
+        }
+
+        Utility::FrameArena::Stats arenaStats = Utility::FrameArena::GetStats();
+        if (arenaStats.numFrames > 0)
+        {
+            Utility::PrintMessage("Frame arena: %.1f KB per frame, peak %.1f KB, reserved %.1f KB\n",
+                arenaStats.totalFrameBytes / 1024.0 / arenaStats.numFrames, arenaStats.peakFrameBytes / 1024.0,
+                arenaStats.reservedBytes / 1024.0);
+        }
+
+        UploadPagePool::Stats uploadStats = UploadPagePool::GetStats();
+        if (uploadStats.numFrames > 0)
+        {
+            Utility::PrintMessage("Upload pages: %.1f KB per frame, peak in flight %.1f KB, resident %.1f KB\n",
+                uploadStats.totalUploadBytes / 1024.0 / uploadStats.numFrames, uploadStats.peakInFlightBytes / 1024.0,
+                uploadStats.residentBytes / 1024.0);
+        }
+    }
+
     void DrawInternalUI();
 
     void InitializeApplication(IGameApp& game)
     {
-        int argc = 0;
-        LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
-        CommandLineArgs::Initialize(argc, argv);
-
         Graphics::Initialize(game.RequiresRaytracingSupport());
-        SystemTime::Initialize();
 
         InitSingleton();
 
@@ -54,11 +119,13 @@ namespace GameApp
 
     void TerminateApplication(IGameApp& game)
     {
+        StagingManager::GetInstance()->WaitIdle();
         CommandQueueManager::GetInstance()->IdleGPU();
 
         game.Cleanup();
 
         Graphics::DestroyResource();
+        UploadPagePool::Shutdown();
 
         DestroySingleton();
     }
@@ -68,25 +135,44 @@ namespace GameApp
         ZoneScoped;
 
         float deltaTime = Graphics::GetFrameTime();
+        StageTimer stageTimer;
 
         CommandQueueManager::GetInstance()->SelectQueueEvent();
+        stageTimer.Next(kStageQueueEvents);
 
         ImGuiRenderer::gImguiContext->Update(deltaTime);
 
         game.Update(deltaTime);
         GameInput::LateUpdate(deltaTime);
         DrawInternalUI();
+        stageTimer.Next(kStageUpdate);
 
         FrameContextManager* frameContextMgr = FrameContextManager::GetInstance();
         frameContextMgr->BeginRender();
         frameContextMgr->Render();
         frameContextMgr->EndRender();
+        stageTimer.Next(kStageRecord);
         frameContextMgr->ComitRenderTask();
+        stageTimer.Next(kStageSubmit);
 
         Graphics::Present();
+        stageTimer.Next(kStagePresent);
 
         FrameMark;
 
+        if (sBenchmarkFrames > 0)
+        {
+            // the first frames still stream assets in, only the steady state is timed
+            if (++sBenchmarkFrameIndex == kBenchmarkWarmupFrames)
+            {
+                std::fill(std::begin(sStageTicks), std::end(sStageTicks), 0);
+                NullDevice::ResetExecutedStats();
+                Utility::FrameArena::ResetStats();
+                UploadPagePool::ResetStats();
+            }
+            return sBenchmarkFrameIndex < kBenchmarkWarmupFrames + sBenchmarkFrames;
+        }
+
         return !game.IsDone();
     }
 
@@ -103,6 +189,17 @@ namespace GameApp
         Microsoft::WRL::Wrappers::RoInitializeWrapper InitializeWinRT(RO_INIT_MULTITHREADED);
         CheckHR(InitializeWinRT);
 
+        int argc = 0;
+        LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+        CommandLineArgs::Initialize(argc, argv);
+        SystemTime::Initialize();
+
+        std::filesystem::current_path(std::filesystem::current_path() / L"..\\");
+
+        int exitCode = 0;
+        if (gameApp->RunOffline(exitCode))
+            return exitCode;
+
         // Register class
         WNDCLASSEX wcex;
         wcex.cbSize = sizeof(WNDCLASSEX);
@@ -131,12 +228,13 @@ namespace GameApp
 
         ASSERT(Graphics::ghWnd != 0);
 
-        std::filesystem::current_path(std::filesystem::current_path() / L"..\\");
         InitializeApplication(*gameApp);
 
         Graphics::gApplicationInited = true;
 
-        ShowWindow(Graphics::ghWnd, nCmdShow/*SW_SHOWDEFAULT*/);
+        CommandLineArgs::GetInteger(L"benchframes", sBenchmarkFrames);
+        if (sBenchmarkFrames == 0)
+            ShowWindow(Graphics::ghWnd, nCmdShow/*SW_SHOWDEFAULT*/);
 
         while (true)
         {
@@ -155,6 +253,9 @@ namespace GameApp
                     break;
             }
         }
+
+        if (sBenchmarkFrames > 0)
+            PrintBenchmark();
            
         TerminateApplication(*gameApp);
         Graphics::Shutdown();
@@ -166,6 +267,7 @@ namespace GameApp
         DescriptorAllocatorManager::GetOrCreateInstance();
         CommandQueueManager::GetOrCreateInstance();
         FrameContextManager::GetOrCreateInstance();
+        StagingManager::GetOrCreateInstance();
         RootSignatureManager::GetOrCreateInstance();
         PipeLineStateManager::GetOrCreateInstance();
         ShaderCompositor::GetOrCreateInstance(L"Shader");
@@ -181,6 +283,7 @@ namespace GameApp
         PipeLineStateManager::RemoveInstance();
         ShaderCompositor::RemoveInstance();
         TextureManager::RemoveInstance();
+        StagingManager::RemoveInstance();
         SamplerManager::RemoveInstance();
         DescriptorAllocatorManager::RemoveInstance();
     }
@@ -191,6 +294,20 @@ namespace GameApp
 
         TextRenderer::gTextContext->DrawFormattedString("FPS %7.2f, mspf %7.5f s\n",
             Graphics::GetFrameRate(), Graphics::GetFrameTime());
+
+        Utility::FrameArena::Stats arenaStats = Utility::FrameArena::GetStats();
+        TextRenderer::gTextContext->DrawFormattedString("Frame arena %7.1f KB, peak %7.1f KB\n",
+            arenaStats.lastFrameBytes / 1024.0, arenaStats.peakFrameBytes / 1024.0);
+
+        UploadPagePool::Stats uploadStats = UploadPagePool::GetStats();
+        TextRenderer::gTextContext->DrawFormattedString("Upload %7.1f KB, pages new %u reused %u freed %u, in flight %7.1f KB, peak %7.1f KB\n",
+            uploadStats.lastFrameUploadBytes / 1024.0, uploadStats.lastFramePagesCreated, uploadStats.lastFramePagesReused,
+            uploadStats.lastFramePagesReclaimed, uploadStats.inFlightBytes / 1024.0, uploadStats.peakInFlightBytes / 1024.0);
+
+        StagingManager::Stats stagingStats = StagingManager::GetInstance()->GetStats();
+        TextRenderer::gTextContext->DrawFormattedString("Staging %u uploads %7.1f KB per batch, %u queued, ring %7.1f / %7.1f KB\n",
+            stagingStats.lastBatchUploads, stagingStats.lastBatchBytes / 1024.0, (uint32_t)stagingStats.numQueued,
+            stagingStats.ringUsedBytes / 1024.0, stagingStats.ringSize / 1024.0);
     }
 
     bool IGameApp::IsDone()
@@ -16,6 +16,10 @@ namespace GameApp
 
 		virtual bool RequiresRaytracingSupport() { return false; }
 
+		// Runs before the window and device exist, returning true quits with exitCode instead of
+		// starting the renderer. Command line tools like asset bakes go here.
+		virtual bool RunOffline(int& exitCode) { return false; }
+
 		virtual bool IsDone();
 	};
 
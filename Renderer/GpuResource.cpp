@@ -0,0 +1,48 @@
+#include "GpuResource.h"
+
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // resources are made on loader and render threads alike, slots come from one shared free list
+    struct TrackingSlotRegistry
+    {
+        std::mutex mutex;
+        std::vector<uint32_t> freeSlots;
+        uint32_t numSlots = 0;
+    };
+
+    TrackingSlotRegistry& GetTrackingSlotRegistry()
+    {
+        // built by the first resource, so it outlives every resource including globals
+        static TrackingSlotRegistry sRegistry;
+        return sRegistry;
+    }
+}
+
+uint32_t GpuResource::GetTrackingSlotCount()
+{
+    TrackingSlotRegistry& registry = GetTrackingSlotRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    return registry.numSlots;
+}
+
+uint32_t GpuResource::AllocateTrackingSlot()
+{
+    TrackingSlotRegistry& registry = GetTrackingSlotRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    if (registry.freeSlots.empty())
+        return registry.numSlots++;
+
+    uint32_t slot = registry.freeSlots.back();
+    registry.freeSlots.pop_back();
+    return slot;
+}
+
+void GpuResource::FreeTrackingSlot(uint32_t slot)
+{
+    TrackingSlotRegistry& registry = GetTrackingSlotRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.freeSlots.push_back(slot);
+}
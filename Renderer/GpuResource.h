@@ -12,16 +12,38 @@ class GpuResource
 public:
     GpuResource() :
         mGpuVirtualAddress(D3D12_VIRTUAL_ADDRESS_NULL),
-        mUsageState(D3D12_RESOURCE_STATE_COMMON)
+        mUsageState(D3D12_RESOURCE_STATE_COMMON),
+        mTrackingSlot(AllocateTrackingSlot())
     {}
 
     GpuResource(ID3D12Resource* pResource, D3D12_RESOURCE_STATES usageState) :
         mGpuVirtualAddress(D3D12_VIRTUAL_ADDRESS_NULL),
         mResource(pResource),
-        mUsageState(usageState)
+        mUsageState(usageState),
+        mTrackingSlot(AllocateTrackingSlot())
     {}
 
-    virtual ~GpuResource() { Destroy(); }
+    // a copy is tracked on its own, the slot stays with the object
+    GpuResource(const GpuResource& other) :
+        mResource(other.mResource),
+        mUsageState(other.mUsageState),
+        mGpuVirtualAddress(other.mGpuVirtualAddress),
+        mTrackingSlot(AllocateTrackingSlot())
+    {}
+
+    GpuResource& operator=(const GpuResource& other)
+    {
+        mResource = other.mResource;
+        mUsageState = other.mUsageState;
+        mGpuVirtualAddress = other.mGpuVirtualAddress;
+        return *this;
+    }
+
+    virtual ~GpuResource()
+    {
+        Destroy();
+        FreeTrackingSlot(mTrackingSlot);
+    }
 
     virtual void Destroy()
     {
@@ -35,8 +57,18 @@ public:
     ID3D12Resource** GetResourceAddressOf() { return mResource.GetAddressOf(); }
 
     D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress() const { return mGpuVirtualAddress; }
+
+    // Dense index among the live resources, reused once the resource is gone. Resource state
+    // tracking indexes arrays with it instead of hashing the resource address.
+    uint32_t GetTrackingSlot() const { return mTrackingSlot; }
+    static uint32_t GetTrackingSlotCount();
+private:
+    static uint32_t AllocateTrackingSlot();
+    static void FreeTrackingSlot(uint32_t slot);
 protected:
     Microsoft::WRL::ComPtr<ID3D12Resource> mResource;
     D3D12_RESOURCE_STATES mUsageState;
     D3D12_GPU_VIRTUAL_ADDRESS mGpuVirtualAddress;
+private:
+    uint32_t mTrackingSlot;
 };
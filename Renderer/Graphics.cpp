@@ -4,11 +4,13 @@
 #include "GameApp.h"
 #include "PixelBuffer.h"
 #include "FrameContext.h"
+#include "NullDevice.h"
 #include "SystemTime.h"
 #include "Math/VectorMath.h"
 #include "Utils/DebugUtils.h"
 #include "Utils/CommandLineArg.h"
 #include "Utils/ThreadPoolExecutor.h"
+#include "Utils/IOQueue.h"
 
 namespace
 {
@@ -32,6 +34,7 @@ namespace
 namespace Utility
 {
     ThreadPoolExecutor gThreadPoolExecutor(4);
+    IOQueue gIOQueue(2);
 }
 
 namespace Graphics
@@ -46,6 +49,7 @@ namespace Graphics
     uint32_t gRenderWidth = 1920;
     uint32_t gRenderHeight = 1080;
     bool gEnableHDROutput = false;
+    bool gUseNullDevice = false;
 
     bool gEnableVSync = false;
     bool gLimitTo30Hz = false;
@@ -270,10 +274,21 @@ namespace Graphics
 #endif
     }
 
-    void InitializeSwapChain()
+    void CreateDisplayPlane(uint32_t i)
     {
-        ASSERT(sSwapChain1 == nullptr, "Graphics has already been initialized");
+        if (gUseNullDevice)
+        {
+            gDisplayPlane[i].Create(L"Primary SwapChain Buffer", gDisplayWidth, gDisplayHeight, 1, SWAP_CHAIN_FORMAT);
+            return;
+        }
 
+        ID3D12Resource* displayPlane = nullptr;
+        CheckHR(sSwapChain1->GetBuffer(i, IID_PPV_ARGS(&displayPlane)));
+        gDisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", displayPlane);
+    }
+
+    void CreateSwapChain()
+    {
         Microsoft::WRL::ComPtr<IDXGIFactory4> dxgiFactory;
         DWORD dxgiFactoryFlags = 0;
         CheckHR(CreateDXGIFactory2(0, IID_PPV_ARGS(dxgiFactory.GetAddressOf())));
@@ -321,14 +336,21 @@ namespace Graphics
             }
         }
 #endif // End CONDITIONALLY_ENABLE_HDR_OUTPUT
+    }
+
+    void InitializeSwapChain()
+    {
+        ASSERT(sSwapChain1 == nullptr, "Graphics has already been initialized");
+
+        // the null device has nothing to present to, its display planes are plain render targets
+        if (!gUseNullDevice)
+            CreateSwapChain();
 
         gSceneColorBufferGpuSRV = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, SWAP_CHAIN_BUFFER_COUNT);
         gSceneDepthBufferGpuSRV = ALLOC_DESCRIPTOR_GPU(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, SWAP_CHAIN_BUFFER_COUNT);
         for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
         {
-            ID3D12Resource* displayPlane = nullptr;
-            CheckHR(sSwapChain1->GetBuffer(i, IID_PPV_ARGS(&displayPlane)));
-            gDisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", displayPlane);
+            CreateDisplayPlane(i);
 
             gSceneColorBuffer[i].Create(L"Scene Color Buffer", gRenderWidth, gRenderHeight, 1, HDR_FORMAT);
             gSceneDepthBuffer[i].Create(L"Scene Depth Buffer", gRenderWidth, gRenderHeight, 1, DSV_FORMAT);
@@ -377,16 +399,15 @@ namespace Graphics
         for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
             gDisplayPlane[i].Destroy();
 
-        ASSERT(sSwapChain1 != nullptr);
-        CheckHR(sSwapChain1->ResizeBuffers(SWAP_CHAIN_BUFFER_COUNT, width, height, SWAP_CHAIN_FORMAT, 0));
-
-        for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+        if (!gUseNullDevice)
         {
-            ID3D12Resource* displayPlane = nullptr;
-            CheckHR(sSwapChain1->GetBuffer(i, IID_PPV_ARGS(&displayPlane)));
-            gDisplayPlane[i].CreateFromSwapChain(L"Primary SwapChain Buffer", displayPlane);
+            ASSERT(sSwapChain1 != nullptr);
+            CheckHR(sSwapChain1->ResizeBuffers(SWAP_CHAIN_BUFFER_COUNT, width, height, SWAP_CHAIN_FORMAT, 0));
         }
 
+        for (uint32_t i = 0; i < SWAP_CHAIN_BUFFER_COUNT; ++i)
+            CreateDisplayPlane(i);
+
         FrameContextManager::GetInstance()->OnResizeSwapChain(gDisplayWidth, gDisplayHeight);
     }
 
@@ -396,7 +417,8 @@ namespace Graphics
 
         UINT PresentInterval = gEnableVSync ? std::min(4, (int)Math::Round(sFrameTime * 60.0f)) : 0;
 
-        sSwapChain1->Present(PresentInterval, 0);
+        if (!gUseNullDevice)
+            sSwapChain1->Present(PresentInterval, 0);
 
         int64_t CurrentTick = SystemTime::GetCurrentTick();
 
@@ -446,6 +468,18 @@ namespace Graphics
 
     void Initialize(bool requireDXRSupport)
     {
+        uint32_t useNullDevice = 0;
+        CommandLineArgs::GetInteger(L"nulldevice", useNullDevice);
+        if (useNullDevice)
+        {
+            float gpuMsPerSubmit = 0.0f;
+            CommandLineArgs::GetFloat(L"nullgpums", gpuMsPerSubmit);
+            CheckHR(NullDevice::CreateDevice(gpuMsPerSubmit, IID_PPV_ARGS(gDevice.GetAddressOf())));
+            gUseNullDevice = true;
+            Utility::PrintMessage("Null device requested, frames are recorded but never rendered\n");
+            return;
+        }
+
         uint32_t useDebugLayers = 0;
         CommandLineArgs::GetInteger(L"debug", useDebugLayers);
 #if _DEBUG
@@ -60,6 +60,7 @@ namespace Graphics
     extern eResolution gDisplayResolution;
     extern eResolution gRenderResolution;
     extern bool gEnableHDROutput; // assume false
+    extern bool gUseNullDevice; // -nulldevice, see NullDevice.h
 
     extern bool gEnableVSync;
     extern bool gLimitTo30Hz;
@@ -2,6 +2,7 @@
 #include "CoreHeader.h"
 #include "Common.h"
 #include "CommandList.h"
+#include "Utils/FrameArena.h"
 
 namespace Graphics
 {
@@ -22,6 +23,18 @@ namespace Graphics
             };
         }
 
+        template<typename F, typename C, typename ...Args>
+        static std::enable_if_t<std::is_member_function_pointer_v<std::remove_reference_t<F>>, GraphicsTask>
+            PushFrameGraphicsTaskBindImpl(F&& f, C* clazz, Args&&... args)
+        {
+            auto bound = std::bind(f, clazz, std::placeholders::_1, std::forward<Args>(args)...);
+            auto* func = Utility::FrameArena::New<decltype(bound)>(std::move(bound));
+            return [func](GraphicsTask::argument_type commandList) -> GraphicsTask::result_type
+            {
+                return (*func)(commandList);
+            };
+        }
+
         // for test just comment
         //template<typename F, typename ...Args>
         //static GraphicsTask PushGraphicsTaskBindImpl(F&& f, Args&&... args)
@@ -39,6 +52,15 @@ namespace Graphics
             WARN_IF_NOT(std::this_thread::get_id() == main_thread_id, L"NOT IN MAIN THREAD!");
             return PushGraphicsTaskBindImpl(std::forward<F>(f), std::forward<Args>(args)...);
         }
+
+        // PushGraphicsTaskBind for frame tasks with large bound arguments: the bound call lives in the frame
+        // arena until the frame retires and the task only holds a pointer, which std::function keeps inline
+        template<typename F, typename ...Args>
+        static GraphicsTask PushFrameGraphicsTaskBind(F&& f, Args&&... args)
+        {
+            WARN_IF_NOT(std::this_thread::get_id() == main_thread_id, L"NOT IN MAIN THREAD!");
+            return PushFrameGraphicsTaskBindImpl(std::forward<F>(f), std::forward<Args>(args)...);
+        }
     protected:
         GraphicsContext() { RegisterGlobal(); }
         ~GraphicsContext() {}
@@ -1,8 +1,52 @@
 #include "LinearAllocator2.h"
 #include "Graphics.h"
+#include "CommandQueue.h"
 #include "Utils/DebugUtils.h"
 #include "Math/Common.h"
 
+#include <atomic>
+
+namespace
+{
+    ID3D12Resource* CreatePageResource(LinearAllocatorType type, size_t size, D3D12_RESOURCE_STATES& defaultUsage)
+    {
+        D3D12_HEAP_PROPERTIES heapProps{};
+        heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+        heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+
+        D3D12_RESOURCE_DESC resourceDesc;
+        resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+        resourceDesc.Alignment = 0;
+        resourceDesc.Width = size;
+        resourceDesc.Height = 1;
+        resourceDesc.DepthOrArraySize = 1;
+        resourceDesc.MipLevels = 1;
+        resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+        resourceDesc.SampleDesc.Count = 1;
+        resourceDesc.SampleDesc.Quality = 0;
+        resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+
+        if (type == kGpuExclusive)
+        {
+            heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
+            resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+            defaultUsage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        }
+        else
+        {
+            heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+            resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+            defaultUsage = D3D12_RESOURCE_STATE_GENERIC_READ;
+        }
+
+        ID3D12Resource* pBuffer;
+        CheckHR(Graphics::gDevice->CreateCommittedResource(
+            &heapProps, D3D12_HEAP_FLAG_NONE, &resourceDesc, defaultUsage, nullptr, IID_PPV_ARGS(&pBuffer)));
+        pBuffer->SetName(L"LinearAllocator Page");
+        return pBuffer;
+    }
+}
+
 AllocSpan LinearAllocator::Allocate(size_t size, size_t alignment)
 {
     // Align the allocation
@@ -82,48 +126,319 @@ LinearAllocationPage& LinearAllocator::AllocNewPage(size_t size)
         return mPages.back();
     }
 
-    D3D12_HEAP_PROPERTIES heapProps{};
-    heapProps.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-    heapProps.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    D3D12_RESOURCE_STATES defaultUsage;
+    ID3D12Resource* pBuffer = CreatePageResource(mType, size == 0 ? mPerPageSize : size, defaultUsage);
 
-    D3D12_RESOURCE_DESC resourceDesc;
-    resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-    resourceDesc.Alignment = 0;
-    resourceDesc.Height = 1;
-    resourceDesc.DepthOrArraySize = 1;
-    resourceDesc.MipLevels = 1;
-    resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-    resourceDesc.SampleDesc.Count = 1;
-    resourceDesc.SampleDesc.Quality = 0;
-    resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    return size == 0 ? mPages.emplace_back(pBuffer, defaultUsage) : mLargePages.emplace_back(pBuffer, defaultUsage);
+}
+
+AllocSpan LinearAllocator::AllocateLargePage(size_t size)
+{
+    LinearAllocationPage& newPage = AllocNewPage(size);
+    return AllocSpan(newPage, newPage.mStart, newPage.mGpuVirtualAddress, size, 0);
+}
 
-    D3D12_RESOURCE_STATES defaultUsage;
 
-    if (mType == kGpuExclusive)
+// -- UploadPagePool --
+class PooledUploadPage : public LinearAllocationPage
+{
+public:
+    PooledUploadPage(ID3D12Resource* pResource, size_t size, uint32_t poolIndex, uint32_t sizeClass) :
+        LinearAllocationPage(pResource, D3D12_RESOURCE_STATE_GENERIC_READ),
+        mSize(size), mPoolIndex(poolIndex), mSizeClass(sizeClass), mNumUsers(0), mNextPage(0)
     {
-        heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
-        resourceDesc.Width = size == 0 ? mPerPageSize : size;
-        resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
-        defaultUsage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        for (std::atomic<uint64_t>& fence : mFences)
+            fence.store(0, std::memory_order_relaxed);
     }
-    else
+
+    const size_t mSize;
+    const uint32_t mPoolIndex;
+    const uint32_t mSizeClass;
+    std::atomic<uint32_t> mNumUsers;  // the thread suballocating from it plus every list holding it
+    std::atomic<uint32_t> mNextPage;  // pool index + 1 of the page below it on a stack, 0 at the bottom
+    std::atomic<uint64_t> mFences[Graphics::NUM_RENDER_TASK_TYPE]; // highest fence of every list that used it
+};
+
+namespace
+{
+    constexpr size_t kUploadPageSize = kCpuAllocatorPageSize;
+
+    // Stack heads pack the pool index + 1 of the top page in the low 32 bits and a tag bumped by
+    // every change in the high 32 bits, so a page popped and pushed back in between fails the CAS
+    std::atomic<PooledUploadPage*> sPages[UploadPagePool::kMaxPages];
+    std::atomic<uint32_t> sNumPages{ 0 };
+    std::atomic<uint64_t> sFreeHeads[UploadPagePool::kNumSizeClasses];
+    std::atomic<uint64_t> sRetiredHead{ 0 };
+    std::atomic<uint64_t> sEpoch{ 1 };
+
+    std::atomic<size_t> sFrameUploadBytes{ 0 };
+    std::atomic<uint32_t> sFramePagesCreated{ 0 };
+    std::atomic<uint32_t> sFramePagesReused{ 0 };
+    std::atomic<uint32_t> sFramePagesReclaimed{ 0 };
+    std::atomic<size_t> sResidentBytes{ 0 };
+    std::atomic<size_t> sInFlightBytes{ 0 };
+    std::atomic<size_t> sPeakInFlightBytes{ 0 };
+    UploadPagePool::Stats sLastFrameStats{};
+
+    uint64_t NextHead(uint64_t head, uint32_t top)
     {
-        heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
-        resourceDesc.Width = size == 0 ? mPerPageSize : size;
-        resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
-        defaultUsage = D3D12_RESOURCE_STATE_GENERIC_READ;
+        return (((head >> 32) + 1) << 32) | top;
     }
 
-    ID3D12Resource* pBuffer;
-    CheckHR(Graphics::gDevice->CreateCommittedResource(
-        &heapProps, D3D12_HEAP_FLAG_NONE, &resourceDesc, defaultUsage, nullptr, IID_PPV_ARGS(&pBuffer)));
-    pBuffer->SetName(L"LinearAllocator Page");
+    PooledUploadPage* GetPage(uint32_t top)
+    {
+        return top == 0 ? nullptr : sPages[top - 1].load(std::memory_order_acquire);
+    }
 
-    return size == 0 ? mPages.emplace_back(pBuffer, defaultUsage) : mLargePages.emplace_back(pBuffer, defaultUsage);
+    void PushPage(std::atomic<uint64_t>& head, PooledUploadPage* page)
+    {
+        uint64_t oldHead = head.load(std::memory_order_relaxed);
+        do
+        {
+            page->mNextPage.store((uint32_t)oldHead, std::memory_order_relaxed);
+        } while (!head.compare_exchange_weak(oldHead, NextHead(oldHead, page->mPoolIndex + 1),
+            std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    PooledUploadPage* PopPage(std::atomic<uint64_t>& head)
+    {
+        uint64_t oldHead = head.load(std::memory_order_acquire);
+        PooledUploadPage* page;
+        do
+        {
+            page = GetPage((uint32_t)oldHead);
+            if (page == nullptr)
+                return nullptr;
+            // pages are only deleted by Shutdown, so reading a link another thread just changed is safe
+        } while (!head.compare_exchange_weak(oldHead, NextHead(oldHead, page->mNextPage.load(std::memory_order_relaxed)),
+            std::memory_order_acq_rel, std::memory_order_acquire));
+        return page;
+    }
+
+    // takes the whole stack, the pages are linked through mNextPage and belong to the caller
+    PooledUploadPage* PopAllPages(std::atomic<uint64_t>& head)
+    {
+        uint64_t oldHead = head.load(std::memory_order_acquire);
+        while (!head.compare_exchange_weak(oldHead, NextHead(oldHead, 0), std::memory_order_acq_rel, std::memory_order_acquire)) {}
+        return GetPage((uint32_t)oldHead);
+    }
+
+    void AtomicMax(std::atomic<uint64_t>& value, uint64_t newValue)
+    {
+        uint64_t curValue = value.load(std::memory_order_relaxed);
+        while (curValue < newValue && !value.compare_exchange_weak(curValue, newValue, std::memory_order_relaxed)) {}
+    }
+
+    void ReclaimFromQueues()
+    {
+        uint64_t completedFences[Graphics::NUM_RENDER_TASK_TYPE];
+        for (int i = 0; i < Graphics::NUM_RENDER_TASK_TYPE; i++)
+        {
+            CommandQueue& queue = CommandQueueManager::GetInstance()->GetQueue(Graphics::GetQueueType((Graphics::RENDER_TASK_TYPE)i));
+            completedFences[i] = queue.GetCompletedFenceValue();
+        }
+        UploadPagePool::Reclaim(completedFences);
+    }
+
+    // mNumUsers is left for the caller to set
+    PooledUploadPage* AcquirePage(uint32_t sizeClass)
+    {
+        PooledUploadPage* page = PopPage(sFreeHeads[sizeClass]);
+        if (page == nullptr)
+        {
+            ReclaimFromQueues();
+            page = PopPage(sFreeHeads[sizeClass]);
+        }
+
+        if (page != nullptr)
+        {
+            sFramePagesReused.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            uint32_t poolIndex = sNumPages.fetch_add(1, std::memory_order_relaxed);
+            ASSERT(poolIndex < UploadPagePool::kMaxPages, "Out of upload pages");
+
+            size_t size = kUploadPageSize << sizeClass;
+            D3D12_RESOURCE_STATES defaultUsage;
+            page = new PooledUploadPage(CreatePageResource(kCpuWritable, size, defaultUsage), size, poolIndex, sizeClass);
+            sPages[poolIndex].store(page, std::memory_order_release);
+
+            sResidentBytes.fetch_add(size, std::memory_order_relaxed);
+            sFramePagesCreated.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t inFlightBytes = sInFlightBytes.fetch_add(page->mSize, std::memory_order_relaxed) + page->mSize;
+        size_t peakBytes = sPeakInFlightBytes.load(std::memory_order_relaxed);
+        while (peakBytes < inFlightBytes && !sPeakInFlightBytes.compare_exchange_weak(peakBytes, inFlightBytes, std::memory_order_relaxed)) {}
+        return page;
+    }
+
+    // the last user to let go moves the page to the retired stack, its fences are all set by then
+    void ReleasePage(PooledUploadPage* page)
+    {
+        if (page->mNumUsers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            PushPage(sRetiredHead, page);
+    }
+
+    struct ThreadPage
+    {
+        PooledUploadPage* page = nullptr;
+        uint64_t epoch = 0;
+
+        // the page of an exiting thread is retired while the pool that made it is still alive
+        ~ThreadPage()
+        {
+            if (page != nullptr && epoch == sEpoch.load(std::memory_order_acquire))
+                ReleasePage(page);
+        }
+    };
+
+    ThreadPage& GetThreadPage()
+    {
+        thread_local ThreadPage tPage;
+        uint64_t epoch = sEpoch.load(std::memory_order_acquire);
+        if (tPage.epoch != epoch)
+        {
+            // the pool was shut down since this thread last allocated
+            tPage.page = nullptr;
+            tPage.epoch = epoch;
+        }
+        return tPage;
+    }
 }
 
-AllocSpan LinearAllocator::AllocateLargePage(size_t size)
+AllocSpan UploadPagePool::Allocate(UploadPageList& list, size_t size, size_t alignment)
 {
-    LinearAllocationPage& newPage = AllocNewPage(size);
-    return AllocSpan(newPage, newPage.mStart, newPage.mGpuVirtualAddress, size, 0);
+    alignment = std::max<size_t>(alignment, 2);
+    ASSERT(((alignment - 1) & alignment) == 0);
+
+    const size_t alignedSize = Math::AlignUp(size, alignment);
+    sFrameUploadBytes.fetch_add(alignedSize, std::memory_order_relaxed);
+
+    if (alignedSize > kUploadPageSize)
+    {
+        uint32_t sizeClass = 1;
+        while ((kUploadPageSize << sizeClass) < alignedSize)
+            sizeClass++;
+        ASSERT(sizeClass < kNumSizeClasses, "Upload allocation too large");
+
+        PooledUploadPage* page = AcquirePage(sizeClass);
+        page->mNumUsers.store(1, std::memory_order_relaxed);
+        list.mPages.push_back(page);
+        return AllocSpan(*page, page->mStart, page->mGpuVirtualAddress, alignedSize, 0);
+    }
+
+    ThreadPage& threadPage = GetThreadPage();
+    PooledUploadPage* page = threadPage.page;
+    size_t offset = page ? Math::AlignUp(page->mOffset, alignment) : 0;
+    if (page == nullptr || offset + alignedSize > kUploadPageSize)
+    {
+        if (page != nullptr)
+            ReleasePage(page);
+
+        page = AcquirePage(0);
+        page->mNumUsers.store(1, std::memory_order_relaxed);
+        threadPage.page = page;
+        offset = 0;
+    }
+
+    if (list.mLastSharedPage != page)
+    {
+        page->mNumUsers.fetch_add(1, std::memory_order_relaxed);
+        list.mPages.push_back(page);
+        list.mLastSharedPage = page;
+    }
+
+    page->mOffset = offset + alignedSize;
+    return AllocSpan(*page, (uint8_t*)page->mStart + offset, page->mGpuVirtualAddress + offset, alignedSize, offset);
+}
+
+void UploadPagePool::Retire(UploadPageList& list, Graphics::RENDER_TASK_TYPE taskType, uint64_t fenceValue)
+{
+    for (PooledUploadPage* page : list.mPages)
+    {
+        AtomicMax(page->mFences[taskType], fenceValue);
+        ReleasePage(page);
+    }
+    list.mPages.clear();
+    list.mLastSharedPage = nullptr;
+}
+
+uint32_t UploadPagePool::Reclaim(const uint64_t completedFences[Graphics::NUM_RENDER_TASK_TYPE])
+{
+    uint32_t numReclaimed = 0;
+    PooledUploadPage* page = PopAllPages(sRetiredHead);
+    while (page != nullptr)
+    {
+        PooledUploadPage* nextPage = GetPage(page->mNextPage.load(std::memory_order_relaxed));
+
+        bool isComplete = true;
+        for (int i = 0; i < Graphics::NUM_RENDER_TASK_TYPE; i++)
+            isComplete &= page->mFences[i].load(std::memory_order_relaxed) <= completedFences[i];
+
+        if (isComplete)
+        {
+            for (std::atomic<uint64_t>& fence : page->mFences)
+                fence.store(0, std::memory_order_relaxed);
+            page->mOffset = 0;
+            sInFlightBytes.fetch_sub(page->mSize, std::memory_order_relaxed);
+            PushPage(sFreeHeads[page->mSizeClass], page);
+            numReclaimed++;
+        }
+        else
+        {
+            PushPage(sRetiredHead, page);
+        }
+        page = nextPage;
+    }
+
+    sFramePagesReclaimed.fetch_add(numReclaimed, std::memory_order_relaxed);
+    return numReclaimed;
+}
+
+void UploadPagePool::EndFrame()
+{
+    ZoneScoped;
+
+    ReclaimFromQueues();
+
+    sLastFrameStats.lastFrameUploadBytes = sFrameUploadBytes.exchange(0, std::memory_order_relaxed);
+    sLastFrameStats.lastFramePagesCreated = sFramePagesCreated.exchange(0, std::memory_order_relaxed);
+    sLastFrameStats.lastFramePagesReused = sFramePagesReused.exchange(0, std::memory_order_relaxed);
+    sLastFrameStats.lastFramePagesReclaimed = sFramePagesReclaimed.exchange(0, std::memory_order_relaxed);
+    sLastFrameStats.totalUploadBytes += sLastFrameStats.lastFrameUploadBytes;
+    sLastFrameStats.numFrames++;
+}
+
+UploadPagePool::Stats UploadPagePool::GetStats()
+{
+    Stats stats = sLastFrameStats;
+    stats.residentBytes = sResidentBytes.load(std::memory_order_relaxed);
+    stats.inFlightBytes = sInFlightBytes.load(std::memory_order_relaxed);
+    stats.peakInFlightBytes = sPeakInFlightBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void UploadPagePool::ResetStats()
+{
+    sLastFrameStats.totalUploadBytes = 0;
+    sLastFrameStats.numFrames = 0;
+    sPeakInFlightBytes.store(sInFlightBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void UploadPagePool::Shutdown()
+{
+    // thread pages still pointing into the pool are dropped instead of released
+    sEpoch.fetch_add(1, std::memory_order_acq_rel);
+
+    uint32_t numPages = std::min(sNumPages.exchange(0, std::memory_order_acq_rel), kMaxPages);
+    for (uint32_t i = 0; i < numPages; i++)
+        delete sPages[i].exchange(nullptr, std::memory_order_acq_rel);
+
+    for (std::atomic<uint64_t>& head : sFreeHeads)
+        head.store(0, std::memory_order_relaxed);
+    sRetiredHead.store(0, std::memory_order_relaxed);
+    sResidentBytes.store(0, std::memory_order_relaxed);
+    sInFlightBytes.store(0, std::memory_order_relaxed);
 }
@@ -21,6 +21,7 @@ enum
 class AllocSpan
 {
     friend class LinearAllocator;
+    friend class UploadPagePool;
     friend class CopyCommandList;
     friend class GraphicsCommandList;
     friend class ComputeCommandList;
@@ -36,6 +37,12 @@ private:
     AllocSpan(LinearAllocationPage& page)
         : AllocSpan(page, nullptr, D3D12_VIRTUAL_ADDRESS_NULL, 0, 0)
     {}
+public:
+    const LinearAllocationPage& GetPage() const { return mPage; }
+    void* GetCpuAddress() const { return mCpuAddress; }
+    D3D12_GPU_VIRTUAL_ADDRESS GetGpuAddress() const { return mGpuAddress; }
+    size_t GetSize() const { return mSize; }
+    size_t GetOffset() const { return mOffset; }
 private:
     LinearAllocationPage& mPage;
     void* mCpuAddress;			             // The CPU-writeable address
@@ -47,6 +54,7 @@ private:
 class LinearAllocationPage : public GpuResource, NonCopyable
 {
     friend class LinearAllocator;
+    friend class UploadPagePool;
     friend struct std::less<LinearAllocationPage>;
 public:
     LinearAllocationPage(ID3D12Resource* pResource, D3D12_RESOURCE_STATES usage) :
@@ -101,3 +109,64 @@ private:
     std::list<LinearAllocationPage> mUnusedPages;
     std::list<LinearAllocationPage> mLargePages;
 };
+
+
+class PooledUploadPage;
+
+// The upload pages a command list has written to. They go back to UploadPagePool when the list is submitted.
+class UploadPageList
+{
+    friend class UploadPagePool;
+public:
+    UploadPageList() : mLastSharedPage(nullptr) {}
+
+    bool IsEmpty() const { return mPages.empty(); }
+private:
+    std::vector<PooledUploadPage*> mPages;
+    PooledUploadPage* mLastSharedPage; // the list only holds one reference per page in a row
+};
+
+/*
+    Upload memory shared by every command list. Each thread suballocates from a current page of its
+    own, a page is retired once the thread has filled it and every list that wrote to it has been
+    submitted, tagged with the highest fence of each queue those lists went to. Reclaim moves retired
+    pages to lock-free free lists as their fences complete. Allocations larger than a page get a whole
+    page of a power of two size class, recycled the same way. Pages are kept until Shutdown.
+*/
+class UploadPagePool
+{
+public:
+    static constexpr uint32_t kMaxPages = 4096;
+    static constexpr uint32_t kNumSizeClasses = 9; // shared kCpuAllocatorPageSize pages, then 4MB to 512MB
+
+    struct Stats
+    {
+        size_t lastFrameUploadBytes;
+        uint32_t lastFramePagesCreated;
+        uint32_t lastFramePagesReused;
+        uint32_t lastFramePagesReclaimed;
+        size_t residentBytes;     // every page created
+        size_t inFlightBytes;     // pages held by a thread or list, or waiting for their fences
+        size_t peakInFlightBytes;
+        size_t totalUploadBytes;  // summed over numFrames since ResetStats
+        uint32_t numFrames;
+    };
+
+    // Valid until list is retired and its fences complete. Thread safe, one list is used by one thread at a time.
+    static AllocSpan Allocate(UploadPageList& list, size_t size, size_t alignment = 2);
+
+    // Hands back the pages of list once it is submitted to the taskType queue, or with fenceValue 0 if it never was
+    static void Retire(UploadPageList& list, Graphics::RENDER_TASK_TYPE taskType, uint64_t fenceValue);
+
+    // Frees the retired pages whose fences are all at most completedFences, returns how many
+    static uint32_t Reclaim(const uint64_t completedFences[Graphics::NUM_RENDER_TASK_TYPE]);
+
+    // Reclaims against the queues and rolls the frame stats over
+    static void EndFrame();
+
+    static Stats GetStats();
+    static void ResetStats();
+
+    // Releases every page, the GPU must be idle and no list may still hold pages
+    static void Shutdown();
+};
@@ -0,0 +1,971 @@
+#include "NullDevice.h"
+#include "Utils/DebugUtils.h"
+#include "Utils/DirectXTex/DirectXTex.h"
+
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+
+namespace
+{
+    constexpr UINT kDescriptorSize = 32;
+    constexpr UINT64 kResourceAlignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+
+    // every object lives in one process wide address space, there is only ever one null device
+    std::atomic<UINT64> sNextGpuVirtualAddress(1ull << 32);
+    std::atomic<UINT64> sNextCpuDescriptor(1ull << 32);
+    std::atomic<UINT64> sNextGpuDescriptor(1ull << 40);
+
+    int64_t sQpcFrequency = 1;
+    int64_t sGpuTicksPerSubmit = 0;
+
+    struct ExecutedStats
+    {
+        std::atomic<uint64_t> commandLists{ 0 };
+        std::atomic<uint64_t> draws{ 0 };
+        std::atomic<uint64_t> dispatches{ 0 };
+        std::atomic<uint64_t> executeIndirects{ 0 };
+        std::atomic<uint64_t> copies{ 0 };
+        std::atomic<uint64_t> clears{ 0 };
+        std::atomic<uint64_t> barriers{ 0 };
+        std::atomic<uint64_t> stateCalls{ 0 };
+        std::atomic<uint64_t> events{ 0 };
+    } sExecutedStats;
+
+    std::atomic<bool> sLogTransitions(false);
+    std::mutex sTransitionLogMutex;
+    std::vector<NullDevice::TransitionRecord> sExecutedTransitions;
+
+    UINT64 AlignUp(UINT64 value, UINT64 alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    int64_t GetTick()
+    {
+        LARGE_INTEGER tick;
+        QueryPerformanceCounter(&tick);
+        return tick.QuadPart;
+    }
+
+    void SleepUntil(int64_t dueTick)
+    {
+        for (int64_t now = GetTick(); now < dueTick; now = GetTick())
+            std::this_thread::sleep_for(std::chrono::microseconds((dueTick - now) * 1000000 / sQpcFrequency));
+    }
+
+    UINT64 AllocateGpuVirtualAddress(UINT64 size)
+    {
+        return sNextGpuVirtualAddress.fetch_add(AlignUp(std::max<UINT64>(size, 1), kResourceAlignment));
+    }
+
+    bool IsCpuVisibleHeap(D3D12_HEAP_TYPE type)
+    {
+        return type == D3D12_HEAP_TYPE_UPLOAD || type == D3D12_HEAP_TYPE_READBACK;
+    }
+
+    D3D12_RESOURCE_DESC ResolveResourceDesc(const D3D12_RESOURCE_DESC& desc)
+    {
+        D3D12_RESOURCE_DESC resolved = desc;
+        if (resolved.Dimension != D3D12_RESOURCE_DIMENSION_BUFFER && resolved.MipLevels == 0)
+        {
+            UINT64 largest = std::max<UINT64>(resolved.Width, resolved.Height);
+            if (resolved.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+                largest = std::max<UINT64>(largest, resolved.DepthOrArraySize);
+
+            resolved.MipLevels = 1;
+            while (largest > 1)
+            {
+                largest >>= 1;
+                resolved.MipLevels++;
+            }
+        }
+        return resolved;
+    }
+
+    // same layout rules as the runtime: rows aligned to 256 bytes, subresources to 512 bytes
+    void ComputeFootprints(const D3D12_RESOURCE_DESC& inDesc, UINT firstSubresource, UINT numSubresources, UINT64 baseOffset,
+        D3D12_PLACED_SUBRESOURCE_FOOTPRINT* pLayouts, UINT* pNumRows, UINT64* pRowSizeInBytes, UINT64* pTotalBytes)
+    {
+        D3D12_RESOURCE_DESC desc = ResolveResourceDesc(inDesc);
+        UINT64 end = baseOffset;
+
+        for (UINT i = 0; i < numSubresources; i++)
+        {
+            D3D12_PLACED_SUBRESOURCE_FOOTPRINT layout = {};
+            UINT numRows = 1;
+            UINT64 rowSize = 0;
+
+            if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+            {
+                rowSize = desc.Width;
+                layout.Offset = end;
+                layout.Footprint = { DXGI_FORMAT_UNKNOWN, (UINT)desc.Width, 1, 1,
+                    (UINT)AlignUp(desc.Width, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT) };
+                end += rowSize;
+            }
+            else
+            {
+                UINT mip = (firstSubresource + i) % desc.MipLevels;
+                UINT width = (UINT)std::max<UINT64>(desc.Width >> mip, 1);
+                UINT height = std::max<UINT>(desc.Height >> mip, 1);
+                UINT depth = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ?
+                    std::max<UINT>(desc.DepthOrArraySize >> mip, 1) : 1;
+
+                size_t rowPitch = 0;
+                size_t slicePitch = 0;
+                if (FAILED(DirectX::ComputePitch(desc.Format, width, height, rowPitch, slicePitch)))
+                    rowPitch = (size_t)width * 4;
+
+                numRows = height;
+                if (DirectX::IsCompressed(desc.Format))
+                {
+                    // block compressed footprints cover whole 4x4 blocks
+                    numRows = (height + 3) / 4;
+                    width = (UINT)AlignUp(width, 4);
+                    height = (UINT)AlignUp(height, 4);
+                }
+
+                rowSize = rowPitch;
+                layout.Offset = AlignUp(end, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+                layout.Footprint = { desc.Format, width, height, depth, (UINT)AlignUp(rowPitch, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT) };
+                end = layout.Offset + (UINT64)layout.Footprint.RowPitch * (numRows * depth - 1) + rowSize;
+            }
+
+            if (pLayouts)
+                pLayouts[i] = layout;
+            if (pNumRows)
+                pNumRows[i] = numRows;
+            if (pRowSizeInBytes)
+                pRowSizeInBytes[i] = rowSize;
+        }
+
+        if (pTotalBytes)
+            *pTotalBytes = end - baseOffset;
+    }
+
+    UINT64 GetResourceSize(const D3D12_RESOURCE_DESC& desc)
+    {
+        if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+            return desc.Width;
+
+        UINT arraySize = desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ? 1 : desc.DepthOrArraySize;
+        UINT64 totalBytes = 0;
+        ComputeFootprints(desc, 0, desc.MipLevels * arraySize, 0, nullptr, nullptr, nullptr, &totalBytes);
+        return totalBytes * std::max<UINT>(desc.SampleDesc.Count, 1);
+    }
+
+    template<typename Interface>
+    bool IsInterfaceOf(REFIID riid)
+    {
+        return riid == __uuidof(Interface) || riid == __uuidof(IUnknown) || riid == __uuidof(ID3D12Object) ||
+            (std::is_base_of_v<ID3D12DeviceChild, Interface> && riid == __uuidof(ID3D12DeviceChild)) ||
+            (std::is_base_of_v<ID3D12Pageable, Interface> && riid == __uuidof(ID3D12Pageable)) ||
+            (std::is_base_of_v<ID3D12CommandList, Interface> && riid == __uuidof(ID3D12CommandList));
+    }
+
+    // hands a freshly created object (one reference) to the caller as riid, a null ppv only validates
+    HRESULT ReturnObject(IUnknown* object, REFIID riid, void** ppv)
+    {
+        HRESULT hr = ppv ? object->QueryInterface(riid, ppv) : S_FALSE;
+        object->Release();
+        return hr;
+    }
+
+
+    template<typename Interface>
+    class NullObject : public Interface
+    {
+    public:
+        virtual ~NullObject() {}
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+        {
+            if (ppvObject == nullptr)
+                return E_POINTER;
+
+            if (!IsInterfaceOf<Interface>(riid))
+            {
+                *ppvObject = nullptr;
+                return E_NOINTERFACE;
+            }
+
+            AddRef();
+            *ppvObject = static_cast<Interface*>(this);
+            return S_OK;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef() override { return ++mRefCount; }
+
+        ULONG STDMETHODCALLTYPE Release() override
+        {
+            ULONG refCount = --mRefCount;
+            if (refCount == 0)
+                delete this;
+            return refCount;
+        }
+
+        // private data isn't kept, nothing in the renderer reads it back
+        HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT* pDataSize, void* pData) override { return DXGI_ERROR_NOT_FOUND; }
+        HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT DataSize, const void* pData) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown* pData) override { return S_OK; }
+
+        HRESULT STDMETHODCALLTYPE SetName(LPCWSTR Name) override
+        {
+            mName = Name ? Name : L"";
+            return S_OK;
+        }
+    protected:
+        std::atomic<ULONG> mRefCount{ 1 };
+        std::wstring mName;
+    };
+
+
+    template<typename Interface>
+    class NullDeviceChild : public NullObject<Interface>
+    {
+    public:
+        NullDeviceChild(ID3D12Device* device) : mDevice(device) {}
+
+        HRESULT STDMETHODCALLTYPE GetDevice(REFIID riid, void** ppvDevice) override
+        {
+            return mDevice->QueryInterface(riid, ppvDevice);
+        }
+    protected:
+        Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+    };
+
+
+    class NullRootSignature : public NullDeviceChild<ID3D12RootSignature>
+    {
+    public:
+        using NullDeviceChild::NullDeviceChild;
+    };
+
+    class NullQueryHeap : public NullDeviceChild<ID3D12QueryHeap>
+    {
+    public:
+        using NullDeviceChild::NullDeviceChild;
+    };
+
+    class NullCommandSignature : public NullDeviceChild<ID3D12CommandSignature>
+    {
+    public:
+        using NullDeviceChild::NullDeviceChild;
+    };
+
+    class NullPipelineState : public NullDeviceChild<ID3D12PipelineState>
+    {
+    public:
+        using NullDeviceChild::NullDeviceChild;
+
+        HRESULT STDMETHODCALLTYPE GetCachedBlob(ID3DBlob** ppBlob) override { return E_NOTIMPL; }
+    };
+
+    class NullCommandAllocator : public NullDeviceChild<ID3D12CommandAllocator>
+    {
+    public:
+        using NullDeviceChild::NullDeviceChild;
+
+        HRESULT STDMETHODCALLTYPE Reset() override { return S_OK; }
+    };
+
+
+    class NullHeap : public NullDeviceChild<ID3D12Heap>
+    {
+    public:
+        NullHeap(ID3D12Device* device, const D3D12_HEAP_DESC& desc) : NullDeviceChild(device), mDesc(desc)
+        {
+            mGpuVirtualAddress = AllocateGpuVirtualAddress(desc.SizeInBytes);
+            if (IsCpuVisibleHeap(desc.Properties.Type))
+                mCpuMemory = std::make_unique<uint8_t[]>(desc.SizeInBytes);
+        }
+
+        D3D12_HEAP_DESC STDMETHODCALLTYPE GetDesc() override { return mDesc; }
+
+        D3D12_GPU_VIRTUAL_ADDRESS GetGpuVirtualAddress() const { return mGpuVirtualAddress; }
+        uint8_t* GetCpuMemory() const { return mCpuMemory.get(); }
+    private:
+        D3D12_HEAP_DESC mDesc;
+        D3D12_GPU_VIRTUAL_ADDRESS mGpuVirtualAddress;
+        std::unique_ptr<uint8_t[]> mCpuMemory;
+    };
+
+
+    class NullResource : public NullDeviceChild<ID3D12Resource>
+    {
+    public:
+        NullResource(ID3D12Device* device, const D3D12_RESOURCE_DESC& desc, const D3D12_HEAP_PROPERTIES& heapProperties,
+            D3D12_HEAP_FLAGS heapFlags, D3D12_GPU_VIRTUAL_ADDRESS gpuVirtualAddress, uint8_t* cpuMemory) :
+            NullDeviceChild(device), mDesc(desc), mHeapProperties(heapProperties), mHeapFlags(heapFlags),
+            mGpuVirtualAddress(gpuVirtualAddress), mCpuMemory(cpuMemory)
+        {}
+
+        // committed resources own their memory, placed ones keep their heap alive
+        void SetBacking(std::unique_ptr<uint8_t[]> ownedMemory, ID3D12Heap* heap)
+        {
+            mOwnedMemory = std::move(ownedMemory);
+            mHeap = heap;
+        }
+
+        HRESULT STDMETHODCALLTYPE Map(UINT Subresource, const D3D12_RANGE* pReadRange, void** ppData) override
+        {
+            if (mCpuMemory == nullptr)
+                return E_INVALIDARG;
+            if (ppData)
+                *ppData = mCpuMemory;
+            return S_OK;
+        }
+
+        void STDMETHODCALLTYPE Unmap(UINT Subresource, const D3D12_RANGE* pWrittenRange) override {}
+
+        D3D12_RESOURCE_DESC STDMETHODCALLTYPE GetDesc() override { return mDesc; }
+
+        D3D12_GPU_VIRTUAL_ADDRESS STDMETHODCALLTYPE GetGPUVirtualAddress() override
+        {
+            // like the runtime, only buffers have one
+            return mDesc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER ? mGpuVirtualAddress : 0;
+        }
+
+        HRESULT STDMETHODCALLTYPE WriteToSubresource(UINT DstSubresource, const D3D12_BOX* pDstBox,
+            const void* pSrcData, UINT SrcRowPitch, UINT SrcDepthPitch) override { return E_NOTIMPL; }
+
+        HRESULT STDMETHODCALLTYPE ReadFromSubresource(void* pDstData, UINT DstRowPitch, UINT DstDepthPitch,
+            UINT SrcSubresource, const D3D12_BOX* pSrcBox) override { return E_NOTIMPL; }
+
+        HRESULT STDMETHODCALLTYPE GetHeapProperties(D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS* pHeapFlags) override
+        {
+            if (pHeapProperties)
+                *pHeapProperties = mHeapProperties;
+            if (pHeapFlags)
+                *pHeapFlags = mHeapFlags;
+            return S_OK;
+        }
+    private:
+        D3D12_RESOURCE_DESC mDesc;
+        D3D12_HEAP_PROPERTIES mHeapProperties;
+        D3D12_HEAP_FLAGS mHeapFlags;
+        D3D12_GPU_VIRTUAL_ADDRESS mGpuVirtualAddress;
+        uint8_t* mCpuMemory;
+        std::unique_ptr<uint8_t[]> mOwnedMemory;
+        Microsoft::WRL::ComPtr<ID3D12Heap> mHeap;
+    };
+
+
+    class NullDescriptorHeap : public NullDeviceChild<ID3D12DescriptorHeap>
+    {
+    public:
+        NullDescriptorHeap(ID3D12Device* device, const D3D12_DESCRIPTOR_HEAP_DESC& desc) : NullDeviceChild(device), mDesc(desc)
+        {
+            UINT64 size = AlignUp((UINT64)std::max<UINT>(desc.NumDescriptors, 1) * kDescriptorSize, kResourceAlignment);
+            mCpuStart.ptr = (SIZE_T)sNextCpuDescriptor.fetch_add(size);
+            mGpuStart.ptr = (desc.Flags & D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE) ? sNextGpuDescriptor.fetch_add(size) : 0;
+        }
+
+        D3D12_DESCRIPTOR_HEAP_DESC STDMETHODCALLTYPE GetDesc() override { return mDesc; }
+        D3D12_CPU_DESCRIPTOR_HANDLE STDMETHODCALLTYPE GetCPUDescriptorHandleForHeapStart() override { return mCpuStart; }
+        D3D12_GPU_DESCRIPTOR_HANDLE STDMETHODCALLTYPE GetGPUDescriptorHandleForHeapStart() override { return mGpuStart; }
+    private:
+        D3D12_DESCRIPTOR_HEAP_DESC mDesc;
+        D3D12_CPU_DESCRIPTOR_HANDLE mCpuStart;
+        D3D12_GPU_DESCRIPTOR_HANDLE mGpuStart;
+    };
+
+
+    // Signals queued by a command queue complete when their simulated GPU time has passed,
+    // checked lazily whenever the fence is read.
+    class NullFence : public NullDeviceChild<ID3D12Fence>
+    {
+    public:
+        NullFence(ID3D12Device* device, UINT64 initialValue) : NullDeviceChild(device), mCompletedValue(initialValue) {}
+
+        UINT64 STDMETHODCALLTYPE GetCompletedValue() override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            Retire(GetTick());
+            return mCompletedValue;
+        }
+
+        HRESULT STDMETHODCALLTYPE SetEventOnCompletion(UINT64 Value, HANDLE hEvent) override
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            Retire(GetTick());
+
+            if (Value > mCompletedValue)
+            {
+                int64_t dueTick = FindDueTick(Value);
+                if (dueTick < 0)
+                {
+                    // nothing queued reaches Value yet, a later signal fires the event
+                    if (hEvent == nullptr)
+                        return E_FAIL;
+                    mWaiters.emplace_back(Value, hEvent);
+                    return S_OK;
+                }
+
+                // the simulated GPU gets there on its own, the caller is about to wait for it anyway
+                lock.unlock();
+                SleepUntil(dueTick);
+                lock.lock();
+                Retire(GetTick());
+            }
+
+            if (hEvent)
+                SetEvent(hEvent);
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE Signal(UINT64 Value) override
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mCompletedValue = Value;
+            FireWaiters();
+            return S_OK;
+        }
+
+        void QueueSignal(UINT64 value, int64_t dueTick)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.emplace_back(value, dueTick);
+            Retire(GetTick());
+        }
+
+        // simulated time the value is reached, 0 when it already is or nothing queued reaches it
+        int64_t GetDueTick(UINT64 value)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            Retire(GetTick());
+            return value <= mCompletedValue ? 0 : std::max<int64_t>(FindDueTick(value), 0);
+        }
+    private:
+        int64_t FindDueTick(UINT64 value) const
+        {
+            for (const std::pair<UINT64, int64_t>& pending : mPending)
+            {
+                if (pending.first >= value)
+                    return pending.second;
+            }
+            return -1;
+        }
+
+        void Retire(int64_t now)
+        {
+            while (!mPending.empty() && mPending.front().second <= now)
+            {
+                mCompletedValue = mPending.front().first;
+                mPending.pop_front();
+            }
+            FireWaiters();
+        }
+
+        void FireWaiters()
+        {
+            for (size_t i = 0; i < mWaiters.size();)
+            {
+                if (mWaiters[i].first <= mCompletedValue)
+                {
+                    SetEvent(mWaiters[i].second);
+                    mWaiters[i] = mWaiters.back();
+                    mWaiters.pop_back();
+                }
+                else
+                {
+                    i++;
+                }
+            }
+        }
+    private:
+        std::mutex mMutex;
+        UINT64 mCompletedValue;
+        std::deque<std::pair<UINT64, int64_t>> mPending; // value, due tick
+        std::vector<std::pair<UINT64, HANDLE>> mWaiters;
+    };
+
+
+    class NullCommandList : public NullDeviceChild<ID3D12GraphicsCommandList>
+    {
+    public:
+        NullCommandList(ID3D12Device* device, D3D12_COMMAND_LIST_TYPE type) : NullDeviceChild(device), mType(type) {}
+
+        const NullDevice::CommandStats& GetStats() const { return mStats; }
+
+        D3D12_COMMAND_LIST_TYPE STDMETHODCALLTYPE GetType() override { return mType; }
+
+        HRESULT STDMETHODCALLTYPE Close() override { return S_OK; }
+
+        const std::vector<D3D12_RESOURCE_TRANSITION_BARRIER>& GetTransitions() const { return mTransitions; }
+
+        HRESULT STDMETHODCALLTYPE Reset(ID3D12CommandAllocator* pAllocator, ID3D12PipelineState* pInitialState) override
+        {
+            mStats = {};
+            mTransitions.clear();
+            return S_OK;
+        }
+
+        void STDMETHODCALLTYPE ClearState(ID3D12PipelineState* pPipelineState) override { mStats.stateCalls++; }
+
+        void STDMETHODCALLTYPE DrawInstanced(UINT VertexCountPerInstance, UINT InstanceCount,
+            UINT StartVertexLocation, UINT StartInstanceLocation) override { mStats.draws++; }
+        void STDMETHODCALLTYPE DrawIndexedInstanced(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation,
+            INT BaseVertexLocation, UINT StartInstanceLocation) override { mStats.draws++; }
+        void STDMETHODCALLTYPE Dispatch(UINT ThreadGroupCountX, UINT ThreadGroupCountY, UINT ThreadGroupCountZ) override { mStats.dispatches++; }
+
+        void STDMETHODCALLTYPE CopyBufferRegion(ID3D12Resource* pDstBuffer, UINT64 DstOffset, ID3D12Resource* pSrcBuffer,
+            UINT64 SrcOffset, UINT64 NumBytes) override { mStats.copies++; }
+        void STDMETHODCALLTYPE CopyTextureRegion(const D3D12_TEXTURE_COPY_LOCATION* pDst, UINT DstX, UINT DstY, UINT DstZ,
+            const D3D12_TEXTURE_COPY_LOCATION* pSrc, const D3D12_BOX* pSrcBox) override { mStats.copies++; }
+        void STDMETHODCALLTYPE CopyResource(ID3D12Resource* pDstResource, ID3D12Resource* pSrcResource) override { mStats.copies++; }
+        void STDMETHODCALLTYPE CopyTiles(ID3D12Resource* pTiledResource, const D3D12_TILED_RESOURCE_COORDINATE* pTileRegionStartCoordinate,
+            const D3D12_TILE_REGION_SIZE* pTileRegionSize, ID3D12Resource* pBuffer, UINT64 BufferStartOffsetInBytes,
+            D3D12_TILE_COPY_FLAGS Flags) override { mStats.copies++; }
+        void STDMETHODCALLTYPE ResolveSubresource(ID3D12Resource* pDstResource, UINT DstSubresource, ID3D12Resource* pSrcResource,
+            UINT SrcSubresource, DXGI_FORMAT Format) override { mStats.copies++; }
+
+        void STDMETHODCALLTYPE IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY PrimitiveTopology) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE RSSetViewports(UINT NumViewports, const D3D12_VIEWPORT* pViewports) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE RSSetScissorRects(UINT NumRects, const D3D12_RECT* pRects) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE OMSetBlendFactor(const FLOAT BlendFactor[4]) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE OMSetStencilRef(UINT StencilRef) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetPipelineState(ID3D12PipelineState* pPipelineState) override { mStats.stateCalls++; }
+
+        void STDMETHODCALLTYPE ResourceBarrier(UINT NumBarriers, const D3D12_RESOURCE_BARRIER* pBarriers) override
+        {
+            mStats.barriers += NumBarriers;
+            if (!sLogTransitions)
+                return;
+            for (UINT i = 0; i < NumBarriers; i++)
+            {
+                if (pBarriers[i].Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION)
+                    mTransitions.push_back(pBarriers[i].Transition);
+            }
+        }
+
+        void STDMETHODCALLTYPE ExecuteBundle(ID3D12GraphicsCommandList* pCommandList) override { mStats.draws++; }
+
+        void STDMETHODCALLTYPE SetDescriptorHeaps(UINT NumDescriptorHeaps, ID3D12DescriptorHeap* const* ppDescriptorHeaps) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRootSignature(ID3D12RootSignature* pRootSignature) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRootSignature(ID3D12RootSignature* pRootSignature) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRootDescriptorTable(UINT RootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRootDescriptorTable(UINT RootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE BaseDescriptor) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRoot32BitConstant(UINT RootParameterIndex, UINT SrcData, UINT DestOffsetIn32BitValues) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRoot32BitConstant(UINT RootParameterIndex, UINT SrcData, UINT DestOffsetIn32BitValues) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRoot32BitConstants(UINT RootParameterIndex, UINT Num32BitValuesToSet, const void* pSrcData,
+            UINT DestOffsetIn32BitValues) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRoot32BitConstants(UINT RootParameterIndex, UINT Num32BitValuesToSet, const void* pSrcData,
+            UINT DestOffsetIn32BitValues) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRootConstantBufferView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRootConstantBufferView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRootShaderResourceView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRootShaderResourceView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetComputeRootUnorderedAccessView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetGraphicsRootUnorderedAccessView(UINT RootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS BufferLocation) override { mStats.stateCalls++; }
+
+        void STDMETHODCALLTYPE IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* pView) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE IASetVertexBuffers(UINT StartSlot, UINT NumViews, const D3D12_VERTEX_BUFFER_VIEW* pViews) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SOSetTargets(UINT StartSlot, UINT NumViews, const D3D12_STREAM_OUTPUT_BUFFER_VIEW* pViews) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE OMSetRenderTargets(UINT NumRenderTargetDescriptors, const D3D12_CPU_DESCRIPTOR_HANDLE* pRenderTargetDescriptors,
+            BOOL RTsSingleHandleToDescriptorRange, const D3D12_CPU_DESCRIPTOR_HANDLE* pDepthStencilDescriptor) override { mStats.stateCalls++; }
+
+        void STDMETHODCALLTYPE ClearDepthStencilView(D3D12_CPU_DESCRIPTOR_HANDLE DepthStencilView, D3D12_CLEAR_FLAGS ClearFlags,
+            FLOAT Depth, UINT8 Stencil, UINT NumRects, const D3D12_RECT* pRects) override { mStats.clears++; }
+        void STDMETHODCALLTYPE ClearRenderTargetView(D3D12_CPU_DESCRIPTOR_HANDLE RenderTargetView, const FLOAT ColorRGBA[4],
+            UINT NumRects, const D3D12_RECT* pRects) override { mStats.clears++; }
+        void STDMETHODCALLTYPE ClearUnorderedAccessViewUint(D3D12_GPU_DESCRIPTOR_HANDLE ViewGPUHandleInCurrentHeap,
+            D3D12_CPU_DESCRIPTOR_HANDLE ViewCPUHandle, ID3D12Resource* pResource, const UINT Values[4],
+            UINT NumRects, const D3D12_RECT* pRects) override { mStats.clears++; }
+        void STDMETHODCALLTYPE ClearUnorderedAccessViewFloat(D3D12_GPU_DESCRIPTOR_HANDLE ViewGPUHandleInCurrentHeap,
+            D3D12_CPU_DESCRIPTOR_HANDLE ViewCPUHandle, ID3D12Resource* pResource, const FLOAT Values[4],
+            UINT NumRects, const D3D12_RECT* pRects) override { mStats.clears++; }
+        void STDMETHODCALLTYPE DiscardResource(ID3D12Resource* pResource, const D3D12_DISCARD_REGION* pRegion) override { mStats.clears++; }
+
+        void STDMETHODCALLTYPE BeginQuery(ID3D12QueryHeap* pQueryHeap, D3D12_QUERY_TYPE Type, UINT Index) override { mStats.events++; }
+        void STDMETHODCALLTYPE EndQuery(ID3D12QueryHeap* pQueryHeap, D3D12_QUERY_TYPE Type, UINT Index) override { mStats.events++; }
+        void STDMETHODCALLTYPE ResolveQueryData(ID3D12QueryHeap* pQueryHeap, D3D12_QUERY_TYPE Type, UINT StartIndex, UINT NumQueries,
+            ID3D12Resource* pDestinationBuffer, UINT64 AlignedDestinationBufferOffset) override { mStats.events++; }
+        void STDMETHODCALLTYPE SetPredication(ID3D12Resource* pBuffer, UINT64 AlignedBufferOffset, D3D12_PREDICATION_OP Operation) override { mStats.stateCalls++; }
+        void STDMETHODCALLTYPE SetMarker(UINT Metadata, const void* pData, UINT Size) override { mStats.events++; }
+        void STDMETHODCALLTYPE BeginEvent(UINT Metadata, const void* pData, UINT Size) override { mStats.events++; }
+        void STDMETHODCALLTYPE EndEvent() override { mStats.events++; }
+
+        void STDMETHODCALLTYPE ExecuteIndirect(ID3D12CommandSignature* pCommandSignature, UINT MaxCommandCount, ID3D12Resource* pArgumentBuffer,
+            UINT64 ArgumentBufferOffset, ID3D12Resource* pCountBuffer, UINT64 CountBufferOffset) override { mStats.executeIndirects++; }
+    private:
+        D3D12_COMMAND_LIST_TYPE mType;
+        NullDevice::CommandStats mStats;
+        std::vector<D3D12_RESOURCE_TRANSITION_BARRIER> mTransitions; // only with the transition log on
+    };
+
+
+    // Every submission takes gpuMsPerSubmit on a timeline that never runs ahead of the CPU clock,
+    // a signal completes when the timeline reaches it.
+    class NullCommandQueue : public NullDeviceChild<ID3D12CommandQueue>
+    {
+    public:
+        NullCommandQueue(ID3D12Device* device, const D3D12_COMMAND_QUEUE_DESC& desc) :
+            NullDeviceChild(device), mDesc(desc), mTimelineTick(0)
+        {}
+
+        void STDMETHODCALLTYPE UpdateTileMappings(ID3D12Resource* pResource, UINT NumResourceRegions,
+            const D3D12_TILED_RESOURCE_COORDINATE* pResourceRegionStartCoordinates, const D3D12_TILE_REGION_SIZE* pResourceRegionSizes,
+            ID3D12Heap* pHeap, UINT NumRanges, const D3D12_TILE_RANGE_FLAGS* pRangeFlags, const UINT* pHeapRangeStartOffsets,
+            const UINT* pRangeTileCounts, D3D12_TILE_MAPPING_FLAGS Flags) override {}
+
+        void STDMETHODCALLTYPE CopyTileMappings(ID3D12Resource* pDstResource, const D3D12_TILED_RESOURCE_COORDINATE* pDstRegionStartCoordinate,
+            ID3D12Resource* pSrcResource, const D3D12_TILED_RESOURCE_COORDINATE* pSrcRegionStartCoordinate,
+            const D3D12_TILE_REGION_SIZE* pRegionSize, D3D12_TILE_MAPPING_FLAGS Flags) override {}
+
+        void STDMETHODCALLTYPE ExecuteCommandLists(UINT NumCommandLists, ID3D12CommandList* const* ppCommandLists) override
+        {
+            for (UINT i = 0; i < NumCommandLists; i++)
+            {
+                const NullDevice::CommandStats& stats = static_cast<NullCommandList*>(ppCommandLists[i])->GetStats();
+                sExecutedStats.commandLists++;
+                sExecutedStats.draws += stats.draws;
+                sExecutedStats.dispatches += stats.dispatches;
+                sExecutedStats.executeIndirects += stats.executeIndirects;
+                sExecutedStats.copies += stats.copies;
+                sExecutedStats.clears += stats.clears;
+                sExecutedStats.barriers += stats.barriers;
+                sExecutedStats.stateCalls += stats.stateCalls;
+                sExecutedStats.events += stats.events;
+            }
+
+            if (sLogTransitions)
+            {
+                std::lock_guard<std::mutex> lock(sTransitionLogMutex);
+                for (UINT i = 0; i < NumCommandLists; i++)
+                {
+                    for (const D3D12_RESOURCE_TRANSITION_BARRIER& transition : static_cast<NullCommandList*>(ppCommandLists[i])->GetTransitions())
+                        sExecutedTransitions.push_back({ transition.pResource, ppCommandLists[i], transition.StateBefore, transition.StateAfter });
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTimelineTick = std::max(mTimelineTick, GetTick()) + sGpuTicksPerSubmit;
+        }
+
+        void STDMETHODCALLTYPE SetMarker(UINT Metadata, const void* pData, UINT Size) override {}
+        void STDMETHODCALLTYPE BeginEvent(UINT Metadata, const void* pData, UINT Size) override {}
+        void STDMETHODCALLTYPE EndEvent() override {}
+
+        HRESULT STDMETHODCALLTYPE Signal(ID3D12Fence* pFence, UINT64 Value) override
+        {
+            int64_t dueTick = 0;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                dueTick = mTimelineTick;
+            }
+            static_cast<NullFence*>(pFence)->QueueSignal(Value, dueTick);
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE Wait(ID3D12Fence* pFence, UINT64 Value) override
+        {
+            // work submitted after the wait can't start before the producer signals
+            int64_t dueTick = static_cast<NullFence*>(pFence)->GetDueTick(Value);
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTimelineTick = std::max(mTimelineTick, dueTick);
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetTimestampFrequency(UINT64* pFrequency) override
+        {
+            *pFrequency = (UINT64)sQpcFrequency;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetClockCalibration(UINT64* pGpuTimestamp, UINT64* pCpuTimestamp) override
+        {
+            *pGpuTimestamp = *pCpuTimestamp = (UINT64)GetTick();
+            return S_OK;
+        }
+
+        D3D12_COMMAND_QUEUE_DESC STDMETHODCALLTYPE GetDesc() override { return mDesc; }
+    private:
+        D3D12_COMMAND_QUEUE_DESC mDesc;
+        std::mutex mMutex;
+        int64_t mTimelineTick;
+    };
+
+
+    class NullD3D12Device : public NullObject<ID3D12Device>
+    {
+    public:
+        UINT STDMETHODCALLTYPE GetNodeCount() override { return 1; }
+
+        HRESULT STDMETHODCALLTYPE CreateCommandQueue(const D3D12_COMMAND_QUEUE_DESC* pDesc, REFIID riid, void** ppCommandQueue) override
+        {
+            return ReturnObject(static_cast<ID3D12CommandQueue*>(new NullCommandQueue(this, *pDesc)), riid, ppCommandQueue);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE type, REFIID riid, void** ppCommandAllocator) override
+        {
+            return ReturnObject(static_cast<ID3D12CommandAllocator*>(new NullCommandAllocator(this)), riid, ppCommandAllocator);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateGraphicsPipelineState(const D3D12_GRAPHICS_PIPELINE_STATE_DESC* pDesc, REFIID riid, void** ppPipelineState) override
+        {
+            return ReturnObject(static_cast<ID3D12PipelineState*>(new NullPipelineState(this)), riid, ppPipelineState);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateComputePipelineState(const D3D12_COMPUTE_PIPELINE_STATE_DESC* pDesc, REFIID riid, void** ppPipelineState) override
+        {
+            return ReturnObject(static_cast<ID3D12PipelineState*>(new NullPipelineState(this)), riid, ppPipelineState);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateCommandList(UINT nodeMask, D3D12_COMMAND_LIST_TYPE type, ID3D12CommandAllocator* pCommandAllocator,
+            ID3D12PipelineState* pInitialState, REFIID riid, void** ppCommandList) override
+        {
+            return ReturnObject(static_cast<ID3D12GraphicsCommandList*>(new NullCommandList(this, type)), riid, ppCommandList);
+        }
+
+        HRESULT STDMETHODCALLTYPE CheckFeatureSupport(D3D12_FEATURE Feature, void* pFeatureSupportData, UINT FeatureSupportDataSize) override
+        {
+            if (pFeatureSupportData == nullptr)
+                return E_INVALIDARG;
+
+            switch (Feature)
+            {
+            case D3D12_FEATURE_FEATURE_LEVELS:
+            {
+                D3D12_FEATURE_DATA_FEATURE_LEVELS* featureLevels = (D3D12_FEATURE_DATA_FEATURE_LEVELS*)pFeatureSupportData;
+                featureLevels->MaxSupportedFeatureLevel = D3D_FEATURE_LEVEL_11_0;
+                for (UINT i = 0; i < featureLevels->NumFeatureLevels; i++)
+                {
+                    D3D_FEATURE_LEVEL level = featureLevels->pFeatureLevelsRequested[i];
+                    if (level <= D3D_FEATURE_LEVEL_12_1 && level > featureLevels->MaxSupportedFeatureLevel)
+                        featureLevels->MaxSupportedFeatureLevel = level;
+                }
+                return S_OK;
+            }
+            case D3D12_FEATURE_ROOT_SIGNATURE:
+            {
+                D3D12_FEATURE_DATA_ROOT_SIGNATURE* rootSignature = (D3D12_FEATURE_DATA_ROOT_SIGNATURE*)pFeatureSupportData;
+                rootSignature->HighestVersion = std::min(rootSignature->HighestVersion, D3D_ROOT_SIGNATURE_VERSION_1_1);
+                return S_OK;
+            }
+            case D3D12_FEATURE_SHADER_MODEL:
+            {
+                D3D12_FEATURE_DATA_SHADER_MODEL* shaderModel = (D3D12_FEATURE_DATA_SHADER_MODEL*)pFeatureSupportData;
+                shaderModel->HighestShaderModel = std::min(shaderModel->HighestShaderModel, D3D_SHADER_MODEL_6_0);
+                return S_OK;
+            }
+            default:
+                // every optional feature and format capability reports unsupported, so callers take their fallback path
+                memset(pFeatureSupportData, 0, FeatureSupportDataSize);
+                return S_OK;
+            }
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateDescriptorHeap(const D3D12_DESCRIPTOR_HEAP_DESC* pDescriptorHeapDesc, REFIID riid, void** ppvHeap) override
+        {
+            return ReturnObject(static_cast<ID3D12DescriptorHeap*>(new NullDescriptorHeap(this, *pDescriptorHeapDesc)), riid, ppvHeap);
+        }
+
+        UINT STDMETHODCALLTYPE GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE DescriptorHeapType) override { return kDescriptorSize; }
+
+        HRESULT STDMETHODCALLTYPE CreateRootSignature(UINT nodeMask, const void* pBlobWithRootSignature, SIZE_T blobLengthInBytes,
+            REFIID riid, void** ppvRootSignature) override
+        {
+            return ReturnObject(static_cast<ID3D12RootSignature*>(new NullRootSignature(this)), riid, ppvRootSignature);
+        }
+
+        // descriptors are never read, writing them is free
+        void STDMETHODCALLTYPE CreateConstantBufferView(const D3D12_CONSTANT_BUFFER_VIEW_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override {}
+        void STDMETHODCALLTYPE CreateShaderResourceView(ID3D12Resource* pResource, const D3D12_SHADER_RESOURCE_VIEW_DESC* pDesc,
+            D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override {}
+        void STDMETHODCALLTYPE CreateUnorderedAccessView(ID3D12Resource* pResource, ID3D12Resource* pCounterResource,
+            const D3D12_UNORDERED_ACCESS_VIEW_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override {}
+        void STDMETHODCALLTYPE CreateRenderTargetView(ID3D12Resource* pResource, const D3D12_RENDER_TARGET_VIEW_DESC* pDesc,
+            D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override {}
+        void STDMETHODCALLTYPE CreateDepthStencilView(ID3D12Resource* pResource, const D3D12_DEPTH_STENCIL_VIEW_DESC* pDesc,
+            D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override {}
+        void STDMETHODCALLTYPE CreateSampler(const D3D12_SAMPLER_DESC* pDesc, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptor) override {}
+        void STDMETHODCALLTYPE CopyDescriptors(UINT NumDestDescriptorRanges, const D3D12_CPU_DESCRIPTOR_HANDLE* pDestDescriptorRangeStarts,
+            const UINT* pDestDescriptorRangeSizes, UINT NumSrcDescriptorRanges, const D3D12_CPU_DESCRIPTOR_HANDLE* pSrcDescriptorRangeStarts,
+            const UINT* pSrcDescriptorRangeSizes, D3D12_DESCRIPTOR_HEAP_TYPE DescriptorHeapsType) override {}
+        void STDMETHODCALLTYPE CopyDescriptorsSimple(UINT NumDescriptors, D3D12_CPU_DESCRIPTOR_HANDLE DestDescriptorRangeStart,
+            D3D12_CPU_DESCRIPTOR_HANDLE SrcDescriptorRangeStart, D3D12_DESCRIPTOR_HEAP_TYPE DescriptorHeapsType) override {}
+
+        D3D12_RESOURCE_ALLOCATION_INFO STDMETHODCALLTYPE GetResourceAllocationInfo(UINT visibleMask, UINT numResourceDescs,
+            const D3D12_RESOURCE_DESC* pResourceDescs) override
+        {
+            D3D12_RESOURCE_ALLOCATION_INFO info = { 0, kResourceAlignment };
+            for (UINT i = 0; i < numResourceDescs; i++)
+                info.SizeInBytes = AlignUp(info.SizeInBytes, kResourceAlignment) + GetResourceSize(ResolveResourceDesc(pResourceDescs[i]));
+            info.SizeInBytes = AlignUp(info.SizeInBytes, kResourceAlignment);
+            return info;
+        }
+
+        D3D12_HEAP_PROPERTIES STDMETHODCALLTYPE GetCustomHeapProperties(UINT nodeMask, D3D12_HEAP_TYPE heapType) override
+        {
+            D3D12_HEAP_PROPERTIES properties = {};
+            properties.Type = D3D12_HEAP_TYPE_CUSTOM;
+            properties.CPUPageProperty = heapType == D3D12_HEAP_TYPE_UPLOAD ? D3D12_CPU_PAGE_PROPERTY_WRITE_COMBINE :
+                heapType == D3D12_HEAP_TYPE_READBACK ? D3D12_CPU_PAGE_PROPERTY_WRITE_BACK : D3D12_CPU_PAGE_PROPERTY_NOT_AVAILABLE;
+            properties.MemoryPoolPreference = D3D12_MEMORY_POOL_L0;
+            properties.CreationNodeMask = 1;
+            properties.VisibleNodeMask = 1;
+            return properties;
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateCommittedResource(const D3D12_HEAP_PROPERTIES* pHeapProperties, D3D12_HEAP_FLAGS HeapFlags,
+            const D3D12_RESOURCE_DESC* pDesc, D3D12_RESOURCE_STATES InitialResourceState, const D3D12_CLEAR_VALUE* pOptimizedClearValue,
+            REFIID riidResource, void** ppvResource) override
+        {
+            if (pHeapProperties == nullptr || pDesc == nullptr)
+                return E_INVALIDARG;
+
+            D3D12_RESOURCE_DESC desc = ResolveResourceDesc(*pDesc);
+            UINT64 size = GetResourceSize(desc);
+
+            std::unique_ptr<uint8_t[]> cpuMemory;
+            if (IsCpuVisibleHeap(pHeapProperties->Type))
+                cpuMemory = std::make_unique<uint8_t[]>(size);
+
+            NullResource* resource = new NullResource(this, desc, *pHeapProperties, HeapFlags,
+                AllocateGpuVirtualAddress(size), cpuMemory.get());
+            resource->SetBacking(std::move(cpuMemory), nullptr);
+            return ReturnObject(static_cast<ID3D12Resource*>(resource), riidResource, ppvResource);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateHeap(const D3D12_HEAP_DESC* pDesc, REFIID riid, void** ppvHeap) override
+        {
+            return ReturnObject(static_cast<ID3D12Heap*>(new NullHeap(this, *pDesc)), riid, ppvHeap);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreatePlacedResource(ID3D12Heap* pHeap, UINT64 HeapOffset, const D3D12_RESOURCE_DESC* pDesc,
+            D3D12_RESOURCE_STATES InitialState, const D3D12_CLEAR_VALUE* pOptimizedClearValue, REFIID riid, void** ppvResource) override
+        {
+            if (pHeap == nullptr || pDesc == nullptr)
+                return E_INVALIDARG;
+
+            NullHeap* heap = static_cast<NullHeap*>(pHeap);
+            D3D12_HEAP_DESC heapDesc = heap->GetDesc();
+            uint8_t* cpuMemory = heap->GetCpuMemory() ? heap->GetCpuMemory() + HeapOffset : nullptr;
+
+            NullResource* resource = new NullResource(this, ResolveResourceDesc(*pDesc), heapDesc.Properties, heapDesc.Flags,
+                heap->GetGpuVirtualAddress() + HeapOffset, cpuMemory);
+            resource->SetBacking(nullptr, pHeap);
+            return ReturnObject(static_cast<ID3D12Resource*>(resource), riid, ppvResource);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateReservedResource(const D3D12_RESOURCE_DESC* pDesc, D3D12_RESOURCE_STATES InitialState,
+            const D3D12_CLEAR_VALUE* pOptimizedClearValue, REFIID riid, void** ppvResource) override
+        {
+            if (pDesc == nullptr)
+                return E_INVALIDARG;
+
+            D3D12_RESOURCE_DESC desc = ResolveResourceDesc(*pDesc);
+            D3D12_HEAP_PROPERTIES heapProperties = {};
+            heapProperties.Type = D3D12_HEAP_TYPE_DEFAULT;
+            return ReturnObject(static_cast<ID3D12Resource*>(new NullResource(this, desc, heapProperties, D3D12_HEAP_FLAG_NONE,
+                AllocateGpuVirtualAddress(GetResourceSize(desc)), nullptr)), riid, ppvResource);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateSharedHandle(ID3D12DeviceChild* pObject, const SECURITY_ATTRIBUTES* pAttributes, DWORD Access,
+            LPCWSTR Name, HANDLE* pHandle) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE OpenSharedHandle(HANDLE NTHandle, REFIID riid, void** ppvObj) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE OpenSharedHandleByName(LPCWSTR Name, DWORD Access, HANDLE* pNTHandle) override { return E_NOTIMPL; }
+
+        HRESULT STDMETHODCALLTYPE MakeResident(UINT NumObjects, ID3D12Pageable* const* ppObjects) override { return S_OK; }
+        HRESULT STDMETHODCALLTYPE Evict(UINT NumObjects, ID3D12Pageable* const* ppObjects) override { return S_OK; }
+
+        HRESULT STDMETHODCALLTYPE CreateFence(UINT64 InitialValue, D3D12_FENCE_FLAGS Flags, REFIID riid, void** ppFence) override
+        {
+            return ReturnObject(static_cast<ID3D12Fence*>(new NullFence(this, InitialValue)), riid, ppFence);
+        }
+
+        HRESULT STDMETHODCALLTYPE GetDeviceRemovedReason() override { return S_OK; }
+
+        void STDMETHODCALLTYPE GetCopyableFootprints(const D3D12_RESOURCE_DESC* pResourceDesc, UINT FirstSubresource, UINT NumSubresources,
+            UINT64 BaseOffset, D3D12_PLACED_SUBRESOURCE_FOOTPRINT* pLayouts, UINT* pNumRows, UINT64* pRowSizeInBytes, UINT64* pTotalBytes) override
+        {
+            ComputeFootprints(*pResourceDesc, FirstSubresource, NumSubresources, BaseOffset, pLayouts, pNumRows, pRowSizeInBytes, pTotalBytes);
+        }
+
+        HRESULT STDMETHODCALLTYPE CreateQueryHeap(const D3D12_QUERY_HEAP_DESC* pDesc, REFIID riid, void** ppvHeap) override
+        {
+            return ReturnObject(static_cast<ID3D12QueryHeap*>(new NullQueryHeap(this)), riid, ppvHeap);
+        }
+
+        HRESULT STDMETHODCALLTYPE SetStablePowerState(BOOL Enable) override { return S_OK; }
+
+        HRESULT STDMETHODCALLTYPE CreateCommandSignature(const D3D12_COMMAND_SIGNATURE_DESC* pDesc, ID3D12RootSignature* pRootSignature,
+            REFIID riid, void** ppvCommandSignature) override
+        {
+            return ReturnObject(static_cast<ID3D12CommandSignature*>(new NullCommandSignature(this)), riid, ppvCommandSignature);
+        }
+
+        void STDMETHODCALLTYPE GetResourceTiling(ID3D12Resource* pTiledResource, UINT* pNumTilesForEntireResource,
+            D3D12_PACKED_MIP_INFO* pPackedMipDesc, D3D12_TILE_SHAPE* pStandardTileShapeForNonPackedMips, UINT* pNumSubresourceTilings,
+            UINT FirstSubresourceTilingToGet, D3D12_SUBRESOURCE_TILING* pSubresourceTilingsForNonPackedMips) override
+        {
+            if (pNumTilesForEntireResource)
+                *pNumTilesForEntireResource = 0;
+            if (pPackedMipDesc)
+                *pPackedMipDesc = {};
+            if (pStandardTileShapeForNonPackedMips)
+                *pStandardTileShapeForNonPackedMips = {};
+            if (pNumSubresourceTilings)
+                *pNumSubresourceTilings = 0;
+        }
+
+        LUID STDMETHODCALLTYPE GetAdapterLuid() override { return {}; }
+    };
+}
+
+namespace NullDevice
+{
+    HRESULT CreateDevice(float gpuMsPerSubmit, REFIID riid, void** ppDevice)
+    {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        sQpcFrequency = frequency.QuadPart;
+        sGpuTicksPerSubmit = (int64_t)(std::max(gpuMsPerSubmit, 0.0f) * sQpcFrequency / 1000.0);
+
+        return ReturnObject(static_cast<ID3D12Device*>(new NullD3D12Device()), riid, ppDevice);
+    }
+
+    CommandStats GetExecutedStats()
+    {
+        CommandStats stats;
+        stats.commandLists = sExecutedStats.commandLists;
+        stats.draws = sExecutedStats.draws;
+        stats.dispatches = sExecutedStats.dispatches;
+        stats.executeIndirects = sExecutedStats.executeIndirects;
+        stats.copies = sExecutedStats.copies;
+        stats.clears = sExecutedStats.clears;
+        stats.barriers = sExecutedStats.barriers;
+        stats.stateCalls = sExecutedStats.stateCalls;
+        stats.events = sExecutedStats.events;
+        return stats;
+    }
+
+    void ResetExecutedStats()
+    {
+        sExecutedStats.commandLists = 0;
+        sExecutedStats.draws = 0;
+        sExecutedStats.dispatches = 0;
+        sExecutedStats.executeIndirects = 0;
+        sExecutedStats.copies = 0;
+        sExecutedStats.clears = 0;
+        sExecutedStats.barriers = 0;
+        sExecutedStats.stateCalls = 0;
+        sExecutedStats.events = 0;
+    }
+
+    void SetTransitionLog(bool enable)
+    {
+        std::lock_guard<std::mutex> lock(sTransitionLogMutex);
+        sExecutedTransitions.clear();
+        sLogTransitions = enable;
+    }
+
+    std::vector<TransitionRecord> GetExecutedTransitions()
+    {
+        std::lock_guard<std::mutex> lock(sTransitionLogMutex);
+        return sExecutedTransitions;
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include "CoreHeader.h"
+
+/*
+    Headless stand in for the D3D12 device. Every object the renderer creates through it is a plain
+    CPU object: resources get fake GPU virtual addresses (upload and readback heaps are backed by
+    system memory so Map works), descriptor heaps hand out fake handles, and command lists count
+    what is recorded instead of executing it. Fences complete on a simulated per queue timeline.
+
+    Selected with -nulldevice 1, -nullgpums <ms> sets the simulated GPU time of one submission.
+*/
+namespace NullDevice
+{
+    // commands recorded on the lists that reached ExecuteCommandLists
+    struct CommandStats
+    {
+        uint64_t commandLists = 0;
+        uint64_t draws = 0;
+        uint64_t dispatches = 0;
+        uint64_t executeIndirects = 0;
+        uint64_t copies = 0;
+        uint64_t clears = 0;
+        uint64_t barriers = 0;
+        uint64_t stateCalls = 0;    // PSO, root signature, root arguments, IA, OM and RS state
+        uint64_t events = 0;        // markers, PIX events and queries
+
+        uint64_t GetTotal() const
+        {
+            return draws + dispatches + executeIndirects + copies + clears + barriers + stateCalls + events;
+        }
+    };
+
+    // gpuMsPerSubmit == 0 completes every fence as soon as it is signaled
+    HRESULT CreateDevice(float gpuMsPerSubmit, REFIID riid, void** ppDevice);
+
+    CommandStats GetExecutedStats();
+    void ResetExecutedStats();
+
+    // one transition barrier of a list that reached ExecuteCommandLists
+    struct TransitionRecord
+    {
+        const ID3D12Resource* resource;
+        const ID3D12CommandList* commandList;
+        D3D12_RESOURCE_STATES stateBefore;
+        D3D12_RESOURCE_STATES stateAfter;
+    };
+
+    // Off by default, a long -nulldevice run would only grow it. Turning it on or off clears the log.
+    void SetTransitionLog(bool enable);
+    // the logged transitions in submission order, lists in the order they were executed
+    std::vector<TransitionRecord> GetExecutedTransitions();
+};
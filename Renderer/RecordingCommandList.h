@@ -0,0 +1,78 @@
+#pragma once
+#include "CoreHeader.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "DescriptorHandle.h"
+#include "StateCachingCommandList.h"
+
+#include <vector>
+
+// Stand-in for GraphicsCommandList that only records the calls it receives, for driving
+// StateCachingCommandList and draw loops without a device. Arguments are kept as raw values:
+// root signature and PSO pointers, CBV and SRV addresses, root constants, descriptor handles
+// and buffer locations.
+class RecordingCommandList
+{
+public:
+    struct Call
+    {
+        eStateCall type;    // kNumStateCalls for draws and dynamic CBVs and SRVs
+        UINT index;         // root index or vertex buffer slot, instance or record count of a draw
+        UINT64 value;       // index count of a draw, argument offset of an ExecuteIndirect
+        bool isDraw;
+    };
+
+    void SetRootSignature(const RootSignature& rootSig) { Record(kStateCallRootSignature, 0, (UINT64)rootSig.GetRootSignature()); }
+    void SetPipelineState(const PipelineState& pso) { Record(kStateCallPipelineState, 0, (UINT64)pso.GetPipelineStateObject()); }
+    void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology) { Record(kStateCallTopology, 0, topology); }
+    void SetConstantBuffer(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS cbv) { Record(kStateCallConstantBuffer, rootIndex, cbv); }
+    void SetDynamicConstantBufferView(UINT rootIndex, size_t bufferSize, const void* bufferData) { Record(kNumStateCalls, rootIndex, bufferSize); }
+    void SetShaderResourceView(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS srv) { Record(kStateCallShaderResource, rootIndex, srv); }
+    void SetDynamicSRV(UINT rootIndex, size_t bufferSize, const void* bufferData) { Record(kNumStateCalls, rootIndex, bufferSize); }
+    void SetConstants(UINT rootIndex, UINT value) { Record(kStateCallRootConstant, rootIndex, value); }
+    void SetDescriptorTable(UINT rootIndex, const DescriptorHandle& firstHandle)
+    {
+        D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = firstHandle;
+        Record(kStateCallDescriptorTable, rootIndex, gpuHandle.ptr);
+    }
+    void SetVertexBuffer(UINT slot, const D3D12_VERTEX_BUFFER_VIEW& vbView) { Record(kStateCallVertexBuffer, slot, vbView.BufferLocation); }
+    void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& ibView) { Record(kStateCallIndexBuffer, 0, ibView.BufferLocation); }
+
+    void DrawIndexed(UINT indexCount, UINT startIndexLocation = 0, INT baseVertexLocation = 0)
+    {
+        DrawIndexedInstanced(indexCount, 1, startIndexLocation, baseVertexLocation, 0);
+    }
+    void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+    {
+        Record(kNumStateCalls, instanceCount, indexCountPerInstance, true);
+        mNumDraws++;
+    }
+
+    void ExecuteIndirect(const CommandSignature& commandSig, ID3D12Resource* argumentBuffer, UINT64 argumentOffset, UINT numCommands)
+    {
+        Record(kNumStateCalls, numCommands, argumentOffset, true);
+        mNumDraws += numCommands;
+    }
+
+    const std::vector<Call>& GetCalls() const { return mCalls; }
+    uint32_t GetDrawCount() const { return mNumDraws; }
+
+    uint32_t GetCallCount(eStateCall type) const
+    {
+        uint32_t count = 0;
+        for (const Call& call : mCalls)
+            count += call.type == type;
+        return count;
+    }
+
+    void Clear()
+    {
+        mCalls.clear();
+        mNumDraws = 0;
+    }
+private:
+    void Record(eStateCall type, UINT index, UINT64 value, bool isDraw = false) { mCalls.push_back({ type, index, value, isDraw }); }
+private:
+    std::vector<Call> mCalls;
+    uint32_t mNumDraws = 0;
+};
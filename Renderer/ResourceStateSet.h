@@ -0,0 +1,90 @@
+#pragma once
+#include "CoreHeader.h"
+#include "GpuResource.h"
+
+struct ResourceStateCache
+{
+    ResourceStateCache(GpuResource& resource) :
+        mGpuResource(resource), mStateCurrent(resource.mUsageState), mStateTransition((D3D12_RESOURCE_STATES)-1),
+        mStateBegin((D3D12_RESOURCE_STATES)-1)
+    {}
+    ~ResourceStateCache() {}
+
+    // Only whole resource transitions are issued, so one state per resource is all there is to keep
+    GpuResource& mGpuResource;
+    D3D12_RESOURCE_STATES mStateCurrent;
+    D3D12_RESOURCE_STATES mStateTransition;
+    D3D12_RESOURCE_STATES mStateBegin; // state a non first commandList expects on entry, -1 until first use
+};
+
+// The resources a command list or a frame has touched, as a sparse set over GpuResource tracking
+// slots: lookups index the sparse array, iteration walks only the dense entries and Clear bumps the
+// generation instead of touching the sparse array. Not thread safe, each list owns its set.
+class ResourceStateSet
+{
+public:
+    ResourceStateSet() : mGeneration(1) {}
+
+    ResourceStateCache* Find(const GpuResource& resource)
+    {
+        uint32_t slot = resource.GetTrackingSlot();
+        if (slot >= mSparse.size() || mSparse[slot].generation != mGeneration)
+            return nullptr;
+
+        ResourceStateCache& stateCache = mDense[mSparse[slot].denseIndex];
+        ASSERT(&stateCache.mGpuResource == &resource, "Resource destroyed while its state was still tracked");
+        return &stateCache;
+    }
+
+    ResourceStateCache& FindOrAdd(GpuResource& resource)
+    {
+        ResourceStateCache* stateCache = Find(resource);
+        return stateCache ? *stateCache : Add(ResourceStateCache(resource));
+    }
+
+    // stateCache.mGpuResource must not be in the set yet
+    ResourceStateCache& Add(const ResourceStateCache& stateCache)
+    {
+        uint32_t slot = stateCache.mGpuResource.GetTrackingSlot();
+        if (slot >= mSparse.size())
+            mSparse.resize(std::max<size_t>(slot + 1, GpuResource::GetTrackingSlotCount()));
+        ASSERT(mSparse[slot].generation != mGeneration);
+
+        mSparse[slot] = { mGeneration, (uint32_t)mDense.size() };
+        return mDense.emplace_back(stateCache);
+    }
+
+    void Clear()
+    {
+        mDense.clear();
+        if (++mGeneration == 0)
+        {
+            // wrapped, entries stamped 2^32 clears ago would read as live again
+            for (SparseEntry& entry : mSparse)
+                entry.generation = 0;
+            mGeneration = 1;
+        }
+    }
+
+    void Swap(ResourceStateSet& other)
+    {
+        mSparse.swap(other.mSparse);
+        mDense.swap(other.mDense);
+        std::swap(mGeneration, other.mGeneration);
+    }
+
+    size_t GetSize() const { return mDense.size(); }
+
+    std::vector<ResourceStateCache>::iterator begin() { return mDense.begin(); }
+    std::vector<ResourceStateCache>::iterator end() { return mDense.end(); }
+private:
+    struct SparseEntry
+    {
+        uint32_t generation; // entry is live only when equal to mGeneration
+        uint32_t denseIndex;
+    };
+
+    std::vector<SparseEntry> mSparse;
+    std::vector<ResourceStateCache> mDense;
+    uint32_t mGeneration;
+};
@@ -0,0 +1,198 @@
+#include "StagingManager.h"
+#include "CommandList.h"
+#include "CommandQueue.h"
+#include "FrameContext.h"
+#include "Utils/DebugUtils.h"
+
+StagingManager::StagingManager() :
+    mScheduler(STAGING_RING_SIZE),
+    mCompletedToken(0),
+    mRingMemory(nullptr),
+    mStats{}
+{
+    mRingBuffer.Create(L"Staging Ring", STAGING_RING_SIZE);
+    // upload heaps may stay mapped while the GPU reads them, the ring is mapped once for good
+    mRingMemory = (uint8_t*)mRingBuffer.Map();
+    mStats.ringSize = STAGING_RING_SIZE;
+}
+
+StagingManager::Token StagingManager::QueueBufferUpload(GpuBuffer& dest, size_t destOffset, const void* data, size_t numBytes,
+    std::shared_ptr<const void> owner)
+{
+    ASSERT(data != nullptr && numBytes > 0);
+    return QueueUpload({ &dest, nullptr, destOffset, data, numBytes, {}, std::move(owner) }, 16);
+}
+
+StagingManager::Token StagingManager::QueueTextureUpload(GpuResource& dest, UINT numSubresources, const D3D12_SUBRESOURCE_DATA subData[],
+    std::shared_ptr<const void> owner)
+{
+    size_t numBytes = GetRequiredIntermediateSize(dest.GetResource(), 0, numSubresources);
+    std::vector<D3D12_SUBRESOURCE_DATA> subresources(subData, subData + numSubresources);
+    return QueueUpload({ nullptr, std::make_unique<GpuResource>(dest), 0, nullptr, numBytes, std::move(subresources), std::move(owner) },
+        D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+}
+
+StagingManager::Token StagingManager::QueueUpload(PendingUpload&& upload, uint32_t alignment)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPendingUploads.push_back(std::move(upload));
+    return mScheduler.Enqueue(mPendingUploads.back().numBytes, alignment);
+}
+
+void StagingManager::Flush(size_t budget)
+{
+    ZoneScoped;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    Retire();
+    SubmitBatch(budget);
+}
+
+void StagingManager::Wait(Token token)
+{
+    ZoneScoped;
+
+    ASSERT(token != 0);
+    if (IsComplete(token))
+        return;
+
+    CommandQueue& copyQueue = CommandQueueManager::GetInstance()->GetCopyQueue();
+    std::lock_guard<std::mutex> lock(mMutex);
+    while (!mScheduler.IsSubmitted(token))
+    {
+        if (!SubmitBatch(SIZE_MAX))
+        {
+            // the ring is full of batches still in flight
+            copyQueue.WaitForFence(mScheduler.GetOldestFence());
+            Retire();
+            mStats.numRingWaits++;
+        }
+    }
+
+    copyQueue.WaitForFence(mScheduler.GetBatchFence(token));
+    Retire();
+}
+
+void StagingManager::WaitIdle()
+{
+    Token lastToken;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        lastToken = mScheduler.GetLastToken();
+    }
+
+    if (lastToken != 0)
+        Wait(lastToken);
+}
+
+StagingManager::Stats StagingManager::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats.numQueued = mScheduler.GetNumQueued();
+    mStats.queuedBytes = mScheduler.GetQueuedBytes();
+    mStats.ringUsedBytes = mScheduler.GetRing().GetUsedCount();
+    return mStats;
+}
+
+bool StagingManager::SubmitBatch(size_t budget)
+{
+    if (mScheduler.GetNumQueued() == 0)
+        return false;
+
+    mBatchOffsets.clear();
+    uint32_t numPacked = mScheduler.PackBatch(budget, mBatchOffsets);
+    if (numPacked == 0)
+        return false;
+
+    size_t numBytes = 0;
+    for (uint32_t i = 0; i < numPacked; i++)
+    {
+        numBytes += mPendingUploads.front().numBytes;
+        mBatchUploads.push_back(std::move(mPendingUploads.front()));
+        mPendingUploads.pop_front();
+    }
+
+    uint64_t fenceValue = FrameContextManager::GetInstance()->CommitAsyncCopyTask(
+        Graphics::GraphicsContext::PushGraphicsTaskBind(&StagingManager::RecordBatchTask, this));
+    mScheduler.CloseBatch(fenceValue);
+
+    // everything is copied out by now, the owners can let go of the source data. The textures are
+    // written by the copy queue until fenceValue
+    for (PendingUpload& upload : mBatchUploads)
+    {
+        if (upload.destTexture != nullptr)
+            mInFlightTextures.emplace_back(fenceValue, std::move(upload.destTexture));
+    }
+    mBatchUploads.clear();
+
+    mStats.lastBatchUploads = numPacked;
+    mStats.lastBatchBytes = numBytes;
+    mStats.numBatches++;
+    return true;
+}
+
+void StagingManager::Retire()
+{
+    uint64_t completedFenceValue = CommandQueueManager::GetInstance()->GetCopyQueue().GetCompletedFenceValue();
+    mScheduler.Retire(completedFenceValue);
+    while (!mInFlightTextures.empty() && mInFlightTextures.front().first <= completedFenceValue)
+        mInFlightTextures.pop_front();
+
+    mCompletedToken.store(mScheduler.GetCompletedToken(), std::memory_order_release);
+}
+
+CommandList* StagingManager::RecordBatchTask(CommandList* commandList)
+{
+    CopyCommandList& copyList = commandList->GetCopyCommandList().Begin(L"Staging Upload");
+
+    // every texture barrier goes out before the first copy, buffers are promoted by the copy itself
+    for (PendingUpload& upload : mBatchUploads)
+    {
+        if (upload.destTexture != nullptr)
+            copyList.TransitionResource(*upload.destTexture, D3D12_RESOURCE_STATE_COPY_DEST);
+    }
+    copyList.FlushResourceBarriers();
+
+    for (size_t i = 0; i < mBatchUploads.size(); i++)
+    {
+        PendingUpload& upload = mBatchUploads[i];
+        uint32_t offset = mBatchOffsets[i];
+        bool hasRingSpace = offset != Utility::StagingScheduler::kNoRingSpace;
+
+        if (upload.destBuffer != nullptr)
+        {
+            if (hasRingSpace)
+            {
+                CopyMemory(mRingMemory + offset, upload.data, upload.numBytes);
+                copyList.CopyBufferRegionDecayed(*upload.destBuffer, upload.destOffset, mRingBuffer, offset, upload.numBytes);
+            }
+            else
+            {
+                copyList.InitializeBufferDecayed(*upload.destBuffer, upload.data, upload.numBytes, upload.destOffset);
+            }
+        }
+        else
+        {
+            if (hasRingSpace)
+            {
+                UpdateSubresources(copyList.GetDeviceCommandList(), upload.destTexture->GetResource(), mRingBuffer.GetResource(),
+                    offset, 0, (UINT)upload.subData.size(), upload.subData.data());
+            }
+            else
+            {
+                copyList.InitializeTexture(*upload.destTexture, (UINT)upload.subData.size(), upload.subData.data());
+            }
+        }
+    }
+
+    // textures are handed back in COMMON, the buffers decay to it once the list has run
+    for (PendingUpload& upload : mBatchUploads)
+    {
+        if (upload.destTexture != nullptr)
+            copyList.TransitionResource(*upload.destTexture, D3D12_RESOURCE_STATE_COMMON);
+    }
+    copyList.FlushResourceBarriers();
+    copyList.Finish();
+
+    return commandList;
+}
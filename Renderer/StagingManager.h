@@ -0,0 +1,89 @@
+#pragma once
+#include "CoreHeader.h"
+#include "Common.h"
+#include "GpuBuffer.h"
+#include "Utils/StagingScheduler.h"
+
+#include <atomic>
+#include <deque>
+
+class CommandList;
+
+// Streams buffer and texture data to the GPU through one persistently mapped upload ring. Uploads are
+// queued from any thread, Flush packs the oldest ones up to a byte budget into a single copy queue
+// command list and the token of an upload tells when it has landed. The destination is left in the
+// COMMON state, which a copy queue resource decays to anyway. A texture's resource is referenced until
+// its copy has completed, so the texture can be reset at any time.
+class StagingManager : public Singleton<StagingManager>
+{
+    USE_SINGLETON;
+public:
+    using Token = uint64_t;
+
+    struct Stats
+    {
+        uint32_t lastBatchUploads;
+        size_t lastBatchBytes;
+        uint32_t numBatches;
+        uint32_t numRingWaits;  // times Wait found the ring full of batches in flight
+        size_t numQueued;
+        size_t queuedBytes;
+        uint32_t ringUsedBytes;
+        uint32_t ringSize;
+    };
+
+    // data must stay valid until the upload is submitted, owner is held until then
+    Token QueueBufferUpload(GpuBuffer& dest, size_t destOffset, const void* data, size_t numBytes,
+        std::shared_ptr<const void> owner = nullptr);
+    Token QueueTextureUpload(GpuResource& dest, UINT numSubresources, const D3D12_SUBRESOURCE_DATA subData[],
+        std::shared_ptr<const void> owner = nullptr);
+
+    // Submits the queued uploads that fit budget bytes and the ring as one batch, once per frame on the main thread
+    void Flush(size_t budget = STAGING_FRAME_BUDGET);
+
+    // Submits everything queued up to token regardless of the budget and waits for the copy queue, main thread only
+    void Wait(Token token);
+    // Wait for everything queued so far
+    void WaitIdle();
+
+    bool IsComplete(Token token) const { return token <= mCompletedToken.load(std::memory_order_acquire); }
+
+    Stats GetStats();
+private:
+    StagingManager();
+    ~StagingManager() {}
+
+    struct PendingUpload
+    {
+        GpuBuffer* destBuffer; // null for a texture
+        std::unique_ptr<GpuResource> destTexture; // own reference, the texture may be reset before the copy lands
+        size_t destOffset;
+        const void* data;
+        size_t numBytes;
+        std::vector<D3D12_SUBRESOURCE_DATA> subData;
+        std::shared_ptr<const void> owner;
+    };
+
+    Token QueueUpload(PendingUpload&& upload, uint32_t alignment);
+
+    // both with mMutex held
+    bool SubmitBatch(size_t budget);
+    void Retire();
+
+    CommandList* RecordBatchTask(CommandList* commandList);
+private:
+    std::mutex mMutex;
+    Utility::StagingScheduler mScheduler;
+    std::deque<PendingUpload> mPendingUploads; // queued, in token order
+    std::vector<PendingUpload> mBatchUploads;
+    std::vector<uint32_t> mBatchOffsets;
+    std::deque<std::pair<uint64_t, std::unique_ptr<GpuResource>>> mInFlightTextures; // released in Retire
+    std::atomic<Token> mCompletedToken;
+
+    UploadBuffer mRingBuffer;
+    uint8_t* mRingMemory;
+
+    Stats mStats;
+};
+
+#define STAGING_MANAGER StagingManager::GetInstance()
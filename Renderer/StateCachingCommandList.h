@@ -0,0 +1,297 @@
+#pragma once
+#include "CoreHeader.h"
+#include "Common.h"
+#include "PipelineState.h"
+#include "RootSignature.h"
+#include "CommandSignature.h"
+#include "DescriptorHandle.h"
+#include "Utils/DebugUtils.h"
+
+enum eStateCall
+{
+    kStateCallRootSignature,
+    kStateCallPipelineState,
+    kStateCallConstantBuffer,
+    kStateCallShaderResource,
+    kStateCallRootConstant,
+    kStateCallDescriptorTable,
+    kStateCallVertexBuffer,
+    kStateCallIndexBuffer,
+    kStateCallTopology,
+    kNumStateCalls
+};
+
+struct StateCallStats
+{
+    uint32_t issued[kNumStateCalls] = {};
+    uint32_t skipped[kNumStateCalls] = {};
+    uint32_t draws = 0;            // draw calls recorded, directly or as indirect records
+    uint32_t instances = 0;        // instances drawn by them, one per mesh
+    uint32_t executeIndirects = 0;
+
+    uint32_t GetIssuedCount() const
+    {
+        uint32_t count = 0;
+        for (uint32_t n : issued)
+            count += n;
+        return count;
+    }
+
+    uint32_t GetSkippedCount() const
+    {
+        uint32_t count = 0;
+        for (uint32_t n : skipped)
+            count += n;
+        return count;
+    }
+
+    void Reset() { *this = StateCallStats(); }
+
+    StateCallStats& operator+=(const StateCallStats& other)
+    {
+        for (uint32_t i = 0; i < kNumStateCalls; i++)
+        {
+            issued[i] += other.issued[i];
+            skipped[i] += other.skipped[i];
+        }
+        draws += other.draws;
+        instances += other.instances;
+        executeIndirects += other.executeIndirects;
+        return *this;
+    }
+};
+
+// Filters the state setters of a draw loop against what was last bound, so consecutive draws
+// sharing a PSO, material or mesh buffers only issue what actually changed. CommandListType is
+// GraphicsCommandList in the renderer and RecordingCommandList when there is no device.
+// The cache starts empty and never reads back state, anything set on the wrapped list behind
+// its back must be followed by Invalidate().
+template<typename CommandListType>
+class StateCachingCommandList : public NonCopyable
+{
+public:
+    static constexpr UINT kMaxRootParameters = 16;
+    static constexpr UINT kMaxVertexBuffers = 4;
+
+    StateCachingCommandList(CommandListType& context, StateCallStats* stats = nullptr) :
+        mContext(context), mStats(stats ? stats : &mLocalStats)
+    {
+        Invalidate();
+    }
+
+    void Invalidate()
+    {
+        mRootSignature = nullptr;
+        mPipelineState = nullptr;
+        mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+        mIndexBuffer = {};
+        for (UINT i = 0; i < kMaxVertexBuffers; i++)
+            mVertexBuffers[i] = {};
+        for (UINT i = 0; i < D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES; i++)
+            mDescriptorHeaps[i] = nullptr;
+        InvalidateRootArguments();
+    }
+
+    void SetRootSignature(const RootSignature& rootSig)
+    {
+        if (Filter(kStateCallRootSignature, mRootSignature == rootSig.GetRootSignature()))
+            return;
+
+        mContext.SetRootSignature(rootSig);
+        // a new root signature leaves every root argument undefined
+        mRootSignature = rootSig.GetRootSignature();
+        InvalidateRootArguments();
+    }
+
+    void SetPipelineState(const PipelineState& pso)
+    {
+        SetRootSignature(pso.GetRootSignature());
+        if (Filter(kStateCallPipelineState, mPipelineState == pso.GetPipelineStateObject()))
+            return;
+
+        mContext.SetPipelineState(pso);
+        mPipelineState = pso.GetPipelineStateObject();
+    }
+
+    void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+    {
+        if (Filter(kStateCallTopology, mTopology == topology))
+            return;
+
+        mContext.SetPrimitiveTopology(topology);
+        mTopology = topology;
+    }
+
+    void SetConstantBuffer(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS cbv)
+    {
+        ASSERT(rootIndex < kMaxRootParameters);
+        if (Filter(kStateCallConstantBuffer, mRootArguments[rootIndex] == cbv))
+            return;
+
+        mContext.SetConstantBuffer(rootIndex, cbv);
+        mRootArguments[rootIndex] = cbv;
+    }
+
+    // always lands in fresh linear allocator memory, so it is never filtered
+    void SetDynamicConstantBufferView(UINT rootIndex, size_t bufferSize, const void* bufferData)
+    {
+        ASSERT(rootIndex < kMaxRootParameters);
+        mStats->issued[kStateCallConstantBuffer]++;
+        mContext.SetDynamicConstantBufferView(rootIndex, bufferSize, bufferData);
+        mRootArguments[rootIndex] = kUnknownArgument;
+    }
+
+    void SetShaderResourceView(UINT rootIndex, D3D12_GPU_VIRTUAL_ADDRESS srv)
+    {
+        ASSERT(rootIndex < kMaxRootParameters);
+        if (Filter(kStateCallShaderResource, mRootArguments[rootIndex] == srv))
+            return;
+
+        mContext.SetShaderResourceView(rootIndex, srv);
+        mRootArguments[rootIndex] = srv;
+    }
+
+    void SetDynamicSRV(UINT rootIndex, size_t bufferSize, const void* bufferData)
+    {
+        ASSERT(rootIndex < kMaxRootParameters);
+        mStats->issued[kStateCallShaderResource]++;
+        mContext.SetDynamicSRV(rootIndex, bufferSize, bufferData);
+        mRootArguments[rootIndex] = kUnknownArgument;
+    }
+
+    // a single 32 bit root constant, compared by value
+    void SetConstant(UINT rootIndex, UINT value)
+    {
+        ASSERT(rootIndex < kMaxRootParameters);
+        if (Filter(kStateCallRootConstant, mRootArguments[rootIndex] == value))
+            return;
+
+        mContext.SetConstants(rootIndex, value);
+        mRootArguments[rootIndex] = value;
+    }
+
+    void SetDescriptorTable(UINT rootIndex, const DescriptorHandle& firstHandle)
+    {
+        ASSERT(rootIndex < kMaxRootParameters);
+        // switching heaps leaves the tables bound from the old heap undefined
+        ID3D12DescriptorHeap*& heap = mDescriptorHeaps[firstHandle.GetType()];
+        if (heap != firstHandle.GetDescriptorHeap())
+        {
+            if (heap != nullptr)
+                InvalidateRootArguments();
+            heap = firstHandle.GetDescriptorHeap();
+        }
+
+        D3D12_GPU_DESCRIPTOR_HANDLE gpuHandle = firstHandle;
+        if (Filter(kStateCallDescriptorTable, mRootArguments[rootIndex] == gpuHandle.ptr))
+            return;
+
+        mContext.SetDescriptorTable(rootIndex, firstHandle);
+        mRootArguments[rootIndex] = gpuHandle.ptr;
+    }
+
+    void SetVertexBuffer(UINT slot, const D3D12_VERTEX_BUFFER_VIEW& vbView)
+    {
+        ASSERT(slot < kMaxVertexBuffers);
+        const D3D12_VERTEX_BUFFER_VIEW& current = mVertexBuffers[slot];
+        bool isSame = current.BufferLocation == vbView.BufferLocation &&
+            current.SizeInBytes == vbView.SizeInBytes && current.StrideInBytes == vbView.StrideInBytes;
+        if (Filter(kStateCallVertexBuffer, isSame))
+            return;
+
+        mContext.SetVertexBuffer(slot, vbView);
+        mVertexBuffers[slot] = vbView;
+    }
+
+    void SetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW& ibView)
+    {
+        bool isSame = mIndexBuffer.BufferLocation == ibView.BufferLocation &&
+            mIndexBuffer.SizeInBytes == ibView.SizeInBytes && mIndexBuffer.Format == ibView.Format;
+        if (Filter(kStateCallIndexBuffer, isSame))
+            return;
+
+        mContext.SetIndexBuffer(ibView);
+        mIndexBuffer = ibView;
+    }
+
+    void DrawIndexed(UINT indexCount, UINT startIndexLocation = 0, INT baseVertexLocation = 0)
+    {
+        mStats->draws++;
+        mStats->instances++;
+        mContext.DrawIndexed(indexCount, startIndexLocation, baseVertexLocation);
+    }
+
+    void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+    {
+        mStats->draws++;
+        mStats->instances += instanceCount;
+        mContext.DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+    }
+
+    // Bindings the signature sets are undefined once ExecuteIndirect returns, they are forgotten here
+    void ExecuteIndirect(const CommandSignature& commandSig, ID3D12Resource* argumentBuffer, UINT64 argumentOffset,
+        UINT numCommands, UINT numInstances)
+    {
+        mStats->executeIndirects++;
+        mStats->draws += numCommands;
+        mStats->instances += numInstances;
+        mContext.ExecuteIndirect(commandSig, argumentBuffer, argumentOffset, numCommands);
+
+        for (UINT i = 0; i < commandSig.GetNumParameters(); i++)
+        {
+            const D3D12_INDIRECT_ARGUMENT_DESC& desc = commandSig[i].GetDesc();
+            switch (desc.Type)
+            {
+            case D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW:
+                mVertexBuffers[desc.VertexBuffer.Slot] = {};
+                break;
+            case D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW:
+                mIndexBuffer = {};
+                break;
+            case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT:
+                mRootArguments[desc.Constant.RootParameterIndex] = kUnknownArgument;
+                break;
+            case D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT_BUFFER_VIEW:
+            case D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW:
+            case D3D12_INDIRECT_ARGUMENT_TYPE_UNORDERED_ACCESS_VIEW:
+                // the root parameter index sits at the same place in all three
+                mRootArguments[desc.ConstantBufferView.RootParameterIndex] = kUnknownArgument;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    CommandListType& GetCommandList() { return mContext; }
+    const StateCallStats& GetStats() const { return *mStats; }
+private:
+    static constexpr UINT64 kUnknownArgument = ~0ull;
+
+    bool Filter(eStateCall call, bool isRedundant)
+    {
+        if (isRedundant)
+            mStats->skipped[call]++;
+        else
+            mStats->issued[call]++;
+        return isRedundant;
+    }
+
+    void InvalidateRootArguments()
+    {
+        for (UINT i = 0; i < kMaxRootParameters; i++)
+            mRootArguments[i] = kUnknownArgument;
+    }
+private:
+    CommandListType& mContext;
+    StateCallStats* mStats;
+    StateCallStats mLocalStats;
+
+    ID3D12RootSignature* mRootSignature;
+    ID3D12PipelineState* mPipelineState;
+    D3D12_PRIMITIVE_TOPOLOGY mTopology;
+    UINT64 mRootArguments[kMaxRootParameters]; // CBV or SRV address, GPU descriptor handle or root constant
+    D3D12_VERTEX_BUFFER_VIEW mVertexBuffers[kMaxVertexBuffers];
+    D3D12_INDEX_BUFFER_VIEW mIndexBuffer;
+    ID3D12DescriptorHeap* mDescriptorHeaps[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
+};
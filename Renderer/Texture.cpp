@@ -2,9 +2,11 @@
 #include "Graphics.h"
 #include "GraphicsResource.h"
 #include "CommandList.h"
+#include "StagingManager.h"
 #include "Utils/DebugUtils.h"
 #include "Utils/FileUtility.h"
 #include "Utils/ThreadPoolExecutor.h"
+#include "Utils/IOQueue.h"
 #include "Utils/DDSTextureLoader12.h"
 #include "Utils/DirectXTex/DirectXTex.h"
 
@@ -394,12 +396,23 @@ void Texture::CreateFromDirectXTex(std::filesystem::path filepath, uint16_t flag
         ASSERT(ConvertToDDS(filepath, flags));
     }
 
-    std::shared_ptr<std::vector<D3D12_SUBRESOURCE_DATA>> subresources = std::make_shared<std::vector<D3D12_SUBRESOURCE_DATA>>();
-    std::shared_ptr<std::vector<uint8_t>> ddsData = std::make_shared<std::vector<uint8_t>>();
+    // subresources point straight into the mapped file, which the copy task keeps alive
+    Utility::MappedFileRef ddsData = Utility::MapFile(newPath);
+    ASSERT(ddsData != nullptr, "Could not open %ws", newPath.c_str());
+
+    CreateFromDDSData(ddsData, ddsData->data(), ddsData->size(), newPath);
+}
+
+void Texture::CreateFromDDSData(std::shared_ptr<const void> ddsOwner, const uint8_t* ddsData, size_t ddsSize,
+    const std::filesystem::path& ddsPath)
+{
+    std::vector<D3D12_SUBRESOURCE_DATA> subresources;
     bool isCubeMap;
-    CheckHR(DirectX::LoadDDSTextureFromFile(
-        Graphics::gDevice.Get(), newPath.c_str(), mResource.GetAddressOf(), *ddsData, *subresources,
+    CheckHR(DirectX::LoadDDSTextureFromMemory(
+        Graphics::gDevice.Get(), ddsData, ddsSize, mResource.GetAddressOf(), subresources,
         0, nullptr, &isCubeMap));
+    mResource->SetName(ddsPath.c_str());
+    mUsageState = D3D12_RESOURCE_STATE_COPY_DEST;
 
     D3D12_RESOURCE_DESC resDesc = mResource->GetDesc();
     D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -437,7 +450,11 @@ void Texture::CreateFromDirectXTex(std::filesystem::path filepath, uint16_t flag
             mDescriptorHandle = ALLOC_DESCRIPTOR1(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
             
         Graphics::gDevice->CreateShaderResourceView(mResource.Get(), &srvDesc, mDescriptorHandle);
-        PushGraphicsTaskAsync(&Texture::InitTextureTask1, this, subresources, std::move(ddsData));
+        uint64_t uploadToken = StagingManager::GetInstance()->QueueTextureUpload(*this, (UINT)subresources.size(), subresources.data(),
+            std::move(ddsOwner));
+        // where the staging copy leaves it, published along with the token
+        mUsageState = D3D12_RESOURCE_STATE_COMMON;
+        mUploadToken.store(uploadToken, std::memory_order_release);
     }
 }
 
@@ -448,9 +465,22 @@ void Texture::Destroy()
     DEALLOC_DESCRIPTOR(mDescriptorHandle, 1);
 }
 
+bool Texture::isValid() const
+{
+    uint64_t uploadToken = mUploadToken.load(std::memory_order_acquire);
+    if (!mIsLoaded)
+        return false;
+    if (uploadToken != 0)
+        return StagingManager::GetInstance()->IsComplete(uploadToken);
+    return AsyncContext::isValid() && *mContextFence != 0;
+}
+
 void Texture::Reset()
 {
     WaitAsyncFence();
+    // the staging manager holds its own reference to the resource until the copy has landed, so nothing
+    // here waits on the copy queue and any thread may reset
+    mUploadToken.store(0, std::memory_order_relaxed);
 
     GpuResource::Destroy();
 
@@ -466,14 +496,6 @@ CommandList* Texture::InitTextureTask(CommandList* commandList, UINT numSubresou
     return commandList;
 }
 
-CommandList* Texture::InitTextureTask1(CommandList* commandList, std::shared_ptr<std::vector<D3D12_SUBRESOURCE_DATA>> subData,
-    std::shared_ptr<std::vector<uint8_t>> initData)
-{
-    (initData); // just for life cycle
-    InitTextureTask(commandList, subData->size(), subData->data());
-    return commandList;
-}
-
 
 // -- TextureRef --
 DescriptorHandle TextureRef::GetSRV() const
@@ -510,6 +532,12 @@ TextureRef TextureManager::GetTexture(const std::filesystem::path& filename, uin
 }
 
 TextureRef TextureManager::GetTexture(const std::filesystem::path& filename, uint16_t flags, Graphics::eDefaultTexture fallback)
+{
+    return GetTexture(filename, flags, fallback, Utility::kIOPriorityNormal);
+}
+
+TextureRef TextureManager::GetTexture(const std::filesystem::path& filename, uint16_t flags, Graphics::eDefaultTexture fallback,
+    Utility::eIOPriority priority)
 {
     ASSERT(!std::filesystem::is_directory(filename));
 
@@ -525,8 +553,28 @@ TextureRef TextureManager::GetTexture(const std::filesystem::path& filename, uin
     const auto& insertIter = mTextures.emplace(filename, filename.stem());
     Texture& newTexture = insertIter.first->second;
 
-    mTextureTasks[filename] = std::move(sPrepareList.emplace(
-        Utility::gThreadPoolExecutor.Submit(&Texture::CreateFromDirectXTex, &newTexture, realPath, flags)));
+    std::filesystem::path ddsPath(realPath);
+    ddsPath.replace_extension(L".dds");
+    if (!std::filesystem::exists(ddsPath))
+    {
+        // needs a conversion first, which is CPU work anyway
+        mTextureTasks[filename] = std::move(sPrepareList.emplace(
+            Utility::gThreadPoolExecutor.Submit(&Texture::CreateFromDirectXTex, &newTexture, realPath, flags)));
+        return TextureRef(&newTexture);
+    }
+
+    // The read waits on an I/O thread, a worker only picks the texture up once the bytes are in memory
+    std::shared_ptr<std::promise<void>> loaded = std::make_shared<std::promise<void>>();
+    mTextureTasks[filename] = loaded->get_future();
+    Utility::gIOQueue.Read(ddsPath, priority, [&newTexture, ddsPath, loaded](Utility::ByteArray ddsData)
+    {
+        Utility::gThreadPoolExecutor.Submit([&newTexture, ddsPath, loaded, ddsData]()
+        {
+            ASSERT(ddsData->size() > 0, "Could not read %ws", ddsPath.c_str());
+            newTexture.CreateFromDDSData(ddsData, ddsData->data(), ddsData->size(), ddsPath);
+            loaded->set_value();
+        });
+    });
     return TextureRef(&newTexture);
 }
 
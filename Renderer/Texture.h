@@ -3,6 +3,9 @@
 #include "GraphicsContext.h"
 #include "DescriptorHandle.h"
 #include "Common.h"
+#include "Utils/IOQueue.h"
+
+#include <atomic>
 
 class CommandList;
 
@@ -27,9 +30,9 @@ class Texture : public GpuResource, public Graphics::AsyncGraphicsContext
     friend class TextureManager;
 public:
     Texture(const std::wstring& name = L"Textrue") :mIsLoaded(false), mWidth(1), mHeight(1), mDepth(1), mName(name),
-        mfallback(Graphics::kWhiteOpaque2D) {}
+        mfallback(Graphics::kWhiteOpaque2D), mUploadToken(0) {}
     Texture(DescriptorHandle handle) :mIsLoaded(false), mWidth(0), mHeight(0), mDepth(0), mfallback(Graphics::kWhiteOpaque2D),
-        mDescriptorHandle(handle) {}
+        mDescriptorHandle(handle), mUploadToken(0) {}
 
     // sync way to create!
     void Create2D(size_t rowPitchBytes, size_t width, size_t height, DXGI_FORMAT format, const void* initData);
@@ -39,12 +42,15 @@ public:
     bool CreateDDSFromMemory(const void* memBuffer, size_t fileSize);
     void CreatePIXImageFromMemory(const void* memBuffer, size_t fileSize);
     void CreateFromDirectXTex(std::filesystem::path filepath, uint16_t flags);
+    // ddsOwner keeps ddsData alive until the upload has been recorded, the upload goes through the StagingManager
+    void CreateFromDDSData(std::shared_ptr<const void> ddsOwner, const uint8_t* ddsData, size_t ddsSize,
+        const std::filesystem::path& ddsPath);
 
     virtual void Destroy() override;
     void Reset();
 
     const DescriptorHandle& GetSRV() const { return mDescriptorHandle; }
-    virtual bool isValid() const { return mIsLoaded && AsyncContext::isValid() && *mContextFence != 0; }
+    virtual bool isValid() const;
 
     uint32_t GetWidth() const { return mWidth; }
     uint32_t GetHeight() const { return mHeight; }
@@ -54,9 +60,6 @@ public:
     std::wstring mName;
 private:
     CommandList* InitTextureTask(CommandList* commandList, UINT numSubresources, D3D12_SUBRESOURCE_DATA subData[]);
-    // just for life cycle
-    CommandList* InitTextureTask1(CommandList* commandList, std::shared_ptr<std::vector<D3D12_SUBRESOURCE_DATA>> subData,
-        std::shared_ptr<std::vector<uint8_t>> initData);
 protected:
     bool mIsLoaded;
     uint32_t mWidth;
@@ -65,6 +68,9 @@ protected:
 
     Graphics::eDefaultTexture mfallback;
     DescriptorHandle mDescriptorHandle;
+    // StagingManager token of the data upload, 0 when uploaded by its own task. Stored with release once
+    // the texture is set up on a loader thread, isValid reads it with acquire on the main thread
+    std::atomic<uint64_t> mUploadToken;
 };
 
 
@@ -107,6 +113,9 @@ public:
     TextureRef GetTexture(const std::filesystem::path& filename, uint16_t flags);
     TextureRef GetTexture(const std::filesystem::path& filename, uint16_t flags,
         Graphics::eDefaultTexture fallback);
+    // priority orders the file read against the other pending ones, textures the first frames show go first
+    TextureRef GetTexture(const std::filesystem::path& filename, uint16_t flags,
+        Graphics::eDefaultTexture fallback, Utility::eIOPriority priority);
     
     std::filesystem::path GetAbsRootPath() const { return std::filesystem::current_path() / mRootPath; }
 
@@ -0,0 +1,62 @@
+#include "FenceRingAllocator.h"
+#include "DebugUtils.h"
+
+using namespace Utility;
+
+void FenceRingAllocator::Reset(uint32_t size)
+{
+	mFinishedFrames.clear();
+	mSize = size;
+	mHead = 0;
+	mUsedCount = 0;
+	mOpenFrameCount = 0;
+}
+
+uint32_t FenceRingAllocator::Allocate(uint32_t count, uint32_t alignment)
+{
+	ASSERT(count > 0 && count <= mSize);
+	ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	// an empty ring starts over, so the whole size fits again
+	if (mUsedCount == 0)
+		mHead = 0;
+
+	// the free indices run from mHead around to where the oldest frame starts
+	uint32_t offset = (mHead + alignment - 1) & ~(alignment - 1);
+	uint32_t skipped = offset - mHead;
+	if (offset + count > mSize)
+	{
+		skipped = mSize - mHead;
+		offset = 0;
+	}
+
+	if (mUsedCount + skipped + count > mSize)
+		return kInvalidOffset;
+
+	mUsedCount += skipped + count;
+	mOpenFrameCount += skipped + count;
+	mHead = offset + count == mSize ? 0 : offset + count;
+	return offset;
+}
+
+void FenceRingAllocator::FinishFrame(uint64_t fenceValue)
+{
+	ASSERT(mFinishedFrames.empty() || mFinishedFrames.back().fenceValue <= fenceValue);
+	if (mOpenFrameCount == 0)
+		return;
+
+	mFinishedFrames.push_back({ fenceValue, mOpenFrameCount });
+	mOpenFrameCount = 0;
+}
+
+uint32_t FenceRingAllocator::Retire(uint64_t completedFenceValue)
+{
+	uint32_t numRetired = 0;
+	while (!mFinishedFrames.empty() && mFinishedFrames.front().fenceValue <= completedFenceValue)
+	{
+		mUsedCount -= mFinishedFrames.front().count;
+		mFinishedFrames.pop_front();
+		numRetired++;
+	}
+	return numRetired;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <deque>
+#include <cstdint>
+
+namespace Utility
+{
+	// Hands out contiguous index ranges in order around a ring of fixed size. Everything allocated
+	// since the last FinishFrame belongs to the frame it closes and is tagged with that frame's fence
+	// value. Retire releases frames in order once their fence is complete. Fence values are plain
+	// numbers, so a timeline can be driven without a queue. Not thread safe.
+	class FenceRingAllocator
+	{
+	public:
+		static constexpr uint32_t kInvalidOffset = (uint32_t)-1;
+
+		explicit FenceRingAllocator(uint32_t size = 0) { Reset(size); }
+
+		// drops every frame, only safe once the GPU is done with all of them
+		void Reset(uint32_t size);
+
+		// First index of count contiguous indices, a multiple of alignment, or kInvalidOffset until an older
+		// frame retires. A range never wraps, the indices skipped for alignment or at the end of the ring are
+		// charged to the frame.
+		uint32_t Allocate(uint32_t count, uint32_t alignment = 1);
+
+		// tags what was allocated since the last call, fenceValue must not go backwards
+		void FinishFrame(uint64_t fenceValue);
+
+		// releases the finished frames whose fence is at most completedFenceValue, returns how many
+		uint32_t Retire(uint64_t completedFenceValue);
+
+		bool HasFinishedFrames() const { return !mFinishedFrames.empty(); }
+		// fence of the oldest frame still holding indices, 0 when none
+		uint64_t GetOldestFence() const { return mFinishedFrames.empty() ? 0 : mFinishedFrames.front().fenceValue; }
+
+		uint32_t GetSize() const { return mSize; }
+		uint32_t GetUsedCount() const { return mUsedCount; }
+		uint32_t GetOpenFrameCount() const { return mOpenFrameCount; }
+	private:
+		struct FinishedFrame
+		{
+			uint64_t fenceValue;
+			uint32_t count; // allocated plus skipped indices
+		};
+
+		std::deque<FinishedFrame> mFinishedFrames; // oldest first
+		uint32_t mSize;
+		uint32_t mHead; // next index handed out, the oldest frame starts mUsedCount indices before it
+		uint32_t mUsedCount;
+		uint32_t mOpenFrameCount;
+	};
+}
@@ -18,6 +18,15 @@
 
 #include "DebugUtils.h"
 #include "ThreadPoolExecutor.h"
+#include "IOQueue.h"
+
+#ifndef _WIN32
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 using namespace Utility;
@@ -28,6 +37,7 @@ namespace Utility
 }
 
 ByteArray DecompressZippedFile( wstring& fileName );
+ByteArray DecompressHelper(const Utility::byte* Data, size_t Size, int& err);
 
 ByteArray ReadFileHelper(const wstring& fileName)
 {
@@ -57,73 +67,250 @@ ByteArray ReadFileHelperEx( shared_ptr<wstring> fileName)
     return ReadFileHelper(*fileName);
 }
 
-ByteArray Inflate(ByteArray CompressedSource, int& err, uint32_t ChunkSize = 0x100000 ) 
+// Deflate codes a 258 byte match in no less than two bits, so no stream inflates to more than this many
+// times its size.  Sizes a header claims are only hints, output past the limit means the data is corrupt.
+static const size_t kMaxInflateRatio = 1032;
+
+static size_t GetInflateLimit(size_t CompressedSize)
 {
-    // Create a dynamic buffer to hold compressed blocks
-    vector<unique_ptr<Utility::byte> > blocks;
+    return CompressedSize > SIZE_MAX / kMaxInflateRatio ? SIZE_MAX : CompressedSize * kMaxInflateRatio;
+}
+
+// Inflates a zlib or gzip stream straight into the returned buffer.  A gzip member ends with ISIZE,
+// the uncompressed size modulo 2^32, which sizes the buffer up front when it is within the inflate
+// limit.  Without it (or when it wrapped or lied) the buffer grows geometrically up to that limit and
+// is trimmed at the end.  A stream that inflates past the limit fails.
+ByteArray Inflate(const Utility::byte* CompressedData, size_t CompressedSize, int& err)
+{
+    const size_t Limit = GetInflateLimit(CompressedSize);
+    size_t ExpectedSize = CompressedSize * 4;
+    if (CompressedSize >= 18 && CompressedData[0] == 0x1f && CompressedData[1] == 0x8b)
+    {
+        uint32_t ISize;
+        memcpy(&ISize, CompressedData + CompressedSize - sizeof(ISize), sizeof(ISize));
+        if (ISize > 0)
+            ExpectedSize = ISize;
+    }
+    ExpectedSize = min(max<size_t>(ExpectedSize, 1), Limit);
+
+    ByteArray byteArray = make_shared<vector<Utility::byte> >( ExpectedSize );
 
     z_stream strm  = {};
     strm.data_type = Z_BINARY;
-    strm.total_in  = strm.avail_in  = (uInt)CompressedSource->size();
-    strm.next_in   = CompressedSource->data();
 
     err = inflateInit2(&strm, (15 + 32)); //15 window bits, and the +32 tells zlib to to detect if using gzip or zlib
 
-    while (err == Z_OK || err == Z_BUF_ERROR)
+    // avail_in and avail_out are 32-bit, so feed and drain in pieces for anything larger
+    const uInt MaxStep = 0x40000000;
+    size_t InputRemaining = CompressedSize;
+    size_t TotalOut = 0;
+
+    while (err == Z_OK)
     {
-        strm.avail_out = ChunkSize;
-        strm.next_out = (Utility::byte*)malloc(ChunkSize);
-        blocks.emplace_back(strm.next_out);
+        if (strm.avail_in == 0 && InputRemaining > 0)
+        {
+            strm.next_in = (Bytef*)CompressedData + (CompressedSize - InputRemaining);
+            strm.avail_in = (uInt)min<size_t>(InputRemaining, MaxStep);
+            InputRemaining -= strm.avail_in;
+        }
+
+        if (TotalOut == byteArray->size())
+        {
+            if (TotalOut == Limit)
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
+            byteArray->resize(min(byteArray->size() * 2, Limit));
+        }
+
+        uInt OutputAvailable = (uInt)min<size_t>(byteArray->size() - TotalOut, MaxStep);
+        strm.next_out = byteArray->data() + TotalOut;
+        strm.avail_out = OutputAvailable;
+
         err = inflate(&strm, Z_NO_FLUSH);
+        TotalOut += OutputAvailable - strm.avail_out;
+
+        // Out of room is not an error, the next pass makes more
+        if (err == Z_BUF_ERROR && strm.avail_out == 0)
+            err = Z_OK;
     }
 
-    if (err != Z_STREAM_END) 
-    {
-        inflateEnd(&strm);
+    inflateEnd(&strm);
+
+    if (err != Z_STREAM_END)
         return NullFile;
-    }
 
-    ASSERT(strm.total_out > 0, "Nothing to decompress");
+    ASSERT(TotalOut > 0, "Nothing to decompress");
 
-    ByteArray byteArray = make_shared<vector<Utility::byte> >( strm.total_out );
+    byteArray->resize(TotalOut);
+    byteArray->shrink_to_fit();
+    return byteArray;
+}
 
-    // Allocate actual memory for this.
-    // copy the bits into that RAM.
-    // Free everything else up!!
-    void* curDest = byteArray->data();
-    size_t remaining = byteArray->size();
+// Chunked container written by CompressChunked:
+//   ChunkedHeader | ChunkRecord[numChunks] | zlib streams
+// Every chunk inflates to chunkSize bytes (the last one to the remainder) independently of the others.
+// The sizes are checked against the inflate limit of each chunk before anything is allocated.
+static const uint32_t kChunkedMagic = 0x4B435A4D; // "MZCK"
 
-    for (size_t i = 0; i < blocks.size(); ++i)
-    {
-        ASSERT(remaining > 0);
+struct ChunkedHeader
+{
+    uint32_t magic;
+    uint32_t chunkSize;
+    uint64_t uncompressedSize;
+    uint32_t numChunks;
+    uint32_t reserved;
+};
+
+struct ChunkRecord
+{
+    uint64_t offset; // from the start of the container
+    uint32_t compressedSize;
+    uint32_t reserved;
+};
+
+bool IsChunkedContainer(const Utility::byte* Data, size_t Size)
+{
+    return Size >= sizeof(ChunkedHeader) && ((const ChunkedHeader*)Data)->magic == kChunkedMagic;
+}
 
-        size_t CopySize = remaining < ChunkSize ? remaining : ChunkSize;
+ByteArray InflateChunked(const Utility::byte* Data, size_t Size, int& err)
+{
+    const ChunkedHeader& header = *(const ChunkedHeader*)Data;
+    const ChunkRecord* records = (const ChunkRecord*)(Data + sizeof(ChunkedHeader));
 
-        memcpy(curDest, blocks[i].get(), CopySize);
-        curDest = (Utility::byte*)curDest + CopySize;
-        remaining -= CopySize;
+    err = Z_DATA_ERROR;
+    if (header.chunkSize == 0 || header.uncompressedSize > GetInflateLimit(Size) ||
+        header.numChunks != (header.uncompressedSize + header.chunkSize - 1) / header.chunkSize ||
+        header.numChunks > (Size - sizeof(ChunkedHeader)) / sizeof(ChunkRecord))
+        return NullFile;
+
+    for (uint32_t i = 0; i < header.numChunks; ++i)
+    {
+        if (records[i].offset > Size || records[i].compressedSize > Size - records[i].offset)
+            return NullFile;
+
+        uint64_t OutSize = min<uint64_t>(header.chunkSize, header.uncompressedSize - (uint64_t)i * header.chunkSize);
+        if (OutSize > GetInflateLimit(records[i].compressedSize))
+            return NullFile;
     }
 
-    inflateEnd(&strm);
+    ByteArray byteArray = make_shared<vector<Utility::byte> >( (size_t)header.uncompressedSize );
+
+    std::atomic<int> FirstError(Z_OK);
+    gThreadPoolExecutor.ParallelFor(0, header.numChunks, 1, [&](size_t i)
+    {
+        size_t OutOffset = i * header.chunkSize;
+        uLongf OutSize = (uLongf)min<uint64_t>(header.chunkSize, header.uncompressedSize - OutOffset);
+        uLongf DestLen = OutSize;
+
+        int result = uncompress(byteArray->data() + OutOffset, &DestLen,
+            Data + records[i].offset, records[i].compressedSize);
+        if (result == Z_OK && DestLen != OutSize)
+            result = Z_DATA_ERROR;
+        if (result != Z_OK)
+        {
+            int expected = Z_OK;
+            FirstError.compare_exchange_strong(expected, result);
+        }
+    });
+
+    err = FirstError.load();
+    if (err != Z_OK)
+        return NullFile;
 
+    err = Z_STREAM_END;
     return byteArray;
 }
 
 ByteArray DecompressZippedFile( wstring& fileName )
 {
-    ByteArray CompressedFile = ReadFileHelper(fileName);
-    if (CompressedFile == NullFile)
+    // The compressed bytes are only read once, so map them rather than holding a second heap copy
+    MappedFileRef CompressedFile = MapFile(fileName);
+    if (CompressedFile == nullptr)
         return NullFile;
 
     int error;
-    ByteArray DecompressedFile = Inflate(CompressedFile, error);
-    if (DecompressedFile->size() == 0)
-    {
+    ByteArray DecompressedFile = DecompressHelper(CompressedFile->data(), CompressedFile->size(), error);
+    if (DecompressedFile == NullFile)
         PrintMessage(L"Couldn't unzip file %s:  Error = %d\n", fileName.c_str(), error);
+
+    return DecompressedFile;
+}
+
+ByteArray DecompressHelper(const Utility::byte* Data, size_t Size, int& err)
+{
+    err = Z_DATA_ERROR;
+    if (Size == 0)
+        return NullFile;
+
+    return IsChunkedContainer(Data, Size) ? InflateChunked(Data, Size, err) : Inflate(Data, Size, err);
+}
+
+ByteArray Utility::Decompress(const void* data, size_t size)
+{
+    int error;
+    return DecompressHelper((const Utility::byte*)data, size, error);
+}
+
+ByteArray Utility::CompressChunked(const void* data, size_t size, uint32_t chunkSize, int level)
+{
+    ASSERT(chunkSize > 0);
+
+    uint32_t numChunks = (uint32_t)((size + chunkSize - 1) / chunkSize);
+    vector<vector<Utility::byte> > chunks(numChunks);
+
+    std::atomic<int> FirstError(Z_OK);
+    gThreadPoolExecutor.ParallelFor(0, numChunks, 1, [&](size_t i)
+    {
+        size_t offset = i * chunkSize;
+        uLong sourceLen = (uLong)min<size_t>(chunkSize, size - offset);
+        uLongf destLen = compressBound(sourceLen);
+
+        chunks[i].resize(destLen);
+        int result = compress2(chunks[i].data(), &destLen, (const Bytef*)data + offset, sourceLen, level);
+        if (result != Z_OK)
+        {
+            int expected = Z_OK;
+            FirstError.compare_exchange_strong(expected, result);
+        }
+        chunks[i].resize(destLen);
+    });
+
+    if (FirstError.load() != Z_OK)
+    {
+        PrintMessage(L"CompressChunked: compress2 failed, Error = %d\n", FirstError.load());
         return NullFile;
     }
 
-    return DecompressedFile;
+    size_t totalSize = sizeof(ChunkedHeader) + numChunks * sizeof(ChunkRecord);
+    for (const auto& chunk : chunks)
+        totalSize += chunk.size();
+
+    ByteArray byteArray = make_shared<vector<Utility::byte> >( totalSize );
+    Utility::byte* dest = byteArray->data();
+
+    ChunkedHeader& header = *(ChunkedHeader*)dest;
+    header.magic = kChunkedMagic;
+    header.chunkSize = chunkSize;
+    header.uncompressedSize = size;
+    header.numChunks = numChunks;
+    header.reserved = 0;
+
+    ChunkRecord* records = (ChunkRecord*)(dest + sizeof(ChunkedHeader));
+    size_t offset = sizeof(ChunkedHeader) + numChunks * sizeof(ChunkRecord);
+    for (uint32_t i = 0; i < numChunks; ++i)
+    {
+        records[i].offset = offset;
+        records[i].compressedSize = (uint32_t)chunks[i].size();
+        records[i].reserved = 0;
+
+        memcpy(dest + offset, chunks[i].data(), chunks[i].size());
+        offset += chunks[i].size();
+    }
+
+    return byteArray;
 }
 
 ByteArray Utility::ReadFileSync( const wstring& fileName)
@@ -133,6 +320,75 @@ ByteArray Utility::ReadFileSync( const wstring& fileName)
 
 std::future<ByteArray> Utility::ReadFileAsync(const wstring& fileName)
 {
-    shared_ptr<wstring> SharedPtr = make_shared<wstring>(fileName);
-    return gThreadPoolExecutor.Submit(ReadFileHelperEx, SharedPtr);
+    // Served by the I/O threads so a slow disk never stalls the worker pool
+    shared_ptr<promise<ByteArray>> Promise = make_shared<promise<ByteArray>>();
+    std::future<ByteArray> Future = Promise->get_future();
+    gIOQueue.Read(fileName, kIOPriorityNormal, [Promise](ByteArray data) { Promise->set_value(std::move(data)); });
+    return Future;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_Data == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_Data);
+#else
+    munmap((void*)m_Data, m_Size);
+#endif
+}
+
+MappedFileRef Utility::MapFile(const wstring& fileName)
+{
+    shared_ptr<MappedFile> mappedFile(new MappedFile());
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        return nullptr;
+    }
+
+    // The view keeps the mapping object alive, so both handles can be closed right away
+    HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(hFile);
+    if (hMapping == nullptr)
+        return nullptr;
+
+    mappedFile->m_Data = (const byte*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(hMapping);
+    if (mappedFile->m_Data == nullptr)
+        return nullptr;
+
+    mappedFile->m_Size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(filesystem::path(fileName).c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || fileStat.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return nullptr;
+
+    madvise(data, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+    mappedFile->m_Data = (const byte*)data;
+    mappedFile->m_Size = (size_t)fileStat.st_size;
+#endif
+
+    return mappedFile;
 }
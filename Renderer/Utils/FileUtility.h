@@ -23,11 +23,47 @@ namespace Utility
     extern ByteArray NullFile;
 
     // Reads the entire contents of a binary file.  If the file with the same name except with an additional
-    // ".gz" suffix exists, it will be loaded and decompressed instead.
+    // ".gz" suffix exists, it will be loaded and decompressed instead.  That file may hold a gzip or zlib
+    // stream, or a chunked container from CompressChunked which is inflated across the thread pool.
     // This operation blocks until the entire file is read.
     ByteArray ReadFileSync(const std::wstring& fileName);
 
     // Same as previous except that it does not block but instead returns a task.
     std::future<ByteArray> ReadFileAsync(const std::wstring& fileName);
 
+    // Deflates data as independent chunkSize pieces behind an index, compressing them in parallel.
+    // Save the result with a ".gz" suffix for ReadFileSync to pick up.  Returns NullFile when zlib
+    // fails, empty data gives a container that inflates back to nothing.
+    ByteArray CompressChunked(const void* data, size_t size, uint32_t chunkSize = 0x100000, int level = 6);
+
+    // Inflates a chunked container, gzip or zlib stream held in memory.  Returns NullFile when the
+    // data is truncated or corrupt.
+    ByteArray Decompress(const void* data, size_t size);
+
+    // Read-only view of an entire file mapped into the address space.  Pages are faulted in
+    // on first touch straight from the OS file cache, so nothing is copied into the heap.
+    class MappedFile
+    {
+    public:
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        const byte* data() const { return m_Data; }
+        size_t size() const { return m_Size; }
+
+    private:
+        friend std::shared_ptr<const MappedFile> MapFile(const std::wstring& fileName);
+        MappedFile() = default;
+
+        const byte* m_Data = nullptr;
+        size_t m_Size = 0;
+    };
+    typedef std::shared_ptr<const MappedFile> MappedFileRef;
+
+    // Maps the file for reading.  Returns nullptr when the file is missing or empty.  Unlike
+    // ReadFileSync this does not look for a ".gz" sibling.  The view stays valid for as long as
+    // any reference to it is held.
+    MappedFileRef MapFile(const std::wstring& fileName);
+
 } // namespace Utility
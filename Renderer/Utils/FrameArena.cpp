@@ -0,0 +1,181 @@
+#include "FrameArena.h"
+#include "DebugUtils.h"
+
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+using namespace Utility;
+
+namespace
+{
+	constexpr size_t kPageAlignment = 64;
+
+	struct Finalizer
+	{
+		void* object;
+		void (*destroy)(void*);
+		Finalizer* next;
+	};
+
+	struct ArenaPage
+	{
+		uint8_t* memory;
+		size_t size;
+	};
+
+	// pages of one thread for one frame slot, only ever touched by that thread until the slot is reset
+	struct SlotArena
+	{
+		std::vector<ArenaPage> pages;
+		size_t nextPage = 0;
+		uint8_t* cursor = nullptr;
+		uint8_t* end = nullptr;
+		size_t allocatedBytes = 0;
+		Finalizer* finalizers = nullptr; // newest first
+
+		void Rewind()
+		{
+			nextPage = 0;
+			cursor = end = nullptr;
+			allocatedBytes = 0;
+			finalizers = nullptr;
+		}
+	};
+
+	struct ThreadArena
+	{
+		SlotArena slots[FrameArena::kMaxFrameSlots];
+
+		~ThreadArena()
+		{
+			for (SlotArena& slot : slots)
+			{
+				for (ArenaPage& page : slot.pages)
+					::operator delete(page.memory, std::align_val_t(kPageAlignment));
+			}
+		}
+	};
+
+	std::mutex sRegistryMutex;
+	std::vector<std::unique_ptr<ThreadArena>> sThreadArenas;
+	std::atomic<size_t> sCurrentSlot{ 0 };
+	std::atomic<size_t> sReservedBytes{ 0 };
+	bool sIsSlotUsed[FrameArena::kMaxFrameSlots] = { true };
+
+	size_t sLastFrameBytes = 0;
+	size_t sPeakFrameBytes = 0;
+	size_t sTotalFrameBytes = 0;
+	uint32_t sNumFrames = 0;
+
+	ThreadArena& GetThreadArena()
+	{
+		thread_local ThreadArena* tArena = nullptr;
+		if (tArena == nullptr)
+		{
+			std::lock_guard<std::mutex> lock(sRegistryMutex);
+			tArena = sThreadArenas.emplace_back(new ThreadArena).get();
+		}
+		return *tArena;
+	}
+
+	uint8_t* AlignUp(uint8_t* ptr, size_t alignment)
+	{
+		return (uint8_t*)(((uintptr_t)ptr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	}
+
+	// pages kept from earlier frames are reused in order, one too small for the request is skipped for this frame
+	uint8_t* NextPage(SlotArena& arena, size_t size, size_t alignment)
+	{
+		size_t needed = size + (alignment > kPageAlignment ? alignment : 0);
+		while (arena.nextPage < arena.pages.size() && arena.pages[arena.nextPage].size < needed)
+			arena.nextPage++;
+
+		if (arena.nextPage == arena.pages.size())
+		{
+			size_t pageSize = std::max(FrameArena::kPageSize, (needed + FrameArena::kPageSize - 1) & ~(FrameArena::kPageSize - 1));
+			uint8_t* memory = (uint8_t*)::operator new(pageSize, std::align_val_t(kPageAlignment));
+			arena.pages.push_back({ memory, pageSize });
+			sReservedBytes += pageSize;
+		}
+
+		ArenaPage& page = arena.pages[arena.nextPage++];
+		arena.end = page.memory + page.size;
+		return AlignUp(page.memory, alignment);
+	}
+}
+
+void FrameArena::BeginFrame(size_t slot)
+{
+	ASSERT(slot < kMaxFrameSlots);
+	std::lock_guard<std::mutex> lock(sRegistryMutex);
+
+	// every destructor runs before any page is rewound, an object may refer to memory of another thread
+	size_t frameBytes = 0;
+	for (auto& threadArena : sThreadArenas)
+	{
+		SlotArena& arena = threadArena->slots[slot];
+		for (Finalizer* finalizer = arena.finalizers; finalizer != nullptr; finalizer = finalizer->next)
+			finalizer->destroy(finalizer->object);
+		frameBytes += arena.allocatedBytes;
+	}
+
+	for (auto& threadArena : sThreadArenas)
+		threadArena->slots[slot].Rewind();
+
+	if (sIsSlotUsed[slot])
+	{
+		sLastFrameBytes = frameBytes;
+		sPeakFrameBytes = std::max(sPeakFrameBytes, frameBytes);
+		sTotalFrameBytes += frameBytes;
+		sNumFrames++;
+	}
+
+	sIsSlotUsed[slot] = true;
+	sCurrentSlot.store(slot, std::memory_order_relaxed);
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+	size = std::max<size_t>(size, 1);
+
+	SlotArena& arena = GetThreadArena().slots[sCurrentSlot.load(std::memory_order_relaxed)];
+	uint8_t* ptr = AlignUp(arena.cursor, alignment);
+	if (arena.cursor == nullptr || ptr + size > arena.end)
+		ptr = NextPage(arena, size, alignment);
+
+	arena.cursor = ptr + size;
+	arena.allocatedBytes += size;
+	return ptr;
+}
+
+void FrameArena::AddFinalizer(void* object, void (*destroy)(void*))
+{
+	Finalizer* finalizer = (Finalizer*)Allocate(sizeof(Finalizer), alignof(Finalizer));
+	SlotArena& arena = GetThreadArena().slots[sCurrentSlot.load(std::memory_order_relaxed)];
+	finalizer->object = object;
+	finalizer->destroy = destroy;
+	finalizer->next = arena.finalizers;
+	arena.finalizers = finalizer;
+}
+
+FrameArena::Stats FrameArena::GetStats()
+{
+	std::lock_guard<std::mutex> lock(sRegistryMutex);
+	Stats stats;
+	stats.lastFrameBytes = sLastFrameBytes;
+	stats.peakFrameBytes = sPeakFrameBytes;
+	stats.reservedBytes = sReservedBytes.load();
+	stats.totalFrameBytes = sTotalFrameBytes;
+	stats.numFrames = sNumFrames;
+	return stats;
+}
+
+void FrameArena::ResetStats()
+{
+	std::lock_guard<std::mutex> lock(sRegistryMutex);
+	sPeakFrameBytes = 0;
+	sTotalFrameBytes = 0;
+	sNumFrames = 0;
+}
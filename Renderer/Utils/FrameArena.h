@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+/*
+	Bump allocator for data that dies with the frame that made it. Every thread allocates from pages
+	of its own, so the only lock is taken when a thread makes its first allocation. Nothing is freed
+	one allocation at a time: a frame slot is rewound as a whole by BeginFrame, which the frame
+	context calls once the GPU has retired the frame that last used the slot. Objects made with New
+	are destroyed at that point, before any memory of the slot is reused.
+*/
+namespace Utility
+{
+	namespace FrameArena
+	{
+		constexpr size_t kMaxFrameSlots = 4;
+		constexpr size_t kPageSize = 64 * 1024;
+
+		struct Stats
+		{
+			size_t lastFrameBytes;  // allocated by all threads in the last frame that was reset
+			size_t peakFrameBytes;
+			size_t reservedBytes;   // pages held by all threads and slots
+			size_t totalFrameBytes; // summed over numFrames since ResetStats
+			uint32_t numFrames;
+		};
+
+		// Destroys what New made in slot, rewinds it and sends every later allocation there.
+		// No thread may still be using the slot.
+		void BeginFrame(size_t slot);
+
+		void* Allocate(size_t size, size_t alignment);
+
+		Stats GetStats();
+		void ResetStats();
+
+		void AddFinalizer(void* object, void (*destroy)(void*));
+
+		template<typename T, typename ...Args>
+		T* New(Args&&... args)
+		{
+			T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+			if constexpr (!std::is_trivially_destructible_v<T>)
+				AddFinalizer(object, [](void* p) { static_cast<T*>(p)->~T(); });
+			return object;
+		}
+	};
+
+	// Stateless allocator over the current frame slot, deallocate is a no-op
+	template<typename T>
+	class FrameAllocator
+	{
+	public:
+		using value_type = T;
+
+		FrameAllocator() noexcept {}
+		template<typename U>
+		FrameAllocator(const FrameAllocator<U>&) noexcept {}
+
+		T* allocate(size_t count) { return static_cast<T*>(FrameArena::Allocate(count * sizeof(T), alignof(T))); }
+		void deallocate(T*, size_t) noexcept {}
+
+		template<typename U>
+		bool operator==(const FrameAllocator<U>&) const noexcept { return true; }
+		template<typename U>
+		bool operator!=(const FrameAllocator<U>&) const noexcept { return false; }
+	};
+
+	template<typename T>
+	using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+	// Runs the destructor only, the memory goes back with the frame slot
+	template<typename T>
+	struct FrameDeleter
+	{
+		FrameDeleter() noexcept {}
+		template<typename U, typename = std::enable_if_t<std::is_convertible_v<U*, T*>>>
+		FrameDeleter(const FrameDeleter<U>&) noexcept {}
+
+		void operator()(T* object) const { object->~T(); }
+	};
+
+	template<typename T>
+	using FrameUniquePtr = std::unique_ptr<T, FrameDeleter<T>>;
+
+	template<typename T, typename ...Args>
+	FrameUniquePtr<T> MakeFrameUnique(Args&&... args)
+	{
+		return FrameUniquePtr<T>(new (FrameArena::Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...));
+	}
+
+	template<typename T, typename ...Args>
+	std::shared_ptr<T> MakeFrameShared(Args&&... args)
+	{
+		return std::allocate_shared<T>(FrameAllocator<T>(), std::forward<Args>(args)...);
+	}
+}
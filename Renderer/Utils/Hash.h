@@ -63,4 +63,20 @@ namespace Utility
         return HashRange((uint32_t*)StateDesc, (uint32_t*)(StateDesc + Count), Hash);
     }
 
+    // Arbitrary byte ranges, the trailing bytes are zero padded to a full word
+    inline size_t HashBytes(const void* Data, size_t Size, size_t Hash = 2166136261U)
+    {
+        const uint32_t* Begin = (const uint32_t*)Data;
+        const uint32_t* End = Begin + Size / 4;
+        Hash = HashRange(Begin, End, Hash);
+
+        if (Size & 3)
+        {
+            uint32_t Tail = 0;
+            memcpy(&Tail, End, Size & 3);
+            Hash = HashRange(&Tail, &Tail + 1, Hash);
+        }
+        return Hash;
+    }
+
 } // namespace Utility
@@ -0,0 +1,113 @@
+#include "IOQueue.h"
+#include "DebugUtils.h"
+
+using namespace Utility;
+
+IOQueue::IOQueue(size_t threadCount) : mIsRunning(true)
+{
+	ASSERT(threadCount > 0);
+	for (size_t i = 0; i < threadCount; i++)
+		mThreads.emplace_back(&IOQueue::WorkerLoop, this);
+}
+
+IORequestRef IOQueue::Read(const std::wstring& fileName, eIOPriority priority, IOCallback onComplete)
+{
+	ASSERT(priority < kNumIOPriorities);
+	IORequestRef request = std::make_shared<IORequest>(fileName, priority, std::move(onComplete));
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		ASSERT(mIsRunning);
+		mRequests[priority].push_back(request);
+	}
+	mRequestCV.notify_one();
+	return request;
+}
+
+std::vector<IORequestRef> IOQueue::ReadBatch(std::vector<IOReadDesc>&& descs)
+{
+	std::vector<IORequestRef> requests;
+	requests.reserve(descs.size());
+	for (IOReadDesc& desc : descs)
+	{
+		ASSERT(desc.priority < kNumIOPriorities);
+		requests.push_back(std::make_shared<IORequest>(desc.fileName, desc.priority, std::move(desc.onComplete)));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		ASSERT(mIsRunning);
+		for (const IORequestRef& request : requests)
+			mRequests[request->mPriority].push_back(request);
+	}
+	mRequestCV.notify_all();
+	return requests;
+}
+
+void IOQueue::Cancel(const IORequestRef& request)
+{
+	request->mIsCancelled.store(true, std::memory_order_relaxed);
+}
+
+size_t IOQueue::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock(mLock);
+	size_t count = 0;
+	for (const auto& requests : mRequests)
+		count += requests.size();
+	return count;
+}
+
+void IOQueue::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		mIsRunning = false;
+	}
+	mRequestCV.notify_all();
+
+	for (auto& t : mThreads)
+	{
+		if (t.joinable())
+			t.join();
+	}
+	mThreads.clear();
+}
+
+IORequestRef IOQueue::PopRequest()
+{
+	std::unique_lock<std::mutex> lock(mLock);
+	while (true)
+	{
+		for (auto& requests : mRequests)
+		{
+			if (!requests.empty())
+			{
+				IORequestRef request = std::move(requests.front());
+				requests.pop_front();
+				return request;
+			}
+		}
+
+		// drain what was queued before shutting down so every callback still runs
+		if (!mIsRunning)
+			return nullptr;
+
+		mRequestCV.wait(lock);
+	}
+}
+
+void IOQueue::WorkerLoop()
+{
+	while (IORequestRef request = PopRequest())
+	{
+		ByteArray data = NullFile;
+		if (!request->IsCancelled())
+			data = ReadFileSync(request->mFileName);
+		if (request->IsCancelled())
+			data = NullFile;
+
+		IOCallback onComplete = std::move(request->mOnComplete);
+		if (onComplete)
+			onComplete(std::move(data));
+	}
+}
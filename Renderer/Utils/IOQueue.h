@@ -0,0 +1,86 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <functional>
+#include <condition_variable>
+
+#include "FileUtility.h"
+
+namespace Utility
+{
+	enum eIOPriority : uint8_t
+	{
+		kIOPriorityHigh,    // visible this frame
+		kIOPriorityNormal,
+		kIOPriorityLow,     // prefetch
+		kNumIOPriorities
+	};
+
+	// Runs on an I/O thread. Anything CPU heavy should be handed to gThreadPoolExecutor from here.
+	using IOCallback = std::function<void(ByteArray)>;
+
+	class IORequest
+	{
+		friend class IOQueue;
+	public:
+		IORequest(const std::wstring& fileName, eIOPriority priority, IOCallback&& onComplete) :
+			mFileName(fileName), mPriority(priority), mOnComplete(std::move(onComplete)), mIsCancelled(false) {}
+
+		const std::wstring& GetFileName() const { return mFileName; }
+		eIOPriority GetPriority() const { return mPriority; }
+		bool IsCancelled() const { return mIsCancelled.load(std::memory_order_relaxed); }
+	private:
+		std::wstring mFileName;
+		eIOPriority mPriority;
+		IOCallback mOnComplete;
+		std::atomic_bool mIsCancelled;
+	};
+	typedef std::shared_ptr<IORequest> IORequestRef;
+
+	struct IOReadDesc
+	{
+		std::wstring fileName;
+		eIOPriority priority;
+		IOCallback onComplete;
+	};
+
+	// A few threads that only block on file reads, so loading never parks the workers of
+	// gThreadPoolExecutor. Requests are served highest priority first, FIFO within a priority.
+	class IOQueue
+	{
+	public:
+		IOQueue(size_t threadCount);
+		~IOQueue() { Shutdown(); }
+
+		IOQueue(const IOQueue&) = delete;
+		IOQueue& operator=(const IOQueue&) = delete;
+
+		IORequestRef Read(const std::wstring& fileName, eIOPriority priority, IOCallback onComplete);
+
+		// queues the whole batch under one lock
+		std::vector<IORequestRef> ReadBatch(std::vector<IOReadDesc>&& descs);
+
+		// A request cancelled before its read finishes completes with NullFile. The callback always runs
+		// exactly once, so anyone waiting on it is released.
+		void Cancel(const IORequestRef& request);
+
+		size_t GetPendingCount();
+
+		void Shutdown();
+	private:
+		void WorkerLoop();
+		IORequestRef PopRequest();
+	private:
+		std::vector<std::thread> mThreads;
+		std::deque<IORequestRef> mRequests[kNumIOPriorities];
+		std::mutex mLock;
+		std::condition_variable mRequestCV;
+		bool mIsRunning;
+	};
+
+	extern IOQueue gIOQueue;
+}
@@ -0,0 +1,234 @@
+#include "IndexBlockPool.h"
+#include "DebugUtils.h"
+
+#include <algorithm>
+
+using namespace Utility;
+
+namespace
+{
+	// slot of every live pool, a destroyed pool's slot goes to the next one created
+	std::atomic<IndexBlockPool*> sLivePools[IndexBlockPool::kMaxPools];
+
+	// held by an exiting thread while it hands its blocks back and by a pool leaving its slot, so no
+	// pool is destroyed under a thread that still returns blocks to it
+	std::mutex sLivePoolsMutex;
+
+	// epochs are unique across pools, so blocks a thread cached from a destroyed pool never pass for
+	// blocks of the pool that took its slot
+	std::atomic<uint64_t> sNextEpoch{ 1 };
+
+	// size class of a count, kNumSizeClasses when it takes the shared path
+	uint32_t GetSizeClass(uint32_t count)
+	{
+		uint32_t alignedCount = IndexRangeAllocator::GetAlignedCount(count);
+		for (uint32_t sizeClass = 0; sizeClass < IndexBlockPool::kNumSizeClasses; sizeClass++)
+		{
+			if (alignedCount == 1u << sizeClass)
+				return sizeClass;
+		}
+		return IndexBlockPool::kNumSizeClasses;
+	}
+
+	struct Magazine
+	{
+		uint64_t epoch = 0;
+		uint32_t numBlocks = 0;
+		IndexBlockPool::Block blocks[IndexBlockPool::kMagazineSize];
+	};
+
+	struct ThreadMagazines
+	{
+		Magazine magazines[IndexBlockPool::kMaxPools][IndexBlockPool::kNumSizeClasses];
+
+		// blocks of an exiting thread go back while their pool is still alive
+		~ThreadMagazines()
+		{
+			std::lock_guard<std::mutex> lock(sLivePoolsMutex);
+			for (uint32_t i = 0; i < IndexBlockPool::kMaxPools; i++)
+			{
+				IndexBlockPool* pool = sLivePools[i].load(std::memory_order_acquire);
+				if (pool == nullptr)
+					continue;
+
+				for (uint32_t sizeClass = 0; sizeClass < IndexBlockPool::kNumSizeClasses; sizeClass++)
+				{
+					Magazine& magazine = magazines[i][sizeClass];
+					if (magazine.numBlocks > 0 && magazine.epoch == pool->GetEpoch())
+						pool->ReturnBlocks(magazine.blocks, magazine.numBlocks, sizeClass);
+				}
+			}
+		}
+	};
+
+	Magazine& GetMagazine(uint32_t poolIndex, uint32_t sizeClass, uint64_t epoch)
+	{
+		thread_local ThreadMagazines tMagazines;
+		Magazine& magazine = tMagazines.magazines[poolIndex][sizeClass];
+		if (magazine.epoch != epoch)
+		{
+			// the pages these blocks came from were cleared, or belong to a destroyed pool
+			magazine.epoch = epoch;
+			magazine.numBlocks = 0;
+		}
+		return magazine;
+	}
+}
+
+IndexBlockPool::IndexBlockPool(uint32_t pageCapacity, bool useMagazines, AddPageFunc onAddPage) :
+	mPageCapacity(pageCapacity), mUseMagazines(useMagazines), mPoolIndex(kMaxPools), mCurrentPage(-1),
+	mEpoch(sNextEpoch.fetch_add(1)), mOnAddPage(std::move(onAddPage))
+{
+	ASSERT(pageCapacity >= (1u << (kNumSizeClasses - 1)));
+	if (!mUseMagazines)
+		return;
+
+	for (uint32_t i = 0; i < kMaxPools; i++)
+	{
+		IndexBlockPool* expected = nullptr;
+		if (sLivePools[i].compare_exchange_strong(expected, this, std::memory_order_acq_rel))
+		{
+			mPoolIndex = i;
+			break;
+		}
+	}
+	// out of slots, this pool goes without magazines
+	ASSERT(mPoolIndex < kMaxPools, "Raise kMaxPools");
+	mUseMagazines = mPoolIndex < kMaxPools;
+}
+
+IndexBlockPool::~IndexBlockPool()
+{
+	if (mUseMagazines)
+	{
+		std::lock_guard<std::mutex> lock(sLivePoolsMutex);
+		sLivePools[mPoolIndex].store(nullptr, std::memory_order_release);
+	}
+	Clear();
+}
+
+IndexBlockPool::Block IndexBlockPool::Allocate(uint32_t count)
+{
+	ASSERT(count > 0 && count <= mPageCapacity);
+
+	uint32_t sizeClass = GetSizeClass(count);
+	if (mUseMagazines && sizeClass < kNumSizeClasses)
+	{
+		Magazine& magazine = GetMagazine(mPoolIndex, sizeClass, GetEpoch());
+		if (magazine.numBlocks == 0)
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (uint32_t i = 0; i < kMagazineRefill; i++)
+				magazine.blocks[magazine.numBlocks++] = AllocateShared(1u << sizeClass);
+		}
+		return magazine.blocks[--magazine.numBlocks];
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	return AllocateShared(count);
+}
+
+void IndexBlockPool::Free(const Block& block, uint32_t count)
+{
+	ASSERT(count > 0 && count <= mPageCapacity);
+
+	uint32_t sizeClass = GetSizeClass(count);
+	if (mUseMagazines && sizeClass < kNumSizeClasses)
+	{
+		Magazine& magazine = GetMagazine(mPoolIndex, sizeClass, GetEpoch());
+		if (magazine.numBlocks == kMagazineSize)
+		{
+			// full, the oldest half goes back so the recently freed blocks stay hot
+			ReturnBlocks(magazine.blocks, kMagazineRefill, sizeClass);
+			magazine.numBlocks -= kMagazineRefill;
+			std::copy(magazine.blocks + kMagazineRefill, magazine.blocks + kMagazineSize, magazine.blocks);
+		}
+		magazine.blocks[magazine.numBlocks++] = block;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	FreeShared(block, count);
+}
+
+uint8_t IndexBlockPool::AddDedicatedPage(uint32_t capacity)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return AddPage(capacity, true);
+}
+
+void IndexBlockPool::Clear()
+{
+	std::unique_lock<std::mutex> lock(mMutex, std::defer_lock);
+	ASSERT(lock.try_lock(), "Lock is owning by other thread!");
+
+	mPages.clear();
+	mCurrentPage = -1;
+	mEpoch.store(sNextEpoch.fetch_add(1), std::memory_order_release);
+}
+
+uint32_t IndexBlockPool::GetPageCount()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return (uint32_t)mPages.size();
+}
+
+uint32_t IndexBlockPool::GetFreeCount()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	uint32_t numFree = 0;
+	for (const IndexRangeAllocator& page : mPages)
+		numFree += page.GetFreeCount();
+	return numFree;
+}
+
+void IndexBlockPool::ReturnBlocks(const Block blocks[], uint32_t numBlocks, uint32_t sizeClass)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	for (uint32_t i = 0; i < numBlocks; i++)
+		FreeShared(blocks[i], 1u << sizeClass);
+}
+
+IndexBlockPool::Block IndexBlockPool::AllocateShared(uint32_t count)
+{
+	// the current page first, then the older ones before growing the pool
+	if (mCurrentPage != (uint8_t)-1)
+	{
+		uint32_t offset = mPages[mCurrentPage].Allocate(count);
+		if (offset != IndexRangeAllocator::kInvalidIndex)
+			return { offset, mCurrentPage };
+	}
+
+	for (uint8_t i = 0; i < (uint8_t)mPages.size(); i++)
+	{
+		uint32_t offset = mPages[i].Allocate(count);
+		if (offset != IndexRangeAllocator::kInvalidIndex)
+		{
+			mCurrentPage = i;
+			return { offset, i };
+		}
+	}
+
+	mCurrentPage = AddPage(mPageCapacity, false);
+	uint32_t offset = mPages[mCurrentPage].Allocate(count);
+	ASSERT(offset != IndexRangeAllocator::kInvalidIndex);
+	return { offset, mCurrentPage };
+}
+
+void IndexBlockPool::FreeShared(const Block& block, uint32_t count)
+{
+	ASSERT(block.page < mPages.size());
+	mPages[block.page].Free(block.offset, count);
+}
+
+uint8_t IndexBlockPool::AddPage(uint32_t capacity, bool isDedicated)
+{
+	ASSERT(mPages.size() < kMaxPages);
+
+	// a dedicated page has no free indices, so AllocateShared passes over it
+	mPages.emplace_back(isDedicated ? 0 : capacity);
+	uint8_t page = (uint8_t)(mPages.size() - 1);
+	if (mOnAddPage)
+		mOnAddPage(page, capacity);
+	return page;
+}
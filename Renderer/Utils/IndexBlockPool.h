@@ -0,0 +1,71 @@
+#pragma once
+#include "IndexRangeAllocator.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace Utility
+{
+	// Index ranges from a growing list of fixed size pages, each an IndexRangeAllocator behind one
+	// mutex, and nothing about what the indices address: the owner creates whatever backs a page in
+	// the onAddPage callback. With magazines, every thread also keeps up to kMagazineSize blocks per size
+	// class of 1, 2, 4 and 8: it allocates and frees from its own magazine and only locks to move
+	// kMagazineRefill blocks at once. Blocks of an exiting thread go back to the pages.
+	class IndexBlockPool
+	{
+	public:
+		static constexpr uint32_t kMaxPools = 16;
+		static constexpr uint32_t kMaxPages = 255;
+		static constexpr uint32_t kNumSizeClasses = 4;
+		static constexpr uint32_t kMagazineSize = 16;
+		static constexpr uint32_t kMagazineRefill = kMagazineSize / 2;
+
+		struct Block
+		{
+			uint32_t offset;
+			uint8_t page;
+		};
+
+		// called under the pool lock for every page added, dedicated ones included
+		using AddPageFunc = std::function<void(uint8_t page, uint32_t capacity)>;
+
+		IndexBlockPool(uint32_t pageCapacity, bool useMagazines, AddPageFunc onAddPage);
+		~IndexBlockPool();
+
+		// Blocks of up to pageCapacity, a full pool adds a page. Free must be given the same count.
+		Block Allocate(uint32_t count);
+		void Free(const Block& block, uint32_t count);
+
+		// a page Allocate never hands out from, the caller manages all capacity indices of it
+		uint8_t AddDedicatedPage(uint32_t capacity);
+
+		// Drops every page. Blocks threads still cache are ignored from then on, no thread may allocate
+		// or free meanwhile.
+		void Clear();
+
+		uint32_t GetPageCount();
+		// indices free in the pages, blocks parked in magazines count as used
+		uint32_t GetFreeCount();
+
+		// bumped by Clear, blocks a thread cached before that are dropped
+		uint64_t GetEpoch() const { return mEpoch.load(std::memory_order_acquire); }
+
+		// Hands blocks cached by a thread back to the pages
+		void ReturnBlocks(const Block blocks[], uint32_t numBlocks, uint32_t sizeClass);
+	private:
+		// mMutex must be held
+		Block AllocateShared(uint32_t count);
+		void FreeShared(const Block& block, uint32_t count);
+		uint8_t AddPage(uint32_t capacity, bool isDedicated);
+	private:
+		uint32_t mPageCapacity;
+		bool mUseMagazines;
+		uint32_t mPoolIndex;
+		uint8_t mCurrentPage;
+		std::atomic<uint64_t> mEpoch;
+		AddPageFunc mOnAddPage;
+		std::mutex mMutex;
+		std::vector<IndexRangeAllocator> mPages;
+	};
+}
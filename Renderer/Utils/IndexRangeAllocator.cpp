@@ -0,0 +1,164 @@
+#include "IndexRangeAllocator.h"
+#include "DebugUtils.h"
+
+#include <algorithm>
+#include <intrin.h>
+
+using namespace Utility;
+
+namespace
+{
+	uint32_t CountTrailingZeros(uint64_t bits)
+	{
+		unsigned long index;
+		return _BitScanForward64(&index, bits) ? (uint32_t)index : 64;
+	}
+
+	// a bit at every multiple of blockSize, blockSize a power of two up to 64
+	uint64_t GetBlockStartMask(uint32_t blockSize)
+	{
+		return blockSize == 64 ? 1ull : ~0ull / ((1ull << blockSize) - 1);
+	}
+}
+
+uint32_t IndexRangeAllocator::GetAlignedCount(uint32_t count)
+{
+	if (count > kMaxBlockSize)
+		return count;
+
+	uint32_t aligned = 1;
+	while (aligned < count)
+		aligned <<= 1;
+	return aligned;
+}
+
+void IndexRangeAllocator::Reset(uint32_t capacity)
+{
+	mCapacity = capacity;
+	mNumFree = capacity;
+
+	size_t numWords = (capacity + 63) / 64;
+	mFreeBits.assign(numWords, ~0ull);
+	if (capacity % 64 != 0)
+		mFreeBits.back() = (1ull << (capacity % 64)) - 1;
+
+	mWordHasFree.assign((numWords + 63) / 64, ~0ull);
+	if (numWords % 64 != 0)
+		mWordHasFree.back() = (1ull << (numWords % 64)) - 1;
+}
+
+uint32_t IndexRangeAllocator::Allocate(uint32_t count)
+{
+	ASSERT(count > 0);
+	count = GetAlignedCount(count);
+	if (count > mNumFree)
+		return kInvalidIndex;
+
+	uint32_t first = count <= kMaxBlockSize ? AllocateBlock(count) : AllocateRun(count);
+	if (first != kInvalidIndex)
+	{
+		SetRange(first, count, false);
+		mNumFree -= count;
+	}
+	return first;
+}
+
+void IndexRangeAllocator::Free(uint32_t first, uint32_t count)
+{
+	count = GetAlignedCount(count);
+	ASSERT(first + count <= mCapacity);
+	SetRange(first, count, true);
+	mNumFree += count;
+}
+
+uint32_t IndexRangeAllocator::AllocateBlock(uint32_t blockSize)
+{
+	uint64_t blockStarts = GetBlockStartMask(blockSize);
+	for (size_t summaryIdx = 0; summaryIdx < mWordHasFree.size(); summaryIdx++)
+	{
+		for (uint64_t summary = mWordHasFree[summaryIdx]; summary != 0; summary &= summary - 1)
+		{
+			size_t wordIdx = summaryIdx * 64 + CountTrailingZeros(summary);
+
+			// a bit survives when the blockSize - 1 bits above it are free too
+			uint64_t candidates = mFreeBits[wordIdx];
+			for (uint32_t shift = 1; shift < blockSize; shift <<= 1)
+				candidates &= candidates >> shift;
+			candidates &= blockStarts;
+
+			if (candidates != 0)
+				return (uint32_t)(wordIdx * 64 + CountTrailingZeros(candidates));
+		}
+	}
+	return kInvalidIndex;
+}
+
+uint32_t IndexRangeAllocator::AllocateRun(uint32_t count)
+{
+	// only runs that reach the end of a word carry over into the next one
+	uint32_t runStart = 0;
+	uint32_t runLength = 0;
+	for (size_t wordIdx = 0; wordIdx < mFreeBits.size(); wordIdx++)
+	{
+		uint64_t bits = mFreeBits[wordIdx];
+		uint32_t bit = 0;
+		while (bit < 64)
+		{
+			uint64_t rest = bits >> bit;
+			if (rest == 0)
+			{
+				runLength = 0;
+				break;
+			}
+
+			uint32_t usedLength = CountTrailingZeros(rest);
+			if (usedLength > 0)
+			{
+				runLength = 0;
+				bit += usedLength;
+				continue;
+			}
+
+			uint32_t freeLength = std::min(CountTrailingZeros(~rest), 64 - bit);
+			if (runLength == 0)
+				runStart = (uint32_t)(wordIdx * 64 + bit);
+			runLength += freeLength;
+			if (runLength >= count)
+				return runStart;
+
+			bit += freeLength;
+			if (bit < 64)
+				runLength = 0;
+		}
+	}
+	return kInvalidIndex;
+}
+
+void IndexRangeAllocator::SetRange(uint32_t first, uint32_t count, bool isFree)
+{
+	uint32_t end = first + count;
+	while (first < end)
+	{
+		uint32_t wordIdx = first / 64;
+		uint32_t bit = first % 64;
+		uint32_t numBits = std::min(64 - bit, end - first);
+		uint64_t mask = (numBits == 64 ? ~0ull : ((1ull << numBits) - 1)) << bit;
+
+		uint64_t& word = mFreeBits[wordIdx];
+		uint64_t summaryBit = 1ull << (wordIdx % 64);
+		if (isFree)
+		{
+			ASSERT((word & mask) == 0, "Freeing indices that are not allocated");
+			word |= mask;
+			mWordHasFree[wordIdx / 64] |= summaryBit;
+		}
+		else
+		{
+			ASSERT((word & mask) == mask);
+			word &= ~mask;
+			if (word == 0)
+				mWordHasFree[wordIdx / 64] &= ~summaryBit;
+		}
+		first += numBits;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+namespace Utility
+{
+	// First fit allocator of index ranges in [0, capacity), with no knowledge of what the indices
+	// address. One bit per index marks it free, a summary bit per 64 bit word marks words that still
+	// have a free bit. Ranges of up to kMaxBlockSize are rounded to a power of two and aligned to it, so
+	// they sit inside one word and are found with a few bit scans. Longer ranges search for a run across
+	// words. Not thread safe.
+	class IndexRangeAllocator
+	{
+	public:
+		static constexpr uint32_t kInvalidIndex = (uint32_t)-1;
+		static constexpr uint32_t kMaxBlockSize = 64;
+
+		explicit IndexRangeAllocator(uint32_t capacity = 0) { Reset(capacity); }
+
+		// frees everything
+		void Reset(uint32_t capacity);
+
+		// first index of the range or kInvalidIndex, Free must be given the same count
+		uint32_t Allocate(uint32_t count);
+		void Free(uint32_t first, uint32_t count);
+
+		uint32_t GetCapacity() const { return mCapacity; }
+		uint32_t GetFreeCount() const { return mNumFree; }
+
+		// what a range of count really takes
+		static uint32_t GetAlignedCount(uint32_t count);
+	private:
+		uint32_t AllocateBlock(uint32_t blockSize);
+		uint32_t AllocateRun(uint32_t count);
+		void SetRange(uint32_t first, uint32_t count, bool isFree);
+	private:
+		std::vector<uint64_t> mFreeBits;
+		std::vector<uint64_t> mWordHasFree;
+		uint32_t mCapacity;
+		uint32_t mNumFree;
+	};
+}
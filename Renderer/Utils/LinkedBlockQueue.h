@@ -1,66 +1,124 @@
 #pragma once
 #include <mutex>
-#include <list>
+#include <thread>
+#include <atomic>
 #include <condition_variable>
 
-template<typename T>
+#include "MPMCRingQueue.h"
+
+// Blocking adapter over MPMCRingQueue. Put and Get spin on the lock free ring for a while
+// and only park on the condition variables when it stays full or empty.
+template<typename T, size_t Capacity = 1024>
 class LinkedBlockQueue
 {
+	static constexpr uint32_t kSpinCount = 64;
 public:
-	LinkedBlockQueue() {}
+	LinkedBlockQueue() : mPutWaiters(0), mGetWaiters(0) {}
 	~LinkedBlockQueue() {}
 
 	void Put(const T& t);
+	void Put(T&& t);
 	T Get();
 	bool Get(T& t);
 	size_t size();
 private:
+	template<typename U>
+	void PutImpl(U&& t);
+	void NotifyOne(std::condition_variable& cv, std::atomic<uint32_t>& waiters);
+private:
+	MPMCRingQueue<T, Capacity> mQueue;
 	std::mutex mLock;
-	std::list<T> mList;
 	std::condition_variable cv_get;
 	std::condition_variable cv_put;
+	std::atomic<uint32_t> mPutWaiters;
+	std::atomic<uint32_t> mGetWaiters;
 };
 
-template<typename T>
-inline void LinkedBlockQueue<T>::Put(const T& t)
+template<typename T, size_t Capacity>
+inline void LinkedBlockQueue<T, Capacity>::Put(const T& t)
 {
-	std::unique_lock<std::mutex> locker(mLock);
-	while (mList.max_size() == mList.size())
-		cv_put.wait(locker);
+	PutImpl(t);
+}
 
-	mList.push_back(t);
-	cv_get.notify_all();
+template<typename T, size_t Capacity>
+inline void LinkedBlockQueue<T, Capacity>::Put(T&& t)
+{
+	PutImpl(std::move(t));
 }
 
-template<typename T>
-inline T LinkedBlockQueue<T>::Get()
+template<typename T, size_t Capacity>
+template<typename U>
+inline void LinkedBlockQueue<T, Capacity>::PutImpl(U&& t)
 {
-	std::unique_lock<std::mutex> lock_(mLock);
-	while (mList.empty())
-		cv_get.wait(lock_);
+	bool pushed = false;
+	for (uint32_t i = 0; i < kSpinCount && !pushed; i++)
+	{
+		pushed = mQueue.TryPush(std::forward<U>(t));
+		if (!pushed)
+			std::this_thread::yield();
+	}
+
+	if (!pushed)
+	{
+		std::unique_lock<std::mutex> locker(mLock);
+		mPutWaiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		cv_put.wait(locker, [&]() { return mQueue.TryPush(std::forward<U>(t)); });
+		mPutWaiters.fetch_sub(1);
+	}
+
+	NotifyOne(cv_get, mGetWaiters);
+}
 
-	T t = std::move(mList.front());
-	mList.pop_front();
-	cv_put.notify_all();
+template<typename T, size_t Capacity>
+inline T LinkedBlockQueue<T, Capacity>::Get()
+{
+	T t;
+	bool popped = false;
+	for (uint32_t i = 0; i < kSpinCount && !popped; i++)
+	{
+		popped = mQueue.TryPop(t);
+		if (!popped)
+			std::this_thread::yield();
+	}
+
+	if (!popped)
+	{
+		std::unique_lock<std::mutex> lock_(mLock);
+		mGetWaiters.fetch_add(1);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		cv_get.wait(lock_, [&]() { return mQueue.TryPop(t); });
+		mGetWaiters.fetch_sub(1);
+	}
+
+	NotifyOne(cv_put, mPutWaiters);
 	return t;
 }
 
-template<typename T>
-inline bool LinkedBlockQueue<T>::Get(T& t)
+template<typename T, size_t Capacity>
+inline bool LinkedBlockQueue<T, Capacity>::Get(T& t)
 {
-	std::unique_lock<std::mutex> lock_(mLock);
-	if (mList.empty())
+	if (!mQueue.TryPop(t))
 		return false;
 
-	t = mList.front();
-	mList.pop_front();
-	cv_put.notify_all();
+	NotifyOne(cv_put, mPutWaiters);
 	return true;
 }
 
-template<typename T>
-inline size_t LinkedBlockQueue<T>::size()
+template<typename T, size_t Capacity>
+inline size_t LinkedBlockQueue<T, Capacity>::size()
+{
+	return mQueue.size();
+}
+
+template<typename T, size_t Capacity>
+inline void LinkedBlockQueue<T, Capacity>::NotifyOne(std::condition_variable& cv, std::atomic<uint32_t>& waiters)
 {
-	std::unique_lock<std::mutex> lock_(mLock);
-	return mList.size();
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiters.load(std::memory_order_relaxed) > 0)
+	{
+		// take the lock so a waiter between its predicate check and wait() can't miss this
+		std::lock_guard<std::mutex> lock_(mLock);
+		cv.notify_one();
+	}
 }
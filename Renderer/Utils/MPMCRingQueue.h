@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+// Bounded multi-producer multi-consumer ring (Vyukov). Every cell carries a sequence number
+// that tells producers and consumers whether the slot is free for the current lap.
+template<typename T, size_t Capacity = 1024>
+class MPMCRingQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	static constexpr size_t kMask = Capacity - 1;
+
+	struct Cell
+	{
+		std::atomic<size_t> mSequence;
+		T mData;
+	};
+public:
+	MPMCRingQueue() : mBuffer(new Cell[Capacity]), mEnqueuePos(0), mDequeuePos(0)
+	{
+		for (size_t i = 0; i < Capacity; i++)
+			mBuffer[i].mSequence.store(i, std::memory_order_relaxed);
+	}
+	~MPMCRingQueue() {}
+
+	MPMCRingQueue(const MPMCRingQueue&) = delete;
+	MPMCRingQueue& operator=(const MPMCRingQueue&) = delete;
+
+	template<typename U>
+	bool TryPush(U&& data)
+	{
+		Cell* cell = nullptr;
+		size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &mBuffer[pos & kMask];
+			size_t seq = cell->mSequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0)
+			{
+				if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // full
+			}
+			else
+			{
+				pos = mEnqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->mData = std::forward<U>(data);
+		cell->mSequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool TryPop(T& data)
+	{
+		Cell* cell = nullptr;
+		size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			cell = &mBuffer[pos & kMask];
+			size_t seq = cell->mSequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0)
+			{
+				if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false; // empty
+			}
+			else
+			{
+				pos = mDequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		data = std::move(cell->mData);
+		cell->mSequence.store(pos + Capacity, std::memory_order_release);
+		return true;
+	}
+
+	// approximate when other threads are pushing or popping
+	size_t size() const
+	{
+		size_t enqueuePos = mEnqueuePos.load(std::memory_order_relaxed);
+		size_t dequeuePos = mDequeuePos.load(std::memory_order_relaxed);
+		return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+	}
+
+	bool empty() const { return size() == 0; }
+
+	static constexpr size_t capacity() { return Capacity; }
+private:
+	std::unique_ptr<Cell[]> mBuffer;
+	alignas(64) std::atomic<size_t> mEnqueuePos;
+	alignas(64) std::atomic<size_t> mDequeuePos;
+};
@@ -0,0 +1,294 @@
+#include "OffsetAllocator.h"
+#include "DebugUtils.h"
+
+#include <algorithm>
+#include <intrin.h>
+
+using namespace Utility;
+
+namespace
+{
+	constexpr uint32_t kMantissaBits = 3;
+	constexpr uint32_t kMantissaValue = 1 << kMantissaBits;
+	constexpr uint32_t kMantissaMask = kMantissaValue - 1;
+
+	uint32_t FindHighestSetBit(uint32_t bits)
+	{
+		unsigned long index;
+		_BitScanReverse(&index, bits);
+		return (uint32_t)index;
+	}
+
+	// lowest set bit at or above startBit, 32 when there is none
+	uint32_t FindLowestSetBitAfter(uint32_t bits, uint32_t startBit)
+	{
+		if (startBit >= 32)
+			return 32;
+		unsigned long index;
+		return _BitScanForward(&index, bits & (~0u << startBit)) ? (uint32_t)index : 32;
+	}
+}
+
+uint32_t OffsetAllocator::GetBinRoundDown(uint32_t size)
+{
+	// sizes below the mantissa range get a class each, above it the class spacing grows with the exponent
+	if (size < kMantissaValue)
+		return size;
+
+	uint32_t mantissaStartBit = FindHighestSetBit(size) - kMantissaBits;
+	uint32_t exponent = mantissaStartBit + 1;
+	uint32_t mantissa = (size >> mantissaStartBit) & kMantissaMask;
+	return (exponent << kMantissaBits) | mantissa;
+}
+
+uint32_t OffsetAllocator::GetBinRoundUp(uint32_t size)
+{
+	if (size < kMantissaValue)
+		return size;
+
+	uint32_t mantissaStartBit = FindHighestSetBit(size) - kMantissaBits;
+	uint32_t exponent = mantissaStartBit + 1;
+	uint32_t mantissa = (size >> mantissaStartBit) & kMantissaMask;
+	// a carry out of the mantissa moves on to the next exponent, which is still the next class
+	if ((size & ((1u << mantissaStartBit) - 1)) != 0)
+		mantissa++;
+	return (exponent << kMantissaBits) + mantissa;
+}
+
+uint32_t OffsetAllocator::GetBinSize(uint32_t bin)
+{
+	uint32_t exponent = bin >> kMantissaBits;
+	uint32_t mantissa = bin & kMantissaMask;
+	return exponent == 0 ? mantissa : (mantissa | kMantissaValue) << (exponent - 1);
+}
+
+void OffsetAllocator::Reset(uint32_t size, uint32_t maxAllocations)
+{
+	mSize = size;
+	mFreeSize = 0;
+	mNumAllocations = 0;
+	mMaxAllocations = maxAllocations;
+
+	// every live range can have a free one below it, plus the one at the top
+	mNodes.resize(maxAllocations * 2 + 1);
+	mFreeNodes.resize(mNodes.size());
+	for (uint32_t i = 0; i < (uint32_t)mFreeNodes.size(); i++)
+		mFreeNodes[i] = (uint32_t)mFreeNodes.size() - 1 - i;
+
+	std::fill(std::begin(mBinHeads), std::end(mBinHeads), kInvalidNode);
+	std::fill(std::begin(mUsedBins), std::end(mUsedBins), (uint8_t)0);
+	mUsedTopBins = 0;
+	mLastNode = kInvalidNode;
+
+	if (size > 0)
+		mLastNode = InsertFreeNode(0, size);
+}
+
+OffsetAllocator::Allocation OffsetAllocator::Allocate(uint32_t size)
+{
+	ASSERT(size > 0);
+	if (mNumAllocations == mMaxAllocations || size > mFreeSize)
+		return {};
+
+	// the first class at or above the rounded up one, every member of it fits
+	uint32_t minBin = GetBinRoundUp(size);
+	if (minBin >= kNumBins)
+		return {};
+
+	uint32_t topBin = minBin / kBinsPerTop;
+	uint32_t leafBin = FindLowestSetBitAfter(mUsedBins[topBin], minBin % kBinsPerTop);
+	if (leafBin >= kBinsPerTop)
+	{
+		topBin = FindLowestSetBitAfter(mUsedTopBins, topBin + 1);
+		if (topBin >= kNumTopBins)
+			return {};
+		leafBin = FindLowestSetBitAfter(mUsedBins[topBin], 0);
+	}
+
+	uint32_t nodeIndex = mBinHeads[topBin * kBinsPerTop + leafBin];
+	RemoveFreeNode(nodeIndex);
+
+	Node& node = mNodes[nodeIndex];
+	uint32_t remainder = node.size - size;
+	node.size = size;
+	node.isUsed = true;
+	mNumAllocations++;
+
+	if (remainder > 0)
+	{
+		// the rest goes back as a free range right above
+		uint32_t nextIndex = InsertFreeNode(node.offset + size, remainder);
+		Node& next = mNodes[nextIndex];
+		next.neighborPrev = nodeIndex;
+		next.neighborNext = mNodes[nodeIndex].neighborNext;
+		if (next.neighborNext != kInvalidNode)
+			mNodes[next.neighborNext].neighborPrev = nextIndex;
+		mNodes[nodeIndex].neighborNext = nextIndex;
+		if (mLastNode == nodeIndex)
+			mLastNode = nextIndex;
+	}
+
+	return { mNodes[nodeIndex].offset, nodeIndex };
+}
+
+void OffsetAllocator::Free(const Allocation& allocation)
+{
+	ASSERT(allocation.IsValid() && mNodes[allocation.node].isUsed && mNodes[allocation.node].offset == allocation.offset);
+
+	uint32_t nodeIndex = allocation.node;
+	uint32_t offset = mNodes[nodeIndex].offset;
+	uint32_t size = mNodes[nodeIndex].size;
+	uint32_t neighborPrev = mNodes[nodeIndex].neighborPrev;
+	uint32_t neighborNext = mNodes[nodeIndex].neighborNext;
+	bool wasLast = mLastNode == nodeIndex;
+	mNumAllocations--;
+
+	// free neighbours are folded in, their nodes go back to the pool
+	if (neighborPrev != kInvalidNode && !mNodes[neighborPrev].isUsed)
+	{
+		uint32_t prevIndex = neighborPrev;
+		offset = mNodes[prevIndex].offset;
+		size += mNodes[prevIndex].size;
+		neighborPrev = mNodes[prevIndex].neighborPrev;
+		RemoveFreeNode(prevIndex);
+		mFreeNodes.push_back(prevIndex);
+	}
+
+	if (neighborNext != kInvalidNode && !mNodes[neighborNext].isUsed)
+	{
+		uint32_t nextIndex = neighborNext;
+		size += mNodes[nextIndex].size;
+		wasLast = wasLast || mLastNode == nextIndex;
+		neighborNext = mNodes[nextIndex].neighborNext;
+		RemoveFreeNode(nextIndex);
+		mFreeNodes.push_back(nextIndex);
+	}
+
+	mNodes[nodeIndex].isUsed = false;
+	mFreeNodes.push_back(nodeIndex);
+
+	uint32_t mergedIndex = InsertFreeNode(offset, size);
+	Node& merged = mNodes[mergedIndex];
+	merged.neighborPrev = neighborPrev;
+	merged.neighborNext = neighborNext;
+	if (neighborPrev != kInvalidNode)
+		mNodes[neighborPrev].neighborNext = mergedIndex;
+	if (neighborNext != kInvalidNode)
+		mNodes[neighborNext].neighborPrev = mergedIndex;
+	if (wasLast)
+		mLastNode = mergedIndex;
+}
+
+void OffsetAllocator::Grow(uint32_t newSize)
+{
+	ASSERT(newSize >= mSize);
+	if (newSize == mSize)
+		return;
+
+	// a free range at the top takes the new space, otherwise it is a free range of its own above it
+	uint32_t offset = mSize;
+	uint32_t size = newSize - mSize;
+	uint32_t neighborPrev = mLastNode;
+	if (mLastNode != kInvalidNode && !mNodes[mLastNode].isUsed)
+	{
+		offset = mNodes[mLastNode].offset;
+		size += mNodes[mLastNode].size;
+		neighborPrev = mNodes[mLastNode].neighborPrev;
+		RemoveFreeNode(mLastNode);
+		mFreeNodes.push_back(mLastNode);
+	}
+
+	uint32_t nodeIndex = InsertFreeNode(offset, size);
+	mNodes[nodeIndex].neighborPrev = neighborPrev;
+	if (neighborPrev != kInvalidNode)
+		mNodes[neighborPrev].neighborNext = nodeIndex;
+	mLastNode = nodeIndex;
+	mSize = newSize;
+}
+
+OffsetAllocator::Allocation OffsetAllocator::GetLastAllocation() const
+{
+	return mLastNode == kInvalidNode ? Allocation() : FindUsedFrom(mLastNode);
+}
+
+OffsetAllocator::Allocation OffsetAllocator::GetPrevAllocation(const Allocation& allocation) const
+{
+	ASSERT(allocation.IsValid() && mNodes[allocation.node].isUsed);
+	uint32_t prev = mNodes[allocation.node].neighborPrev;
+	return prev == kInvalidNode ? Allocation() : FindUsedFrom(prev);
+}
+
+OffsetAllocator::Report OffsetAllocator::GetReport() const
+{
+	Report report = { mFreeSize, 0, 0, mNumAllocations };
+	for (uint32_t bin = 0; bin < kNumBins; bin++)
+	{
+		for (uint32_t node = mBinHeads[bin]; node != kInvalidNode; node = mNodes[node].binNext)
+		{
+			report.largestFreeSize = std::max(report.largestFreeSize, mNodes[node].size);
+			report.numFreeRanges++;
+		}
+	}
+	return report;
+}
+
+uint32_t OffsetAllocator::InsertFreeNode(uint32_t offset, uint32_t size)
+{
+	ASSERT(!mFreeNodes.empty());
+	uint32_t nodeIndex = mFreeNodes.back();
+	mFreeNodes.pop_back();
+
+	uint32_t bin = GetBinRoundDown(size);
+	Node& node = mNodes[nodeIndex];
+	node.offset = offset;
+	node.size = size;
+	node.binPrev = kInvalidNode;
+	node.binNext = mBinHeads[bin];
+	node.neighborPrev = kInvalidNode;
+	node.neighborNext = kInvalidNode;
+	node.isUsed = false;
+
+	if (node.binNext != kInvalidNode)
+		mNodes[node.binNext].binPrev = nodeIndex;
+	mBinHeads[bin] = nodeIndex;
+	mUsedBins[bin / kBinsPerTop] |= (uint8_t)(1u << (bin % kBinsPerTop));
+	mUsedTopBins |= 1u << (bin / kBinsPerTop);
+
+	mFreeSize += size;
+	return nodeIndex;
+}
+
+void OffsetAllocator::RemoveFreeNode(uint32_t nodeIndex)
+{
+	Node& node = mNodes[nodeIndex];
+	ASSERT(!node.isUsed);
+
+	if (node.binPrev != kInvalidNode)
+	{
+		mNodes[node.binPrev].binNext = node.binNext;
+	}
+	else
+	{
+		// the head of its class, the class may run empty
+		uint32_t bin = GetBinRoundDown(node.size);
+		mBinHeads[bin] = node.binNext;
+		if (node.binNext == kInvalidNode)
+		{
+			mUsedBins[bin / kBinsPerTop] &= (uint8_t)~(1u << (bin % kBinsPerTop));
+			if (mUsedBins[bin / kBinsPerTop] == 0)
+				mUsedTopBins &= ~(1u << (bin / kBinsPerTop));
+		}
+	}
+	if (node.binNext != kInvalidNode)
+		mNodes[node.binNext].binPrev = node.binPrev;
+
+	mFreeSize -= node.size;
+}
+
+OffsetAllocator::Allocation OffsetAllocator::FindUsedFrom(uint32_t node) const
+{
+	// free ranges never touch, so at most one has to be skipped
+	if (!mNodes[node].isUsed)
+		node = mNodes[node].neighborPrev;
+	return node == kInvalidNode ? Allocation() : Allocation{ mNodes[node].offset, node };
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+namespace Utility
+{
+	// Two level segregated fit allocator of offset ranges in [0, size), with no knowledge of what the
+	// offsets address. Free ranges are kept in 256 size classes, each a 3 bit mantissa and 5 bit exponent
+	// float, with one bit per class so Allocate and Free are a couple of bit scans and list links. A
+	// range is taken from a class whose smallest member fits, freed ranges merge with free neighbours at
+	// once. Not thread safe.
+	class OffsetAllocator
+	{
+	public:
+		static constexpr uint32_t kInvalidOffset = (uint32_t)-1;
+		static constexpr uint32_t kInvalidNode = (uint32_t)-1;
+		static constexpr uint32_t kNumTopBins = 32;
+		static constexpr uint32_t kBinsPerTop = 8;
+		static constexpr uint32_t kNumBins = kNumTopBins * kBinsPerTop;
+
+		struct Allocation
+		{
+			uint32_t offset = kInvalidOffset;
+			uint32_t node = kInvalidNode; // identifies the range for Free, below GetMaxNodes
+
+			bool IsValid() const { return offset != kInvalidOffset; }
+		};
+
+		struct Report
+		{
+			uint32_t freeSize;
+			uint32_t largestFreeSize;
+			uint32_t numFreeRanges;
+			uint32_t numAllocations;
+		};
+
+		OffsetAllocator() { Reset(0, 0); }
+		OffsetAllocator(uint32_t size, uint32_t maxAllocations) { Reset(size, maxAllocations); }
+
+		// frees everything, at most maxAllocations ranges can be live at once
+		void Reset(uint32_t size, uint32_t maxAllocations);
+
+		// invalid when no free range fits or maxAllocations are live
+		Allocation Allocate(uint32_t size);
+		void Free(const Allocation& allocation);
+		// extends [0, size) to [0, newSize), live ranges keep their offsets and nodes
+		void Grow(uint32_t newSize);
+
+		uint32_t GetAllocationSize(const Allocation& allocation) const { return mNodes[allocation.node].size; }
+
+		// The live range placed highest, and the live one below a given one, invalid at the bottom.
+		// Walking down from the top finds what a compaction should move first.
+		Allocation GetLastAllocation() const;
+		Allocation GetPrevAllocation(const Allocation& allocation) const;
+
+		Report GetReport() const;
+		uint32_t GetSize() const { return mSize; }
+		uint32_t GetFreeSize() const { return mFreeSize; }
+		uint32_t GetMaxNodes() const { return (uint32_t)mNodes.size(); }
+
+		// size class a free range of size is filed under, and the first one whose members all fit size
+		static uint32_t GetBinRoundDown(uint32_t size);
+		static uint32_t GetBinRoundUp(uint32_t size);
+		static uint32_t GetBinSize(uint32_t bin);
+	private:
+		struct Node
+		{
+			uint32_t offset;
+			uint32_t size;
+			uint32_t binPrev; // links within a size class, free ranges only
+			uint32_t binNext;
+			uint32_t neighborPrev; // ranges below and above, free or not
+			uint32_t neighborNext;
+			bool isUsed;
+		};
+
+		uint32_t InsertFreeNode(uint32_t offset, uint32_t size);
+		void RemoveFreeNode(uint32_t node);
+		Allocation FindUsedFrom(uint32_t node) const;
+	private:
+		std::vector<Node> mNodes;
+		std::vector<uint32_t> mFreeNodes; // unused node indices, taken from the back
+		uint32_t mBinHeads[kNumBins];
+		uint32_t mUsedTopBins;            // bit per top bin with a non empty class
+		uint8_t mUsedBins[kNumTopBins];   // bit per class of each top bin
+		uint32_t mLastNode;               // the range ending at mSize
+		uint32_t mSize;
+		uint32_t mFreeSize;
+		uint32_t mNumAllocations;
+		uint32_t mMaxAllocations;
+	};
+}
@@ -0,0 +1,173 @@
+#include "RadixSort.h"
+#include "ThreadPoolExecutor.h"
+#include "FrameArena.h"
+#include "DebugUtils.h"
+
+#include <algorithm>
+
+namespace
+{
+	constexpr uint32_t kRadixBits = 8;
+	constexpr uint32_t kRadixSize = 1 << kRadixBits;
+	constexpr uint32_t kNumDigits = 64 / kRadixBits;
+	constexpr size_t kMinParallelChunk = 16 * 1024;
+
+	inline uint32_t GetDigit(uint64_t key, uint32_t digit)
+	{
+		return (uint32_t)(key >> (digit * kRadixBits)) & (kRadixSize - 1);
+	}
+
+	// every digit is counted in one read, a digit whose keys all land in one bucket needs no pass
+	void CountDigits(const uint64_t* keys, size_t count, uint32_t histograms[kNumDigits][kRadixSize])
+	{
+		memset(histograms, 0, sizeof(uint32_t) * kNumDigits * kRadixSize);
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t key = keys[i];
+			for (uint32_t d = 0; d < kNumDigits; d++)
+				histograms[d][GetDigit(key, d)]++;
+		}
+	}
+
+	bool IsDigitConstant(const uint32_t histogram[kRadixSize], const uint64_t* keys, size_t count, uint32_t digit)
+	{
+		return histogram[GetDigit(keys[0], digit)] == count;
+	}
+}
+
+void Utility::RadixSort(uint64_t* keys, size_t count, uint64_t* scratch)
+{
+	if (count <= kRadixSortSmallThreshold)
+	{
+		std::sort(keys, keys + count);
+		return;
+	}
+
+	if (count >= kRadixSortParallelThreshold && gThreadPoolExecutor.GetThreadCount() > 0)
+	{
+		ParallelRadixSort(keys, count, scratch);
+		return;
+	}
+
+	ASSERT(count <= UINT32_MAX);
+
+	uint32_t histograms[kNumDigits][kRadixSize];
+	CountDigits(keys, count, histograms);
+
+	uint64_t* src = keys;
+	uint64_t* dst = scratch;
+	for (uint32_t d = 0; d < kNumDigits; d++)
+	{
+		if (IsDigitConstant(histograms[d], src, count, d))
+			continue;
+
+		uint32_t offsets[kRadixSize];
+		uint32_t sum = 0;
+		for (uint32_t b = 0; b < kRadixSize; b++)
+		{
+			offsets[b] = sum;
+			sum += histograms[d][b];
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			uint64_t key = src[i];
+			dst[offsets[GetDigit(key, d)]++] = key;
+		}
+		std::swap(src, dst);
+	}
+
+	if (src != keys)
+		memcpy(keys, src, count * sizeof(uint64_t));
+}
+
+void Utility::ParallelRadixSort(uint64_t* keys, size_t count, uint64_t* scratch)
+{
+	ZoneScoped;
+	if (count <= kRadixSortSmallThreshold)
+	{
+		std::sort(keys, keys + count);
+		return;
+	}
+
+	ASSERT(count <= UINT32_MAX);
+
+	size_t numChunks = std::min(gThreadPoolExecutor.GetThreadCount() + 1, (count + kMinParallelChunk - 1) / kMinParallelChunk);
+	numChunks = std::max<size_t>(numChunks, 1);
+	size_t chunkSize = (count + numChunks - 1) / numChunks;
+
+	// per chunk histograms of every digit, then summed for the skip test
+	FrameVector<uint32_t> chunkCounts(numChunks * kNumDigits * kRadixSize);
+	auto GetChunkHistogram = [&](size_t chunk, uint32_t digit) { return &chunkCounts[(chunk * kNumDigits + digit) * kRadixSize]; };
+
+	gThreadPoolExecutor.ParallelFor(0, numChunks, 1, [&](size_t chunk)
+	{
+		size_t begin = chunk * chunkSize;
+		size_t end = std::min(begin + chunkSize, count);
+		CountDigits(keys + begin, end - begin, (uint32_t(*)[kRadixSize])GetChunkHistogram(chunk, 0));
+	});
+
+	uint32_t histograms[kNumDigits][kRadixSize] = {};
+	for (size_t chunk = 0; chunk < numChunks; chunk++)
+	{
+		for (uint32_t d = 0; d < kNumDigits; d++)
+		{
+			const uint32_t* chunkHistogram = GetChunkHistogram(chunk, d);
+			for (uint32_t b = 0; b < kRadixSize; b++)
+				histograms[d][b] += chunkHistogram[b];
+		}
+	}
+
+	uint64_t* src = keys;
+	uint64_t* dst = scratch;
+	bool isFirstPass = true;
+	for (uint32_t d = 0; d < kNumDigits; d++)
+	{
+		if (IsDigitConstant(histograms[d], src, count, d))
+			continue;
+
+		// the counts taken up front still match the chunks until the first scatter reorders them
+		if (!isFirstPass)
+		{
+			gThreadPoolExecutor.ParallelFor(0, numChunks, 1, [&](size_t chunk)
+			{
+				size_t begin = chunk * chunkSize;
+				size_t end = std::min(begin + chunkSize, count);
+				uint32_t* chunkHistogram = GetChunkHistogram(chunk, d);
+				memset(chunkHistogram, 0, sizeof(uint32_t) * kRadixSize);
+				for (size_t i = begin; i < end; i++)
+					chunkHistogram[GetDigit(src[i], d)]++;
+			});
+		}
+		isFirstPass = false;
+
+		// chunk c writes bucket b after every earlier bucket and after chunks < c of bucket b, which keeps it stable
+		uint32_t sum = 0;
+		for (uint32_t b = 0; b < kRadixSize; b++)
+		{
+			for (size_t chunk = 0; chunk < numChunks; chunk++)
+			{
+				uint32_t* chunkHistogram = GetChunkHistogram(chunk, d);
+				uint32_t bucketCount = chunkHistogram[b];
+				chunkHistogram[b] = sum;
+				sum += bucketCount;
+			}
+		}
+
+		gThreadPoolExecutor.ParallelFor(0, numChunks, 1, [&](size_t chunk)
+		{
+			size_t begin = chunk * chunkSize;
+			size_t end = std::min(begin + chunkSize, count);
+			uint32_t* offsets = GetChunkHistogram(chunk, d);
+			for (size_t i = begin; i < end; i++)
+			{
+				uint64_t key = src[i];
+				dst[offsets[GetDigit(key, d)]++] = key;
+			}
+		});
+		std::swap(src, dst);
+	}
+
+	if (src != keys)
+		memcpy(keys, src, count * sizeof(uint64_t));
+}
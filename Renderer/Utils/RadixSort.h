@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace Utility
+{
+	constexpr size_t kRadixSortSmallThreshold = 1024;
+	constexpr size_t kRadixSortParallelThreshold = 64 * 1024;
+
+	// LSD radix sort on 8 bit digits. A digit that is the same in every key is skipped, so packed keys
+	// with constant or narrow fields only pay for the bits that vary. scratch must hold count keys, it
+	// is not touched when count <= kRadixSortSmallThreshold. Short lists use std::sort, below about a
+	// thousand draw keys the histogram passes cost more than they save (RadixSort_DrawKeys benchmark),
+	// long ones split every digit pass across gThreadPoolExecutor.
+	void RadixSort(uint64_t* keys, size_t count, uint64_t* scratch);
+	void ParallelRadixSort(uint64_t* keys, size_t count, uint64_t* scratch);
+}
@@ -0,0 +1,87 @@
+#include "StagingScheduler.h"
+#include "DebugUtils.h"
+
+using namespace Utility;
+
+void StagingScheduler::Reset(uint32_t ringSize)
+{
+	mRing.Reset(ringSize);
+	mQueued.clear();
+	mBatches.clear();
+	mQueuedBytes = 0;
+	mNextToken = 1;
+	mPackedToken = 0;
+	mSubmittedToken = 0;
+	mCompletedToken = 0;
+}
+
+uint64_t StagingScheduler::Enqueue(uint64_t size, uint32_t alignment)
+{
+	ASSERT(size > 0);
+	mQueued.push_back({ size, alignment });
+	mQueuedBytes += size;
+	return mNextToken++;
+}
+
+uint32_t StagingScheduler::PackBatch(uint64_t budget, std::vector<uint32_t>& offsets)
+{
+	uint32_t numPacked = 0;
+	uint64_t packedBytes = 0;
+	while (!mQueued.empty())
+	{
+		const QueuedUpload& upload = mQueued.front();
+		if (numPacked > 0 && packedBytes + upload.size > budget)
+			break;
+
+		uint32_t offset = kNoRingSpace;
+		if (upload.size <= mRing.GetSize())
+		{
+			offset = mRing.Allocate((uint32_t)upload.size, upload.alignment);
+			if (offset == FenceRingAllocator::kInvalidOffset)
+				break;
+		}
+
+		offsets.push_back(offset);
+		packedBytes += upload.size;
+		mQueuedBytes -= upload.size;
+		mQueued.pop_front();
+		mPackedToken++;
+		numPacked++;
+	}
+	return numPacked;
+}
+
+void StagingScheduler::CloseBatch(uint64_t fenceValue)
+{
+	ASSERT(mPackedToken > mSubmittedToken);
+	ASSERT(mBatches.empty() || mBatches.back().fenceValue <= fenceValue);
+
+	mRing.FinishFrame(fenceValue);
+	mBatches.push_back({ mPackedToken, fenceValue });
+	mSubmittedToken = mPackedToken;
+}
+
+uint32_t StagingScheduler::Retire(uint64_t completedFenceValue)
+{
+	mRing.Retire(completedFenceValue);
+
+	uint32_t numRetired = 0;
+	while (!mBatches.empty() && mBatches.front().fenceValue <= completedFenceValue)
+	{
+		mCompletedToken = mBatches.front().lastToken;
+		mBatches.pop_front();
+		numRetired++;
+	}
+	return numRetired;
+}
+
+uint64_t StagingScheduler::GetBatchFence(uint64_t token) const
+{
+	ASSERT(IsSubmitted(token));
+	for (const Batch& batch : mBatches)
+	{
+		if (token <= batch.lastToken)
+			return batch.fenceValue;
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "FenceRingAllocator.h"
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace Utility
+{
+	// Orders queued uploads into batches over a FenceRingAllocator of staging bytes. Uploads are packed
+	// first in first out under a byte budget per batch, a batch is closed with the fence it was submitted
+	// with and its uploads complete once Retire sees that fence. Tokens count up from 1 in queue order,
+	// so an upload is complete when every upload before it is. Only sizes and fence values are kept,
+	// the caller owns the data and the queue. Not thread safe.
+	class StagingScheduler
+	{
+	public:
+		static constexpr uint32_t kNoRingSpace = FenceRingAllocator::kInvalidOffset;
+
+		explicit StagingScheduler(uint32_t ringSize = 0) { Reset(ringSize); }
+
+		// drops every upload and batch, only safe once the GPU is done with all of them
+		void Reset(uint32_t ringSize);
+
+		uint64_t Enqueue(uint64_t size, uint32_t alignment);
+
+		// Packs queued uploads in order until budget bytes are packed and appends one ring offset per
+		// packed upload to offsets. The first upload always goes, so one over the budget still moves.
+		// An upload larger than the ring gets kNoRingSpace and must bring memory of its own. Packing
+		// stops at the first upload the ring can't hold before an older batch retires.
+		uint32_t PackBatch(uint64_t budget, std::vector<uint32_t>& offsets);
+
+		// the uploads packed since the last call were submitted with fenceValue, which must not go backwards
+		void CloseBatch(uint64_t fenceValue);
+
+		// completes the batches whose fence is at most completedFenceValue, returns how many
+		uint32_t Retire(uint64_t completedFenceValue);
+
+		bool IsSubmitted(uint64_t token) const { return token <= mSubmittedToken; }
+		bool IsComplete(uint64_t token) const { return token <= mCompletedToken; }
+		// fence of the batch token was submitted in, 0 once it completed
+		uint64_t GetBatchFence(uint64_t token) const;
+		// fence to wait for when the ring is full, 0 when no batch holds ring space
+		uint64_t GetOldestFence() const { return mRing.GetOldestFence(); }
+
+		uint64_t GetLastToken() const { return mNextToken - 1; }
+		uint64_t GetCompletedToken() const { return mCompletedToken; }
+		size_t GetNumQueued() const { return mQueued.size(); }
+		uint64_t GetQueuedBytes() const { return mQueuedBytes; }
+		const FenceRingAllocator& GetRing() const { return mRing; }
+	private:
+		struct QueuedUpload
+		{
+			uint64_t size;
+			uint32_t alignment;
+		};
+
+		struct Batch
+		{
+			uint64_t lastToken;
+			uint64_t fenceValue;
+		};
+
+		FenceRingAllocator mRing;
+		std::deque<QueuedUpload> mQueued;
+		std::deque<Batch> mBatches; // submitted, oldest first
+		uint64_t mQueuedBytes;
+		uint64_t mNextToken;
+		uint64_t mPackedToken;
+		uint64_t mSubmittedToken;
+		uint64_t mCompletedToken;
+	};
+}
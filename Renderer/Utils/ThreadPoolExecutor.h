@@ -2,16 +2,138 @@
 #include <future>
 #include <thread>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <deque>
+#include <cstddef>
 
-#include "LinkedBlockQueue.h"
+#include "WorkStealingQueue.h"
+#include "MPMCRingQueue.h"
 #include "DebugUtils.h"
 
+// Small buffer optimized callable, avoids the heap for captures up to kInlineSize bytes
+class JobFunction
+{
+	static constexpr size_t kInlineSize = 48;
+
+	struct VTable
+	{
+		void (*mInvoke)(void*);
+		void (*mDestroy)(void*);
+	};
+
+	template<typename Fn>
+	static inline const VTable sInlineVTable = {
+		[](void* object) { (*static_cast<Fn*>(object))(); },
+		[](void* object) { static_cast<Fn*>(object)->~Fn(); } };
+
+	template<typename Fn>
+	static inline const VTable sHeapVTable = {
+		[](void* object) { (*static_cast<Fn*>(object))(); },
+		[](void* object) { delete static_cast<Fn*>(object); } };
+public:
+	JobFunction() : mVTable(nullptr), mObject(nullptr) {}
+	~JobFunction() { Reset(); }
+
+	JobFunction(const JobFunction&) = delete;
+	JobFunction& operator=(const JobFunction&) = delete;
+
+	template<typename F>
+	void Set(F&& f)
+	{
+		using Fn = std::decay_t<F>;
+		ASSERT(mVTable == nullptr);
+		if constexpr (sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t))
+		{
+			mObject = new (mStorage) Fn(std::forward<F>(f));
+			mVTable = &sInlineVTable<Fn>;
+		}
+		else
+		{
+			mObject = new Fn(std::forward<F>(f));
+			mVTable = &sHeapVTable<Fn>;
+		}
+	}
+
+	void Reset()
+	{
+		if (mVTable)
+		{
+			mVTable->mDestroy(mObject);
+			mVTable = nullptr;
+			mObject = nullptr;
+		}
+	}
+
+	void operator()() { mVTable->mInvoke(mObject); }
+private:
+	alignas(std::max_align_t) uint8_t mStorage[kInlineSize];
+	const VTable* mVTable;
+	void* mObject;
+};
+
+
+// Counts outstanding jobs. A child counter keeps its parent busy until it drains,
+// so waiting on the parent also waits for every job dispatched against the children.
+class JobCounter
+{
+public:
+	JobCounter(JobCounter* parent = nullptr) : mCount(0), mParent(parent) {}
+	~JobCounter() { ASSERT(IsDone()); }
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	void Add(int32_t count = 1)
+	{
+		if (mCount.fetch_add(count, std::memory_order_acq_rel) == 0 && mParent)
+			mParent->Add();
+	}
+
+	void Done()
+	{
+		// the waiter may destroy the counter as soon as it reaches zero
+		JobCounter* parent = mParent;
+		if (mCount.fetch_sub(1, std::memory_order_acq_rel) == 1 && parent)
+			parent->Done();
+	}
+
+	bool IsDone() const { return mCount.load(std::memory_order_acquire) == 0; }
+private:
+	std::atomic<int32_t> mCount;
+	JobCounter* mParent;
+};
+
+
+struct alignas(64) Job
+{
+	JobFunction mFunction;
+	JobCounter* mCounter;
+};
+
+
 class ThreadPoolExecutor
 {
-	using task_type = std::function<void()>;
+	static constexpr size_t kMaxCachedJobs = 256;
+	static constexpr uint32_t kIdleSpinCount = 64;
+
+	struct WorkerContext
+	{
+		ThreadPoolExecutor* mOwner = nullptr;
+		size_t mIndex = 0;
+	};
+
+	struct JobCache
+	{
+		std::vector<Job*> mFreeJobs;
+		~JobCache() { for (Job* job : mFreeJobs) delete job; }
+	};
 public:
-	ThreadPoolExecutor(size_t thread_cout): 
-		mIsRunning(true)
+	ThreadPoolExecutor(size_t thread_cout):
+		mIsRunning(true), mQueuedJobs(0), mNumOverflowJobs(0), mSleepingThreads(0)
 	{
 		Init(thread_cout);
 	}
@@ -22,40 +144,268 @@ public:
 	decltype(auto) Submit(F&& f, Args&& ...args)
 	{
 		using RetType = std::invoke_result_t<F, Args...>;
-		std::shared_ptr<std::packaged_task<RetType()>> task = std::make_shared<std::packaged_task<RetType()>>(
+		std::packaged_task<RetType()> task(
 			std::bind<RetType, F, Args...>(std::forward<F>(f), std::forward<Args>(args)...));
-		auto future = task->get_future();
-		mTaskList.Put([=]() { task->operator()(); });
+		auto future = task.get_future();
+		Push(AllocJob(std::move(task), nullptr));
 		return future;
 	}
 
-	void Shutdown() 
-	{ 
-		for (auto& t : mThreads)
+	// fire a job tracked by counter, use Wait(counter) instead of a future
+	template<typename F>
+	void Dispatch(JobCounter& counter, F&& f)
+	{
+		counter.Add();
+		Push(AllocJob(std::forward<F>(f), &counter));
+	}
+
+	// runs pending jobs on the calling thread until counter drains
+	void Wait(JobCounter& counter)
+	{
+		while (!counter.IsDone())
 		{
-			for (size_t i = 0; i < mThreads.size(); i++)
-				Submit([=]() {mIsRunning = false; });
+			if (!RunOne())
+				std::this_thread::yield();
+		}
+	}
+
+	// func(i) for i in [begin, end), split into grainSize chunks (0 picks a size from the thread count)
+	template<typename F>
+	void ParallelFor(size_t begin, size_t end, size_t grainSize, F&& func)
+	{
+		if (begin >= end)
+			return;
+
+		size_t count = end - begin;
+		if (grainSize == 0)
+			grainSize = std::max<size_t>(1, count / ((mQueues.size() + 1) * 4));
 
+		JobCounter counter;
+		size_t first = begin;
+		for (; first + grainSize < end; first += grainSize)
+		{
+			size_t last = first + grainSize;
+			Dispatch(counter, [&func, first, last]()
+			{
+				for (size_t i = first; i < last; i++)
+					func(i);
+			});
+		}
+
+		for (size_t i = first; i < end; i++)
+			func(i);
+
+		Wait(counter);
+	}
+
+	size_t GetThreadCount() const { return mQueues.size(); }
+
+	void Shutdown()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mSleepLock);
+			mIsRunning.store(false, std::memory_order_release);
+		}
+		mSleepCV.notify_all();
+
+		for (auto& t : mThreads)
+		{
 			if (t.joinable())
 				t.join();
 		}
+		mThreads.clear();
 	}
 private:
 	void Init(size_t thread_cout)
 	{
+		mQueues.reserve(thread_cout);
+		for (size_t i = 0; i < thread_cout; i++)
+			mQueues.emplace_back(std::make_unique<WorkStealingQueue<Job>>());
+
 		for (size_t i = 0; i < thread_cout; i++)
+			mThreads.emplace_back(&ThreadPoolExecutor::WorkerLoop, this, i);
+	}
+
+	void WorkerLoop(size_t index)
+	{
+		WorkerContext& context = GetWorkerContext();
+		context.mOwner = this;
+		context.mIndex = index;
+
+		uint32_t idleSpins = 0;
+		while (true)
 		{
-			mThreads.emplace_back([this]()
+			if (RunOne())
 			{
-				while (mIsRunning)
-					mTaskList.Get()();
-			});
+				idleSpins = 0;
+				continue;
+			}
+
+			if (!mIsRunning.load(std::memory_order_acquire))
+				break;
+
+			if (++idleSpins < kIdleSpinCount)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(mSleepLock);
+			mSleepingThreads.fetch_add(1);
+			mSleepCV.wait(lock, [this]() { return mQueuedJobs.load() > 0 || !mIsRunning.load(); });
+			mSleepingThreads.fetch_sub(1);
+			idleSpins = 0;
+		}
+
+		context.mOwner = nullptr;
+	}
+
+	void Push(Job* job)
+	{
+		mQueuedJobs.fetch_add(1);
+
+		WorkerContext& context = GetWorkerContext();
+		if (context.mOwner == this)
+		{
+			if (!mQueues[context.mIndex]->Push(job))
+			{
+				// local deque is full, don't block the producer
+				mQueuedJobs.fetch_sub(1);
+				Execute(job);
+				return;
+			}
+		}
+		else if (mNumOverflowJobs.load(std::memory_order_acquire) > 0 || !mGlobalJobs.TryPush(job))
+		{
+			// the ring is full only when workers are saturated, park the job instead of spinning the
+			// producer. Later pushes follow it while the overflow is non empty so order is kept.
+			std::lock_guard<std::mutex> lock(mOverflowLock);
+			mOverflowJobs.push_back(job);
+			mNumOverflowJobs.fetch_add(1, std::memory_order_release);
+		}
+
+		if (mSleepingThreads.load() > 0)
+		{
+			std::lock_guard<std::mutex> lock(mSleepLock);
+			mSleepCV.notify_one();
 		}
 	}
+
+	Job* TakeJob()
+	{
+		WorkerContext& context = GetWorkerContext();
+		bool isWorker = context.mOwner == this;
+		Job* job = nullptr;
+
+		if (isWorker)
+			job = mQueues[context.mIndex]->Pop();
+
+		if (!job && !mGlobalJobs.TryPop(job) && mNumOverflowJobs.load(std::memory_order_acquire) > 0)
+		{
+			std::lock_guard<std::mutex> lock(mOverflowLock);
+			if (!mOverflowJobs.empty())
+			{
+				job = mOverflowJobs.front();
+				mOverflowJobs.pop_front();
+				mNumOverflowJobs.fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		if (!job)
+		{
+			size_t numQueues = mQueues.size();
+			size_t start = isWorker ? context.mIndex + 1 : 0;
+			for (size_t i = 0; i < numQueues && !job; i++)
+			{
+				size_t victim = (start + i) % numQueues;
+				if (isWorker && victim == context.mIndex)
+					continue;
+				job = mQueues[victim]->Steal();
+			}
+		}
+
+		if (job)
+			mQueuedJobs.fetch_sub(1);
+		return job;
+	}
+
+	bool RunOne()
+	{
+		Job* job = TakeJob();
+		if (!job)
+			return false;
+
+		Execute(job);
+		return true;
+	}
+
+	void Execute(Job* job)
+	{
+		JobCounter* counter = job->mCounter;
+		job->mFunction();
+		FreeJob(job);
+		if (counter)
+			counter->Done();
+	}
+
+	template<typename F>
+	Job* AllocJob(F&& f, JobCounter* counter)
+	{
+		std::vector<Job*>& freeJobs = GetJobCache().mFreeJobs;
+		Job* job = nullptr;
+		if (freeJobs.empty())
+		{
+			job = new Job();
+		}
+		else
+		{
+			job = freeJobs.back();
+			freeJobs.pop_back();
+		}
+
+		job->mFunction.Set(std::forward<F>(f));
+		job->mCounter = counter;
+		return job;
+	}
+
+	void FreeJob(Job* job)
+	{
+		job->mFunction.Reset();
+		job->mCounter = nullptr;
+
+		std::vector<Job*>& freeJobs = GetJobCache().mFreeJobs;
+		if (freeJobs.size() < kMaxCachedJobs)
+			freeJobs.push_back(job);
+		else
+			delete job;
+	}
+
+	static WorkerContext& GetWorkerContext()
+	{
+		static thread_local WorkerContext sWorkerContext;
+		return sWorkerContext;
+	}
+
+	static JobCache& GetJobCache()
+	{
+		static thread_local JobCache sJobCache;
+		return sJobCache;
+	}
 private:
-	bool mIsRunning;
-	LinkedBlockQueue<task_type> mTaskList;
+	std::atomic_bool mIsRunning;
+	std::atomic<int64_t> mQueuedJobs;
+	std::vector<std::unique_ptr<WorkStealingQueue<Job>>> mQueues;
 	std::vector<std::thread> mThreads;
+
+	// jobs pushed from threads outside the pool, and the ones that did not fit in the ring
+	MPMCRingQueue<Job*, 4096> mGlobalJobs;
+	std::mutex mOverflowLock;
+	std::deque<Job*> mOverflowJobs;
+	std::atomic<size_t> mNumOverflowJobs;
+
+	std::mutex mSleepLock;
+	std::condition_variable mSleepCV;
+	std::atomic<uint32_t> mSleepingThreads;
 };
 
 namespace Utility
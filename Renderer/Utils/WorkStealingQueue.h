@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Chase-Lev deque (Le et al. "Correct and Efficient Work-Stealing for Weak Memory Models").
+// The owner thread pushes and pops at the bottom, other threads steal from the top.
+// Capacity is fixed, Push returns false when full and the caller should run the item inline.
+template<typename T, size_t Capacity = 4096>
+class WorkStealingQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	static constexpr int64_t kMask = Capacity - 1;
+public:
+	WorkStealingQueue() : mTop(0), mBottom(0)
+	{
+		for (auto& item : mBuffer)
+			item.store(nullptr, std::memory_order_relaxed);
+	}
+	~WorkStealingQueue() {}
+
+	// owner thread only
+	bool Push(T* item)
+	{
+		int64_t b = mBottom.load(std::memory_order_relaxed);
+		int64_t t = mTop.load(std::memory_order_acquire);
+		if (b - t >= (int64_t)Capacity)
+			return false;
+
+		mBuffer[b & kMask].store(item, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		mBottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// owner thread only
+	T* Pop()
+	{
+		int64_t b = mBottom.load(std::memory_order_relaxed) - 1;
+		mBottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = mTop.load(std::memory_order_relaxed);
+
+		if (t > b)
+		{
+			mBottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		T* item = mBuffer[b & kMask].load(std::memory_order_relaxed);
+		if (t == b)
+		{
+			// last item, race against thieves
+			if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+				item = nullptr;
+			mBottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return item;
+	}
+
+	// any thread
+	T* Steal()
+	{
+		int64_t t = mTop.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = mBottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return nullptr;
+
+		T* item = mBuffer[t & kMask].load(std::memory_order_relaxed);
+		if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+		return item;
+	}
+
+	bool Empty() const
+	{
+		return mTop.load(std::memory_order_relaxed) >= mBottom.load(std::memory_order_relaxed);
+	}
+private:
+	alignas(64) std::atomic<int64_t> mTop;
+	alignas(64) std::atomic<int64_t> mBottom;
+	alignas(64) std::atomic<T*> mBuffer[Capacity];
+};
@@ -1,10 +1,5 @@
 #include "ForwardRS.hlsli"
-
-cbuffer MeshConstants : register(b0)
-{
-    float4x4 gWorldMatrix;
-    float3x3 gWorldITMatrix;
-}
+#include "MeshInstance.hlsli"
 
 cbuffer GlobalConstants : register(b1)
 {
@@ -28,10 +23,12 @@ struct VSOutput
 };
 
 [RootSignature(ForwardRendererRootSig)]
-VSOutput main(VSInput vsInput)
+VSOutput main(VSInput vsInput, uint instanceID : SV_InstanceID)
 {
+    MeshInstance instance = GetMeshInstance(instanceID);
+
     VSOutput vsOutput;
-    float4 worldPos = mul(gWorldMatrix, float4(vsInput.position, 1.0));
+    float4 worldPos = mul(instance.worldMatrix, float4(vsInput.position, 1.0));
     vsOutput.positionSV = mul(gViewProjMatrix, worldPos);
 #ifdef ENABLE_ALPHATEST
     vsOutput.uv0 = vsInput.uv0;
@@ -7,6 +7,9 @@
     "DescriptorTable(Sampler(s0, numDescriptors = 8), visibility = SHADER_VISIBILITY_PIXEL)," \
     "DescriptorTable(SRV(t10, numDescriptors = 8), visibility = SHADER_VISIBILITY_PIXEL)," \
     "DescriptorTable(SRV(t18, numDescriptors = 1), visibility = SHADER_VISIBILITY_PIXEL)," \
+    "SRV(t20, visibility = SHADER_VISIBILITY_VERTEX), " \
+    "SRV(t21, visibility = SHADER_VISIBILITY_VERTEX), " \
+    "RootConstants(b2, num32BitConstants = 1, visibility = SHADER_VISIBILITY_VERTEX), " \
     "StaticSampler(s10, maxAnisotropy = 8, visibility = SHADER_VISIBILITY_PIXEL)," \
     "StaticSampler(s11, visibility = SHADER_VISIBILITY_PIXEL," \
         "addressU = TEXTURE_ADDRESS_CLAMP," \
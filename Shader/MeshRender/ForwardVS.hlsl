@@ -1,12 +1,7 @@
 #include "ForwardRS.hlsli"
+#include "MeshInstance.hlsli"
 #include "ShadowUtility.hlsli"
 
-cbuffer MeshConstants : register(b0)
-{
-    float4x4 gWorldMatrix;
-    float3x3 gWorldITMatrix;
-}
-
 cbuffer GlobalConstants : register(b1)
 {
     float4x4 gViewProjMatrix;
@@ -44,13 +39,15 @@ struct VSOutput
 
 
 [RootSignature(ForwardRendererRootSig)]
-VSOutput main(VSInput vsInput)
+VSOutput main(VSInput vsInput, uint instanceID : SV_InstanceID)
 {
+    MeshInstance instance = GetMeshInstance(instanceID);
+
     VSOutput vsOutput;
-    vsOutput.positionWorld = mul(gWorldMatrix, float4(vsInput.position, 1.0)).xyz;
+    vsOutput.positionWorld = mul(instance.worldMatrix, float4(vsInput.position, 1.0)).xyz;
     vsOutput.positionSV = mul(gViewProjMatrix, float4(vsOutput.positionWorld, 1.0));
-    vsOutput.normalWorld = mul(gWorldITMatrix, vsInput.normal * 2.0 - 1.0);
-    vsOutput.tangetWorld = float4(mul(gWorldITMatrix, vsInput.tanget.xyz * 2.0 - 1.0), vsInput.tanget.w);
+    vsOutput.normalWorld = mul(instance.worldITMatrix, vsInput.normal * 2.0 - 1.0);
+    vsOutput.tangetWorld = float4(mul(instance.worldITMatrix, vsInput.tanget.xyz * 2.0 - 1.0), vsInput.tanget.w);
     vsOutput.uv0 = vsInput.uv0;
     
 #if NUM_CSM_SHADOW_MAP > 1
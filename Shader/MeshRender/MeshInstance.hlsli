@@ -0,0 +1,46 @@
+#ifndef __MESHINSTANCE_HLSLI__
+#define __MESHINSTANCE_HLSLI__
+
+// ModelTransform of ConstantBuffer.h, the rows of the 3x4 object to world matrix of every model
+struct ModelInstance
+{
+    float4 worldRows[3];
+};
+
+StructuredBuffer<ModelInstance> gModelInstances : register(t20);
+// model index of every draw recorded on the command list, in draw order
+StructuredBuffer<uint> gInstanceModelIndices : register(t21);
+
+cbuffer InstanceConstants : register(b2)
+{
+    uint gFirstInstance; // index of the first instance of the draw in gInstanceModelIndices
+}
+
+struct MeshInstance
+{
+    float4x4 worldMatrix;
+    float3x3 worldITMatrix;
+};
+
+// SV_InstanceID restarts from 0 for every draw whatever StartInstanceLocation is
+MeshInstance GetMeshInstance(uint instanceID)
+{
+    ModelInstance model = gModelInstances[gInstanceModelIndices[gFirstInstance + instanceID]];
+
+    MeshInstance instance;
+    instance.worldMatrix = float4x4(model.worldRows[0], model.worldRows[1], model.worldRows[2], float4(0.0, 0.0, 0.0, 1.0));
+
+    // The cofactor matrix is the inverse transpose times det, normals are normalized in the PS so
+    // only the sign of det is kept to leave mirrored models facing the right way
+    float3 axisX = float3(model.worldRows[0].x, model.worldRows[1].x, model.worldRows[2].x);
+    float3 axisY = float3(model.worldRows[0].y, model.worldRows[1].y, model.worldRows[2].y);
+    float3 axisZ = float3(model.worldRows[0].z, model.worldRows[1].z, model.worldRows[2].z);
+    float3 cofactorX = cross(axisY, axisZ);
+    float3 cofactorY = cross(axisZ, axisX);
+    float3 cofactorZ = cross(axisX, axisY);
+    float detSign = dot(axisX, cofactorX) < 0.0 ? -1.0 : 1.0;
+    instance.worldITMatrix = transpose(float3x3(cofactorX, cofactorY, cofactorZ)) * detSign;
+    return instance;
+}
+
+#endif // __MESHINSTANCE_HLSLI__
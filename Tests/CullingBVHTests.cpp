@@ -0,0 +1,82 @@
+#include "TestFramework.h"
+#include "CullingBVH.h"
+
+#include <cmath>
+
+namespace
+{
+    Math::BoundingSphere RandomSphere(Test::Random& random, float extent)
+    {
+        return Math::BoundingSphere(random.NextFloat(-extent, extent), random.NextFloat(-extent * 0.1f, extent * 0.1f),
+            random.NextFloat(-extent, extent), random.NextFloat(0.5f, 4.0f));
+    }
+}
+
+TEST_CASE(CullingBVH_RefitEntriesMatchesFullRefit)
+{
+    // models of one to three spheres, like submeshes
+    const uint32_t kNumModels = 3000;
+    Test::Random random = { 17 };
+    std::vector<CullingBVH::BuildItem> items;
+    std::vector<Math::BoundingSphere> spheres;
+    for (uint32_t i = 0; i < kNumModels; i++)
+    {
+        uint32_t numEntries = 1 + i % 3;
+        Math::BoundingSphere sphere = RandomSphere(random, 500.0f);
+        items.push_back({ { sphere.GetCenter().GetX(), sphere.GetCenter().GetY(), sphere.GetCenter().GetZ() },
+            (uint32_t)spheres.size(), numEntries });
+        for (uint32_t j = 0; j < numEntries; j++)
+            spheres.push_back(sphere);
+    }
+
+    CullingBVH partial;
+    partial.Build(items);
+    SphereCuller culler;
+    culler.Resize(spheres.size());
+    uint32_t leafEntry = 0;
+    for (const CullingBVH::BuildItem& item : items)
+    {
+        for (uint32_t j = 0; j < item.numEntries; j++)
+            culler.SetSphere(leafEntry++, spheres[item.firstEntry + j]);
+    }
+    partial.Refit(culler);
+    CHECK(partial.GetCostGrowth() == 1.0f);
+
+    // a few models drift per frame, some far enough to grow the root
+    std::vector<uint32_t> moved;
+    for (uint32_t frame = 0; frame < 50; frame++)
+    {
+        moved.clear();
+        for (uint32_t i = 0; i < 30; i++)
+        {
+            uint32_t entry = (uint32_t)(random.NextFloat(0.0f, 1.0f) * (spheres.size() - 1));
+            culler.SetSphere(entry, RandomSphere(random, frame % 10 == 9 ? 800.0f : 500.0f));
+            moved.push_back(entry);
+        }
+        partial.RefitEntries(culler, moved);
+
+        CullingBVH full = partial;
+        full.Refit(culler);
+
+        float partialMin[3], partialMax[3], fullMin[3], fullMax[3];
+        partial.GetBounds(partialMin, partialMax);
+        full.GetBounds(fullMin, fullMax);
+        bool areBoundsEqual = true;
+        for (int axis = 0; axis < 3; axis++)
+            areBoundsEqual = areBoundsEqual && partialMin[axis] == fullMin[axis] && partialMax[axis] == fullMax[axis];
+        CHECK(areBoundsEqual);
+        CHECK(std::fabs(partial.GetCostGrowth() - full.GetCostGrowth()) < 1e-4f * full.GetCostGrowth());
+    }
+
+    // spread across the whole tree it falls back to the full refit
+    moved.clear();
+    for (uint32_t entry = 0; entry < (uint32_t)spheres.size(); entry += 2)
+    {
+        culler.SetSphere(entry, RandomSphere(random, 500.0f));
+        moved.push_back(entry);
+    }
+    partial.RefitEntries(culler, moved);
+    CullingBVH full = partial;
+    full.Refit(culler);
+    CHECK(partial.GetCostGrowth() == full.GetCostGrowth());
+}
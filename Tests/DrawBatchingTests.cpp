@@ -0,0 +1,140 @@
+#include "TestFramework.h"
+#include "DrawBatching.h"
+
+#include <algorithm>
+
+namespace
+{
+    const DrawBatchKey kBaseKey = { 1, 7, 3, 0x1000, 0x8000, 120, 36, 40 };
+
+    std::vector<DrawBatch> Batch(const std::vector<DrawBatchKey>& keys, uint32_t maxInstances = kMaxBatchInstances)
+    {
+        std::vector<DrawBatch> batches;
+        BuildDrawBatches((uint32_t)keys.size(), maxInstances, batches, [&](uint32_t drawIdx) { return keys[drawIdx]; });
+        return batches;
+    }
+
+    bool IsBatch(const DrawBatch& batch, uint32_t firstDraw, uint32_t numInstances)
+    {
+        return batch.firstDraw == firstDraw && batch.numInstances == numInstances;
+    }
+
+    // the batches cover the draws in order, share one key each and are as long as the cap allows
+    bool AreBatchesOf(const std::vector<DrawBatch>& batches, const std::vector<DrawBatchKey>& keys, uint32_t maxInstances)
+    {
+        uint32_t nextDraw = 0;
+        for (size_t i = 0; i < batches.size(); i++)
+        {
+            const DrawBatch& batch = batches[i];
+            if (batch.firstDraw != nextDraw || batch.numInstances == 0 || batch.numInstances > maxInstances)
+                return false;
+
+            for (uint32_t draw = batch.firstDraw + 1; draw < batch.firstDraw + batch.numInstances; draw++)
+            {
+                if (keys[draw] != keys[batch.firstDraw])
+                    return false;
+            }
+
+            nextDraw = batch.firstDraw + batch.numInstances;
+            if (nextDraw < keys.size() && keys[nextDraw] == keys[nextDraw - 1] && batch.numInstances < maxInstances)
+                return false;
+        }
+        return nextDraw == keys.size();
+    }
+}
+
+TEST_CASE(DrawBatching_SplitsOnEveryBoundState)
+{
+    std::vector<DrawBatchKey> keys(3, kBaseKey);
+
+    // each change of what the draw binds starts a batch of two
+    auto AddPair = [&keys](DrawBatchKey key) { keys.push_back(key); keys.push_back(key); };
+    DrawBatchKey key = kBaseKey;
+    key.psoIdx++;
+    AddPair(key);
+    key.materialIdx++;
+    AddPair(key);
+    key.vbOffset += 0x100;
+    AddPair(key);
+    key.ibOffset += 0x100;
+    AddPair(key);
+    key.startIndex += 36;
+    AddPair(key);
+    key.baseVertex += 24;
+    AddPair(key);
+    key.pass++;
+    AddPair(key);
+    // the same submesh again is a new batch, only neighbours are merged
+    AddPair(kBaseKey);
+
+    std::vector<DrawBatch> batches = Batch(keys);
+    CHECK_EQ(batches.size(), 9u);
+    CHECK(IsBatch(batches[0], 0, 3));
+    for (uint32_t i = 1; i < 9; i++)
+        CHECK(IsBatch(batches[i], 1 + 2 * i, 2));
+    CHECK(AreBatchesOf(batches, keys, kMaxBatchInstances));
+}
+
+TEST_CASE(DrawBatching_InstanceCapSplits)
+{
+    std::vector<DrawBatchKey> keys(2 * kMaxBatchInstances + 452, kBaseKey);
+    std::vector<DrawBatch> batches = Batch(keys);
+    CHECK_EQ(batches.size(), 3u);
+    CHECK(IsBatch(batches[0], 0, kMaxBatchInstances));
+    CHECK(IsBatch(batches[1], kMaxBatchInstances, kMaxBatchInstances));
+    CHECK(IsBatch(batches[2], 2 * kMaxBatchInstances, 452));
+
+    // a cap of one turns instancing off, and a cut run restarts counting at the next key change
+    CHECK_EQ(Batch(keys, 1).size(), keys.size());
+    keys.resize(5);
+    keys[3].psoIdx++;
+    keys[4].psoIdx++;
+    batches = Batch(keys, 2);
+    CHECK_EQ(batches.size(), 3u);
+    CHECK(IsBatch(batches[0], 0, 2));
+    CHECK(IsBatch(batches[1], 2, 1));
+    CHECK(IsBatch(batches[2], 3, 2));
+
+    CHECK(Batch(std::vector<DrawBatchKey>()).empty());
+}
+
+TEST_CASE(DrawBatching_SortedDrawListsMatchTheirRuns)
+{
+    // draws of a few PSOs, materials and meshes, sorted the way a state ordered pass would be
+    Test::Random random = { 99 };
+    for (uint32_t round = 0; round < 20; round++)
+    {
+        std::vector<DrawBatchKey> keys(1 + random.Next(5000));
+        for (DrawBatchKey& key : keys)
+        {
+            key = kBaseKey;
+            key.psoIdx = random.Next(3);
+            key.materialIdx = random.Next(4);
+            uint32_t mesh = random.Next(1 + round % 6);
+            key.vbOffset = mesh * 0x10000;
+            key.ibOffset = mesh * 0x8000;
+        }
+        std::sort(keys.begin(), keys.end(), [](const DrawBatchKey& a, const DrawBatchKey& b)
+        {
+            if (a.psoIdx != b.psoIdx)
+                return a.psoIdx < b.psoIdx;
+            if (a.materialIdx != b.materialIdx)
+                return a.materialIdx < b.materialIdx;
+            return a.vbOffset < b.vbOffset;
+        });
+
+        uint32_t maxInstances = round % 2 == 0 ? kMaxBatchInstances : 1 + random.Next(64);
+        uint32_t nextDraw = 0;
+        bool isInOrder = true;
+        std::vector<DrawBatch> batches;
+        BuildDrawBatches((uint32_t)keys.size(), maxInstances, batches, [&](uint32_t drawIdx)
+        {
+            isInOrder = isInOrder && drawIdx == nextDraw++;
+            return keys[drawIdx];
+        });
+
+        CHECK(isInOrder);
+        CHECK_EQ(nextDraw, (uint32_t)keys.size());
+        CHECK(AreBatchesOf(batches, keys, maxInstances));
+    }
+}
@@ -0,0 +1,168 @@
+#include "TestFramework.h"
+#include "Utils/FenceRingAllocator.h"
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+
+namespace
+{
+    struct LiveFrame
+    {
+        uint64_t fenceValue;
+        uint32_t count; // allocated plus skipped
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    };
+}
+
+TEST_CASE(FenceRingAllocator_WrapChargesSkippedToFrame)
+{
+    Utility::FenceRingAllocator ring(10);
+    CHECK_EQ(ring.Allocate(6), 0u);
+    ring.FinishFrame(1);
+    CHECK_EQ(ring.Allocate(3), 6u);
+    ring.FinishFrame(2);
+    CHECK_EQ(ring.GetUsedCount(), 9u);
+
+    // frame 2 still holds 6..8, so 4 only fit at the front once frame 1 is gone
+    CHECK_EQ(ring.Allocate(4), Utility::FenceRingAllocator::kInvalidOffset);
+    CHECK_EQ(ring.GetOldestFence(), 1u);
+    CHECK_EQ(ring.Retire(1), 1u);
+    CHECK_EQ(ring.GetUsedCount(), 3u);
+
+    // index 9 is skipped and charged to the open frame with the 4
+    CHECK_EQ(ring.Allocate(4), 0u);
+    CHECK_EQ(ring.GetOpenFrameCount(), 5u);
+    CHECK_EQ(ring.GetUsedCount(), 8u);
+    ring.FinishFrame(3);
+
+    // an empty frame is not tagged, nothing retires for it
+    ring.FinishFrame(4);
+    CHECK_EQ(ring.Retire(2), 1u);
+    CHECK_EQ(ring.GetUsedCount(), 5u);
+
+    // alignment skips are charged too, 4..7 go with the index at 8
+    CHECK_EQ(ring.Allocate(1, 8), 8u);
+    CHECK_EQ(ring.GetOpenFrameCount(), 5u);
+    CHECK_EQ(ring.GetUsedCount(), 10u);
+    ring.FinishFrame(5);
+    CHECK_EQ(ring.Retire(4), 1u);
+    CHECK_EQ(ring.GetUsedCount(), 5u);
+    CHECK_EQ(ring.Retire(5), 1u);
+    CHECK_EQ(ring.GetUsedCount(), 0u);
+    CHECK(!ring.HasFinishedFrames());
+
+    // and an empty ring starts over at the front
+    CHECK_EQ(ring.Allocate(10), 0u);
+}
+
+TEST_CASE(FenceRingAllocator_SimulatedTimeline)
+{
+    // Frames of random allocations against a queue running behind by a random number of frames.
+    // A full ring waits for its oldest fence only, as DescriptorRing::Allocate does. Every index
+    // handed out must not belong to a frame the queue has not finished, and the used count must be
+    // what the live frames allocated and skipped.
+    const uint32_t kSize = 1024;
+    const uint32_t kAlignments[] = { 1, 1, 1, 4, 16, 64 };
+
+    Utility::FenceRingAllocator ring(kSize);
+    Test::SimulatedQueue queue; // the graphics queue as DescriptorRing sees it, one fence per frame
+    Test::Random random = { 99 };
+    std::vector<uint64_t> owners(kSize, 0); // fence of the frame holding each index, 0 when free
+    std::deque<LiveFrame> liveFrames;
+    LiveFrame openFrame = {};
+    uint32_t modelUsed = 0;
+    uint32_t head = 0;
+
+    uint32_t numWaits = 0;
+    uint32_t numWraps = 0;
+    bool isConsistent = true;
+
+    auto retireModel = [&]()
+    {
+        uint32_t numRetired = 0;
+        while (!liveFrames.empty() && liveFrames.front().fenceValue <= queue.completed)
+        {
+            for (auto& range : liveFrames.front().ranges)
+            {
+                for (uint32_t i = range.first; i < range.first + range.second; i++)
+                    owners[i] = 0;
+            }
+            modelUsed -= liveFrames.front().count;
+            liveFrames.pop_front();
+            numRetired++;
+        }
+        return numRetired;
+    };
+
+    for (uint32_t frame = 0; frame < 3000 && isConsistent; frame++)
+    {
+        // frames mostly take a few hundred indices, now and then up to a quarter of the ring, which
+        // the open frame alone must never fill
+        uint32_t numAllocations = 1 + random.Next(24);
+        uint32_t maxCount = random.Next(8) == 0 ? 128 : 32;
+        uint64_t frameFence = queue.lastSignaled + 1;
+        for (uint32_t a = 0; a < numAllocations && isConsistent; a++)
+        {
+            uint32_t count = 1 + random.Next(maxCount);
+            uint32_t alignment = kAlignments[random.Next((uint32_t)std::size(kAlignments))];
+            if (openFrame.count + count + alignment > kSize / 4)
+                break;
+
+            uint32_t offset = ring.Allocate(count, alignment);
+            while (offset == Utility::FenceRingAllocator::kInvalidOffset)
+            {
+                // only frames still in flight can give space back
+                isConsistent = isConsistent && ring.HasFinishedFrames() && ring.GetOldestFence() == liveFrames.front().fenceValue;
+                if (!isConsistent)
+                    break;
+                queue.WaitForFence(ring.GetOldestFence());
+                uint32_t numRetired = ring.Retire(queue.completed);
+                isConsistent = numRetired == 1 && retireModel() == 1;
+                numWaits++;
+                offset = ring.Allocate(count, alignment);
+            }
+            if (!isConsistent)
+                break;
+
+            // in order from the head, wrapping to the front only when the end is too short
+            if (modelUsed == 0)
+                head = 0;
+            uint32_t aligned = (head + alignment - 1) & ~(alignment - 1);
+            uint32_t skipped = aligned + count > kSize ? kSize - head : aligned - head;
+            isConsistent = offset == (aligned + count > kSize ? 0 : aligned) && offset % alignment == 0 && offset + count <= kSize;
+            numWraps += offset == 0 && head != 0;
+
+            for (uint32_t i = offset; i < offset + count && isConsistent; i++)
+            {
+                isConsistent = owners[i] == 0;
+                owners[i] = frameFence;
+            }
+            openFrame.ranges.push_back({ offset, count });
+            openFrame.count += skipped + count;
+            modelUsed += skipped + count;
+            head = offset + count == kSize ? 0 : offset + count;
+            isConsistent = isConsistent && ring.GetUsedCount() == modelUsed && modelUsed <= kSize;
+        }
+
+        ring.FinishFrame(queue.Signal());
+        openFrame.fenceValue = frameFence;
+        liveFrames.push_back(std::move(openFrame));
+        openFrame = {};
+
+        queue.Advance(random, 5);
+        isConsistent = isConsistent && ring.Retire(queue.completed) == retireModel();
+        isConsistent = isConsistent && ring.GetUsedCount() == modelUsed;
+    }
+    CHECK(isConsistent);
+
+    // the timeline has to have wrapped and run full for the checks above to mean anything
+    CHECK(numWraps > 100);
+    CHECK(numWaits > 0);
+
+    // once the queue drains everything is free
+    queue.WaitForFence(queue.lastSignaled);
+    ring.Retire(queue.completed);
+    CHECK_EQ(ring.GetUsedCount(), 0u);
+    CHECK(!ring.HasFinishedFrames());
+}
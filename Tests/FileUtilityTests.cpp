@@ -0,0 +1,226 @@
+#include "TestFramework.h"
+#include "Utils/FileUtility.h"
+
+#include <cstring>
+#include <zlib/zlib.h>
+
+namespace
+{
+    // compressible but not trivially so, runs of a counter mixed with noise
+    std::vector<Utility::byte> MakeData(size_t size)
+    {
+        std::vector<Utility::byte> data(size);
+        Test::Random random = { 12345 };
+        for (size_t i = 0; i < size; i++)
+        {
+            uint32_t bits = random.NextBits();
+            data[i] = (i & 64) ? (Utility::byte)(bits >> 24) : (Utility::byte)(i / 256);
+        }
+        return data;
+    }
+
+    bool RoundTrips(const std::vector<Utility::byte>& data, uint32_t chunkSize)
+    {
+        Utility::ByteArray compressed = Utility::CompressChunked(data.data(), data.size(), chunkSize);
+        if (compressed == Utility::NullFile)
+            return false;
+
+        Utility::ByteArray inflated = Utility::Decompress(compressed->data(), compressed->size());
+        return inflated != Utility::NullFile && *inflated == data;
+    }
+
+    // one stream the way a .gz tool writes it, windowBits 15 + 16 for gzip and 15 for zlib
+    std::vector<Utility::byte> Deflate(const std::vector<Utility::byte>& data, int windowBits)
+    {
+        z_stream strm = {};
+        deflateInit2(&strm, 6, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+
+        std::vector<Utility::byte> out(deflateBound(&strm, (uLong)data.size()));
+        strm.next_in = (Bytef*)data.data();
+        strm.avail_in = (uInt)data.size();
+        strm.next_out = out.data();
+        strm.avail_out = (uInt)out.size();
+        int err = deflate(&strm, Z_FINISH);
+        out.resize(strm.total_out);
+        deflateEnd(&strm);
+        return err == Z_STREAM_END ? out : std::vector<Utility::byte>();
+    }
+
+    bool Inflates(const std::vector<Utility::byte>& compressed, const std::vector<Utility::byte>& data)
+    {
+        Utility::ByteArray inflated = Utility::Decompress(compressed.data(), compressed.size());
+        return inflated != Utility::NullFile && *inflated == data && inflated->capacity() == inflated->size();
+    }
+
+    bool Fails(const std::vector<Utility::byte>& compressed, size_t size)
+    {
+        return Utility::Decompress(compressed.data(), size) == Utility::NullFile;
+    }
+}
+
+TEST_CASE(CompressChunked_EmptyRoundTrip)
+{
+    std::vector<Utility::byte> empty;
+    Utility::ByteArray compressed = Utility::CompressChunked(empty.data(), 0);
+    CHECK(compressed != Utility::NullFile);
+
+    Utility::ByteArray inflated = Utility::Decompress(compressed->data(), compressed->size());
+    CHECK(inflated != Utility::NullFile);
+    CHECK_EQ(inflated->size(), 0u);
+}
+
+TEST_CASE(CompressChunked_OneChunkRoundTrip)
+{
+    CHECK(RoundTrips(MakeData(1), 4096));
+    CHECK(RoundTrips(MakeData(1000), 4096));
+    CHECK(RoundTrips(MakeData(4096), 4096));
+}
+
+TEST_CASE(CompressChunked_ManyChunksRoundTrip)
+{
+    // exact multiple, one byte over, and a short tail
+    CHECK(RoundTrips(MakeData(64 * 1024), 4096));
+    CHECK(RoundTrips(MakeData(64 * 1024 + 1), 4096));
+    CHECK(RoundTrips(MakeData(3 * 1000 * 1000 + 17), 64 * 1024));
+}
+
+TEST_CASE(CompressChunked_TruncatedInputFails)
+{
+    std::vector<Utility::byte> data = MakeData(40000);
+    Utility::ByteArray compressed = Utility::CompressChunked(data.data(), data.size(), 4096);
+    CHECK(compressed != Utility::NullFile);
+
+    // inside the header, inside the chunk index, inside the last stream
+    const size_t cuts[] = { 0, 8, 40, compressed->size() / 2, compressed->size() - 1 };
+    for (size_t size : cuts)
+        CHECK(Utility::Decompress(compressed->data(), size) == Utility::NullFile);
+
+    // a flipped byte in a stream is caught by its adler32
+    std::vector<Utility::byte> corrupt = *compressed;
+    corrupt[corrupt.size() - 10] ^= 0x5a;
+    CHECK(Utility::Decompress(corrupt.data(), corrupt.size()) == Utility::NullFile);
+}
+
+TEST_CASE(CompressChunked_BadLevelFails)
+{
+    std::vector<Utility::byte> data = MakeData(10000);
+    CHECK(Utility::CompressChunked(data.data(), data.size(), 4096, 42) == Utility::NullFile);
+}
+
+TEST_CASE(Decompress_GzipRoundTrip)
+{
+    // ISIZE sizes the buffer, the result is trimmed to exactly what came out
+    const std::vector<Utility::byte> data = MakeData(300000);
+    std::vector<Utility::byte> gzip = Deflate(data, 15 + 16);
+    CHECK(!gzip.empty());
+    CHECK(Inflates(gzip, data));
+
+    // zeros inflate well past the 4x a missing size guesses
+    const std::vector<Utility::byte> zeros(4 * 1024 * 1024, 0);
+    CHECK(Inflates(Deflate(zeros, 15 + 16), zeros));
+}
+
+TEST_CASE(Decompress_GzipISizeIsOnlyAHint)
+{
+    const std::vector<Utility::byte> data = MakeData(100000);
+    const std::vector<Utility::byte> gzip = Deflate(data, 15 + 16);
+
+    // a claimed size far past what the stream could hold allocates no more than the inflate limit,
+    // and the length check in the trailer then rejects it
+    std::vector<Utility::byte> huge = gzip;
+    const uint32_t hugeSize = 0xFFFFFFF0;
+    memcpy(huge.data() + huge.size() - 4, &hugeSize, 4);
+    CHECK(Fails(huge, huge.size()));
+
+    std::vector<Utility::byte> small = gzip;
+    const uint32_t smallSize = 16;
+    memcpy(small.data() + small.size() - 4, &smallSize, 4);
+    CHECK(Fails(small, small.size()));
+}
+
+TEST_CASE(Decompress_ZlibRoundTrip)
+{
+    // no size in the stream, the buffer grows from a guess
+    const std::vector<Utility::byte> data = MakeData(300000);
+    CHECK(Inflates(Deflate(data, 15), data));
+
+    const std::vector<Utility::byte> zeros(4 * 1024 * 1024, 0);
+    CHECK(Inflates(Deflate(zeros, 15), zeros));
+
+    const std::vector<Utility::byte> one(1, 42);
+    CHECK(Inflates(Deflate(one, 15), one));
+}
+
+TEST_CASE(Decompress_TruncatedOrCorruptStreamFails)
+{
+    const std::vector<Utility::byte> data = MakeData(40000);
+    for (int windowBits : { 15 + 16, 15 })
+    {
+        const std::vector<Utility::byte> compressed = Deflate(data, windowBits);
+        CHECK(!compressed.empty());
+
+        // inside the header, inside the stream, and short of the check value
+        const size_t cuts[] = { 0, 1, 5, compressed.size() / 2, compressed.size() - 1 };
+        for (size_t size : cuts)
+            CHECK(Fails(compressed, size));
+
+        std::vector<Utility::byte> corrupt = compressed;
+        corrupt[corrupt.size() / 2] ^= 0x5a;
+        CHECK(Fails(corrupt, corrupt.size()));
+    }
+}
+
+TEST_CASE(CompressChunked_ClaimedSizeOverLimitFails)
+{
+    std::vector<Utility::byte> data = MakeData(40000);
+    Utility::ByteArray compressed = Utility::CompressChunked(data.data(), data.size(), 4096);
+    CHECK(compressed != Utility::NullFile);
+
+    // ChunkedHeader is magic, chunkSize, uncompressedSize, numChunks. A claimed size that wraps the chunk
+    // count around to zero is rejected before anything that size is allocated.
+    std::vector<Utility::byte> huge = *compressed;
+    const uint32_t hugeChunk = 2;
+    const uint64_t hugeSize = ~0ull;
+    const uint32_t hugeChunks = 0;
+    memcpy(huge.data() + 4, &hugeChunk, 4);
+    memcpy(huge.data() + 8, &hugeSize, 8);
+    memcpy(huge.data() + 16, &hugeChunks, 4);
+    CHECK(Utility::Decompress(huge.data(), huge.size()) == Utility::NullFile);
+
+    // chunks larger than their few KB of stream can fill
+    std::vector<Utility::byte> wide = *compressed;
+    const uint32_t wideChunk = 4 * 1024 * 1024;
+    const uint64_t wideSize = (uint64_t)wideChunk * 2;
+    const uint32_t wideChunks = 2;
+    memcpy(wide.data() + 4, &wideChunk, 4);
+    memcpy(wide.data() + 8, &wideSize, 8);
+    memcpy(wide.data() + 16, &wideChunks, 4);
+    CHECK(Utility::Decompress(wide.data(), wide.size()) == Utility::NullFile);
+}
+
+// Inflate throughput of one gzip stream, one zlib stream and the chunked container on the thread pool
+BENCHMARK(Decompress_Throughput)
+{
+    const std::vector<Utility::byte> data = MakeData(64 * 1024 * 1024);
+    const std::vector<Utility::byte> gzip = Deflate(data, 15 + 16);
+    const std::vector<Utility::byte> zlib = Deflate(data, 15);
+    Utility::ByteArray chunked = Utility::CompressChunked(data.data(), data.size());
+
+    struct Input { const char* name; const Utility::byte* data; size_t size; };
+    const Input inputs[] = {
+        { "gzip", gzip.data(), gzip.size() },
+        { "zlib", zlib.data(), zlib.size() },
+        { "chunked 1 MB", chunked->data(), chunked->size() } };
+
+    printf("  %.0f MB in\n", data.size() / 1048576.0);
+    printf("  %-14s %12s %10s %12s\n", "", "compressed", "ms", "MB/s out");
+    for (const Input& input : inputs)
+    {
+        size_t outSize = 0;
+        double ms = Test::MeasureBestMs(3, [&]()
+        {
+            outSize = Utility::Decompress(input.data, input.size)->size();
+        });
+        printf("  %-14s %9.1f MB %10.2f %12.0f\n", input.name, input.size / 1048576.0, ms, outSize / 1048576.0 / (ms / 1000.0));
+    }
+}
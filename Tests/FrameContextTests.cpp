@@ -0,0 +1,140 @@
+#include "TestFramework.h"
+#include "FrameContext.h"
+#include "Graphics.h"
+#include "GpuBuffer.h"
+#include "CommandQueue.h"
+#include "StagingManager.h"
+#include "NullDevice.h"
+
+#include <algorithm>
+
+namespace
+{
+    // FrameContextManager::ComitRenderTask needs the swap chain buffers, the descriptor ring and the
+    // staging manager, set up once the way InitializeApplication does on the headless device
+    void InitializeNullFrame()
+    {
+        static bool sInitialized = false;
+        if (sInitialized)
+            return;
+        sInitialized = true;
+
+        Graphics::gUseNullDevice = true;
+        if (Graphics::gDevice == nullptr)
+            CheckHR(NullDevice::CreateDevice(0.0f, IID_PPV_ARGS(Graphics::gDevice.GetAddressOf())));
+        DescriptorAllocatorManager::GetOrCreateInstance();
+        CommandQueueManager::GetOrCreateInstance();
+        FrameContextManager::GetOrCreateInstance();
+        StagingManager::GetOrCreateInstance();
+        Graphics::InitializeSwapChain();
+    }
+
+    using ListTask = std::function<void(CommandList&)>;
+
+    // Records one task per entry on its own direct list, in parallel like the mesh chunks, and submits
+    // them as one frame. lists receives the device list each task recorded on.
+    void CommitFrame(const std::vector<ListTask>& tasks, std::vector<const ID3D12CommandList*>& lists)
+    {
+        lists.assign(tasks.size(), nullptr);
+        for (size_t i = 0; i < tasks.size(); i++)
+        {
+            PUSH_MUTIRENDER_TASK({ D3D12_COMMAND_LIST_TYPE_DIRECT, [&tasks, &lists, i](CommandList* commandList)
+            {
+                lists[i] = commandList->GetDeviceCommandList();
+                tasks[i](*commandList);
+                return commandList;
+            } });
+        }
+        FrameContextManager::GetInstance()->ComitRenderTask();
+    }
+
+    struct Transition
+    {
+        size_t listIndex;
+        D3D12_RESOURCE_STATES stateBefore;
+        D3D12_RESOURCE_STATES stateAfter;
+
+        bool operator==(const Transition& other) const
+        {
+            return listIndex == other.listIndex && stateBefore == other.stateBefore && stateAfter == other.stateAfter;
+        }
+    };
+
+    // the executed transitions of one resource, with the index of the task whose list they landed in
+    std::vector<Transition> GetTransitions(const GpuResource& resource, const std::vector<const ID3D12CommandList*>& lists)
+    {
+        std::vector<Transition> transitions;
+        for (const NullDevice::TransitionRecord& record : NullDevice::GetExecutedTransitions())
+        {
+            if (record.resource != resource.GetResource())
+                continue;
+            size_t listIndex = std::find(lists.begin(), lists.end(), record.commandList) - lists.begin();
+            transitions.push_back({ listIndex, record.stateBefore, record.stateAfter });
+        }
+        return transitions;
+    }
+}
+
+// A list after the first cannot see the states the lists before it left, its first use of a resource
+// becomes its begin state and the frame context transitions the previous list into it
+TEST_CASE(FrameContext_StitchesStatesAcrossLists)
+{
+    InitializeNullFrame();
+
+    const D3D12_RESOURCE_STATES kCommon = D3D12_RESOURCE_STATE_COMMON;
+    const D3D12_RESOURCE_STATES kCopyDest = D3D12_RESOURCE_STATE_COPY_DEST;
+    const D3D12_RESOURCE_STATES kIndexBuffer = D3D12_RESOURCE_STATE_INDEX_BUFFER;
+    const D3D12_RESOURCE_STATES kShaderResource = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+
+    // shared is written by the first three chunks and read by the last, moved is first used by
+    // a later chunk that moves it on and is then expected by the last one
+    ByteAddressBuffer shared, moved, untouched;
+    shared.Create(L"Shared", 256, 4);
+    moved.Create(L"Moved", 256, 4);
+    untouched.Create(L"Untouched", 256, 4);
+
+    NullDevice::SetTransitionLog(true);
+
+    std::vector<const ID3D12CommandList*> lists;
+    std::vector<ListTask> tasks = {
+        [&](CommandList& list) { list.TransitionResource(shared, kCopyDest); },
+        [&](CommandList& list)
+        {
+            list.TransitionResource(shared, kCopyDest);
+            list.TransitionResource(moved, kIndexBuffer);
+            list.TransitionResource(moved, kCopyDest);
+        },
+        [&](CommandList& list) { list.TransitionResource(shared, kCopyDest); },
+        [&](CommandList& list)
+        {
+            list.TransitionResource(shared, kShaderResource);
+            list.ExceptResourceBeginState(moved, kShaderResource);
+        } };
+    CommitFrame(tasks, lists);
+
+    // chunks that begin in the state the one before left need nothing, the read is stitched into chunk 2
+    std::vector<Transition> expectShared = { { 0, kCommon, kCopyDest }, { 2, kCopyDest, kShaderResource } };
+    CHECK(GetTransitions(shared, lists) == expectShared);
+
+    // the state of last frame is stitched into chunk 0, the move stays in chunk 1, the expected state in chunk 2
+    std::vector<Transition> expectMoved = { { 0, kCommon, kIndexBuffer }, { 1, kIndexBuffer, kCopyDest }, { 2, kCopyDest, kShaderResource } };
+    CHECK(GetTransitions(moved, lists) == expectMoved);
+    CHECK(GetTransitions(untouched, lists).empty());
+
+    // the next frame starts from the states this one ended in
+    NullDevice::SetTransitionLog(true);
+    tasks = {
+        [&](CommandList& list)
+        {
+            list.TransitionResource(shared, kCopyDest);
+            list.TransitionResource(moved, kShaderResource);
+        },
+        [&](CommandList& list) { list.ExceptResourceBeginState(shared, kCopyDest); } };
+    CommitFrame(tasks, lists);
+
+    expectShared = { { 0, kShaderResource, kCopyDest } };
+    CHECK(GetTransitions(shared, lists) == expectShared);
+    CHECK(GetTransitions(moved, lists).empty());
+
+    NullDevice::SetTransitionLog(false);
+}
@@ -0,0 +1,120 @@
+#include "TestFramework.h"
+#include "Utils/IOQueue.h"
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+
+namespace
+{
+    // a file the reads can find, removed again when the test is done
+    struct TempFile
+    {
+        std::filesystem::path path;
+
+        TempFile(const char* name, size_t size) : path(std::filesystem::temp_directory_path() / name)
+        {
+            std::ofstream file(path, std::ios::binary);
+            std::vector<char> data(size, 'x');
+            file.write(data.data(), data.size());
+        }
+        ~TempFile()
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+    };
+
+    // Keeps the only I/O thread busy in its first callback, so everything queued after it waits in the
+    // queue until Release and comes out in the order the queue picks
+    struct BlockedQueue
+    {
+        Utility::IOQueue queue;
+        std::promise<void> started;
+        std::promise<void> release;
+
+        BlockedQueue(const std::wstring& fileName) : queue(1)
+        {
+            std::shared_future<void> released = release.get_future().share();
+            queue.Read(fileName, Utility::kIOPriorityHigh, [this, released](Utility::ByteArray)
+            {
+                started.set_value();
+                released.wait();
+            });
+            started.get_future().wait();
+        }
+
+        void Release() { release.set_value(); queue.Shutdown(); }
+    };
+}
+
+TEST_CASE(IOQueue_PriorityOrder)
+{
+    TempFile file("IOQueueTests_Priority.bin", 64);
+    BlockedQueue blocked(file.path.wstring());
+
+    std::mutex lock;
+    std::vector<int> order;
+    auto record = [&lock, &order](int id)
+    {
+        return [&lock, &order, id](Utility::ByteArray) { std::lock_guard<std::mutex> guard(lock); order.push_back(id); };
+    };
+
+    // ids sort the way the queue should serve them, priority first and FIFO within one
+    blocked.queue.Read(file.path.wstring(), Utility::kIOPriorityLow, record(6));
+    blocked.queue.Read(file.path.wstring(), Utility::kIOPriorityNormal, record(3));
+    blocked.queue.Read(file.path.wstring(), Utility::kIOPriorityHigh, record(0));
+    blocked.queue.Read(file.path.wstring(), Utility::kIOPriorityLow, record(7));
+
+    std::vector<Utility::IOReadDesc> batch;
+    batch.push_back({ file.path.wstring(), Utility::kIOPriorityNormal, record(4) });
+    batch.push_back({ file.path.wstring(), Utility::kIOPriorityHigh, record(1) });
+    batch.push_back({ file.path.wstring(), Utility::kIOPriorityNormal, record(5) });
+    batch.push_back({ file.path.wstring(), Utility::kIOPriorityHigh, record(2) });
+    std::vector<Utility::IORequestRef> requests = blocked.queue.ReadBatch(std::move(batch));
+    CHECK_EQ(requests.size(), 4u);
+    CHECK_EQ(requests[1]->GetPriority(), Utility::kIOPriorityHigh);
+    CHECK_EQ(blocked.queue.GetPendingCount(), 8u);
+
+    blocked.Release();
+
+    CHECK_EQ(order.size(), 8u);
+    for (size_t i = 0; i < order.size(); i++)
+        CHECK_EQ(order[i], (int)i);
+    CHECK_EQ(blocked.queue.GetPendingCount(), 0u);
+}
+
+TEST_CASE(IOQueue_CancelCompletesWithNullFile)
+{
+    TempFile file("IOQueueTests_Cancel.bin", 4096);
+    BlockedQueue blocked(file.path.wstring());
+
+    uint32_t numCancelled = 0;
+    uint32_t numRead = 0;
+    bool isConsistent = true;
+
+    Utility::IORequestRef cancelled = blocked.queue.Read(file.path.wstring(), Utility::kIOPriorityNormal,
+        [&](Utility::ByteArray data) { numCancelled++; isConsistent &= data == Utility::NullFile; });
+    Utility::IORequestRef kept = blocked.queue.Read(file.path.wstring(), Utility::kIOPriorityNormal,
+        [&](Utility::ByteArray data) { numRead++; isConsistent &= data != Utility::NullFile && data->size() == 4096; });
+
+    blocked.queue.Cancel(cancelled);
+    CHECK(cancelled->IsCancelled());
+    CHECK(!kept->IsCancelled());
+
+    blocked.Release();
+
+    // the callback of a cancelled request still runs once, so nobody waits on it forever
+    CHECK_EQ(numCancelled, 1u);
+    CHECK_EQ(numRead, 1u);
+    CHECK(isConsistent);
+}
+
+TEST_CASE(IOQueue_MissingFileReadsNullFile)
+{
+    Utility::IOQueue queue(2);
+    std::promise<Utility::ByteArray> result;
+    queue.Read((std::filesystem::temp_directory_path() / "IOQueueTests_Missing.bin").wstring(), Utility::kIOPriorityNormal,
+        [&result](Utility::ByteArray data) { result.set_value(std::move(data)); });
+    CHECK(result.get_future().get() == Utility::NullFile);
+}
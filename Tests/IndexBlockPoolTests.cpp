@@ -0,0 +1,574 @@
+#include "TestFramework.h"
+#include "Utils/IndexBlockPool.h"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <thread>
+
+namespace
+{
+    // what a range of count takes in DescriptorAllocator's size classes, mostly single descriptors
+    // and small tables, now and then a table too long for a magazine
+    uint32_t NextCount(Test::Random& random)
+    {
+        const uint32_t kCounts[] = { 1, 1, 1, 1, 2, 2, 3, 4, 6, 8 };
+        return random.Next(16) == 0 ? 9 + random.Next(32) : kCounts[random.Next((uint32_t)std::size(kCounts))];
+    }
+
+    // The bitmap tree DescriptorAllocator used before the IndexRangeAllocator pages, without the D3D
+    // heaps. A 63 node tree of 32 bit words per 1024 descriptor heap with a layer per power of two
+    // size, a set bit in a node marks its block or a part of it used. One mutex, taken with a
+    // try_lock spin. Kept as the benchmark baseline.
+    class BitmapTreeAllocator
+    {
+    public:
+        static constexpr uint32_t kHeapSize = 1024;
+        static constexpr uint32_t kNodeBits = 32;
+        static constexpr uint32_t kNumNodes = 63;
+        static constexpr uint32_t kMaxCount = kHeapSize / kNodeBits;
+
+        struct Handle
+        {
+            uint32_t offset;
+            uint8_t heapIndex;
+        };
+
+        Handle Allocate(uint32_t count)
+        {
+            count = AlignCount(count);
+            uint32_t startLayer = GetLayer(count);
+            uint32_t totalNodes = (1u << (startLayer + 1)) - 1;
+            uint32_t startLayerNode = (1u << startLayer) - 1;
+
+            std::unique_lock<std::mutex> lock(mMutex, std::defer_lock);
+            while (!lock.try_lock())
+                std::this_thread::yield();
+
+            if (mCurrentHeapIndex == (uint8_t)-1 || mHeaps[mCurrentHeapIndex]->numRemain < count)
+                mCurrentHeapIndex = AddHeap();
+
+            Handle handle = AllocateLayer(startLayerNode, totalNodes, count);
+            if (handle.offset != kInvalidOffset)
+                return handle;
+
+            mCurrentHeapIndex = AddHeap();
+            return AllocateLayer(startLayerNode, totalNodes, count);
+        }
+
+        void Deallocate(const Handle& handle, uint32_t count)
+        {
+            count = AlignCount(count);
+            uint32_t startLayer = GetLayer(count);
+
+            std::unique_lock<std::mutex> lock(mMutex, std::defer_lock);
+            while (!lock.try_lock())
+                std::this_thread::yield();
+
+            SubHeap& heap = *mHeaps[handle.heapIndex];
+            uint32_t offset = handle.offset / count;
+            uint32_t nodeIdx = (1u << startLayer) - 1 + offset / kNodeBits;
+            uint32_t bitIdx = offset % kNodeBits;
+
+            heap.bitMap[nodeIdx] ^= 1u << bitIdx;
+            ShiftResetBit(heap.bitMap, nodeIdx, bitIdx);
+            SinkSetAll(heap.bitMap, nodeIdx, bitIdx, false);
+            heap.numRemain += count;
+            heap.numReleased += count;
+
+            // every few frees the allocations move to the heap with the most room
+            if (heap.numReleased > 16)
+            {
+                heap.numReleased = 0;
+                auto maxIter = std::max_element(mHeaps.cbegin(), mHeaps.cend(),
+                    [](auto& a, auto& b) { return a->numRemain < b->numRemain; });
+                mCurrentHeapIndex = (uint8_t)std::distance(mHeaps.cbegin(), maxIter);
+            }
+        }
+
+        uint32_t GetFreeCount() const
+        {
+            uint32_t numFree = 0;
+            for (const auto& heap : mHeaps)
+                numFree += heap->numRemain;
+            return numFree;
+        }
+
+        uint32_t GetCapacity() const { return (uint32_t)mHeaps.size() * kHeapSize; }
+    private:
+        static constexpr uint32_t kInvalidOffset = (uint32_t)-1;
+
+        struct SubHeap
+        {
+            uint32_t numRemain = kHeapSize;
+            uint32_t numReleased = 0;
+            uint32_t bitMap[kNumNodes] = {};
+        };
+
+        static uint32_t AlignCount(uint32_t count)
+        {
+            uint32_t aligned = 1;
+            while (aligned < count)
+                aligned <<= 1;
+            return aligned;
+        }
+
+        static uint32_t GetLayer(uint32_t alignedCount)
+        {
+            uint32_t layer = 5; // log2(kMaxCount)
+            for (uint32_t size = alignedCount; size > 1; size >>= 1)
+                layer--;
+            return layer;
+        }
+
+        static bool TestBit(uint32_t word, uint32_t bit) { return (word >> bit) & 1; }
+
+        static void ShiftSetBit(uint32_t bitMap[], int nodeIdx, uint32_t bitIdx)
+        {
+            bool isRight = nodeIdx % 2 == 0;
+            nodeIdx = ((nodeIdx + 1) >> 1) - 1;
+            bitIdx >>= 1;
+            while (nodeIdx >= 0)
+            {
+                bitMap[nodeIdx] |= 1u << (isRight ? bitIdx + kNodeBits / 2 : bitIdx);
+                isRight = nodeIdx % 2 == 0;
+                nodeIdx = ((nodeIdx + 1) >> 1) - 1;
+                bitIdx >>= 1;
+            }
+        }
+
+        // a parent bit only clears once both of its child bits are clear
+        static void ShiftResetBit(uint32_t bitMap[], int nodeIdx, uint32_t bitIdx)
+        {
+            bool isRight = nodeIdx % 2 == 0;
+            bool hasBitSet = TestBit(bitMap[nodeIdx], bitIdx) || TestBit(bitMap[nodeIdx], bitIdx ^ 1);
+            nodeIdx = ((nodeIdx + 1) >> 1) - 1;
+            bitIdx >>= 1;
+            while (nodeIdx >= 0 && !hasBitSet)
+            {
+                bitMap[nodeIdx] ^= 1u << (isRight ? bitIdx + kNodeBits / 2 : bitIdx);
+                hasBitSet = TestBit(bitMap[nodeIdx], bitIdx) || TestBit(bitMap[nodeIdx], bitIdx ^ 1);
+                isRight = nodeIdx % 2 == 0;
+                nodeIdx = ((nodeIdx + 1) >> 1) - 1;
+                bitIdx >>= 1;
+            }
+        }
+
+        static void SinkSetAll(uint32_t bitMap[], uint32_t nodeIdx, uint32_t bitIdx, bool isSet)
+        {
+            const uint32_t kBitSets[] = { 3, 15, 255, 65535, 4294967295 };
+            bool isLeft = bitIdx < kNodeBits / 2;
+            uint32_t childIdx = nodeIdx * 2 + (isLeft ? 1 : 2);
+            bitIdx = (bitIdx % (kNodeBits / 2)) << 1;
+            for (uint32_t i = 0; i < 5 && childIdx < kNumNodes; i++)
+            {
+                if (isSet)
+                    bitMap[childIdx] |= kBitSets[i] << bitIdx;
+                else
+                    bitMap[childIdx] &= ~(kBitSets[i] << bitIdx);
+
+                isLeft = bitIdx < kNodeBits / 2;
+                bitIdx = (bitIdx % (kNodeBits / 2)) << 1;
+                childIdx = childIdx * 2 + (isLeft ? 1 : 2);
+            }
+        }
+
+        uint8_t AddHeap()
+        {
+            mHeaps.push_back(std::make_unique<SubHeap>());
+            return (uint8_t)(mHeaps.size() - 1);
+        }
+
+        Handle AllocateLayer(uint32_t startLayerNode, uint32_t totalNodes, uint32_t count)
+        {
+            SubHeap& heap = *mHeaps[mCurrentHeapIndex];
+            for (uint32_t i = startLayerNode, j = 0; i < totalNodes; i++, j++)
+            {
+                uint32_t freeBits = ~heap.bitMap[i];
+                if (freeBits == 0)
+                    continue;
+
+                uint32_t freeIdx = 0;
+                while (!TestBit(freeBits, freeIdx))
+                    freeIdx++;
+                heap.numRemain -= count;
+                heap.bitMap[i] |= 1u << freeIdx;
+                ShiftSetBit(heap.bitMap, i, freeIdx);
+                SinkSetAll(heap.bitMap, i, freeIdx, true);
+                return { (j * kNodeBits + freeIdx) * count, mCurrentHeapIndex };
+            }
+            return { kInvalidOffset, mCurrentHeapIndex };
+        }
+    private:
+        std::vector<std::unique_ptr<SubHeap>> mHeaps;
+        uint8_t mCurrentHeapIndex = (uint8_t)-1;
+        std::mutex mMutex;
+    };
+
+    // the thread that holds every index of the pool, 0 when none does
+    class IndexOwners
+    {
+    public:
+        explicit IndexOwners(uint32_t pageCapacity) :
+            mPageCapacity(pageCapacity), mOwners(new std::atomic<uint32_t>[Utility::IndexBlockPool::kMaxPages * pageCapacity]())
+        {}
+
+        // false when any index of the block already had an owner
+        bool Take(const Utility::IndexBlockPool::Block& block, uint32_t count, uint32_t owner)
+        {
+            bool isFree = true;
+            for (uint32_t i = 0; i < Utility::IndexRangeAllocator::GetAlignedCount(count); i++)
+                isFree = isFree && mOwners[block.page * mPageCapacity + block.offset + i].exchange(owner) == 0;
+            return isFree;
+        }
+
+        // false when any index of the block was not the owner's
+        bool Give(const Utility::IndexBlockPool::Block& block, uint32_t count, uint32_t owner)
+        {
+            bool isOwned = true;
+            for (uint32_t i = 0; i < Utility::IndexRangeAllocator::GetAlignedCount(count); i++)
+                isOwned = isOwned && mOwners[block.page * mPageCapacity + block.offset + i].exchange(0) == owner;
+            return isOwned;
+        }
+    private:
+        uint32_t mPageCapacity;
+        std::unique_ptr<std::atomic<uint32_t>[]> mOwners;
+    };
+}
+
+TEST_CASE(IndexRangeAllocator_MatchesFirstFit)
+{
+    // one bit per index, blocks up to 64 aligned to their size, longer runs anywhere
+    const uint32_t kCapacity = 1000;
+    Utility::IndexRangeAllocator allocator(kCapacity);
+    std::vector<bool> isUsed(kCapacity, false);
+    struct Range { uint32_t first; uint32_t count; };
+    std::vector<Range> live;
+
+    auto findFirstFit = [&](uint32_t alignedCount)
+    {
+        uint32_t step = alignedCount <= Utility::IndexRangeAllocator::kMaxBlockSize ? alignedCount : 1;
+        for (uint32_t first = 0; first + alignedCount <= kCapacity; first += step)
+        {
+            if (std::none_of(isUsed.begin() + first, isUsed.begin() + first + alignedCount, [](bool used) { return used; }))
+                return first;
+        }
+        return Utility::IndexRangeAllocator::kInvalidIndex;
+    };
+
+    Test::Random random = { 7 };
+    bool isConsistent = true;
+    for (uint32_t step = 0; step < 20000 && isConsistent; step++)
+    {
+        if (live.empty() || random.Next(100) < 55)
+        {
+            uint32_t count = random.Next(8) == 0 ? 65 + random.Next(100) : 1 + random.Next(64);
+            uint32_t alignedCount = Utility::IndexRangeAllocator::GetAlignedCount(count);
+            uint32_t first = allocator.Allocate(count);
+            isConsistent = first == findFirstFit(alignedCount);
+            if (isConsistent && first != Utility::IndexRangeAllocator::kInvalidIndex)
+            {
+                std::fill(isUsed.begin() + first, isUsed.begin() + first + alignedCount, true);
+                live.push_back({ first, count });
+            }
+        }
+        else
+        {
+            size_t i = random.Next((uint32_t)live.size());
+            allocator.Free(live[i].first, live[i].count);
+            uint32_t alignedCount = Utility::IndexRangeAllocator::GetAlignedCount(live[i].count);
+            std::fill(isUsed.begin() + live[i].first, isUsed.begin() + live[i].first + alignedCount, false);
+            live[i] = live.back();
+            live.pop_back();
+        }
+        isConsistent = isConsistent && allocator.GetFreeCount() == (uint32_t)std::count(isUsed.begin(), isUsed.end(), false);
+    }
+    CHECK(isConsistent);
+}
+
+TEST_CASE(IndexBlockPool_ThreadsNeverShareIndices)
+{
+    // Threads allocate and free through their magazines and the shared path at once, and hand blocks
+    // to each other so frees land in magazines other than the one that allocated. Every index has
+    // one owner at a time, and once the threads are gone all of it is free again.
+    const uint32_t kPageCapacity = 1024;
+    const uint32_t kNumThreads = 8;
+    const uint32_t kInTransit = kNumThreads + 1;
+    std::atomic<uint32_t> numPagesAdded{ 0 };
+    bool isPageOrderKept = true;
+    Utility::IndexBlockPool pool(kPageCapacity, true, [&](uint8_t page, uint32_t capacity)
+    {
+        isPageOrderKept = isPageOrderKept && page == numPagesAdded && capacity == kPageCapacity;
+        numPagesAdded++;
+    });
+    IndexOwners owners(kPageCapacity);
+
+    struct Handoff
+    {
+        std::mutex mutex;
+        std::vector<std::pair<Utility::IndexBlockPool::Block, uint32_t>> blocks;
+    } handoffs[kNumThreads];
+
+    std::atomic<uint32_t> numErrors{ 0 };
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < kNumThreads; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            uint32_t owner = t + 1;
+            Test::Random random = { 1000 + t };
+            std::vector<std::pair<Utility::IndexBlockPool::Block, uint32_t>> live;
+            for (uint32_t step = 0; step < 50000; step++)
+            {
+                uint32_t op = random.Next(100);
+                if (op < 50 && live.size() < 200)
+                {
+                    uint32_t count = NextCount(random);
+                    Utility::IndexBlockPool::Block block = pool.Allocate(count);
+                    numErrors += !owners.Take(block, count, owner);
+                    live.push_back({ block, count });
+                }
+                else if (op < 95 && !live.empty())
+                {
+                    size_t i = random.Next((uint32_t)live.size());
+                    numErrors += !owners.Give(live[i].first, live[i].second, owner);
+                    pool.Free(live[i].first, live[i].second);
+                    live[i] = live.back();
+                    live.pop_back();
+                }
+                else if (!live.empty())
+                {
+                    // the next thread frees this one
+                    Handoff& handoff = handoffs[(t + 1) % kNumThreads];
+                    numErrors += !owners.Give(live.back().first, live.back().second, owner);
+                    numErrors += !owners.Take(live.back().first, live.back().second, kInTransit);
+                    std::lock_guard<std::mutex> lock(handoff.mutex);
+                    handoff.blocks.push_back(live.back());
+                    live.pop_back();
+                }
+
+                if (step % 64 == 0)
+                {
+                    Handoff& handoff = handoffs[t];
+                    std::lock_guard<std::mutex> lock(handoff.mutex);
+                    for (auto& handed : handoff.blocks)
+                    {
+                        numErrors += !owners.Give(handed.first, handed.second, kInTransit);
+                        numErrors += !owners.Take(handed.first, handed.second, owner);
+                        live.push_back(handed);
+                    }
+                    handoff.blocks.clear();
+                }
+            }
+
+            for (auto& block : live)
+            {
+                numErrors += !owners.Give(block.first, block.second, owner);
+                pool.Free(block.first, block.second);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    // whatever was handed off after the receiver's last pickup, from a thread of its own so its
+    // magazines go back when it exits
+    std::thread([&]()
+    {
+        for (Handoff& handoff : handoffs)
+        {
+            for (auto& block : handoff.blocks)
+                pool.Free(block.first, block.second);
+        }
+    }).join();
+
+    CHECK_EQ(numErrors.load(), 0u);
+    CHECK(isPageOrderKept);
+    CHECK_EQ(pool.GetPageCount(), numPagesAdded.load());
+    CHECK_EQ(pool.GetFreeCount(), pool.GetPageCount() * kPageCapacity);
+}
+
+TEST_CASE(IndexBlockPool_ExitingThreadsReturnTheirMagazines)
+{
+    const uint32_t kPageCapacity = 256;
+    Utility::IndexBlockPool pool(kPageCapacity, true, nullptr);
+
+    std::thread([&]()
+    {
+        // leaves a few blocks of every size class cached
+        std::vector<Utility::IndexBlockPool::Block> blocks;
+        for (uint32_t sizeClass = 0; sizeClass < Utility::IndexBlockPool::kNumSizeClasses; sizeClass++)
+        {
+            for (uint32_t i = 0; i < 3; i++)
+                blocks.push_back(pool.Allocate(1u << sizeClass));
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                pool.Free(blocks.back(), 1u << sizeClass);
+                blocks.pop_back();
+            }
+        }
+        CHECK(pool.GetFreeCount() < pool.GetPageCount() * kPageCapacity);
+    }).join();
+
+    CHECK_EQ(pool.GetFreeCount(), pool.GetPageCount() * kPageCapacity);
+}
+
+// Threads that exit while their pool is destroyed either hand their blocks back first or find the
+// pool gone, and never return them to the pool that takes the slot next
+TEST_CASE(IndexBlockPool_PoolDestroyedWhileThreadsExit)
+{
+    const uint32_t kPageCapacity = 256;
+    const uint32_t kNumThreads = 4;
+    for (uint32_t round = 0; round < 200; round++)
+    {
+        auto pool = std::make_unique<Utility::IndexBlockPool>(kPageCapacity, true, nullptr);
+        Utility::IndexBlockPool* poolPtr = pool.get();
+        std::atomic<uint32_t> numCached{ 0 };
+        std::atomic<bool> canExit{ false };
+
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < kNumThreads; t++)
+        {
+            threads.emplace_back([&, poolPtr]()
+            {
+                for (uint32_t sizeClass = 0; sizeClass < Utility::IndexBlockPool::kNumSizeClasses; sizeClass++)
+                    poolPtr->Free(poolPtr->Allocate(1u << sizeClass), 1u << sizeClass);
+                numCached++;
+                while (!canExit)
+                    std::this_thread::yield();
+            });
+        }
+        while (numCached < kNumThreads)
+            std::this_thread::yield();
+
+        // the threads exit while the pool goes away, and the next pool takes its slot
+        canExit = true;
+        pool.reset();
+        Utility::IndexBlockPool next(kPageCapacity, true, nullptr);
+        next.Free(next.Allocate(kPageCapacity / 2), kPageCapacity / 2);
+        for (std::thread& thread : threads)
+            thread.join();
+
+        CHECK_EQ(next.GetFreeCount(), kPageCapacity);
+    }
+}
+
+TEST_CASE(IndexBlockPool_ClearDropsCachedBlocks)
+{
+    const uint32_t kPageCapacity = 64;
+    const uint32_t kRefill = Utility::IndexBlockPool::kMagazineRefill;
+    uint32_t numPagesAdded = 0;
+    {
+        Utility::IndexBlockPool pool(kPageCapacity, true, [&](uint8_t, uint32_t) { numPagesAdded++; });
+
+        // a refill parks kRefill - 1 more blocks in this thread's magazine
+        pool.Allocate(1);
+        CHECK_EQ(pool.GetFreeCount(), kPageCapacity - kRefill);
+
+        pool.Clear();
+        CHECK_EQ(pool.GetPageCount(), 0u);
+
+        // the parked blocks belong to the cleared page, a new one has to be added for them
+        Utility::IndexBlockPool::Block block = pool.Allocate(1);
+        CHECK_EQ(pool.GetPageCount(), 1u);
+        CHECK_EQ(block.page, 0);
+        CHECK_EQ(pool.GetFreeCount(), kPageCapacity - kRefill);
+        CHECK_EQ(numPagesAdded, 2u);
+
+        // dedicated pages are skipped by Allocate
+        uint8_t dedicated = pool.AddDedicatedPage(4096);
+        for (uint32_t i = 0; i < kPageCapacity; i++)
+            CHECK(pool.Allocate(4).page != dedicated);
+    }
+
+    // a new pool takes the destroyed one's slot, the blocks this thread still parks for the old one
+    // must not be handed out by it
+    {
+        Utility::IndexBlockPool pool(kPageCapacity, true, nullptr);
+        pool.Allocate(1);
+    }
+    Utility::IndexBlockPool pool(kPageCapacity, true, nullptr);
+    pool.Allocate(1);
+    CHECK_EQ(pool.GetPageCount(), 1u);
+    CHECK_EQ(pool.GetFreeCount(), kPageCapacity - kRefill);
+}
+
+TEST_CASE(IndexBlockPool_WithoutMagazinesReusesAtOnce)
+{
+    // shader visible heaps: a freed block is the next one handed out, no thread keeps any
+    Utility::IndexBlockPool pool(1024, false, nullptr);
+    Utility::IndexBlockPool::Block first = pool.Allocate(4);
+    CHECK_EQ(pool.GetFreeCount(), 1020u);
+    pool.Free(first, 4);
+    CHECK_EQ(pool.GetFreeCount(), 1024u);
+    Utility::IndexBlockPool::Block second = pool.Allocate(3);
+    CHECK(second.offset == first.offset && second.page == first.page);
+}
+
+// Descriptor churn the way loading threads create and drop views: every thread keeps a window of
+// live ranges and replaces a random one per step. Against the bitmap tree the allocator used before.
+BENCHMARK(IndexBlockPool_VsBitmapTree)
+{
+    const uint32_t kStepsPerThread = 200000;
+    const uint32_t kWindow = 256;
+
+    printf("  ns per allocate and free pair, %u live ranges per thread\n", kWindow);
+    printf("  %8s %14s %14s %14s\n", "threads", "magazines", "pages only", "bitmap tree");
+    const uint32_t threadCounts[] = { 1, 2, 4, 8 };
+    for (uint32_t numThreads : threadCounts)
+    {
+        auto run = [&](auto&& allocate, auto&& free)
+        {
+            return Test::MeasureBestMs(3, [&]()
+            {
+                std::vector<std::thread> threads;
+                for (uint32_t t = 0; t < numThreads; t++)
+                {
+                    threads.emplace_back([&, t]()
+                    {
+                        Test::Random random = { 77 + t };
+                        std::vector<uint32_t> counts(kWindow);
+                        std::vector<decltype(allocate(1u))> live(kWindow);
+                        for (uint32_t i = 0; i < kWindow; i++)
+                        {
+                            counts[i] = 1u << random.Next(4);
+                            live[i] = allocate(counts[i]);
+                        }
+                        for (uint32_t step = 0; step < kStepsPerThread; step++)
+                        {
+                            uint32_t i = random.Next(kWindow);
+                            free(live[i], counts[i]);
+                            counts[i] = 1u << random.Next(4);
+                            live[i] = allocate(counts[i]);
+                        }
+                        for (uint32_t i = 0; i < kWindow; i++)
+                            free(live[i], counts[i]);
+                    });
+                }
+                for (std::thread& thread : threads)
+                    thread.join();
+            });
+        };
+
+        Utility::IndexBlockPool magazinePool(1024, true, nullptr);
+        double magazineMs = run([&](uint32_t count) { return magazinePool.Allocate(count); },
+            [&](const Utility::IndexBlockPool::Block& block, uint32_t count) { magazinePool.Free(block, count); });
+
+        Utility::IndexBlockPool sharedPool(1024, false, nullptr);
+        double sharedMs = run([&](uint32_t count) { return sharedPool.Allocate(count); },
+            [&](const Utility::IndexBlockPool::Block& block, uint32_t count) { sharedPool.Free(block, count); });
+
+        BitmapTreeAllocator bitmapTree;
+        double bitmapMs = run([&](uint32_t count) { return bitmapTree.Allocate(count); },
+            [&](const BitmapTreeAllocator::Handle& handle, uint32_t count) { bitmapTree.Deallocate(handle, count); });
+
+        // everything is back, exited threads returned their magazines
+        CHECK_EQ(magazinePool.GetFreeCount(), magazinePool.GetPageCount() * 1024);
+        CHECK_EQ(sharedPool.GetFreeCount(), sharedPool.GetPageCount() * 1024);
+        CHECK_EQ(bitmapTree.GetFreeCount(), bitmapTree.GetCapacity());
+
+        double numPairs = (double)numThreads * kStepsPerThread;
+        printf("  %8u %14.1f %14.1f %14.1f\n", numThreads, magazineMs * 1e6 / numPairs, sharedMs * 1e6 / numPairs,
+            bitmapMs * 1e6 / numPairs);
+    }
+}
@@ -0,0 +1,295 @@
+#include "TestFramework.h"
+#include "ModelConverter.h"
+#include "MeshCache.h"
+#include "glTF.h"
+#include "Utils/FileUtility.h"
+
+#include <psapi.h>
+
+namespace
+{
+    const std::filesystem::path kBenchAssets[] = {
+        L"Asset/Sponza2/sponza2.gltf",
+        L"../Asset/Sponza2/sponza2.gltf" };
+
+    // absolute, so a cache written outside the asset folder still finds its sources
+    std::filesystem::path FindBenchAsset()
+    {
+        std::error_code ec;
+        for (const std::filesystem::path& path : kBenchAssets)
+        {
+            if (std::filesystem::exists(path, ec))
+                return std::filesystem::absolute(path, ec);
+        }
+        return std::filesystem::path();
+    }
+
+    // A cache baked into the temp directory instead of next to the asset, removed again with
+    // either form when the test is done
+    struct TempMeshCache
+    {
+        std::filesystem::path path;
+
+        TempMeshCache(const char* name) : path(std::filesystem::temp_directory_path() / name) {}
+        ~TempMeshCache()
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            std::filesystem::remove(MeshCache::GetCompressedPath(path), ec);
+        }
+
+        bool Bake(const std::filesystem::path& sourcePath, MeshCache::BakedAsset& baked, bool compress = false)
+        {
+            return ModelConverter::ConvertAsset(sourcePath, baked) &&
+                MeshCache::Write(path, baked, ModelConverter::GetConverterSettingsHash(), compress);
+        }
+    };
+
+    // a root with a child that has a child of its own, none of them drawing anything
+    std::vector<MeshCache::NodeRecord> MakeNodes()
+    {
+        MeshCache::NodeRecord node = {};
+        node.isValid = true;
+        node.meshIndex = MeshCache::kInvalidIndex;
+        node.rotation[3] = 1.0f;
+        node.scale[0] = node.scale[1] = node.scale[2] = 1.0f;
+
+        std::vector<MeshCache::NodeRecord> nodes(3, node);
+        nodes[0].parentIndex = MeshCache::kInvalidIndex;
+        nodes[0].hasChildren = true;
+        nodes[1].parentIndex = 0;
+        nodes[1].hasChildren = true;
+        nodes[2].parentIndex = 1;
+        return nodes;
+    }
+
+    // every byte the upload would read, so the mapped pages are faulted in like at load time
+    uint64_t TouchMeshData(const MeshCache::BakedAsset& baked)
+    {
+        uint64_t sum = 0;
+        for (const Mesh& mesh : baked.meshes)
+        {
+            const byte* blobs[] = { mesh.VB, mesh.DepthVB, mesh.IB };
+            const uint32_t sizes[] = { mesh.sizeVB, mesh.sizeDepthVB, mesh.sizeIB };
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                for (uint32_t offset = 0; offset < sizes[i]; offset += 64)
+                    sum += blobs[i][offset];
+            }
+        }
+        return sum;
+    }
+
+    uint64_t TouchBytes(const byte* data, size_t size)
+    {
+        uint64_t sum = 0;
+        for (size_t offset = 0; offset < size; offset += 4096)
+            sum += data[offset];
+        return sum;
+    }
+
+    struct MemoryUsage
+    {
+        size_t workingSet;
+        size_t privateBytes;
+    };
+
+    MemoryUsage GetMemoryUsage()
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters));
+        return { counters.WorkingSetSize, counters.PrivateUsage };
+    }
+
+    // Growth of the working set and private bytes from a trimmed process to the moment load holds
+    // the most memory, what one way of loading the cache costs on its own
+    template<typename F>
+    MemoryUsage MeasurePeakGrowth(F&& load)
+    {
+        SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+        MemoryUsage before = GetMemoryUsage();
+        MemoryUsage peak = load();
+        auto Growth = [](size_t from, size_t to) { return to > from ? to - from : 0; };
+        return { Growth(before.workingSet, peak.workingSet), Growth(before.privateBytes, peak.privateBytes) };
+    }
+}
+
+// A baked cache reads back to the data it was written from, in both forms
+TEST_CASE(MeshCache_BakeRoundTrip)
+{
+    const std::filesystem::path sourcePath = FindBenchAsset();
+    if (sourcePath.empty())
+    {
+        printf("  skipped, %ls not found\n", kBenchAssets[0].c_str());
+        return;
+    }
+
+    const uint64_t settingsHash = ModelConverter::GetConverterSettingsHash();
+    for (bool compress : { false, true })
+    {
+        TempMeshCache cache("MeshCacheTests_RoundTrip.meshcache");
+        MeshCache::BakedAsset converted;
+        CHECK(cache.Bake(sourcePath, converted, compress));
+
+        MeshCache::BakedAsset baked;
+        CHECK(MeshCache::Read(cache.path, baked, settingsHash));
+        CHECK(!MeshCache::Read(cache.path, baked, settingsHash + 1));
+
+        CHECK_EQ(baked.meshes.size(), converted.meshes.size());
+        CHECK_EQ(baked.nodes.size(), converted.nodes.size());
+        CHECK_EQ(baked.materials.size(), converted.materials.size());
+        for (size_t i = 0; i < baked.meshes.size() && i < converted.meshes.size(); i++)
+        {
+            const Mesh& a = baked.meshes[i];
+            const Mesh& b = converted.meshes[i];
+            CHECK(a.sizeVB == b.sizeVB && a.sizeDepthVB == b.sizeDepthVB && a.sizeIB == b.sizeIB);
+            CHECK(a.subMeshCount == b.subMeshCount);
+            CHECK(memcmp(a.VB, b.VB, a.sizeVB) == 0);
+            CHECK(memcmp(a.DepthVB, b.DepthVB, a.sizeDepthVB) == 0);
+            CHECK(memcmp(a.IB, b.IB, a.sizeIB) == 0);
+        }
+    }
+}
+
+// Node records that point past the meshes or nodes, or at a parent that does not come first, reject
+// the cache so the scene is loaded from its glTF instead
+TEST_CASE(MeshCache_BadNodeIndicesFail)
+{
+    TempMeshCache cache("MeshCacheTests_Nodes.meshcache");
+    MeshCache::BakedAsset asset;
+    asset.nodes = MakeNodes();
+    CHECK(MeshCache::Write(cache.path, asset, 1));
+
+    MeshCache::BakedAsset baked;
+    CHECK(MeshCache::Read(cache.path, baked, 1));
+    CHECK_EQ(baked.nodes.size(), asset.nodes.size());
+
+    auto ReadsWith = [&](uint32_t node, uint32_t parentIndex, uint32_t meshIndex)
+    {
+        MeshCache::BakedAsset corrupt;
+        corrupt.nodes = MakeNodes();
+        corrupt.nodes[node].parentIndex = parentIndex;
+        corrupt.nodes[node].meshIndex = meshIndex;
+        MeshCache::BakedAsset read;
+        return MeshCache::Write(cache.path, corrupt, 1) && MeshCache::Read(cache.path, read, 1);
+    };
+
+    // there are no meshes, so any mesh index is out of range
+    CHECK(!ReadsWith(2, 1, 0));
+    CHECK(!ReadsWith(2, 1, 12345));
+    // past the nodes, the node itself and a node after it
+    CHECK(!ReadsWith(1, 3, MeshCache::kInvalidIndex));
+    CHECK(!ReadsWith(1, 1, MeshCache::kInvalidIndex));
+    CHECK(!ReadsWith(0, 2, MeshCache::kInvalidIndex));
+    // what the corrupt ones were changed from still reads
+    CHECK(ReadsWith(2, 0, MeshCache::kInvalidIndex));
+}
+
+// Load time of the scene geometry with and without a mesh cache, from the working directory or its parent
+BENCHMARK(MeshCache_LoadTime)
+{
+    const std::filesystem::path sourcePath = FindBenchAsset();
+    if (sourcePath.empty())
+    {
+        printf("  skipped, %ls not found\n", kBenchAssets[0].c_str());
+        return;
+    }
+
+    TempMeshCache cache("MeshCacheTests_LoadTime.meshcache");
+    const uint64_t settingsHash = ModelConverter::GetConverterSettingsHash();
+    MeshCache::BakedAsset converted;
+    if (!cache.Bake(sourcePath, converted))
+    {
+        printf("  skipped, %ls could not be baked\n", sourcePath.c_str());
+        return;
+    }
+    converted = MeshCache::BakedAsset();
+
+    // the files are in the OS cache after the first run, so these are warm numbers
+    double parseMs = Test::MeasureBestMs(3, [&]()
+    {
+        glTF::Asset asset(sourcePath);
+    });
+
+    double convertMs = Test::MeasureBestMs(3, [&]()
+    {
+        MeshCache::BakedAsset baked;
+        ModelConverter::ConvertAsset(sourcePath, baked);
+    });
+
+    uint64_t sink = 0;
+    size_t numMeshes = 0;
+    double readMs = Test::MeasureBestMs(5, [&]()
+    {
+        MeshCache::BakedAsset baked;
+        MeshCache::Read(cache.path, baked, settingsHash);
+        numMeshes = baked.meshes.size();
+    });
+
+    double readTouchMs = Test::MeasureBestMs(5, [&]()
+    {
+        MeshCache::BakedAsset baked;
+        MeshCache::Read(cache.path, baked, settingsHash);
+        sink += TouchMeshData(baked);
+    });
+
+    printf("  %ls, %zu meshes\n", sourcePath.c_str(), numMeshes);
+    printf("  %-34s %10.2f ms\n", "glTF parse", parseMs);
+    printf("  %-34s %10.2f ms\n", "glTF parse + mesh build (miss)", convertMs);
+    printf("  %-34s %10.2f ms\n", "mesh cache read (hit)", readMs);
+    printf("  %-34s %10.2f ms  (%.1fx faster than a miss)\n", "mesh cache read + touch all data", readTouchMs, convertMs / readTouchMs);
+    printf("  checksum %llu\n", (unsigned long long)sink);
+}
+
+// Mapping the cache against reading it into the heap, how long until every byte was seen and how much
+// memory that takes at its peak. Mapped pages come from the OS file cache and are shared, read ones are
+// private copies.
+BENCHMARK(MeshCache_MapFileVsReadFileSync)
+{
+    const std::filesystem::path sourcePath = FindBenchAsset();
+    if (sourcePath.empty())
+    {
+        printf("  skipped, %ls not found\n", kBenchAssets[0].c_str());
+        return;
+    }
+
+    TempMeshCache cache("MeshCacheTests_MapVsRead.meshcache");
+    {
+        MeshCache::BakedAsset converted;
+        if (!cache.Bake(sourcePath, converted))
+        {
+            printf("  skipped, %ls could not be baked\n", sourcePath.c_str());
+            return;
+        }
+    }
+
+    uint64_t sink = 0;
+    size_t fileSize = 0;
+    auto mapFile = [&]()
+    {
+        Utility::MappedFileRef file = Utility::MapFile(cache.path);
+        fileSize = file != nullptr ? file->size() : 0;
+        sink += file != nullptr ? TouchBytes(file->data(), file->size()) : 0;
+        return GetMemoryUsage();
+    };
+    auto readFile = [&]()
+    {
+        Utility::ByteArray file = Utility::ReadFileSync(cache.path);
+        sink += TouchBytes(file->data(), file->size());
+        return GetMemoryUsage();
+    };
+
+    // warm the OS file cache, both sides then read from memory
+    mapFile();
+
+    double mapMs = Test::MeasureBestMs(5, mapFile);
+    double readMs = Test::MeasureBestMs(5, readFile);
+    MemoryUsage mapPeak = MeasurePeakGrowth(mapFile);
+    MemoryUsage readPeak = MeasurePeakGrowth(readFile);
+
+    printf("  %ls, %.1f MB\n", cache.path.c_str(), fileSize / 1048576.0);
+    printf("  %-16s %10s %18s %18s\n", "", "load ms", "peak working set", "peak private");
+    printf("  %-16s %10.2f %15.1f MB %15.1f MB\n", "MapFile", mapMs, mapPeak.workingSet / 1048576.0, mapPeak.privateBytes / 1048576.0);
+    printf("  %-16s %10.2f %15.1f MB %15.1f MB\n", "ReadFileSync", readMs, readPeak.workingSet / 1048576.0, readPeak.privateBytes / 1048576.0);
+    printf("  checksum %llu\n", (unsigned long long)sink);
+}
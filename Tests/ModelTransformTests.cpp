@@ -0,0 +1,156 @@
+#include "TestFramework.h"
+#include "ConstantBuffer.h"
+
+#include <cmath>
+
+namespace
+{
+    struct Float3
+    {
+        float x, y, z;
+    };
+
+    float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    Float3 Cross(const Float3& a, const Float3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    float Length(const Float3& a) { return std::sqrt(Dot(a, a)); }
+
+    // GetMeshInstance of MeshInstance.hlsli on the CPU: positions through the rows, normals through
+    // the cofactors of the basis columns signed by the determinant
+    struct DecodedInstance
+    {
+        float rows[3][4];
+        Float3 cofactors[3];
+        float detSign;
+
+        explicit DecodedInstance(const ModelTransform& transform)
+        {
+            for (int r = 0; r < 3; r++)
+            {
+                for (int c = 0; c < 4; c++)
+                    rows[r][c] = transform.World.m[r][c];
+            }
+
+            Float3 axisX = { rows[0][0], rows[1][0], rows[2][0] };
+            Float3 axisY = { rows[0][1], rows[1][1], rows[2][1] };
+            Float3 axisZ = { rows[0][2], rows[1][2], rows[2][2] };
+            cofactors[0] = Cross(axisY, axisZ);
+            cofactors[1] = Cross(axisZ, axisX);
+            cofactors[2] = Cross(axisX, axisY);
+            detSign = Dot(axisX, cofactors[0]) < 0.0f ? -1.0f : 1.0f;
+        }
+
+        // mul(worldMatrix, float4(p, 1))
+        Float3 TransformPoint(const Float3& p) const
+        {
+            float out[3];
+            for (int r = 0; r < 3; r++)
+                out[r] = rows[r][0] * p.x + rows[r][1] * p.y + rows[r][2] * p.z + rows[r][3];
+            return { out[0], out[1], out[2] };
+        }
+
+        Float3 TransformVector(const Float3& v) const
+        {
+            float out[3];
+            for (int r = 0; r < 3; r++)
+                out[r] = rows[r][0] * v.x + rows[r][1] * v.y + rows[r][2] * v.z;
+            return { out[0], out[1], out[2] };
+        }
+
+        // mul(worldITMatrix, n), the transpose puts the cofactors in the columns
+        Float3 TransformNormal(const Float3& n) const
+        {
+            return {
+                detSign * (cofactors[0].x * n.x + cofactors[1].x * n.y + cofactors[2].x * n.z),
+                detSign * (cofactors[0].y * n.x + cofactors[1].y * n.y + cofactors[2].y * n.z),
+                detSign * (cofactors[0].z * n.x + cofactors[1].z * n.y + cofactors[2].z * n.z) };
+        }
+    };
+
+    Float3 ToFloat3(Math::Vector3 v) { return { (float)v.GetX(), (float)v.GetY(), (float)v.GetZ() }; }
+
+    bool IsNear(const Float3& a, const Float3& b, float tolerance)
+    {
+        float scale = std::fmax(1.0f, std::fmax(Length(a), Length(b)));
+        return std::fabs(a.x - b.x) <= tolerance * scale && std::fabs(a.y - b.y) <= tolerance * scale &&
+            std::fabs(a.z - b.z) <= tolerance * scale;
+    }
+
+    std::vector<Math::AffineTransform> MakeTransforms()
+    {
+        using namespace Math;
+        std::vector<AffineTransform> transforms;
+        transforms.push_back(AffineTransform(kIdentity));
+        transforms.push_back(AffineTransform(Vector3(10.0f, -20.0f, 30.0f)));
+        transforms.push_back(AffineTransform(Matrix3::MakeYRotation(0.7f) * Matrix3::MakeScale(2.5f), Vector3(1.0f, 2.0f, 3.0f)));
+        transforms.push_back(AffineTransform(Matrix3::MakeXRotation(-1.2f) * Matrix3::MakeScale(1.0f, 3.0f, 0.25f), Vector3(-4.0f, 0.0f, 8.0f)));
+        // mirrored, the winding and the normals flip together
+        transforms.push_back(AffineTransform(Matrix3::MakeZRotation(0.3f) * Matrix3::MakeScale(-1.0f, 1.0f, 1.0f), Vector3(0.0f, 5.0f, 0.0f)));
+        // sheared, normals are no longer the transformed normal directions
+        transforms.push_back(AffineTransform(Vector3(1.0f, 0.0f, 0.0f), Vector3(0.5f, 1.0f, 0.0f), Vector3(0.0f, 0.3f, 2.0f), Vector3(7.0f, -7.0f, 7.0f)));
+        // far from the origin, where float translation precision matters
+        transforms.push_back(AffineTransform(Matrix3::MakeYRotation(2.0f), Vector3(1.0e5f, -3.0e4f, 2.5e5f)));
+        return transforms;
+    }
+
+    const Float3 kTestPoints[] = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 2.0f, 3.0f }, { -5.0f, 0.5f, 11.0f }, { 100.0f, -100.0f, 0.25f } };
+    const Float3 kTestNormals[] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.6f, 0.0f, 0.8f }, { -0.48f, 0.6f, 0.64f } };
+}
+
+TEST_CASE(ModelTransform_RowsHoldTheAffineMatrix)
+{
+    // row r is component r of the X, Y, Z basis vectors and the translation, 12 floats with no padding
+    for (const Math::AffineTransform& world : MakeTransforms())
+    {
+        ModelTransform transform = ModelTransform::Encode(world);
+        const Float3 columns[4] = { ToFloat3(world.GetX()), ToFloat3(world.GetY()), ToFloat3(world.GetZ()), ToFloat3(world.GetTranslation()) };
+        bool isExact = true;
+        for (int c = 0; c < 4; c++)
+        {
+            isExact = isExact && transform.World.m[0][c] == columns[c].x && transform.World.m[1][c] == columns[c].y &&
+                transform.World.m[2][c] == columns[c].z;
+        }
+        CHECK(isExact);
+        CHECK(&transform.World.m[1][0] == &transform.World.m[0][0] + 4);
+    }
+}
+
+TEST_CASE(ModelTransform_DecodeRoundTrip)
+{
+    for (const Math::AffineTransform& world : MakeTransforms())
+    {
+        DecodedInstance decoded(ModelTransform::Encode(world));
+
+        // positions come back as the affine transform would place them
+        for (const Float3& p : kTestPoints)
+        {
+            Float3 expected = ToFloat3(world * Math::Vector3(p.x, p.y, p.z));
+            CHECK(IsNear(decoded.TransformPoint(p), expected, 1e-6f));
+        }
+
+        // a normal stays perpendicular to every transformed tangent and on the outer side of the
+        // transformed surface, which is what the inverse transpose guarantees, mirrored or not
+        for (const Float3& n : kTestNormals)
+        {
+            Float3 normal = decoded.TransformNormal(n);
+            float normalLength = Length(normal);
+            CHECK(normalLength > 0.0f);
+
+            Float3 tangent = Cross(n, std::fabs(n.x) < 0.9f ? Float3{ 1.0f, 0.0f, 0.0f } : Float3{ 0.0f, 1.0f, 0.0f });
+            Float3 bitangent = Cross(n, tangent);
+            for (const Float3& t : { tangent, bitangent })
+            {
+                Float3 tangentWS = decoded.TransformVector(t);
+                CHECK(std::fabs(Dot(normal, tangentWS)) <= 1e-5f * normalLength * Length(tangentWS));
+            }
+            CHECK(Dot(normal, decoded.TransformVector(n)) > 0.0f);
+
+            // and it points where the CPU side inverse transpose does
+            Float3 reference = ToFloat3(Math::InverseTranspose(world.GetBasis()) * Math::Vector3(n.x, n.y, n.z));
+            Float3 direction = { normal.x / normalLength, normal.y / normalLength, normal.z / normalLength };
+            float referenceLength = Length(reference);
+            Float3 referenceDirection = { reference.x / referenceLength, reference.y / referenceLength, reference.z / referenceLength };
+            float detSign = decoded.detSign;
+            CHECK(IsNear(direction, { detSign * referenceDirection.x, detSign * referenceDirection.y, detSign * referenceDirection.z }, 1e-5f));
+        }
+    }
+}
@@ -0,0 +1,402 @@
+#include "TestFramework.h"
+#include "Utils/OffsetAllocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+using Utility::OffsetAllocator;
+
+namespace
+{
+    // Free ranges in offset order, the first one that fits is split. Stands in for a plain free list.
+    class FirstFitAllocator
+    {
+    public:
+        explicit FirstFitAllocator(uint32_t size) { mFreeRanges[0] = size; }
+
+        uint32_t Allocate(uint32_t size)
+        {
+            for (auto iter = mFreeRanges.begin(); iter != mFreeRanges.end(); ++iter)
+            {
+                if (iter->second < size)
+                    continue;
+
+                uint32_t offset = iter->first;
+                uint32_t remainder = iter->second - size;
+                mFreeRanges.erase(iter);
+                if (remainder > 0)
+                    mFreeRanges[offset + size] = remainder;
+                return offset;
+            }
+            return OffsetAllocator::kInvalidOffset;
+        }
+
+        void Free(uint32_t offset, uint32_t size)
+        {
+            auto next = mFreeRanges.lower_bound(offset);
+            if (next != mFreeRanges.end() && next->first == offset + size)
+            {
+                size += next->second;
+                next = mFreeRanges.erase(next);
+            }
+            if (next != mFreeRanges.begin())
+            {
+                auto prev = std::prev(next);
+                if (prev->first + prev->second == offset)
+                {
+                    prev->second += size;
+                    return;
+                }
+            }
+            mFreeRanges[offset] = size;
+        }
+
+        OffsetAllocator::Report GetReport() const
+        {
+            OffsetAllocator::Report report = {};
+            for (auto& range : mFreeRanges)
+            {
+                report.freeSize += range.second;
+                report.largestFreeSize = std::max(report.largestFreeSize, range.second);
+                report.numFreeRanges++;
+            }
+            return report;
+        }
+    private:
+        std::map<uint32_t, uint32_t> mFreeRanges; // offset, size
+    };
+
+    // longest run of free units and the number of runs, what the allocator's report has to agree with
+    void ScanFreeRuns(const std::vector<uint32_t>& owners, uint32_t& largestRun, uint32_t& numRuns)
+    {
+        largestRun = 0;
+        numRuns = 0;
+        uint32_t run = 0;
+        for (uint32_t owner : owners)
+        {
+            run = owner == 0 ? run + 1 : 0;
+            numRuns += run == 1;
+            largestRun = std::max(largestRun, run);
+        }
+    }
+}
+
+TEST_CASE(OffsetAllocator_SizeClassesAndGrow)
+{
+    OffsetAllocator allocator(100, 8);
+    OffsetAllocator::Allocation a = allocator.Allocate(10);
+    OffsetAllocator::Allocation b = allocator.Allocate(20);
+    OffsetAllocator::Allocation c = allocator.Allocate(30);
+    CHECK(a.offset == 0 && b.offset == 10 && c.offset == 30);
+    CHECK_EQ(allocator.GetFreeSize(), 40u);
+
+    // freed ranges merge with free neighbours only
+    allocator.Free(b);
+    CHECK_EQ(allocator.GetReport().numFreeRanges, 2u);
+    allocator.Free(a);
+    OffsetAllocator::Report report = allocator.GetReport();
+    CHECK(report.numFreeRanges == 2 && report.largestFreeSize == 40 && report.numAllocations == 1);
+
+    // the smallest class a request fits takes it, not the lowest range
+    OffsetAllocator::Allocation low = allocator.Allocate(3);
+    OffsetAllocator::Allocation fit = allocator.Allocate(24);
+    CHECK(low.offset == 0 && fit.offset == 3);
+
+    // the walk for a compaction goes down the live ranges from the top
+    CHECK_EQ(allocator.GetLastAllocation().offset, 30u);
+    CHECK_EQ(allocator.GetPrevAllocation(allocator.GetLastAllocation()).offset, 3u);
+    CHECK_EQ(allocator.GetPrevAllocation(fit).offset, 0u);
+    CHECK(!allocator.GetPrevAllocation(low).IsValid());
+
+    // a free range is filed under the class its size rounds down to, so 27 free units in the class
+    // that starts at 26 only take requests of up to 26
+    OffsetAllocator classes(64, 4);
+    OffsetAllocator::Allocation exact = classes.Allocate(27);
+    CHECK_EQ(classes.Allocate(32).offset, 27u);
+    classes.Free(exact);
+    CHECK_EQ(OffsetAllocator::GetBinSize(OffsetAllocator::GetBinRoundDown(27)), 26u);
+    CHECK(!classes.Allocate(27).IsValid());
+    CHECK_EQ(classes.Allocate(26).offset, 0u);
+
+    // growing under a used top range adds a free one above it
+    OffsetAllocator full(64, 4);
+    OffsetAllocator::Allocation whole = full.Allocate(64);
+    CHECK(!full.Allocate(1).IsValid());
+    full.Grow(100);
+    CHECK(full.GetSize() == 100 && full.GetFreeSize() == 36);
+    CHECK_EQ(full.GetLastAllocation().offset, whole.offset);
+    CHECK_EQ(full.Allocate(36).offset, 64u);
+
+    // and over a free top range extends it, nodes and offsets of the live ranges stay
+    OffsetAllocator topFree(64, 4);
+    OffsetAllocator::Allocation first = topFree.Allocate(16);
+    topFree.Grow(128);
+    report = topFree.GetReport();
+    CHECK(report.numFreeRanges == 1 && report.largestFreeSize == 112);
+    topFree.Free(first);
+    report = topFree.GetReport();
+    CHECK(report.numFreeRanges == 1 && report.largestFreeSize == 128 && report.numAllocations == 0);
+
+    // an empty allocator grows from nothing
+    OffsetAllocator empty(0, 4);
+    CHECK(!empty.Allocate(1).IsValid() && !empty.GetLastAllocation().IsValid());
+    empty.Grow(48);
+    CHECK_EQ(empty.Allocate(48).offset, 0u);
+    CHECK_EQ(empty.GetFreeSize(), 0u);
+}
+
+TEST_CASE(OffsetAllocator_RandomChurn)
+{
+    // Random allocations and frees of sizes from one unit to a few thousand, checked against a map of
+    // the owner of every unit. The heap grows now and then the way a mesh heap does. Ranges must
+    // never overlap, free ranges must always be merged, a failed allocation must only happen when no
+    // free range is a size class above the request and the walk from the top must see every live
+    // range in order.
+    const uint32_t kMaxAllocations = 512;
+    OffsetAllocator allocator(1 << 15, kMaxAllocations);
+    Test::Random random = { 11 };
+    std::vector<uint32_t> owners(allocator.GetSize(), 0);
+    std::vector<std::pair<OffsetAllocator::Allocation, uint32_t>> live; // allocation, owner
+    uint32_t modelFreeSize = allocator.GetSize();
+    uint32_t nextOwner = 1;
+    uint32_t numFailed = 0;
+    uint32_t numGrows = 0;
+    bool isConsistent = true;
+
+    for (uint32_t step = 0; step < 40000 && isConsistent; step++)
+    {
+        if (!live.empty() && random.Next(100) < 48)
+        {
+            size_t i = random.Next((uint32_t)live.size());
+            OffsetAllocator::Allocation allocation = live[i].first;
+            uint32_t size = allocator.GetAllocationSize(allocation);
+            for (uint32_t unit = allocation.offset; unit < allocation.offset + size; unit++)
+            {
+                isConsistent = isConsistent && owners[unit] == live[i].second;
+                owners[unit] = 0;
+            }
+            allocator.Free(allocation);
+            modelFreeSize += size;
+            live[i] = live.back();
+            live.pop_back();
+        }
+        else
+        {
+            uint32_t size = random.Next(16) == 0 ? 1 + random.Next(4000) : 1 + random.Next(300);
+            OffsetAllocator::Allocation allocation = allocator.Allocate(size);
+            if (allocation.IsValid())
+            {
+                isConsistent = allocation.offset + size <= allocator.GetSize() && allocator.GetAllocationSize(allocation) == size;
+                for (uint32_t unit = allocation.offset; unit < allocation.offset + size && isConsistent; unit++)
+                {
+                    isConsistent = owners[unit] == 0;
+                    owners[unit] = nextOwner;
+                }
+                modelFreeSize -= size;
+                live.push_back({ allocation, nextOwner++ });
+            }
+            else
+            {
+                uint32_t largestRun, numRuns;
+                ScanFreeRuns(owners, largestRun, numRuns);
+                uint32_t fitSize = OffsetAllocator::GetBinSize(OffsetAllocator::GetBinRoundUp(size));
+                isConsistent = largestRun < fitSize || live.size() == kMaxAllocations;
+                numFailed++;
+            }
+        }
+
+        if (step % 5000 == 4999)
+        {
+            uint32_t newSize = allocator.GetSize() + 1 + random.Next(1 << 13);
+            allocator.Grow(newSize);
+            modelFreeSize += newSize - (uint32_t)owners.size();
+            owners.resize(newSize, 0);
+            numGrows++;
+        }
+
+        isConsistent = isConsistent && allocator.GetFreeSize() == modelFreeSize;
+        if (step % 64 == 0 && isConsistent)
+        {
+            uint32_t largestRun, numRuns;
+            ScanFreeRuns(owners, largestRun, numRuns);
+            OffsetAllocator::Report report = allocator.GetReport();
+            isConsistent = report.largestFreeSize == largestRun && report.numFreeRanges == numRuns && report.numAllocations == live.size();
+
+            uint32_t numWalked = 0;
+            uint32_t lastOffset = OffsetAllocator::kInvalidOffset;
+            for (OffsetAllocator::Allocation allocation = allocator.GetLastAllocation(); allocation.IsValid() && isConsistent;
+                allocation = allocator.GetPrevAllocation(allocation))
+            {
+                isConsistent = allocation.offset < lastOffset && owners[allocation.offset] != 0;
+                lastOffset = allocation.offset;
+                numWalked++;
+            }
+            isConsistent = isConsistent && numWalked == live.size();
+        }
+    }
+    CHECK(isConsistent);
+
+    // the heap has to have run full and grown for the checks to mean anything
+    CHECK(numFailed > 100);
+    CHECK_EQ(numGrows, 8u);
+
+    for (auto& entry : live)
+        allocator.Free(entry.first);
+    OffsetAllocator::Report report = allocator.GetReport();
+    CHECK(report.numFreeRanges == 1 && report.largestFreeSize == allocator.GetSize());
+}
+
+BENCHMARK(OffsetAllocator_MeshChurnFragmentation)
+{
+    // Mesh sized ranges, 1 KB to 2 MB in 16 byte units with small meshes the most common, in a 256 MB
+    // heap filled to about three quarters. Then meshes are swapped out one for one. Reported are the
+    // failed allocations, the largest free range against all free space and the time per operation.
+    // The size class allocator runs alone and with MeshManager's compaction moving up to 2 MB every 16
+    // swaps, a frame's worth. A first fit free list is the baseline.
+    const uint32_t kHeapSize = (256u << 20) / 16;
+    const uint32_t kSteps = 200000;
+    const uint32_t kSwapsPerFrame = 16;
+    const uint32_t kMoveBudget = (2u << 20) / 16;
+
+    auto meshSize = [](Test::Random& random)
+    {
+        // log uniform over 64 .. 128K units
+        return (uint32_t)std::exp2(6.0 + random.Next(1 << 16) * (11.0 / 65536.0));
+    };
+
+    struct Result
+    {
+        double ms;
+        uint32_t numFailed;
+        uint32_t numMoves;
+        OffsetAllocator::Report report;
+    };
+
+    auto runSizeClasses = [&](bool compact)
+    {
+        Result result = {};
+        OffsetAllocator allocator(kHeapSize, 16 * 1024);
+        std::vector<OffsetAllocator::Allocation> live;
+        std::vector<uint32_t> nodeSlots(allocator.GetMaxNodes(), 0); // slot in live of each node
+        Test::Random random = { 5 };
+
+        auto allocate = [&](uint32_t size)
+        {
+            OffsetAllocator::Allocation allocation = allocator.Allocate(size);
+            if (!allocation.IsValid())
+            {
+                result.numFailed++;
+                return;
+            }
+            nodeSlots[allocation.node] = (uint32_t)live.size();
+            live.push_back(allocation);
+        };
+
+        while (allocator.GetFreeSize() > kHeapSize / 4)
+            allocate(meshSize(random));
+
+        result.ms = Test::MeasureMs([&]()
+        {
+            for (uint32_t step = 0; step < kSteps; step++)
+            {
+                uint32_t i = random.Next((uint32_t)live.size());
+                allocator.Free(live[i]);
+                live[i] = live.back();
+                nodeSlots[live[i].node] = i;
+                live.pop_back();
+                allocate(meshSize(random));
+
+                if (!compact || step % kSwapsPerFrame != 0)
+                    continue;
+
+                // the same walk as MeshManager::StartHeapMoves, a copy lands at once here
+                uint32_t moved = 0;
+                for (OffsetAllocator::Allocation allocation = allocator.GetLastAllocation(); allocation.IsValid();)
+                {
+                    OffsetAllocator::Allocation prev = allocator.GetPrevAllocation(allocation);
+                    uint32_t size = allocator.GetAllocationSize(allocation);
+                    if (moved + size <= kMoveBudget)
+                    {
+                        OffsetAllocator::Allocation target = allocator.Allocate(size);
+                        if (!target.IsValid())
+                            break;
+                        if (target.offset < allocation.offset)
+                        {
+                            uint32_t slot = nodeSlots[allocation.node];
+                            allocator.Free(allocation);
+                            live[slot] = target;
+                            nodeSlots[target.node] = slot;
+                            moved += size;
+                            result.numMoves++;
+                        }
+                        else
+                        {
+                            allocator.Free(target);
+                        }
+                    }
+                    allocation = prev;
+                }
+            }
+        });
+        result.report = allocator.GetReport();
+        return result;
+    };
+
+    auto runFirstFit = [&]()
+    {
+        Result result = {};
+        FirstFitAllocator allocator(kHeapSize);
+        std::vector<std::pair<uint32_t, uint32_t>> live; // offset, size
+        Test::Random random = { 5 };
+        uint64_t freeSize = kHeapSize;
+
+        auto allocate = [&](uint32_t size)
+        {
+            uint32_t offset = allocator.Allocate(size);
+            if (offset == OffsetAllocator::kInvalidOffset)
+            {
+                result.numFailed++;
+                return;
+            }
+            live.push_back({ offset, size });
+            freeSize -= size;
+        };
+
+        while (freeSize > kHeapSize / 4)
+            allocate(meshSize(random));
+
+        result.ms = Test::MeasureMs([&]()
+        {
+            for (uint32_t step = 0; step < kSteps; step++)
+            {
+                uint32_t i = random.Next((uint32_t)live.size());
+                allocator.Free(live[i].first, live[i].second);
+                freeSize += live[i].second;
+                live[i] = live.back();
+                live.pop_back();
+                allocate(meshSize(random));
+            }
+        });
+        result.report = allocator.GetReport();
+        return result;
+    };
+
+    Result results[] = { runSizeClasses(false), runSizeClasses(true), runFirstFit() };
+    const char* names[] = { "size classes", "+ compaction", "first fit" };
+
+    printf("  %u swaps of mesh sized ranges in a %u MB heap\n", kSteps, (kHeapSize * 16) >> 20);
+    printf("  %14s %10s %12s %14s %12s %10s\n", "", "failed", "free MB", "largest MB", "free ranges", "ns/op");
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        const Result& result = results[i];
+        printf("  %14s %10u %12.1f %14.1f %12u %10.0f\n", names[i], result.numFailed,
+            result.report.freeSize * 16.0 / 1048576.0, result.report.largestFreeSize * 16.0 / 1048576.0,
+            result.report.numFreeRanges, result.ms * 1e6 / (2.0 * kSteps));
+    }
+    printf("  %u compaction moves\n", results[1].numMoves);
+
+    // moving the top ranges down leaves the free space in one piece at the top
+    CHECK(results[1].report.largestFreeSize > results[0].report.largestFreeSize);
+    CHECK(results[1].numFailed <= results[0].numFailed);
+}
@@ -0,0 +1,113 @@
+#include "TestFramework.h"
+#include "Utils/RadixSort.h"
+#include "Utils/ThreadPoolExecutor.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    // Keys packed like MeshRenderer's: pass in the top 4 bits, objectIdx in the low 16, the policy
+    // fields between. Distances are positive float bits, a few hundred PSOs and materials per scene.
+    enum eKeyLayout { kFrontToBack, kStateOrdered, kNumKeyLayouts };
+    const char* const kKeyLayoutNames[kNumKeyLayouts] = { "front to back", "state ordered" };
+
+    std::vector<uint64_t> MakeDrawKeys(eKeyLayout layout, size_t count, uint32_t seed)
+    {
+        std::vector<uint64_t> keys(count);
+        Test::Random random = { seed };
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint64_t pass = i % 3;
+            uint64_t objectIdx = i & 0xffff;
+            uint64_t pso = random.NextBits() % 300;
+            uint64_t key = (pass << 60) | objectIdx;
+            if (layout == kFrontToBack)
+            {
+                // 1 to 1024 units away
+                float distance = 1.0f + (float)(random.NextBits() >> 8) / (float)(1 << 14);
+                uint32_t distanceBits;
+                memcpy(&distanceBits, &distance, sizeof(distanceBits));
+                key |= ((uint64_t)distanceBits << 28) | (pso << 16);
+            }
+            else
+            {
+                uint64_t material = random.NextBits() % 1000;
+                uint64_t mesh = random.NextBits() % 40;
+                uint64_t bucket = random.NextBits() % 20;
+                key |= (pso << 48) | (material << 33) | (mesh << 21) | (bucket << 16);
+            }
+            keys[i] = key;
+        }
+        return keys;
+    }
+
+    bool SortsLikeStdSort(std::vector<uint64_t> keys)
+    {
+        std::vector<uint64_t> expected = keys;
+        std::sort(expected.begin(), expected.end());
+        std::vector<uint64_t> scratch(keys.size());
+        Utility::RadixSort(keys.data(), keys.size(), scratch.data());
+        return keys == expected;
+    }
+}
+
+TEST_CASE(RadixSort_MatchesStdSort)
+{
+    // the std::sort cut, the single threaded passes and the parallel ones
+    const size_t sizes[] = { 0, 1, 2, Utility::kRadixSortSmallThreshold, Utility::kRadixSortSmallThreshold + 1,
+        5000, Utility::kRadixSortParallelThreshold, 200000 };
+    for (size_t size : sizes)
+    {
+        for (uint32_t layout = 0; layout < kNumKeyLayouts; layout++)
+            CHECK(SortsLikeStdSort(MakeDrawKeys((eKeyLayout)layout, size, (uint32_t)size + layout)));
+    }
+
+    // every digit varies, and every digit but the top one is constant
+    std::vector<uint64_t> full(70000);
+    Test::Random random = { 1 };
+    for (uint64_t& key : full)
+    {
+        uint64_t high = random.NextBits();
+        key = (high << 32) | random.NextBits();
+    }
+    CHECK(SortsLikeStdSort(full));
+
+    std::vector<uint64_t> topOnly(70000);
+    for (size_t i = 0; i < topOnly.size(); i++)
+        topOnly[i] = (uint64_t)((i * 7919) & 0xff) << 56;
+    CHECK(SortsLikeStdSort(topOnly));
+}
+
+// The draw key sort of one frame at growing scene sizes, up to 64k objects in each of 3 passes
+BENCHMARK(RadixSort_DrawKeys)
+{
+    const size_t sizes[] = { 256, 2048, 16384, 65536, 3 * 65536 };
+
+    printf("  %u pool threads, ms per sort\n", (uint32_t)Utility::gThreadPoolExecutor.GetThreadCount());
+    printf("  %-14s %8s %12s %12s %12s\n", "layout", "keys", "std::sort", "RadixSort", "speedup");
+    for (uint32_t layout = 0; layout < kNumKeyLayouts; layout++)
+    {
+        for (size_t size : sizes)
+        {
+            const std::vector<uint64_t> source = MakeDrawKeys((eKeyLayout)layout, size, 42);
+            std::vector<uint64_t> keys(size);
+            std::vector<uint64_t> scratch(size);
+            uint32_t numRuns = size < 16384 ? 50 : 10;
+
+            double stdSortMs = Test::MeasureBestMs(numRuns, [&]()
+            {
+                keys = source;
+                std::sort(keys.begin(), keys.end());
+            });
+            double radixMs = Test::MeasureBestMs(numRuns, [&]()
+            {
+                keys = source;
+                Utility::RadixSort(keys.data(), keys.size(), scratch.data());
+            });
+
+            printf("  %-14s %8zu %12.3f %12.3f %11.1fx\n", kKeyLayoutNames[layout], size, stdSortMs, radixMs, stdSortMs / radixMs);
+        }
+    }
+}
@@ -0,0 +1,194 @@
+#include "TestFramework.h"
+#include "ResourceStateSet.h"
+#include "Utils/Hash.h"
+
+#include <map>
+#include <memory>
+#include <algorithm>
+
+namespace
+{
+    const D3D12_RESOURCE_STATES kStates[] = { D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST,
+        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_DEPTH_WRITE };
+
+    // what the set must agree with, current state per resource
+    using StateModel = std::map<const GpuResource*, D3D12_RESOURCE_STATES>;
+
+    bool Matches(ResourceStateSet& set, const StateModel& model, const std::vector<std::unique_ptr<GpuResource>>& resources)
+    {
+        if (set.GetSize() != model.size())
+            return false;
+
+        // iteration visits every live entry once
+        StateModel seen;
+        for (ResourceStateCache& stateCache : set)
+        {
+            if (!seen.emplace(&stateCache.mGpuResource, stateCache.mStateCurrent).second)
+                return false;
+        }
+        if (seen != model)
+            return false;
+
+        // and lookups find exactly those
+        for (const std::unique_ptr<GpuResource>& resource : resources)
+        {
+            ResourceStateCache* stateCache = set.Find(*resource);
+            auto modelIter = model.find(resource.get());
+            if ((stateCache != nullptr) != (modelIter != model.end()))
+                return false;
+            if (stateCache != nullptr && stateCache->mStateCurrent != modelIter->second)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST_CASE(ResourceStateSet_MatchesMapModel)
+{
+    // slots of destroyed resources are handed out again, the sets must not mistake the new owner
+    // for the old one
+    std::vector<std::unique_ptr<GpuResource>> resources;
+    for (uint32_t i = 0; i < 64; i++)
+        resources.push_back(std::make_unique<GpuResource>());
+
+    ResourceStateSet sets[2];
+    StateModel models[2];
+    Test::Random random = { 23 };
+    bool isConsistent = true;
+    for (uint32_t step = 0; step < 20000 && isConsistent; step++)
+    {
+        uint32_t s = random.Next(2);
+        ResourceStateSet& set = sets[s];
+        StateModel& model = models[s];
+        uint32_t op = random.Next(100);
+        if (op < 60)
+        {
+            // a transition, the way CommandList records one
+            GpuResource& resource = *resources[random.Next((uint32_t)resources.size())];
+            D3D12_RESOURCE_STATES state = kStates[random.Next(_countof(kStates))];
+            set.FindOrAdd(resource).mStateCurrent = state;
+            model[&resource] = state;
+        }
+        else if (op < 90)
+        {
+            GpuResource& resource = *resources[random.Next((uint32_t)resources.size())];
+            ResourceStateCache* stateCache = set.Find(resource);
+            isConsistent = (stateCache != nullptr) == (model.count(&resource) != 0);
+        }
+        else if (op < 95)
+        {
+            set.Clear();
+            model.clear();
+        }
+        else if (op < 97)
+        {
+            sets[0].Swap(sets[1]);
+            std::swap(models[0], models[1]);
+        }
+        else
+        {
+            // resources only go away once no list tracks them any more
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                sets[i].Clear();
+                models[i].clear();
+            }
+            for (uint32_t i = 0; i < 8; i++)
+                resources[random.Next((uint32_t)resources.size())] = std::make_unique<GpuResource>();
+        }
+
+        if (step % 97 == 0)
+            isConsistent = isConsistent && Matches(sets[0], models[0], resources) && Matches(sets[1], models[1], resources);
+    }
+    CHECK(isConsistent);
+    CHECK(Matches(sets[0], models[0], resources));
+    CHECK(Matches(sets[1], models[1], resources));
+}
+
+TEST_CASE(ResourceStateSet_AddKeepsEntryState)
+{
+    GpuResource first;
+    GpuResource second;
+    ResourceStateSet set;
+
+    // Add copies the whole entry, the frame merge relies on the begin state surviving it
+    ResourceStateCache stateCache(first);
+    stateCache.mStateCurrent = D3D12_RESOURCE_STATE_RENDER_TARGET;
+    stateCache.mStateBegin = D3D12_RESOURCE_STATE_COPY_DEST;
+    set.Add(stateCache);
+    CHECK(set.Find(first) != nullptr && set.Find(first)->mStateBegin == D3D12_RESOURCE_STATE_COPY_DEST);
+    CHECK(set.Find(second) == nullptr);
+
+    // FindOrAdd starts a new entry from the resource's own state
+    ResourceStateCache& added = set.FindOrAdd(second);
+    CHECK(&added.mGpuResource == &second);
+    CHECK(added.mStateCurrent == D3D12_RESOURCE_STATE_COMMON);
+    CHECK(&set.FindOrAdd(second) == &added);
+    CHECK_EQ(set.GetSize(), 2u);
+
+    // a resource made after the set was sized grows the sparse array on its first Add
+    GpuResource late;
+    set.FindOrAdd(late).mStateCurrent = D3D12_RESOURCE_STATE_DEPTH_WRITE;
+    CHECK(set.Find(late) != nullptr && set.Find(late)->mStateCurrent == D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+    set.Clear();
+    CHECK_EQ(set.GetSize(), 0u);
+    CHECK(set.Find(first) == nullptr && set.Find(second) == nullptr && set.Find(late) == nullptr);
+}
+
+// One command list worth of transitions over 10k resources: every draw looks up a handful of them,
+// then the list walks its set to publish the states and clears it for reuse. Against the std::map
+// keyed on the hashed GpuResource bytes that the lists used before.
+BENCHMARK(ResourceStateSet_10kResources)
+{
+    const uint32_t kNumResources = 10000;
+    std::vector<std::unique_ptr<GpuResource>> resources;
+    for (uint32_t i = 0; i < kNumResources; i++)
+        resources.push_back(std::make_unique<GpuResource>());
+
+    printf("  ms per list of lookups over %u resources\n", kNumResources);
+    printf("  %10s %10s %12s %12s\n", "lookups", "touched", "sparse set", "std::map");
+    const uint32_t lookupCounts[] = { 1000, 20000, 100000 };
+    for (uint32_t numLookups : lookupCounts)
+    {
+        // a working set that grows with the list, revisited the way draws reuse textures
+        Test::Random random = { numLookups };
+        std::vector<GpuResource*> lookups(numLookups);
+        uint32_t workingSet = std::min(kNumResources, numLookups / 4);
+        for (GpuResource*& resource : lookups)
+            resource = resources[random.Next(workingSet)].get();
+
+        ResourceStateSet set;
+        size_t numTouched = 0;
+        double setMs = Test::MeasureBestMs(10, [&]()
+        {
+            for (GpuResource* resource : lookups)
+                set.FindOrAdd(*resource).mStateCurrent = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+            numTouched = 0;
+            for (ResourceStateCache& stateCache : set)
+                numTouched += stateCache.mStateCurrent != D3D12_RESOURCE_STATE_COMMON;
+            set.Clear();
+        });
+
+        std::map<size_t, ResourceStateCache> map;
+        size_t numMapTouched = 0;
+        double mapMs = Test::MeasureBestMs(10, [&]()
+        {
+            for (GpuResource* resource : lookups)
+            {
+                size_t resourceHash = Utility::HashState(resource);
+                auto findIter = map.find(resourceHash);
+                if (findIter == map.end())
+                    findIter = map.emplace(resourceHash, *resource).first;
+                findIter->second.mStateCurrent = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+            }
+            numMapTouched = 0;
+            for (auto& entry : map)
+                numMapTouched += entry.second.mStateCurrent != D3D12_RESOURCE_STATE_COMMON;
+            map.clear();
+        });
+
+        CHECK_EQ(numTouched, numMapTouched);
+        printf("  %10u %10zu %12.3f %12.3f\n", numLookups, numTouched, setMs, mapMs);
+    }
+}
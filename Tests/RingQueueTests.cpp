@@ -0,0 +1,275 @@
+#include "TestFramework.h"
+#include "Utils/MPMCRingQueue.h"
+#include "Utils/LinkedBlockQueue.h"
+#include "Utils/ThreadPoolExecutor.h"
+
+#include <deque>
+#include <chrono>
+
+namespace
+{
+    constexpr uint32_t kItemsPerProducer = 200000;
+
+    // producer index in the high bits, sequence in the low ones
+    uint64_t MakeItem(uint32_t producer, uint32_t sequence) { return ((uint64_t)producer << 32) | sequence; }
+
+    // what the ring replaced in the pool, one lock around a deque
+    template<typename T>
+    class LockedQueue
+    {
+    public:
+        bool TryPush(const T& data)
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            mItems.push_back(data);
+            return true;
+        }
+
+        bool TryPop(T& data)
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (mItems.empty())
+                return false;
+            data = mItems.front();
+            mItems.pop_front();
+            return true;
+        }
+    private:
+        std::mutex mLock;
+        std::deque<T> mItems;
+    };
+
+    // numProducers threads push kItemsPerProducer each while numConsumers pop, returns false when an
+    // item is lost, seen twice or seen out of order for its producer
+    template<typename Queue>
+    bool RunProducersConsumers(Queue& queue, uint32_t numProducers, uint32_t numConsumers)
+    {
+        std::vector<std::atomic<uint32_t>> seen(numProducers);
+        std::atomic<uint64_t> numPopped = 0;
+        std::atomic<bool> isOrdered = true;
+        uint64_t numItems = (uint64_t)numProducers * kItemsPerProducer;
+
+        std::vector<std::thread> threads;
+        for (uint32_t p = 0; p < numProducers; p++)
+        {
+            threads.emplace_back([&queue, p]()
+            {
+                for (uint32_t i = 0; i < kItemsPerProducer; i++)
+                {
+                    while (!queue.TryPush(MakeItem(p, i)))
+                        std::this_thread::yield();
+                }
+            });
+        }
+
+        for (uint32_t c = 0; c < numConsumers; c++)
+        {
+            threads.emplace_back([&]()
+            {
+                // per producer the sequences a single consumer sees must rise
+                std::vector<int64_t> last(numProducers, -1);
+                while (numPopped.load(std::memory_order_relaxed) < numItems)
+                {
+                    uint64_t item;
+                    if (!queue.TryPop(item))
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    uint32_t producer = (uint32_t)(item >> 32);
+                    int64_t sequence = (int64_t)(item & 0xffffffff);
+                    if (sequence <= last[producer])
+                        isOrdered = false;
+                    last[producer] = sequence;
+                    seen[producer].fetch_add(1, std::memory_order_relaxed);
+                    numPopped.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        bool allSeen = numPopped.load() == numItems;
+        for (std::atomic<uint32_t>& count : seen)
+            allSeen = allSeen && count.load() == kItemsPerProducer;
+        return allSeen && isOrdered.load();
+    }
+
+    // Same checks through the blocking Put and Get, every consumer takes an equal share so none is
+    // left parked once the producers are done
+    template<typename Queue>
+    bool RunBlockingProducersConsumers(Queue& queue, uint32_t numProducers, uint32_t numConsumers)
+    {
+        std::vector<std::atomic<uint32_t>> seen(numProducers);
+        std::atomic<bool> isOrdered = true;
+        uint64_t numItems = (uint64_t)numProducers * kItemsPerProducer;
+        if (numItems % numConsumers != 0)
+            return false;
+
+        std::vector<std::thread> threads;
+        for (uint32_t p = 0; p < numProducers; p++)
+        {
+            threads.emplace_back([&queue, p]()
+            {
+                for (uint32_t i = 0; i < kItemsPerProducer; i++)
+                    queue.Put(MakeItem(p, i));
+            });
+        }
+
+        for (uint32_t c = 0; c < numConsumers; c++)
+        {
+            threads.emplace_back([&, numItems]()
+            {
+                std::vector<int64_t> last(numProducers, -1);
+                for (uint64_t i = 0; i < numItems / numConsumers; i++)
+                {
+                    uint64_t item = queue.Get();
+                    uint32_t producer = (uint32_t)(item >> 32);
+                    int64_t sequence = (int64_t)(item & 0xffffffff);
+                    if (sequence <= last[producer])
+                        isOrdered = false;
+                    last[producer] = sequence;
+                    seen[producer].fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        for (std::thread& thread : threads)
+            thread.join();
+
+        bool allSeen = true;
+        for (std::atomic<uint32_t>& count : seen)
+            allSeen = allSeen && count.load() == kItemsPerProducer;
+        return allSeen && isOrdered.load();
+    }
+}
+
+TEST_CASE(MPMCRingQueue_FillAndDrain)
+{
+    MPMCRingQueue<uint32_t, 8> queue;
+    CHECK(queue.empty());
+    for (uint32_t i = 0; i < 8; i++)
+        CHECK(queue.TryPush(i));
+    CHECK(!queue.TryPush(8u));
+    CHECK_EQ(queue.size(), 8u);
+
+    // wrap around a few laps
+    for (uint32_t lap = 0; lap < 4; lap++)
+    {
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            uint32_t value = ~0u;
+            CHECK(queue.TryPop(value));
+            CHECK_EQ(value, lap * 8 + i);
+            CHECK(queue.TryPush(lap * 8 + i + 8));
+        }
+    }
+
+    uint32_t value;
+    for (uint32_t i = 0; i < 8; i++)
+        CHECK(queue.TryPop(value));
+    CHECK(!queue.TryPop(value));
+}
+
+// Meant to be run under ThreadSanitizer as well, a small ring keeps producers and consumers colliding
+TEST_CASE(MPMCRingQueue_Stress)
+{
+    MPMCRingQueue<uint64_t, 64> queue;
+    CHECK(RunProducersConsumers(queue, 4, 4));
+    CHECK(queue.empty());
+
+    MPMCRingQueue<uint64_t, 64> unbalanced;
+    CHECK(RunProducersConsumers(unbalanced, 7, 1));
+    CHECK(RunProducersConsumers(unbalanced, 1, 7));
+}
+
+TEST_CASE(LinkedBlockQueue_WakesParkedGet)
+{
+    LinkedBlockQueue<uint32_t, 8> queue;
+    uint32_t value = 0;
+    CHECK(!queue.Get(value));
+
+    // the consumer outlasts its spin on the empty ring and parks, one Put has to wake it
+    std::promise<uint32_t> received;
+    std::thread consumer([&queue, &received]() { received.set_value(queue.Get()); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.Put(42u);
+    CHECK_EQ(received.get_future().get(), 42u);
+    consumer.join();
+
+    // a producer parked on the full ring is let through by the Get that frees a slot
+    for (uint32_t i = 0; i < 8; i++)
+        queue.Put(i);
+    std::thread producer([&queue]() { queue.Put(8u); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_EQ(queue.size(), 8u);
+    for (uint32_t i = 0; i <= 8; i++)
+        CHECK_EQ(queue.Get(), i);
+    producer.join();
+    CHECK(!queue.Get(value));
+}
+
+// A ring of 16 keeps both sides parking and waking each other all the time
+TEST_CASE(LinkedBlockQueue_Stress)
+{
+    LinkedBlockQueue<uint64_t, 16> queue;
+    CHECK(RunBlockingProducersConsumers(queue, 4, 4));
+    CHECK(RunBlockingProducersConsumers(queue, 8, 1));
+    CHECK(RunBlockingProducersConsumers(queue, 1, 8));
+    CHECK_EQ(queue.size(), 0u);
+}
+
+TEST_CASE(ThreadPool_PushPastTheGlobalRing)
+{
+    // the only worker is held, so pushes from outside fill the ring and must spill instead of blocking
+    ThreadPoolExecutor pool(1);
+    std::atomic<bool> release = false;
+    std::future<void> blocker = pool.Submit([&release]()
+    {
+        while (!release.load())
+            std::this_thread::yield();
+    });
+
+    constexpr uint32_t kNumJobs = 20000;
+    std::vector<uint32_t> seen;
+    std::vector<std::future<void>> futures;
+    for (uint32_t i = 0; i < kNumJobs; i++)
+        futures.push_back(pool.Submit([&seen, i]() { seen.push_back(i); }));
+
+    release = true;
+    for (std::future<void>& future : futures)
+        future.wait();
+
+    // one worker and nobody helping, the ring and the overflow behind it drain in push order
+    bool inOrder = seen.size() == kNumJobs;
+    for (uint32_t i = 0; inOrder && i < kNumJobs; i++)
+        inOrder = seen[i] == i;
+    CHECK(inOrder);
+}
+
+BENCHMARK(MPMCRingQueue_Throughput)
+{
+    struct Config { uint32_t producers; uint32_t consumers; };
+    constexpr Config kConfigs[] = { { 1, 1 }, { 2, 2 }, { 4, 4 }, { 8, 8 }, { 8, 1 }, { 1, 8 } };
+
+    printf("  %u items per producer, million items/sec\n", kItemsPerProducer);
+    printf("  %10s %10s %14s %14s\n", "producers", "consumers", "locked deque", "MPMC ring");
+    for (const Config& config : kConfigs)
+    {
+        double numItems = (double)config.producers * kItemsPerProducer;
+        double lockedMs = Test::MeasureBestMs(3, [&]()
+        {
+            LockedQueue<uint64_t> queue;
+            RunProducersConsumers(queue, config.producers, config.consumers);
+        });
+        double ringMs = Test::MeasureBestMs(3, [&]()
+        {
+            MPMCRingQueue<uint64_t, 4096> queue;
+            RunProducersConsumers(queue, config.producers, config.consumers);
+        });
+        printf("  %10u %10u %14.2f %14.2f\n", config.producers, config.consumers,
+            numItems / lockedMs / 1000.0, numItems / ringMs / 1000.0);
+    }
+}
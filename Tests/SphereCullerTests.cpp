@@ -0,0 +1,222 @@
+#include "TestFramework.h"
+#include "SphereCuller.h"
+#include "Camera.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    Math::BoundingSphere RandomSphere(Test::Random& random, float extent)
+    {
+        return Math::BoundingSphere(random.NextFloat(-extent, extent), random.NextFloat(-extent, extent),
+            random.NextFloat(-extent, extent), random.NextFloat(0.1f, extent * 0.05f));
+    }
+
+    // a camera somewhere in the scene looking at another random point, with a random lens
+    Math::Camera RandomCamera(Test::Random& random, float extent)
+    {
+        Math::Camera camera;
+        camera.SetPerspectiveMatrix(random.NextFloat(0.3f, 1.5f), random.NextFloat(0.5f, 1.0f), 0.5f,
+            random.NextFloat(extent * 0.2f, extent * 3.0f));
+        Math::Vector3 eye(random.NextFloat(-extent, extent), random.NextFloat(-extent, extent), random.NextFloat(-extent, extent));
+        Math::Vector3 at(random.NextFloat(-extent, extent), random.NextFloat(-extent, extent), random.NextFloat(-extent, extent));
+        camera.SetEyeAtUp(eye, at, Math::Vector3(Math::kYUnitVector));
+        camera.Update();
+        return camera;
+    }
+
+    struct CullResult
+    {
+        std::vector<uint32_t> indices;
+        std::vector<float> distances;
+    };
+
+    void Cull(const SphereCuller& culler, SphereCuller::eCullPath path, const SphereCuller::ViewPlanes* views, uint32_t numViews,
+        size_t begin, size_t end, bool acceptAll, std::vector<SphereCuller::VisibleList>& lists)
+    {
+        SphereCuller::eCullPath oldPath = SphereCuller::GetCullPath();
+        SphereCuller::SetCullPath(path);
+
+        uint32_t numVisible[SphereCuller::kMaxViews];
+        lists.resize(numViews);
+        for (uint32_t v = 0; v < numViews; v++)
+            culler.BeginCull(lists[v], numVisible[v]);
+        culler.CullRange(views, (1u << numViews) - 1, begin, end, acceptAll, lists.data(), numVisible);
+        for (uint32_t v = 0; v < numViews; v++)
+            culler.EndCull(lists[v], numVisible[v]);
+
+        SphereCuller::SetCullPath(oldPath);
+    }
+
+    // Straight from the frustum and view matrix, one sphere at a time. nearPlane is how close the sphere came
+    // to the plane that decided it, float differences between the paths only matter that close.
+    void CullReference(const std::vector<Math::BoundingSphere>& spheres, const Math::Camera& camera, size_t begin, size_t end,
+        CullResult& result, std::vector<float>& nearPlane)
+    {
+        const Math::Frustum& frustum = camera.GetWorldSpaceFrustum();
+        result = CullResult();
+        nearPlane.assign(spheres.size(), FLT_MAX);
+        for (size_t i = begin; i < end; i++)
+        {
+            const Math::BoundingSphere& sphere = spheres[i];
+            bool inside = true;
+            for (int p = 0; p < Math::Frustum::kNumPlanes; p++)
+            {
+                float d = (float)frustum.GetFrustumPlane((Math::Frustum::PlaneID)p).DistanceFromPoint(sphere.GetCenter()) + sphere.GetRadius();
+                nearPlane[i] = std::min(nearPlane[i], std::fabs(d));
+                inside = inside && d >= 0.0f;
+            }
+            if (inside)
+            {
+                result.indices.push_back((uint32_t)i);
+                result.distances.push_back(-(float)(camera.GetViewMatrix() * sphere.GetCenter()).GetZ() - sphere.GetRadius());
+            }
+        }
+    }
+
+    // The same spheres in the same order, except ones within tolerance of a plane either side may keep or drop
+    bool Matches(const SphereCuller::VisibleList& list, const CullResult& reference, const std::vector<float>& nearPlane, float tolerance)
+    {
+        size_t a = 0, b = 0;
+        while (a < list.indices.size() || b < reference.indices.size())
+        {
+            uint32_t ia = a < list.indices.size() ? list.indices[a] : UINT32_MAX;
+            uint32_t ib = b < reference.indices.size() ? reference.indices[b] : UINT32_MAX;
+            if (ia == ib)
+            {
+                if (std::fabs(list.distances[a] - reference.distances[b]) > tolerance * (1.0f + std::fabs(reference.distances[b])))
+                    return false;
+                a++;
+                b++;
+            }
+            else if (ia < ib)
+            {
+                if (nearPlane[ia] > tolerance)
+                    return false;
+                a++;
+            }
+            else
+            {
+                if (nearPlane[ib] > tolerance)
+                    return false;
+                b++;
+            }
+        }
+        return true;
+    }
+
+    bool AreEqual(const SphereCuller::VisibleList& a, const SphereCuller::VisibleList& b)
+    {
+        return a.indices == b.indices && a.distances == b.distances;
+    }
+}
+
+// Every path keeps the spheres the frustum planes keep, for ranges that start and end off the SIMD batches
+TEST_CASE(SphereCuller_SIMDMatchesScalar)
+{
+    const float kExtent = 500.0f;
+    const SphereCuller::eCullPath paths[] = { SphereCuller::kCullScalar, SphereCuller::kCullSSE, SphereCuller::kCullAVX };
+    Test::Random random = { 91 };
+
+    // counts that are and are not multiples of the 4 and 8 wide batches
+    const size_t counts[] = { 1, 3, 4, 7, 8, 9, 13, 64, 1001, 4099 };
+    for (size_t count : counts)
+    {
+        std::vector<Math::BoundingSphere> spheres;
+        SphereCuller culler;
+        culler.Resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            spheres.push_back(RandomSphere(random, kExtent));
+            culler.SetSphere(i, spheres[i]);
+        }
+
+        for (uint32_t trial = 0; trial < 8; trial++)
+        {
+            const uint32_t numViews = 1 + trial % SphereCuller::kMaxViews;
+            std::vector<Math::Camera> cameras;
+            std::vector<SphereCuller::ViewPlanes> views;
+            for (uint32_t v = 0; v < numViews; v++)
+                cameras.push_back(RandomCamera(random, kExtent));
+            for (const Math::Camera& camera : cameras)
+                views.push_back(SphereCuller::MakeViewPlanes({ &camera.GetWorldSpaceFrustum(), &camera.GetViewMatrix() }));
+
+            // the whole set, then a range cut off both batch edges
+            size_t begin = trial % 2 ? 0 : (size_t)random.NextFloat(0.0f, (float)count);
+            size_t end = trial % 2 ? count : begin + (size_t)random.NextFloat(0.0f, (float)(count - begin)) + 1;
+            end = std::min(end, count);
+
+            std::vector<SphereCuller::VisibleList> byPath[_countof(paths)];
+            for (size_t p = 0; p < _countof(paths); p++)
+                Cull(culler, paths[p], views.data(), numViews, begin, end, false, byPath[p]);
+
+            for (uint32_t v = 0; v < numViews; v++)
+            {
+                CullResult reference;
+                std::vector<float> nearPlane;
+                CullReference(spheres, cameras[v], begin, end, reference, nearPlane);
+                CHECK(Matches(byPath[0][v], reference, nearPlane, 1e-3f));
+
+                // the sums run in the same order, so the SIMD lanes agree with the scalar loop exactly
+                CHECK(AreEqual(byPath[1][v], byPath[0][v]));
+                CHECK(AreEqual(byPath[2][v], byPath[0][v]));
+            }
+
+            // acceptAll keeps the whole range on every path
+            for (size_t p = 0; p < _countof(paths); p++)
+            {
+                std::vector<SphereCuller::VisibleList> all;
+                Cull(culler, paths[p], views.data(), 1, begin, end, true, all);
+                bool isWholeRange = all[0].indices.size() == end - begin;
+                for (size_t i = 0; isWholeRange && i < all[0].indices.size(); i++)
+                    isWholeRange = all[0].indices[i] == begin + i;
+                CHECK(isWholeRange);
+            }
+        }
+    }
+}
+
+// Spheres per second of each path against one and four views
+BENCHMARK(SphereCuller_Throughput)
+{
+    const float kExtent = 1000.0f;
+    const SphereCuller::eCullPath paths[] = { SphereCuller::kCullScalar, SphereCuller::kCullSSE, SphereCuller::kCullAVX };
+    const char* pathNames[] = { "scalar", "SSE", "AVX" };
+    const size_t counts[] = { 10000, 100000, 1000000 };
+    const uint32_t viewCounts[] = { 1, 4 };
+    Test::Random random = { 5 };
+
+    std::vector<Math::Camera> cameras;
+    std::vector<SphereCuller::ViewPlanes> views;
+    for (uint32_t v = 0; v < 4; v++)
+        cameras.push_back(RandomCamera(random, kExtent));
+    for (const Math::Camera& camera : cameras)
+        views.push_back(SphereCuller::MakeViewPlanes({ &camera.GetWorldSpaceFrustum(), &camera.GetViewMatrix() }));
+
+    if (SphereCuller::GetCullPath() != SphereCuller::kCullAVX)
+        printf("  no AVX on this CPU, the AVX row runs SSE\n");
+    printf("  %-10s %6s %8s %10s %14s %10s\n", "spheres", "views", "path", "ms", "Mspheres/s", "visible");
+    for (size_t count : counts)
+    {
+        SphereCuller culler;
+        culler.Resize(count);
+        for (size_t i = 0; i < count; i++)
+            culler.SetSphere(i, RandomSphere(random, kExtent));
+
+        for (uint32_t numViews : viewCounts)
+        {
+            for (size_t p = 0; p < _countof(paths); p++)
+            {
+                std::vector<SphereCuller::VisibleList> lists;
+                double ms = Test::MeasureBestMs(5, [&]()
+                {
+                    Cull(culler, paths[p], views.data(), numViews, 0, count, false, lists);
+                });
+                printf("  %-10zu %6u %8s %10.3f %14.1f %10zu\n", count, numViews, pathNames[p], ms,
+                    count / 1000.0 / ms, lists[0].indices.size());
+            }
+        }
+    }
+}
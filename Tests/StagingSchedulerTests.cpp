@@ -0,0 +1,207 @@
+#include "TestFramework.h"
+#include "Utils/StagingScheduler.h"
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+
+namespace
+{
+    struct QueuedUpload
+    {
+        uint64_t token;
+        uint32_t size;
+        uint32_t alignment;
+    };
+
+    struct SubmittedBatch
+    {
+        uint64_t fenceValue;
+        uint64_t lastToken;
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    };
+}
+
+TEST_CASE(StagingScheduler_BatchesWrapAndComplete)
+{
+    Utility::StagingScheduler scheduler(256);
+    std::vector<uint32_t> offsets;
+    CHECK_EQ(scheduler.Enqueue(100, 16), 1u);
+    CHECK_EQ(scheduler.Enqueue(100, 16), 2u);
+    CHECK_EQ(scheduler.Enqueue(100, 16), 3u);
+    CHECK_EQ(scheduler.Enqueue(1000, 16), 4u);
+    CHECK_EQ(scheduler.GetQueuedBytes(), 1300u);
+
+    // the budget stops the second upload, the first always goes
+    CHECK_EQ(scheduler.PackBatch(150, offsets), 1u);
+    CHECK(offsets == std::vector<uint32_t>{ 0 });
+    scheduler.CloseBatch(1);
+    CHECK(scheduler.IsSubmitted(1) && !scheduler.IsSubmitted(2));
+    CHECK_EQ(scheduler.GetBatchFence(1), 1u);
+
+    // the third does not fit behind the second and the front is still held by the first batch
+    offsets.clear();
+    CHECK_EQ(scheduler.PackBatch(SIZE_MAX, offsets), 1u);
+    CHECK(offsets == std::vector<uint32_t>{ 112 });
+    scheduler.CloseBatch(2);
+    offsets.clear();
+    CHECK_EQ(scheduler.PackBatch(SIZE_MAX, offsets), 0u);
+    CHECK_EQ(scheduler.GetOldestFence(), 1u);
+
+    CHECK_EQ(scheduler.Retire(0), 0u);
+    CHECK(!scheduler.IsComplete(1));
+    CHECK_EQ(scheduler.Retire(1), 1u);
+    CHECK(scheduler.IsComplete(1) && !scheduler.IsComplete(2));
+    CHECK_EQ(scheduler.GetCompletedToken(), 1u);
+
+    // now it wraps to the front, and one larger than the ring goes without ring space
+    CHECK_EQ(scheduler.PackBatch(SIZE_MAX, offsets), 2u);
+    CHECK(offsets == (std::vector<uint32_t>{ 0, Utility::StagingScheduler::kNoRingSpace }));
+    scheduler.CloseBatch(3);
+    CHECK_EQ(scheduler.GetBatchFence(2), 2u);
+    CHECK_EQ(scheduler.GetBatchFence(4), 3u);
+    CHECK_EQ(scheduler.GetNumQueued(), 0u);
+    CHECK_EQ(scheduler.GetQueuedBytes(), 0u);
+
+    // tokens complete in order, one retire finishes both batches
+    CHECK_EQ(scheduler.Retire(3), 2u);
+    CHECK(scheduler.IsComplete(4));
+    CHECK_EQ(scheduler.GetBatchFence(2), 0u);
+    CHECK_EQ(scheduler.GetRing().GetUsedCount(), 0u);
+}
+
+TEST_CASE(StagingScheduler_SimulatedTimeline)
+{
+    // Uploads of random sizes queued every frame and flushed under a random budget against a copy
+    // queue running a few batches behind. When nothing fits, the oldest batch is waited for, as
+    // StagingManager::Wait does. Ring bytes handed out must not belong to a batch the queue has not
+    // finished, batches must hold the oldest uploads in order and a token must complete exactly when
+    // the batch it went in has.
+    const uint32_t kRingSize = 4096;
+    const uint32_t kAlignments[] = { 4, 16, 16, 256 };
+
+    Utility::StagingScheduler scheduler(kRingSize);
+    Test::SimulatedQueue queue; // the copy queue as StagingManager sees it
+    Test::Random random = { 7 };
+    std::vector<uint64_t> owners(kRingSize, 0); // fence of the batch holding each byte, 0 when free
+    std::deque<QueuedUpload> queued;
+    std::deque<SubmittedBatch> batches;
+    std::vector<uint64_t> tokenFences(1, 0); // fence of the batch each token went in, by token
+    std::vector<uint32_t> offsets;
+    uint64_t nextToken = 1;
+    uint64_t completedToken = 0;
+    uint32_t lastOffset = 0;
+
+    uint32_t numWraps = 0;
+    uint32_t numWaits = 0;
+    uint32_t numOversized = 0;
+    bool isConsistent = true;
+
+    auto retire = [&]()
+    {
+        uint32_t numRetired = 0;
+        while (!batches.empty() && batches.front().fenceValue <= queue.completed)
+        {
+            for (auto& range : batches.front().ranges)
+                std::fill(owners.begin() + range.first, owners.begin() + range.first + range.second, 0);
+            completedToken = batches.front().lastToken;
+            batches.pop_front();
+            numRetired++;
+        }
+        return scheduler.Retire(queue.completed) == numRetired && scheduler.GetCompletedToken() == completedToken;
+    };
+
+    for (uint32_t frame = 0; frame < 3000 && isConsistent; frame++)
+    {
+        uint32_t numUploads = random.Next(7);
+        for (uint32_t u = 0; u < numUploads; u++)
+        {
+            uint32_t size = random.Next(48) == 0 ? kRingSize + 1 + random.Next(1000) : 1 + random.Next(900);
+            uint32_t alignment = kAlignments[random.Next((uint32_t)std::size(kAlignments))];
+            isConsistent = isConsistent && scheduler.Enqueue(size, alignment) == nextToken;
+            queued.push_back({ nextToken++, size, alignment });
+        }
+
+        uint64_t budget = 256 + random.Next(2048);
+        offsets.clear();
+        uint32_t numPacked = scheduler.PackBatch(budget, offsets);
+        if (numPacked == 0)
+        {
+            // only a ring full of batches in flight holds the queue back, the oldest of those holding ring space
+            if (!queued.empty())
+            {
+                auto oldestIter = std::find_if(batches.begin(), batches.end(), [](const SubmittedBatch& batch) { return !batch.ranges.empty(); });
+                isConsistent = isConsistent && oldestIter != batches.end() && scheduler.GetOldestFence() == oldestIter->fenceValue;
+                queue.WaitForFence(scheduler.GetOldestFence());
+                isConsistent = isConsistent && retire();
+                numWaits++;
+            }
+        }
+        else
+        {
+            SubmittedBatch batch = { queue.lastSignaled + 1, queued[numPacked - 1].token, {} };
+            uint64_t packedBytes = 0;
+            for (uint32_t i = 0; i < numPacked && isConsistent; i++)
+            {
+                QueuedUpload upload = queued.front();
+                queued.pop_front();
+                packedBytes += upload.size;
+                tokenFences.push_back(batch.fenceValue);
+
+                uint32_t offset = offsets[i];
+                if (upload.size > kRingSize)
+                {
+                    isConsistent = offset == Utility::StagingScheduler::kNoRingSpace;
+                    numOversized++;
+                    continue;
+                }
+
+                isConsistent = offset != Utility::StagingScheduler::kNoRingSpace && offset % upload.alignment == 0 && offset + upload.size <= kRingSize;
+                for (uint32_t b = offset; b < offset + upload.size && isConsistent; b++)
+                {
+                    isConsistent = owners[b] == 0;
+                    owners[b] = batch.fenceValue;
+                }
+                batch.ranges.push_back({ offset, upload.size });
+                numWraps += offset < lastOffset;
+                lastOffset = offset;
+            }
+            isConsistent = isConsistent && offsets.size() == numPacked && (numPacked == 1 || packedBytes <= budget);
+
+            scheduler.CloseBatch(queue.Signal());
+            isConsistent = isConsistent && scheduler.IsSubmitted(batch.lastToken) && scheduler.GetBatchFence(batch.lastToken) == batch.fenceValue;
+            batches.push_back(std::move(batch));
+        }
+
+        queue.Advance(random, 4);
+        isConsistent = isConsistent && retire();
+
+        // a token is complete once its batch is, and not before
+        uint64_t token = 1 + random.Next((uint32_t)tokenFences.size());
+        if (token < tokenFences.size())
+            isConsistent = isConsistent && scheduler.IsComplete(token) == (tokenFences[token] <= queue.completed);
+        isConsistent = isConsistent && scheduler.GetNumQueued() == queued.size();
+    }
+    CHECK(isConsistent);
+
+    // the ring has to have wrapped, run full and passed on oversized uploads for the checks to mean anything
+    CHECK(numWraps > 100);
+    CHECK(numWaits > 0);
+    CHECK(numOversized > 0);
+
+    // once the queue drains every queued upload completes
+    while (isConsistent && !queued.empty())
+    {
+        offsets.clear();
+        uint32_t numPacked = scheduler.PackBatch(SIZE_MAX, offsets);
+        if (numPacked > 0)
+        {
+            queued.erase(queued.begin(), queued.begin() + numPacked);
+            scheduler.CloseBatch(queue.Signal());
+        }
+        queue.WaitForFence(queue.lastSignaled);
+        scheduler.Retire(queue.completed);
+    }
+    CHECK(scheduler.IsComplete(scheduler.GetLastToken()));
+    CHECK_EQ(scheduler.GetRing().GetUsedCount(), 0u);
+}
@@ -0,0 +1,239 @@
+#include "TestFramework.h"
+#include "RecordingCommandList.h"
+#include "StateCachingCommandList.h"
+
+#include <cstring>
+
+namespace
+{
+    // Distinct PSO pointers without a device. They are never dereferenced, the ComPtr lets go of
+    // them before it could release one.
+    class FakePipelineState : public PipelineState
+    {
+    public:
+        FakePipelineState(const RootSignature& rootSig, uintptr_t id) : PipelineState(L"Fake PSO")
+        {
+            SetRootSignature(rootSig);
+            mPipelineState.Attach((ID3D12PipelineState*)id);
+        }
+
+        ~FakePipelineState() { mPipelineState.Detach(); }
+    };
+
+    constexpr uint32_t kNumPsos = 3;
+    constexpr uint32_t kNumMaterials = 5;
+    constexpr uint32_t kNumMeshes = 4;
+
+    // root layout of the draw loop below
+    constexpr UINT kRootObjectCB = 0;
+    constexpr UINT kRootMaterialCB = 1;
+    constexpr UINT kRootMaterialFlags = 2;
+    constexpr UINT kRootSceneSRV = 3;
+    constexpr UINT kNumRootArguments = 4;
+
+    constexpr D3D12_GPU_VIRTUAL_ADDRESS kSceneBuffer = 0x100000;
+    constexpr D3D12_GPU_VIRTUAL_ADDRESS kObjectBuffer = 0x200000;
+    constexpr D3D12_GPU_VIRTUAL_ADDRESS kMaterialBuffer = 0x300000;
+    constexpr D3D12_GPU_VIRTUAL_ADDRESS kMeshBuffer = 0x400000;
+
+    struct TestDraw
+    {
+        uint32_t pso;
+        uint32_t material;
+        uint32_t mesh;
+        uint32_t objectIdx;
+        uint32_t modelIdx;      // three submeshes per model share its constant buffer
+        bool dynamicObjectCB;   // a submesh that writes its own constants in between
+    };
+
+    // sorted like a state ordered pass, so neighbours mostly share PSO, material and mesh
+    std::vector<TestDraw> MakeDraws(uint32_t count)
+    {
+        std::vector<TestDraw> draws(count);
+        Test::Random random = { 7 };
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t bits = random.NextBits();
+            TestDraw& draw = draws[i];
+            draw.pso = i * kNumPsos / count;
+            draw.material = (i / 8 + (bits >> 28)) % kNumMaterials;
+            draw.mesh = (i / 3) % kNumMeshes;
+            draw.objectIdx = i;
+            draw.modelIdx = i / 3;
+            draw.dynamicObjectCB = i % 3 == 1 && (bits >> 16) % 3 == 0;
+        }
+        return draws;
+    }
+
+    void SetRootConstant(RecordingCommandList& list, UINT rootIndex, UINT value) { list.SetConstants(rootIndex, value); }
+
+    template<typename CommandListType>
+    void SetRootConstant(StateCachingCommandList<CommandListType>& list, UINT rootIndex, UINT value) { list.SetConstant(rootIndex, value); }
+
+    // the draw loop as MeshRenderer issues it, every binding on every draw
+    template<typename List>
+    void IssueDraws(List& list, const TestDraw* draws, size_t numDraws, const FakePipelineState* psos)
+    {
+        for (size_t i = 0; i < numDraws; i++)
+        {
+            const TestDraw& draw = draws[i];
+            list.SetPipelineState(psos[draw.pso]);
+            list.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            list.SetShaderResourceView(kRootSceneSRV, kSceneBuffer);
+
+            uint32_t objectData[4] = { draw.objectIdx };
+            if (draw.dynamicObjectCB)
+                list.SetDynamicConstantBufferView(kRootObjectCB, sizeof(objectData), objectData);
+            else
+                list.SetConstantBuffer(kRootObjectCB, kObjectBuffer + draw.modelIdx * 256);
+            list.SetConstantBuffer(kRootMaterialCB, kMaterialBuffer + draw.material * 256);
+            SetRootConstant(list, kRootMaterialFlags, draw.material & 1);
+
+            D3D12_GPU_VIRTUAL_ADDRESS meshBuffer = kMeshBuffer + draw.mesh * 0x10000;
+            list.SetVertexBuffer(0, { meshBuffer, 0x8000, 32 });
+            list.SetIndexBuffer({ meshBuffer + 0x8000, 0x8000, DXGI_FORMAT_R16_UINT });
+
+            // a unique index count tags each draw so the replay sees the submission order
+            list.DrawIndexed(3 * (draw.objectIdx + 1));
+        }
+    }
+
+    // What the GPU would see bound at one draw
+    struct DrawState
+    {
+        UINT64 pipelineState = ~0ull;
+        UINT64 topology = ~0ull;
+        UINT64 rootArguments[kNumRootArguments] = { ~0ull, ~0ull, ~0ull, ~0ull };
+        UINT64 vertexBuffer = ~0ull;
+        UINT64 indexBuffer = ~0ull;
+        UINT64 indexCount = 0;
+
+        bool operator==(const DrawState& other) const { return memcmp(this, &other, sizeof(DrawState)) == 0; }
+    };
+
+    // Plays a recorded stream back in order and snapshots the bindings at every draw. Dynamic
+    // buffers are never filtered, so the n-th one stands for the same data in either stream.
+    std::vector<DrawState> Replay(const std::vector<RecordingCommandList::Call>& calls)
+    {
+        std::vector<DrawState> draws;
+        DrawState state;
+        UINT64 numDynamicBuffers = 0;
+        for (const RecordingCommandList::Call& call : calls)
+        {
+            switch (call.type)
+            {
+            case kStateCallPipelineState: state.pipelineState = call.value; break;
+            case kStateCallTopology: state.topology = call.value; break;
+            case kStateCallConstantBuffer:
+            case kStateCallShaderResource:
+            case kStateCallRootConstant:
+                state.rootArguments[call.index] = call.value;
+                break;
+            case kStateCallVertexBuffer: state.vertexBuffer = call.value; break;
+            case kStateCallIndexBuffer: state.indexBuffer = call.value; break;
+            case kNumStateCalls:
+                if (call.isDraw)
+                {
+                    state.indexCount = call.value;
+                    draws.push_back(state);
+                }
+                else
+                {
+                    state.rootArguments[call.index] = (1ull << 63) | numDynamicBuffers++;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return draws;
+    }
+
+    bool IsSameCall(const RecordingCommandList::Call& a, const RecordingCommandList::Call& b)
+    {
+        return a.type == b.type && a.index == b.index && a.value == b.value && a.isDraw == b.isDraw;
+    }
+
+    // every call of filtered appears in full, in the same order
+    bool IsOrderedSubset(const std::vector<RecordingCommandList::Call>& filtered, const std::vector<RecordingCommandList::Call>& full)
+    {
+        size_t next = 0;
+        for (const RecordingCommandList::Call& call : full)
+        {
+            if (next < filtered.size() && IsSameCall(filtered[next], call))
+                next++;
+        }
+        return next == filtered.size();
+    }
+}
+
+TEST_CASE(StateCaching_ReplayMatchesUnfiltered)
+{
+    RootSignature rootSig(L"Fake Root Signature");
+    FakePipelineState psos[kNumPsos] = { { rootSig, 0x1000 }, { rootSig, 0x2000 }, { rootSig, 0x3000 } };
+    std::vector<TestDraw> draws = MakeDraws(300);
+
+    RecordingCommandList full;
+    IssueDraws(full, draws.data(), draws.size(), psos);
+
+    RecordingCommandList filtered;
+    StateCallStats stats;
+    {
+        StateCachingCommandList<RecordingCommandList> cached(filtered, &stats);
+        IssueDraws(cached, draws.data(), draws.size(), psos);
+    }
+
+    // same bindings at every draw, draws in submission order, and nothing reordered around them
+    std::vector<DrawState> fullStates = Replay(full.GetCalls());
+    std::vector<DrawState> filteredStates = Replay(filtered.GetCalls());
+    CHECK_EQ(fullStates.size(), draws.size());
+    CHECK(filteredStates == fullStates);
+    CHECK(IsOrderedSubset(filtered.GetCalls(), full.GetCalls()));
+    CHECK_EQ(filtered.GetDrawCount(), full.GetDrawCount());
+
+    // topology, scene SRV and the PSO are set once per change
+    CHECK_EQ(stats.issued[kStateCallTopology], 1u);
+    CHECK_EQ(stats.issued[kStateCallShaderResource], 1u);
+    CHECK_EQ(stats.issued[kStateCallPipelineState], kNumPsos);
+    CHECK_EQ(filtered.GetCallCount(kStateCallPipelineState), kNumPsos);
+    CHECK(stats.skipped[kStateCallVertexBuffer] > 0);
+    CHECK(stats.skipped[kStateCallConstantBuffer] > 0);
+
+    // every setter the draw loop called was counted one way or the other; the wrapper adds one
+    // root signature check per PSO call
+    uint32_t numSetters = (uint32_t)full.GetCalls().size() - full.GetDrawCount();
+    uint32_t numRootSigChecks = stats.issued[kStateCallRootSignature] + stats.skipped[kStateCallRootSignature];
+    CHECK_EQ(stats.GetIssuedCount() + stats.GetSkippedCount() - numRootSigChecks, numSetters);
+    CHECK_EQ(stats.GetIssuedCount() - stats.issued[kStateCallRootSignature], (uint32_t)filtered.GetCalls().size() - filtered.GetDrawCount());
+    CHECK_EQ(stats.draws, (uint32_t)draws.size());
+}
+
+TEST_CASE(StateCaching_InvalidateReissuesBindings)
+{
+    RootSignature rootSig(L"Fake Root Signature");
+    FakePipelineState psos[kNumPsos] = { { rootSig, 0x1000 }, { rootSig, 0x2000 }, { rootSig, 0x3000 } };
+    std::vector<TestDraw> draws = MakeDraws(60);
+    size_t half = draws.size() / 2;
+
+    RecordingCommandList full;
+    IssueDraws(full, draws.data(), draws.size(), psos);
+
+    // something else bound state behind the wrapper's back halfway through
+    RecordingCommandList filtered;
+    StateCachingCommandList<RecordingCommandList> cached(filtered);
+    IssueDraws(cached, draws.data(), half, psos);
+    size_t callsBefore = filtered.GetCalls().size();
+    filtered.SetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+    filtered.SetShaderResourceView(kRootSceneSRV, 0);
+    cached.Invalidate();
+    IssueDraws(cached, draws.data() + half, draws.size() - half, psos);
+
+    // the first draw after the invalidate binds everything again, on top of the foreign calls
+    const std::vector<RecordingCommandList::Call>& calls = filtered.GetCalls();
+    uint32_t numRebound = 0;
+    for (size_t i = callsBefore + 2; i < calls.size() && !calls[i].isDraw; i++)
+        numRebound++;
+    CHECK_EQ(numRebound, 8u);
+    CHECK(Replay(filtered.GetCalls()) == Replay(full.GetCalls()));
+    CHECK_EQ(cached.GetStats().issued[kStateCallTopology], 2u);
+}
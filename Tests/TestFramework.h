@@ -0,0 +1,91 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+// Just enough of a test runner for the CPU side of the engine. TEST_CASE bodies run by default and
+// count CHECK failures, BENCHMARK bodies only run with -bench and print their own numbers.
+namespace Test
+{
+    using TestFunc = void (*)();
+
+    struct TestCase
+    {
+        const char* name;
+        TestFunc func;
+        bool isBenchmark;
+    };
+
+    std::vector<TestCase>& GetRegistry();
+    void ReportFailure(const char* file, int line, const char* expression);
+
+    struct Registrar
+    {
+        Registrar(const char* name, TestFunc func, bool isBenchmark) { GetRegistry().push_back({ name, func, isBenchmark }); }
+    };
+
+    // wall time of one call in milliseconds
+    template<typename F>
+    double MeasureMs(F&& func)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // best of numRuns calls, benchmarks use it to keep one slow run from skewing the report
+    template<typename F>
+    double MeasureBestMs(uint32_t numRuns, F&& func)
+    {
+        double best = MeasureMs(func);
+        for (uint32_t i = 1; i < numRuns; i++)
+        {
+            double ms = MeasureMs(func);
+            best = ms < best ? ms : best;
+        }
+        return best;
+    }
+
+    // The one generator every test draws from, an LCG so a seed gives the same data on every compiler
+    struct Random
+    {
+        uint32_t state;
+
+        uint32_t NextBits() { state = state * 1664525u + 1013904223u; return state; }
+        // the low bits of an LCG repeat quickly, ranges come from the high ones
+        uint32_t Next(uint32_t range) { return (NextBits() >> 8) % range; }
+        float NextFloat(float minValue, float maxValue) { return minValue + (maxValue - minValue) * Next(1 << 20) / float(1 << 20); }
+    };
+
+    // A GPU queue as the CPU side sees it, finishing its fences a few submits late. Fences count from 1.
+    struct SimulatedQueue
+    {
+        uint64_t lastSignaled = 0;
+        uint64_t completed = 0;
+
+        uint64_t Signal() { return ++lastSignaled; }
+        void WaitForFence(uint64_t fenceValue) { completed = std::max(completed, fenceValue); }
+
+        // the GPU is between 0 and maxLag submits behind
+        void Advance(Random& random, uint32_t maxLag)
+        {
+            uint64_t lag = random.Next(maxLag + 1);
+            if (lastSignaled > lag)
+                completed = std::max(completed, lastSignaled - lag);
+        }
+    };
+}
+
+#define TEST_REGISTER(name, isBenchmark) \
+    static void name(); \
+    static Test::Registrar sRegistrar_##name(#name, &name, isBenchmark); \
+    static void name()
+
+#define TEST_CASE(name) TEST_REGISTER(name, false)
+#define BENCHMARK(name) TEST_REGISTER(name, true)
+
+#define CHECK(expression) \
+    do { if (!(expression)) Test::ReportFailure(__FILE__, __LINE__, #expression); } while (0)
+#define CHECK_EQ(a, b) CHECK((a) == (b))
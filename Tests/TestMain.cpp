@@ -0,0 +1,54 @@
+#include "TestFramework.h"
+
+#include <cstring>
+
+namespace
+{
+    uint32_t sNumFailures = 0;
+}
+
+std::vector<Test::TestCase>& Test::GetRegistry()
+{
+    static std::vector<TestCase> sRegistry;
+    return sRegistry;
+}
+
+void Test::ReportFailure(const char* file, int line, const char* expression)
+{
+    printf("  FAILED %s(%d): %s\n", file, line, expression);
+    sNumFailures++;
+}
+
+// Tests [-bench] [filter]: runs the tests, or the benchmarks with -bench, whose name contains filter
+int main(int argc, char** argv)
+{
+    bool runBenchmarks = false;
+    const char* filter = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-bench") == 0)
+            runBenchmarks = true;
+        else
+            filter = argv[i];
+    }
+
+    uint32_t numRun = 0;
+    uint32_t numFailed = 0;
+    for (const Test::TestCase& testCase : Test::GetRegistry())
+    {
+        if (testCase.isBenchmark != runBenchmarks || (filter && !strstr(testCase.name, filter)))
+            continue;
+
+        printf("[ RUN  ] %s\n", testCase.name);
+        uint32_t failuresBefore = sNumFailures;
+        double ms = Test::MeasureMs(testCase.func);
+        bool passed = sNumFailures == failuresBefore;
+        printf("[ %s ] %s (%.1f ms)\n", passed ? " OK " : "FAIL", testCase.name, ms);
+
+        numRun++;
+        numFailed += passed ? 0 : 1;
+    }
+
+    printf("%u run, %u failed\n", numRun, numFailed);
+    return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+#include "TestFramework.h"
+#include "Utils/ThreadPoolExecutor.h"
+
+#include <list>
+
+namespace
+{
+    // The executor as it was before work stealing: one mutex guarded list, notify_all on every push
+    // and a shared packaged_task wrapped in a std::function per task. Kept as the benchmark baseline.
+    class LockedQueueExecutor
+    {
+        using TaskType = std::function<void()>;
+    public:
+        explicit LockedQueueExecutor(size_t numThreads) : mIsRunning(true)
+        {
+            for (size_t i = 0; i < numThreads; i++)
+            {
+                mThreads.emplace_back([this]()
+                {
+                    while (mIsRunning)
+                        Get()();
+                });
+            }
+        }
+
+        ~LockedQueueExecutor()
+        {
+            for (size_t i = 0; i < mThreads.size(); i++)
+                Submit([this]() { mIsRunning = false; });
+            for (std::thread& thread : mThreads)
+                thread.join();
+        }
+
+        template<typename F>
+        std::future<void> Submit(F&& f)
+        {
+            auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+            std::future<void> future = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(mLock);
+                mTasks.push_back([task]() { (*task)(); });
+            }
+            mTaskReady.notify_all();
+            return future;
+        }
+    private:
+        TaskType Get()
+        {
+            std::unique_lock<std::mutex> lock(mLock);
+            mTaskReady.wait(lock, [this]() { return !mTasks.empty(); });
+            TaskType task = std::move(mTasks.front());
+            mTasks.pop_front();
+            return task;
+        }
+    private:
+        std::atomic_bool mIsRunning;
+        std::mutex mLock;
+        std::condition_variable mTaskReady;
+        std::list<TaskType> mTasks;
+        std::vector<std::thread> mThreads;
+    };
+
+    constexpr size_t kBenchTasks = 100000;
+    constexpr size_t kThreadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+    // a little work per task so the queue is not the only thing measured
+    void SpinWork(std::atomic<uint64_t>& sink)
+    {
+        uint64_t value = 0;
+        for (uint32_t i = 0; i < 64; i++)
+            value = value * 6364136223846793005ull + i;
+        sink.fetch_add(value & 1, std::memory_order_relaxed);
+    }
+}
+
+TEST_CASE(ThreadPool_SubmitReturnsValues)
+{
+    ThreadPoolExecutor pool(4);
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 1000; i++)
+        futures.push_back(pool.Submit([](int value) { return value * 2; }, i));
+
+    for (int i = 0; i < 1000; i++)
+        CHECK_EQ(futures[i].get(), i * 2);
+}
+
+TEST_CASE(ThreadPool_ParallelForVisitsEveryIndexOnce)
+{
+    ThreadPoolExecutor pool(4);
+    std::vector<std::atomic<uint32_t>> visits(100003);
+    pool.ParallelFor(0, visits.size(), 0, [&visits](size_t i) { visits[i].fetch_add(1); });
+
+    bool allOnce = true;
+    for (std::atomic<uint32_t>& count : visits)
+        allOnce = allOnce && count.load() == 1;
+    CHECK(allOnce);
+}
+
+TEST_CASE(ThreadPool_ChildCountersHoldTheParent)
+{
+    ThreadPoolExecutor pool(4);
+    std::atomic<uint32_t> numDone = 0;
+    JobCounter parent;
+    std::vector<std::unique_ptr<JobCounter>> children;
+    for (int i = 0; i < 8; i++)
+        children.push_back(std::make_unique<JobCounter>(&parent));
+
+    // jobs dispatched from inside jobs land on the worker deques and get stolen
+    for (std::unique_ptr<JobCounter>& child : children)
+    {
+        JobCounter* childCounter = child.get();
+        pool.Dispatch(*childCounter, [&pool, &numDone, childCounter]()
+        {
+            for (int i = 0; i < 100; i++)
+                pool.Dispatch(*childCounter, [&numDone]() { numDone.fetch_add(1); });
+            numDone.fetch_add(1);
+        });
+    }
+
+    pool.Wait(parent);
+    CHECK_EQ(numDone.load(), 8u * 101u);
+    for (std::unique_ptr<JobCounter>& child : children)
+        CHECK(child->IsDone());
+}
+
+TEST_CASE(ThreadPool_LargeCapturesGoToTheHeap)
+{
+    ThreadPoolExecutor pool(2);
+    std::array<uint64_t, 32> payload;
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = i;
+
+    std::future<uint64_t> sum = pool.Submit([payload]()
+    {
+        uint64_t total = 0;
+        for (uint64_t value : payload)
+            total += value;
+        return total;
+    });
+    CHECK_EQ(sum.get(), 31u * 32u / 2u);
+}
+
+BENCHMARK(ThreadPool_TasksPerSecond)
+{
+    printf("  %zu tasks submitted from outside the pool, tasks/sec\n", kBenchTasks);
+    printf("  %8s %14s %14s %14s\n", "threads", "locked queue", "Submit", "Dispatch");
+    for (size_t numThreads : kThreadCounts)
+    {
+        std::atomic<uint64_t> sink = 0;
+
+        double lockedMs;
+        {
+            LockedQueueExecutor lockedPool(numThreads);
+            lockedMs = Test::MeasureMs([&]()
+            {
+                std::vector<std::future<void>> futures;
+                futures.reserve(kBenchTasks);
+                for (size_t i = 0; i < kBenchTasks; i++)
+                    futures.push_back(lockedPool.Submit([&sink]() { SpinWork(sink); }));
+                for (std::future<void>& future : futures)
+                    future.wait();
+            });
+        }
+
+        ThreadPoolExecutor pool(numThreads);
+        double submitMs = Test::MeasureMs([&]()
+        {
+            std::vector<std::future<void>> futures;
+            futures.reserve(kBenchTasks);
+            for (size_t i = 0; i < kBenchTasks; i++)
+                futures.push_back(pool.Submit([&sink]() { SpinWork(sink); }));
+            for (std::future<void>& future : futures)
+                future.wait();
+        });
+
+        double dispatchMs = Test::MeasureMs([&]()
+        {
+            JobCounter counter;
+            for (size_t i = 0; i < kBenchTasks; i++)
+                pool.Dispatch(counter, [&sink]() { SpinWork(sink); });
+            pool.Wait(counter);
+        });
+
+        printf("  %8zu %14.0f %14.0f %14.0f\n", numThreads, kBenchTasks / lockedMs * 1000.0,
+            kBenchTasks / submitMs * 1000.0, kBenchTasks / dispatchMs * 1000.0);
+    }
+}
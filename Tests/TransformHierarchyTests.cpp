@@ -0,0 +1,275 @@
+#include "TestFramework.h"
+#include "TransformHierarchy.h"
+#include "ConstantBuffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    struct TestNode
+    {
+        uint32_t parent;
+        Math::XMFLOAT3 position;
+        Math::XMFLOAT4 rotation;
+        Math::XMFLOAT3 scale;
+    };
+
+    Math::XMFLOAT4 RandomRotation(Test::Random& random)
+    {
+        Math::XMFLOAT4 rotation;
+        Math::XMStoreFloat4(&rotation, Math::Normalize(Math::Quaternion(Math::Vector3(random.NextFloat(-1.0f, 1.0f),
+            random.NextFloat(-1.0f, 1.0f), random.NextFloat(0.1f, 1.0f)), random.NextFloat(-3.0f, 3.0f))));
+        return rotation;
+    }
+
+    // glTF like scenes: a root every few nodes, otherwise a parent among the recent ones, so
+    // subtrees are a handful of levels deep and mostly contiguous
+    std::vector<TestNode> MakeNodes(uint32_t count, uint32_t seed)
+    {
+        Test::Random random = { seed };
+        std::vector<TestNode> nodes(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            TestNode& node = nodes[i];
+            node.parent = i == 0 || random.Next(8) == 0 ? TransformHierarchy::kInvalidIndex : i - 1 - random.Next(std::min(i, 16u));
+            node.position = Math::XMFLOAT3(random.NextFloat(-50.0f, 50.0f), random.NextFloat(-5.0f, 5.0f), random.NextFloat(-50.0f, 50.0f));
+            node.rotation = RandomRotation(random);
+            // mirrored and non-uniform scales must survive the trip through the parent as well
+            float mirror = random.Next(10) == 0 ? -1.0f : 1.0f;
+            node.scale = Math::XMFLOAT3(mirror * random.NextFloat(0.8f, 1.25f), random.NextFloat(0.8f, 1.25f), random.NextFloat(0.8f, 1.25f));
+        }
+        return nodes;
+    }
+
+    void SetNodes(TransformHierarchy& hierarchy, const std::vector<TestNode>& nodes)
+    {
+        hierarchy.Resize(nodes.size(), 3);
+        for (uint32_t i = 0; i < (uint32_t)nodes.size(); i++)
+            hierarchy.SetNode(i, nodes[i].parent, nodes[i].position, nodes[i].rotation, nodes[i].scale);
+    }
+
+    // one node with the math library, what Update computed per node before the SoA kernel
+    void ComputeReferenceWorld(const TransformHierarchy& hierarchy, std::vector<Math::AffineTransform>& worlds, uint32_t index)
+    {
+        Math::AffineTransform local(Math::Matrix3(Math::Quaternion(hierarchy.GetRotation(index))) *
+            Math::Matrix3::MakeScale(Math::Vector3(hierarchy.GetScale(index))), Math::Vector3(hierarchy.GetPosition(index)));
+        uint32_t parent = hierarchy.GetParent(index);
+        worlds[index] = parent == TransformHierarchy::kInvalidIndex ? local : worlds[parent] * local;
+    }
+
+    void ComputeReferenceWorlds(const TransformHierarchy& hierarchy, std::vector<Math::AffineTransform>& worlds)
+    {
+        worlds.resize(hierarchy.GetSize());
+        for (uint32_t i = 0; i < (uint32_t)hierarchy.GetSize(); i++)
+            ComputeReferenceWorld(hierarchy, worlds, i);
+    }
+
+    // largest difference of the uploaded rows, relative to the magnitude of the row
+    float GetMaxError(const TransformHierarchy& hierarchy, const std::vector<Math::AffineTransform>& worlds)
+    {
+        float maxError = 0.0f;
+        for (uint32_t i = 0; i < (uint32_t)worlds.size(); i++)
+        {
+            float rows[3][4];
+            hierarchy.GetWorldRows(i, rows);
+            ModelTransform expected = ModelTransform::Encode(worlds[i]);
+            for (int r = 0; r < 3; r++)
+            {
+                float scale = 1.0f;
+                for (int c = 0; c < 4; c++)
+                    scale = std::max(scale, std::fabs(expected.World.m[r][c]));
+                for (int c = 0; c < 4; c++)
+                    maxError = std::max(maxError, std::fabs(rows[r][c] - expected.World.m[r][c]) / scale);
+            }
+        }
+        return maxError;
+    }
+
+    bool IsUnderMoved(const TransformHierarchy& hierarchy, uint32_t index, const std::vector<uint8_t>& moved)
+    {
+        for (uint32_t node = index; node != TransformHierarchy::kInvalidIndex; node = hierarchy.GetParent(node))
+        {
+            if (moved[node])
+                return true;
+        }
+        return false;
+    }
+}
+
+TEST_CASE(TransformHierarchy_MatchesPerNodeMath)
+{
+    // sizes off the 4 lane batches, with and without roots at the batch boundaries
+    const uint32_t counts[] = { 1, 3, 4, 5, 257, 1003 };
+    for (uint32_t count : counts)
+    {
+        TransformHierarchy hierarchy;
+        SetNodes(hierarchy, MakeNodes(count, count));
+        CHECK_EQ(hierarchy.Update(), (size_t)count);
+
+        std::vector<Math::AffineTransform> worlds;
+        ComputeReferenceWorlds(hierarchy, worlds);
+        CHECK(GetMaxError(hierarchy, worlds) < 1e-5f);
+
+        // GetWorld hands back the same matrix as the rows
+        Math::AffineTransform last = hierarchy.GetWorld(count - 1);
+        float rows[3][4];
+        hierarchy.GetWorldRows(count - 1, rows);
+        CHECK(memcmp(ModelTransform::Encode(last).World.m, rows, sizeof(rows)) == 0);
+    }
+
+    // a single chain is one node per level, no batch ever fills
+    std::vector<TestNode> chain = MakeNodes(64, 5);
+    for (uint32_t i = 1; i < (uint32_t)chain.size(); i++)
+    {
+        chain[i].parent = i - 1;
+        chain[i].scale = Math::XMFLOAT3(1.0f, 1.0f, 1.0f);
+    }
+    TransformHierarchy hierarchy;
+    SetNodes(hierarchy, chain);
+    hierarchy.Update();
+    std::vector<Math::AffineTransform> worlds;
+    ComputeReferenceWorlds(hierarchy, worlds);
+    CHECK(GetMaxError(hierarchy, worlds) < 1e-5f);
+}
+
+TEST_CASE(TransformHierarchy_UpdatesOnlyDirtySubtrees)
+{
+    const uint32_t kNumNodes = 2000;
+    TransformHierarchy hierarchy;
+    SetNodes(hierarchy, MakeNodes(kNumNodes, 11));
+    hierarchy.Update();
+    std::vector<TransformHierarchy::Range> ranges;
+    for (uint32_t slot = 0; slot < 3; slot++)
+    {
+        hierarchy.TakeStaleRanges(slot, ranges);
+        CHECK(ranges.size() == 1 && ranges[0].first == 0 && ranges[0].count == kNumNodes);
+    }
+
+    std::vector<float> before(kNumNodes * 12);
+    for (uint32_t i = 0; i < kNumNodes; i++)
+        hierarchy.GetWorldRows(i, (float(*)[4])&before[i * 12]);
+
+    // move a few nodes, some inside the subtree of another
+    Test::Random random = { 3 };
+    std::vector<uint8_t> moved(kNumNodes, 0);
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        uint32_t index = random.Next(kNumNodes);
+        moved[index] = 1;
+        hierarchy.SetLocal(index, hierarchy.GetPosition(index), RandomRotation(random), hierarchy.GetScale(index));
+    }
+
+    std::vector<uint8_t> expected(kNumNodes, 0);
+    size_t numExpected = 0;
+    for (uint32_t i = 0; i < kNumNodes; i++)
+    {
+        expected[i] = IsUnderMoved(hierarchy, i, moved);
+        numExpected += expected[i];
+    }
+    CHECK_EQ(hierarchy.Update(), numExpected);
+
+    // the updated levels list exactly the moved subtrees, roots on the first level only
+    std::vector<uint8_t> updated(kNumNodes, 0);
+    bool isAscending = true;
+    bool areRootsFirst = true;
+    const std::vector<std::vector<uint32_t>>& levels = hierarchy.GetUpdatedLevels();
+    for (size_t depth = 0; depth < levels.size(); depth++)
+    {
+        for (size_t i = 0; i < levels[depth].size(); i++)
+        {
+            uint32_t index = levels[depth][i];
+            updated[index]++;
+            isAscending = isAscending && (i == 0 || levels[depth][i - 1] < index);
+            areRootsFirst = areRootsFirst && (depth == 0) == (hierarchy.GetParent(index) == TransformHierarchy::kInvalidIndex);
+        }
+    }
+    CHECK(updated == expected);
+    CHECK(isAscending);
+    CHECK(areRootsFirst);
+
+    // nothing outside them was rewritten, everything inside matches the reference
+    bool areOthersIntact = true;
+    for (uint32_t i = 0; i < kNumNodes; i++)
+    {
+        float rows[3][4];
+        hierarchy.GetWorldRows(i, rows);
+        if (!expected[i])
+            areOthersIntact = areOthersIntact && memcmp(rows, &before[i * 12], sizeof(rows)) == 0;
+    }
+    CHECK(areOthersIntact);
+    std::vector<Math::AffineTransform> worlds;
+    ComputeReferenceWorlds(hierarchy, worlds);
+    CHECK(GetMaxError(hierarchy, worlds) < 1e-5f);
+
+    // every frame slot gets the moved nodes once, as ascending ranges
+    for (uint32_t slot = 0; slot < 3; slot++)
+    {
+        hierarchy.TakeStaleRanges(slot, ranges);
+        std::vector<uint8_t> stale(kNumNodes, 0);
+        for (const TransformHierarchy::Range& range : ranges)
+        {
+            for (uint32_t i = range.first; i < range.first + range.count; i++)
+                stale[i]++;
+        }
+        CHECK(stale == expected);
+        hierarchy.TakeStaleRanges(slot, ranges);
+        CHECK(ranges.empty());
+    }
+
+    // a quiet frame updates nothing and reports no levels
+    CHECK_EQ(hierarchy.Update(), (size_t)0);
+    bool areLevelsEmpty = true;
+    for (const std::vector<uint32_t>& level : hierarchy.GetUpdatedLevels())
+        areLevelsEmpty = areLevelsEmpty && level.empty();
+    CHECK(areLevelsEmpty);
+}
+
+// 100k nodes with every node or 1% of them moved, through Update against the per node math library
+// loop over the same dirty levels that it replaced. Update spreads the levels over gThreadPoolExecutor,
+// the reference runs on this thread only.
+BENCHMARK(TransformHierarchy_100kNodes)
+{
+    const uint32_t kNumNodes = 100000;
+    std::vector<TestNode> nested = MakeNodes(kNumNodes, 1);
+    std::vector<TestNode> flat = nested;
+    for (TestNode& node : flat)
+        node.parent = TransformHierarchy::kInvalidIndex;
+
+    printf("  ms per update of %u nodes\n", kNumNodes);
+    printf("  %-8s %8s %10s %12s %12s\n", "scene", "moved", "updated", "hierarchy", "per node");
+    const std::pair<const char*, const std::vector<TestNode>*> scenes[] = { { "flat", &flat }, { "nested", &nested } };
+    for (const auto& scene : scenes)
+    {
+        TransformHierarchy hierarchy;
+        SetNodes(hierarchy, *scene.second);
+        std::vector<Math::AffineTransform> worlds;
+        hierarchy.Update();
+        ComputeReferenceWorlds(hierarchy, worlds);
+
+        for (uint32_t percent : { 100u, 1u })
+        {
+            size_t numUpdated = 0;
+            double updateMs = Test::MeasureBestMs(10, [&]()
+            {
+                for (uint32_t i = 0; i < kNumNodes; i += 100)
+                {
+                    for (uint32_t j = i; j < i + percent; j++)
+                        hierarchy.SetLocal(j, hierarchy.GetPosition(j), hierarchy.GetRotation(j), hierarchy.GetScale(j));
+                }
+                numUpdated = hierarchy.Update();
+            });
+            double referenceMs = Test::MeasureBestMs(10, [&]()
+            {
+                for (const std::vector<uint32_t>& level : hierarchy.GetUpdatedLevels())
+                {
+                    for (uint32_t index : level)
+                        ComputeReferenceWorld(hierarchy, worlds, index);
+                }
+            });
+            printf("  %-8s %7u%% %10zu %12.3f %12.3f\n", scene.first, percent, numUpdated, updateMs, referenceMs);
+        }
+        CHECK(GetMaxError(hierarchy, worlds) < 1e-5f);
+    }
+}
@@ -0,0 +1,214 @@
+#include "TestFramework.h"
+#include "LinearAllocator2.h"
+#include "Graphics.h"
+#include "CommandQueue.h"
+#include "NullDevice.h"
+#include "Utils/ThreadPoolExecutor.h"
+
+#include <deque>
+
+namespace
+{
+    // UploadPagePool creates its pages through Graphics::gDevice and falls back to the completed fences
+    // of the queues when it runs out of free pages. Both come from the headless device here, whose
+    // queues are never signaled, so that fallback only ever reclaims lists that were not submitted.
+    void UseNullDevice()
+    {
+        if (Graphics::gDevice == nullptr)
+        {
+            CheckHR(NullDevice::CreateDevice(0.0f, IID_PPV_ARGS(Graphics::gDevice.GetAddressOf())));
+            CommandQueueManager::GetOrCreateInstance();
+        }
+        // a fresh pool, pages pool threads kept from an earlier test are dropped
+        UploadPagePool::Shutdown();
+    }
+
+    // what one recorded list wrote, each span filled with the list's tag
+    struct RecordedList
+    {
+        UploadPageList pages;
+        uint32_t tag = 0;
+        Graphics::RENDER_TASK_TYPE queue = Graphics::RENDER_TASK_TYPE_GRAPHICS;
+        uint64_t fenceValue = 0;
+        std::vector<std::pair<uint32_t*, size_t>> spans; // words written
+    };
+
+    // a few words through every span, enough to see another list's tag in an overlap or a reused page
+    bool IsIntact(const RecordedList& list)
+    {
+        for (auto& span : list.spans)
+        {
+            for (size_t i = 0; i < span.second; i += 61)
+            {
+                if (span.first[i] != list.tag)
+                    return false;
+            }
+            if (span.first[span.second - 1] != list.tag)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST_CASE(UploadPagePool_SharedPageWaitsForEveryList)
+{
+    UseNullDevice();
+    const size_t kPageSize = kCpuAllocatorPageSize;
+
+    // lists recorded on one thread suballocate the same page, each holding it once
+    UploadPageList graphicsList, computeList;
+    AllocSpan first = UploadPagePool::Allocate(graphicsList, 1000);
+    AllocSpan second = UploadPagePool::Allocate(computeList, 1000, 256);
+    UploadPagePool::Allocate(graphicsList, 16);
+    CHECK(&first.GetPage() == &second.GetPage());
+    CHECK(second.GetOffset() >= first.GetOffset() + first.GetSize() && second.GetOffset() % 256 == 0);
+    CHECK(second.GetGpuAddress() == first.GetGpuAddress() - first.GetOffset() + second.GetOffset());
+
+    UploadPagePool::Retire(graphicsList, Graphics::RENDER_TASK_TYPE_GRAPHICS, 5);
+    UploadPagePool::Retire(computeList, Graphics::RENDER_TASK_TYPE_COMPUTE, 7);
+    CHECK(graphicsList.IsEmpty() && computeList.IsEmpty());
+
+    // the thread still suballocates from it
+    const uint64_t allDone[Graphics::NUM_RENDER_TASK_TYPE] = { 100, 100, 100 };
+    CHECK_EQ(UploadPagePool::Reclaim(allDone), 0u);
+
+    // a full page is let go of by the thread, then it waits for both queues
+    UploadPageList fillList;
+    AllocSpan fill = UploadPagePool::Allocate(fillList, kPageSize);
+    CHECK(&fill.GetPage() != &first.GetPage());
+    const uint64_t graphicsDone[Graphics::NUM_RENDER_TASK_TYPE] = { 5, 6, 0 };
+    CHECK_EQ(UploadPagePool::Reclaim(graphicsDone), 0u);
+    const uint64_t bothDone[Graphics::NUM_RENDER_TASK_TYPE] = { 5, 7, 0 };
+    CHECK_EQ(UploadPagePool::Reclaim(bothDone), 1u);
+
+    // and is the next one handed out, from its start
+    UploadPageList reuseList;
+    AllocSpan reused = UploadPagePool::Allocate(reuseList, 64);
+    CHECK(&reused.GetPage() == &first.GetPage());
+    CHECK_EQ(reused.GetOffset(), 0u);
+
+    // larger than a page, a whole page of the next size class only the list holds
+    UploadPageList largeList;
+    AllocSpan large = UploadPagePool::Allocate(largeList, 3 * 1024 * 1024);
+    CHECK(large.GetSize() >= 3 * 1024 * 1024 && large.GetOffset() == 0);
+    UploadPagePool::Retire(largeList, Graphics::RENDER_TASK_TYPE_COPY, 3);
+    const uint64_t copyBehind[Graphics::NUM_RENDER_TASK_TYPE] = { 100, 100, 2 };
+    CHECK_EQ(UploadPagePool::Reclaim(copyBehind), 0u);
+    const uint64_t copyDone[Graphics::NUM_RENDER_TASK_TYPE] = { 0, 0, 3 };
+    CHECK_EQ(UploadPagePool::Reclaim(copyDone), 1u);
+    AllocSpan largeAgain = UploadPagePool::Allocate(largeList, 4 * 1024 * 1024);
+    CHECK(&largeAgain.GetPage() == &large.GetPage());
+
+    // a list that was never submitted gives its pages back at once
+    UploadPagePool::Retire(fillList, Graphics::RENDER_TASK_TYPE_GRAPHICS, 0);
+    const uint64_t nothingDone[Graphics::NUM_RENDER_TASK_TYPE] = { 0, 0, 0 };
+    CHECK_EQ(UploadPagePool::Reclaim(nothingDone), 1u);
+
+    UploadPagePool::Stats stats = UploadPagePool::GetStats();
+    CHECK_EQ(stats.residentBytes, 2 * kPageSize + 2 * kPageSize);
+    CHECK_EQ(stats.inFlightBytes, kPageSize + 2 * kPageSize);
+
+    UploadPagePool::Retire(reuseList, Graphics::RENDER_TASK_TYPE_GRAPHICS, 0);
+    UploadPagePool::Retire(largeList, Graphics::RENDER_TASK_TYPE_GRAPHICS, 0);
+    UploadPagePool::Shutdown();
+}
+
+TEST_CASE(UploadPagePool_SimulatedTimeline)
+{
+    // Frames of lists recorded in parallel on the pool threads, so lists of different frames and
+    // queues share the pages those threads keep. Every list fills its spans with its own tag and goes
+    // to a random queue, or is dropped unsubmitted. The queues finish up to three frames late. As
+    // long as a list's fence is not complete its spans must still hold its tag, a page reused early
+    // or handed to two threads would overwrite them.
+    UseNullDevice();
+    const uint32_t kNumFrames = 200;
+    const uint32_t kListsPerFrame = 12;
+
+    Test::Random frameRandom = { 5 };
+    uint64_t lastFences[Graphics::NUM_RENDER_TASK_TYPE] = {};
+    uint64_t completedFences[Graphics::NUM_RENDER_TASK_TYPE] = {};
+    std::deque<std::unique_ptr<RecordedList>> inFlight;
+    uint32_t nextTag = 1;
+    size_t totalBytes = 0;
+    bool isIntact = true;
+
+    for (uint32_t frame = 0; frame < kNumFrames && isIntact; frame++)
+    {
+        std::vector<std::unique_ptr<RecordedList>> lists(kListsPerFrame);
+        for (std::unique_ptr<RecordedList>& list : lists)
+        {
+            list = std::make_unique<RecordedList>();
+            list->tag = nextTag++;
+        }
+
+        Utility::gThreadPoolExecutor.ParallelFor(0, kListsPerFrame, 1, [&](size_t i)
+        {
+            RecordedList& list = *lists[i];
+            Test::Random random = { list.tag * 7919u };
+            uint32_t numAllocations = 1 + random.Next(40);
+            for (uint32_t a = 0; a < numAllocations; a++)
+            {
+                // mostly constants and small buffers, now and then a texture too big for a page
+                size_t size = random.Next(64) == 0 ? kCpuAllocatorPageSize + random.Next(1 << 20) : 4 + random.Next(24 * 1024);
+                size_t alignment = (size_t)4 << random.Next(7);
+                AllocSpan span = UploadPagePool::Allocate(list.pages, size, alignment);
+
+                uint32_t* words = (uint32_t*)span.GetCpuAddress();
+                size_t numWords = size / sizeof(uint32_t);
+                if (numWords == 0 || (span.GetOffset() & (alignment - 1)) != 0)
+                {
+                    list.tag = 0; // reported below
+                    continue;
+                }
+                std::fill(words, words + numWords, list.tag);
+                list.spans.push_back({ words, numWords });
+            }
+        });
+
+        for (std::unique_ptr<RecordedList>& list : lists)
+        {
+            isIntact = isIntact && list->tag != 0;
+            for (auto& span : list->spans)
+                totalBytes += span.second * sizeof(uint32_t);
+
+            // one in eight lists is recorded for nothing
+            list->queue = (Graphics::RENDER_TASK_TYPE)frameRandom.Next(Graphics::NUM_RENDER_TASK_TYPE);
+            list->fenceValue = frameRandom.Next(8) == 0 ? 0 : ++lastFences[list->queue];
+            UploadPagePool::Retire(list->pages, list->queue, list->fenceValue);
+            if (list->fenceValue != 0)
+                inFlight.push_back(std::move(list));
+        }
+
+        // the next frame's lists were written after every list still in flight
+        for (const std::unique_ptr<RecordedList>& list : inFlight)
+            isIntact = isIntact && IsIntact(*list);
+
+        for (int queue = 0; queue < Graphics::NUM_RENDER_TASK_TYPE; queue++)
+        {
+            uint64_t lag = frameRandom.Next(4 * kListsPerFrame / Graphics::NUM_RENDER_TASK_TYPE);
+            if (lastFences[queue] > lag)
+                completedFences[queue] = std::max(completedFences[queue], lastFences[queue] - lag);
+        }
+        UploadPagePool::Reclaim(completedFences);
+
+        for (auto iter = inFlight.begin(); iter != inFlight.end();)
+        {
+            if ((*iter)->fenceValue <= completedFences[(*iter)->queue])
+                iter = inFlight.erase(iter);
+            else
+                ++iter;
+        }
+    }
+    CHECK(isIntact);
+
+    // once the queues drain only the pages the threads suballocate from are still out
+    inFlight.clear();
+    UploadPagePool::Reclaim(lastFences);
+    UploadPagePool::Stats stats = UploadPagePool::GetStats();
+    size_t numThreads = Utility::gThreadPoolExecutor.GetThreadCount() + 1;
+    CHECK(stats.inFlightBytes <= numThreads * kCpuAllocatorPageSize);
+
+    // and pages were reused rather than made for every frame
+    CHECK(stats.residentBytes < totalBytes / 8);
+    UploadPagePool::Shutdown();
+}